@@ -0,0 +1,158 @@
+/*
+ * host/windows.h – the Win32 types sendto_core.c uses, for building the
+ * portable core on other hosts (the Linux tests and sendto-cachetool)
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ *
+ * Only types, constants and the few CRT-style string helpers of the core
+ * are provided.  Build with -fshort-wchar, so WCHAR and L"" literals are
+ * UTF-16 code units as on Windows and cache files are byte-compatible.
+ * The string helpers fold ASCII only, like the MSVC "C" locale.  Do not
+ * include <wchar.h> next to this header: its wcs* functions assume the
+ * host's 32-bit wchar_t.
+ */
+
+#ifndef SENDTO_HOST_WINDOWS_H
+#define SENDTO_HOST_WINDOWS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int            BOOL;
+typedef int            INT;
+typedef unsigned int   UINT;
+typedef unsigned char  BYTE;
+typedef uint8_t        UINT8;
+typedef uint16_t       WORD;
+typedef uint32_t       UINT32;
+typedef uint32_t       DWORD;
+typedef int32_t        LONG;
+typedef uint64_t       UINT64;
+typedef int64_t        LONGLONG;
+typedef uintptr_t      ULONG_PTR;
+typedef uintptr_t      UINT_PTR;
+typedef wchar_t        WCHAR;
+typedef WCHAR          *PWSTR, *LPWSTR;
+typedef const WCHAR    *PCWSTR, *LPCWSTR;
+typedef struct HMENU__ *HMENU;
+
+#define TRUE  1
+#define FALSE 0
+
+#define MAX_PATH 260
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define ZeroMemory(p, n) memset((p), 0, (n))
+
+#define FILE_ATTRIBUTE_READONLY      0x01
+#define FILE_ATTRIBUTE_HIDDEN        0x02
+#define FILE_ATTRIBUTE_SYSTEM        0x04
+#define FILE_ATTRIBUTE_DIRECTORY     0x10
+#define FILE_ATTRIBUTE_NORMAL        0x80
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x400
+
+typedef struct {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct {
+    DWORD    dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD    nFileSizeHigh;
+    DWORD    nFileSizeLow;
+    DWORD    dwReserved0;
+    DWORD    dwReserved1;
+    WCHAR    cFileName[MAX_PATH];
+    WCHAR    cAlternateFileName[14];
+} WIN32_FIND_DATAW;
+
+_Static_assert(sizeof(WCHAR) == 2, "build the host core with -fshort-wchar");
+
+/**
+ * HostFold – ASCII upper-casing, as the MSVC "C" locale does.
+ */
+static inline WCHAR HostFold(WCHAR ch)
+{
+    return (ch >= L'a' && ch <= L'z') ? (WCHAR)(ch - L'a' + L'A') : ch;
+}
+
+static inline size_t HostWcslen(PCWSTR s)
+{
+    size_t n = 0;
+    while (s[n]) {
+        n++;
+    }
+    return n;
+}
+
+static inline PWSTR HostWcschr(PCWSTR s, WCHAR ch)
+{
+    for (;; ++s) {
+        if (*s == ch) {
+            return (PWSTR)s;
+        }
+        if (!*s) {
+            return NULL;
+        }
+    }
+}
+
+static inline int HostWcscmp(PCWSTR a, PCWSTR b)
+{
+    for (; *a && *a == *b; ++a, ++b) {
+    }
+    return (int)*a - (int)*b;
+}
+
+static inline int HostWcsnicmp(PCWSTR a, PCWSTR b, size_t n)
+{
+    for (; n; --n, ++a, ++b) {
+        const int d = (int)HostFold(*a) - (int)HostFold(*b);
+        if (d || !*a) {
+            return d;
+        }
+    }
+    return 0;
+}
+
+static inline int HostWcsicmp(PCWSTR a, PCWSTR b)
+{
+    return HostWcsnicmp(a, b, (size_t)-1);
+}
+
+static inline PWSTR HostWcsdup(PCWSTR s)
+{
+    const size_t size = (HostWcslen(s) + 1) * sizeof(WCHAR);
+    PWSTR copy = malloc(size);
+    if (copy) {
+        memcpy(copy, s, size);
+    }
+    return copy;
+}
+
+/**
+ * CharUpperW – ASCII only, like the rest of the shim; a pointer with a zero
+ *              high word is a single character, as on Windows.
+ */
+static inline LPWSTR CharUpperW(LPWSTR s)
+{
+    if ((ULONG_PTR)s <= 0xFFFF) {
+        return (LPWSTR)(ULONG_PTR)HostFold((WCHAR)(ULONG_PTR)s);
+    }
+    for (PWSTR p = s; *p; ++p) {
+        *p = HostFold(*p);
+    }
+    return s;
+}
+
+#define wcslen    HostWcslen
+#define wcschr    HostWcschr
+#define wcscmp    HostWcscmp
+#define _wcsicmp  HostWcsicmp
+#define _wcsnicmp HostWcsnicmp
+#define _wcsdup   HostWcsdup
+
+#endif /* SENDTO_HOST_WINDOWS_H */
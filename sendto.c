@@ -18,21 +18,54 @@
 #include <commctrl.h>
 #include <commoncontrols.h> /* for IID_IImageList */
 #include <shellapi.h>
+#include <psapi.h>
 #include <strsafe.h>
 #include <stdbool.h>
+#include <stdarg.h>
+
+#include "sendto_core.h"
 
 #pragma comment(lib, "comctl32.lib")   // commctrl.h – InitCommonControlsEx, ImageList_*, etc.
 #pragma comment(lib, "shell32.lib")    // shlobj.h, shobjidl.h – SHGetKnownFolderPath, IShellItem, etc.
 #pragma comment(lib, "shlwapi.lib")    // shlwapi.h – PathIsDirectoryW, StrCmpLogicalW, etc.
 #pragma comment(lib, "ole32.lib")      // COM: CoCreateInstance, etc.
+#pragma comment(lib, "msimg32.lib")    // AlphaBlend (icon atlas blits)
+#pragma comment(lib, "uuid.lib")       // CLSID_ShellLink, IID_IShellLinkW, IID_IPersistFile
+#pragma comment(lib, "psapi.lib")      // GetProcessMemoryInfo when PSAPI_VERSION is 1
 
-#define MAX_DEPTH 5
-#define MAX_LOCAL_PATH 32767
 #define MENU_POOL_SIZE 64
 
-/** Binary cache file signature: "STC\0" (SendTo Cache). */
-#define CACHE_MAGIC  0x00435453
-#define CACHE_VERSION 1
+/** Longest prefix shown in a page label such as "Ba – Bo". */
+#define MENU_PAGE_LABEL_MAX 8
+
+/** Time budget (ms) for icon resolution per popup open or timer tick. */
+#define ICON_BUDGET_MS    8
+/** Timer that resumes icon resolution while a popup is displayed. */
+#define ICON_TIMER_ID     1
+
+/** Posted to the owner window with a finished EnumResult * in lParam. */
+#define WM_ENUM_LISTED    (WM_APP + 1)
+/** Longest wait (ms) for the enumeration worker once the menu is dismissed. */
+#define ENUM_STOP_WAIT_MS 200
+
+/** [Snapshot] Use values: never, for network roots only (default), always. */
+#define SNAPSHOT_USE_NEVER      0
+#define SNAPSHOT_USE_NETWORK    1
+#define SNAPSHOT_USE_ALWAYS     2
+/** [Snapshot] MaxAgeMinutes default and cap (30 days). */
+#define SNAPSHOT_MAX_AGE        1440
+#define SNAPSHOT_MAX_AGE_CAP    43200
+/** Longest wait (ms) at exit for a revalidation still in progress. */
+#define SNAPSHOT_WAIT_MS        1000
+
+/** Superseded journal records tolerated before a save compacts the file. */
+#define CACHE_COMPACT_SLACK 64
+/** A hit refreshes the persisted lastHit at most this often (1 day, 100 ns units). */
+#define CACHE_HIT_RESOLUTION (24ull * 60 * 60 * 10000000)
+/** Longest wait at teardown for the background missing-path sweep. */
+#define CACHE_SWEEP_WAIT_MS  50
+/** Other instances may read, append to and replace the file concurrently. */
+#define CACHE_SHARE_MODE    (FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE)
 
 static LPSHELLFOLDER desktopShellFolder = NULL;
 static HDC hdcIconCache = NULL;
@@ -49,6 +82,105 @@ static HDC hdcIconCache = NULL;
 /* Helpers                                                                    */
 /* -------------------------------------------------------------------------- */
 
+/**
+ * TraceF – printf-style trace line sent to OutputDebugStringW.
+ *
+ * Lines are prefixed with "[SendTo+] " and newline-terminated, matching the
+ * plain OutputDebugStringW calls elsewhere.  Output longer than the local
+ * buffer is truncated.
+ *
+ * @param format  StringCchPrintfW format string.
+ * @param ...     Format arguments.
+ */
+static void TraceF(PCWSTR format, ...)
+{
+    WCHAR line[512] = L"[SendTo+] ";
+    const size_t prefixLen = wcslen(line);
+
+    va_list args;
+    va_start(args, format);
+    StringCchVPrintfW(line + prefixLen, ARRAYSIZE(line) - prefixLen - 1, format, args);
+    va_end(args);
+
+    StringCchCatW(line, ARRAYSIZE(line), L"\n");
+    OutputDebugStringW(line);
+}
+
+/**
+ * QpcNow – current QueryPerformanceCounter value.
+ *
+ * @return  Tick count; convert differences with QpcElapsedMs.
+ */
+static LONGLONG QpcNow(void)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+/**
+ * QpcElapsedMs – milliseconds elapsed since a QpcNow timestamp.
+ *
+ * @param since  Earlier QpcNow value.
+ * @return       Elapsed time in milliseconds.
+ */
+static double QpcElapsedMs(LONGLONG since)
+{
+    static LONGLONG frequency = 0;
+    if (!frequency) {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        frequency = freq.QuadPart;
+    }
+
+    return (double)(QpcNow() - since) * 1000.0 / (double)frequency;
+}
+
+/**
+ * TraceMemory – trace the working set and private bytes of the process,
+ *               so the cost of building and showing the menu can be read
+ *               off the debug output.
+ *
+ * @param stage  What just happened, e.g. "menu built".
+ */
+static void TraceMemory(PCWSTR stage)
+{
+    PROCESS_MEMORY_COUNTERS_EX counters = { sizeof(counters) };
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&counters, sizeof(counters))) {
+        return;
+    }
+    TraceF(L"memory: %s: working set %Iu KB (peak %Iu KB), private %Iu KB", stage,
+           counters.WorkingSetSize / 1024, counters.PeakWorkingSetSize / 1024,
+           counters.PrivateUsage / 1024);
+}
+
+/**
+ * IconStats – instrumentation counters for the icon pipeline, reported once
+ *             per run by TraceIconStats.
+ *
+ * @member shellCalls  SHGetFileInfoW calls made to resolve icons.
+ * @member extHits     Icons served by the per-extension memo.
+ * @member extMisses   Extension memo misses (icon fetched from the shell).
+ * @member linkHits    Icons served by the .lnk target memo.
+ * @member linkMisses  Link memo misses (icon fetched from the shell).
+ * @member statCalls   File metadata queries made to validate cache entries
+ *                     (0 when enumeration timestamps are carried through).
+ * @member movedHits   Cache hits found by file identity after a path miss
+ *                     (renamed or moved targets).
+ */
+typedef struct {
+    UINT shellCalls;
+    UINT extHits;
+    UINT extMisses;
+    UINT linkHits;
+    UINT linkMisses;
+    UINT statCalls;
+    UINT movedHits;
+} IconStats;
+
+/** Global counters; single-threaded, updated inline by the icon resolvers. */
+static IconStats g_iconStats = { 0 };
+
 /**
  * OptInDarkPopupMenus
  *
@@ -94,129 +226,22 @@ static void OptInDarkPopupMenus(void)
 
 
 /* -------------------------------------------------------------------------- */
-/* Dynamic array for menu items                                               */
+/* Icon atlas                                                                 */
 /* -------------------------------------------------------------------------- */
 
-/**
- * MenuEntry – one "Send To" item.
- *
- * @member path  Heap-alloc'd absolute path via _wcsdup (owner; freed by VectorDestroy).
- * @member icon  32-bit ARGB bitmap for the menu (may be NULL).
- */
-typedef struct {
-    PWSTR   path;
-    HBITMAP icon;
-} MenuEntry;
-
-/**
- * MenuVector – simple grow-only array.
- *
- * @member items     Pointer to contiguous buffer (realloc'd).
- * @member count     Elements currently stored.
- * @member capacity  Allocated slots in @items.
- */
-typedef struct {
-    MenuEntry *items;
-    UINT       count;
-    UINT       capacity;
-} MenuVector;
-
-/**
- * Pointer to the active menu-item vector; used by SendToWndProc to
- * lazily resolve icons on WM_INITMENUPOPUP. Set once in RunSendTo().
- */
-static MenuVector *g_menuItems = NULL;
-
-/**
- * VectorEnsureCapacity – make room for at least @need elements.
- *
- * @param vec   Target vector.
- * @param need  Desired minimum capacity.
- * @return      true on success, false on OOM.
- */
-static bool VectorEnsureCapacity(MenuVector *vec, UINT need)
-{
-    if (need <= vec->capacity) {
-        return true;
-    }
-
-    // Amortized growth: double current capacity (or start at 64), but at least 'need'
-    UINT newCap = vec->capacity ? vec->capacity * 2 : MENU_POOL_SIZE;
-    if (newCap < need) {
-        newCap = need;
-    }
-
-    MenuEntry *tmp = realloc(vec->items, newCap * sizeof *tmp);
-    if (!tmp) {
-        return false;
-    }
-
-    // Zero the new tail so later clean-up is safe.
-    ZeroMemory(tmp + vec->capacity,
-               (newCap - vec->capacity) * sizeof *tmp);
-
-    vec->items    = tmp;
-    vec->capacity = newCap;
-
-    return true;
-}
-
-/**
- * VectorPush – append a new entry (takes ownership of resources).
- *
- * @param vec   Vector to modify.
- * @param path  Heap path (caller must not reuse).
- * @param icon  Bitmap handle (may be NULL, ownership transferred).
- * @return      true on success, false on OOM — if false the caller still
- *              owns @path/@icon and must free/delete them.
- */
-static bool VectorPush(MenuVector *vec, PCWSTR path, HBITMAP icon)
-{
-    // If capacity growth fails, we do *not* consume the resources.
-    if (!VectorEnsureCapacity(vec, vec->count + 1)) {
-        return false;
-    }
-
-    // Heap-duplicate the path string; caller retains no ownership.
-    PWSTR dupPath = _wcsdup(path);
-    if (!dupPath) {
-        return false;
-    }
-
-    vec->items[vec->count].path = dupPath;
-    vec->items[vec->count].icon = icon;
-    vec->count++;
-
-    return true;
-}
+/** Edge length of one atlas page (square, top-down 32-bit DIB). */
+#define ATLAS_PAGE_DIM 256
 
 /**
- * VectorDestroy – free all stored paths/bitmaps and reset vector to zero.
- *
- * @param vec  Vector to wipe.
+ * IconId – handle of a pooled icon: 1-based slot in g_iconPool, 0 = no icon.
  */
-static void VectorDestroy(MenuVector *vec)
-{
-    for (UINT i = 0; i < vec->count; ++i) {
-        free(vec->items[i].path);
-        if (vec->items[i].icon) {
-            DeleteObject(vec->items[i].icon);
-        }
-    }
-    free(vec->items);
-    ZeroMemory(vec, sizeof *vec);
-}
-
-
-/* -------------------------------------------------------------------------- */
-/* Icons tools                                                                */
-/* -------------------------------------------------------------------------- */
+typedef UINT IconId;
 
 /**
  * InitBitmapInfo32 – fill a BITMAPINFO structure for a top-down 32-bit DIB.
  *
- * Centralises the BITMAPINFO setup used by CreateDIBSection32, IconCacheLookup,
- * and IconCacheStore so the format is defined in exactly one place.
+ * Centralises the BITMAPINFO setup used by CreateDIBSection32 and the
+ * icon mask read-back so the format is defined in exactly one place.
  *
  * @param bmi     Pointer to BITMAPINFO to initialise (caller-allocated).
  * @param width   Desired bitmap width in pixels.
@@ -239,8 +264,7 @@ static void InitBitmapInfo32(BITMAPINFO *bmi, int width, int height)
  * @param width    Desired bitmap width in pixels.
  * @param height   Desired bitmap height in pixels.
  * @param outBits  Optional; if non-NULL, receives the pointer to the raw pixel
- *                 buffer.  Pass NULL when the caller doesn't need direct access
- *                 (e.g. DibFromIcon, which draws via GDI instead).
+ *                 buffer.
  * @return         New HBITMAP or NULL on failure.
  */
 static HBITMAP CreateDIBSection32(int width, int height, PVOID *outBits)
@@ -258,913 +282,5055 @@ static HBITMAP CreateDIBSection32(int width, int height, PVOID *outBits)
 }
 
 /**
- * DibFromIcon – convert an HICON to a 32-bit ARGB HBITMAP.
+ * AtlasPage – one large DIB section holding many icon cells.
  *
- * @param iconHandle  Source HICON (ownership transferred; this function destroys it).
- * @return            HBITMAP or NULL on failure.
+ * @member bitmap     Page DIB (ATLAS_PAGE_DIM square, premultiplied BGRA).
+ * @member bits       Pixel pointer of @bitmap.
+ * @member dc         Memory DC with @bitmap permanently selected (blit source).
+ * @member oldBitmap  Bitmap originally selected into @dc.
+ * @member packer     Cell allocator for this page.
+ * @member freeCells  First unreferenced icon on this page (IconId, 0 = none);
+ *                    the cells a new icon of equal size may recycle.
  */
-static HBITMAP DibFromIcon(HICON iconHandle)
-{
-    if (!iconHandle) {
-        return NULL;
-    }
-
-    ICONINFO iconInfo;
-    if (!GetIconInfo(iconHandle, &iconInfo)) {
-        // failed to extract bitmap handles
-        DestroyIcon(iconHandle);
-        return NULL;
-    }
-
-    // get dimensions from the color bitmap
-    BITMAP bmpMetrics;
-    if (!GetObject(iconInfo.hbmColor, sizeof bmpMetrics, &bmpMetrics)) {
-        DeleteObject(iconInfo.hbmColor);
-        DeleteObject(iconInfo.hbmMask);
-        DestroyIcon(iconHandle);
-        return NULL;
-    }
-
-    // allocate DIB section; pixel pointer not needed (drawing via GDI)
-    HBITMAP dibBitmap = CreateDIBSection32(bmpMetrics.bmWidth, bmpMetrics.bmHeight, NULL);
-    if (dibBitmap) {
-        // use global temporary DC
-        HGDIOBJ oldObj = SelectObject(hdcIconCache, dibBitmap);
-        DrawIconEx(hdcIconCache, 0, 0, iconHandle, bmpMetrics.bmWidth, bmpMetrics.bmHeight, 0, NULL, DI_NORMAL);
-        SelectObject(hdcIconCache, oldObj);
-    }
-
-    // Cleanup original icon and bitmaps
-    DeleteObject(iconInfo.hbmColor);
-    DeleteObject(iconInfo.hbmMask);
-    DestroyIcon(iconHandle);
-
-    return dibBitmap;
-}
+typedef struct {
+    HBITMAP     bitmap;
+    UINT32      *bits;
+    HDC         dc;
+    HGDIOBJ     oldBitmap;
+    AtlasPacker packer;
+    IconId      freeCells;
+} AtlasPage;
 
 /**
- * IconForItem – retrieve shell small icon for a file or directory.
+ * PooledIcon – one unique icon stored in an atlas cell.
  *
- * Works for both files and directories: SHGetFileInfoW resolves the
- * appropriate icon in either case, including custom folder icons set
- * via desktop.ini and shortcut (.lnk) target icons.
+ * Slots are never moved, so their 1-based index is a stable IconId.  A slot
+ * whose @refs dropped to zero keeps its pixels: it is revived if the same
+ * icon shows up again, or its cell is recycled for a new icon of equal size.
  *
- * @param filePath  Null-terminated wide string path to a file or directory.
- * @return          32-bit ARGB HBITMAP, or NULL on failure.
+ * @member digest    IconPixelDigest of the pixels (index key, checked
+ *                   before memcmp).
+ * @member width     Icon width in pixels.
+ * @member height    Icon height in pixels.
+ * @member refs      Outstanding references.
+ * @member page      Index into g_iconPool.pages.
+ * @member x         Left edge of the cell inside the page.
+ * @member y         Top edge of the cell inside the page.
+ * @member prevFree  Neighbours in the page's free-cell list while @refs is
+ * @member nextFree  zero (IconId, 0 = none).
  */
-static HBITMAP IconForItem(PCWSTR filePath)
-{
-    SHFILEINFOW info;
-    UINT flags;
-
-    // primary: real icon from the shell (resolves .lnk targets, desktop.ini, etc.)
-    flags = SHGFI_ICON | SHGFI_SMALLICON;
-    if (SHGetFileInfoW(filePath, FILE_ATTRIBUTE_NORMAL, &info, sizeof(info), flags)) {
-        HBITMAP result = DibFromIcon(info.hIcon);
-        if (result) {
-            return result;
-        }
-    }
-
-    // fallback: system image list (includes non-existent/virtual items)
-    flags = SHGFI_USEFILEATTRIBUTES | SHGFI_SYSICONINDEX | SHGFI_SMALLICON;
-    if (SHGetFileInfoW(filePath, FILE_ATTRIBUTE_NORMAL, &info, sizeof(info), flags)) {
-        HBITMAP result = DibFromIcon(info.hIcon);
-        if (result) {
-            return result;
-        }
-    }
-
-    return NULL;
-}
-
-
-/* -------------------------------------------------------------------------- */
-/* Persistent icon cache                                                      */
-/* -------------------------------------------------------------------------- */
+typedef struct {
+    UINT32 digest;
+    int    width;
+    int    height;
+    UINT   refs;
+    UINT   page;
+    int    x;
+    int    y;
+    IconId prevFree;
+    IconId nextFree;
+} PooledIcon;
+
+/** Initial slot count of the pool's digest index (power of two). */
+#define ICON_INDEX_INITIAL_SLOTS 256
 
 /**
- * IconCacheEntry – one cached icon with its invalidation key.
+ * IconPool – reference-counted set of unique icons packed into atlas pages.
+ *
+ * Identical icons (same size and pixels) resolve to one IconId, and all
+ * icons share a handful of page DIBs, so GDI section objects stay constant
+ * no matter how many items the menu has.  Interning runs on the UI thread
+ * for every item, so neither step scans the slots: identical pixels are
+ * found through @index, and recyclable cells through each page's free list.
  *
- * @member path       Absolute path of the file this icon belongs to.
- * @member lastWrite  Last-write timestamp of the file when the icon was resolved.
- * @member width      Bitmap width in pixels.
- * @member height     Bitmap height in pixels.
- * @member pixels     Heap-alloc'd raw 32-bit ARGB pixel data (width*height*4 bytes).
+ * @member icons         Pointer to contiguous slot buffer (realloc'd).
+ * @member count         Slots in use (live or recyclable).
+ * @member capacity      Allocated slots in @icons.
+ * @member pages         Pointer to contiguous page buffer (realloc'd).
+ * @member pageCount     Pages allocated.
+ * @member pageCapacity  Allocated slots in @pages.
+ * @member index         Open-addressing table of IconIds keyed by digest
+ *                       (linear probing, 0 = empty); see IconPoolFind.
+ * @member indexMask     Slot count - 1 (power of two), 0 before the first icon.
+ * @member indexCount    Occupied slots.
  */
 typedef struct {
-    WCHAR    path[MAX_PATH];
-    FILETIME lastWrite;
-    int      width;
-    int      height;
-    BYTE     *pixels;
-} IconCacheEntry;
+    PooledIcon *icons;
+    UINT        count;
+    UINT        capacity;
+    AtlasPage  *pages;
+    UINT        pageCount;
+    UINT        pageCapacity;
+    IconId     *index;
+    UINT        indexMask;
+    UINT        indexCount;
+} IconPool;
+
+/** Global pool; every icon shown in the menu is a reference into it. */
+static IconPool g_iconPool = { 0 };
 
 /**
- * IconCache – in-memory store of cached icons loaded from / saved to disk.
+ * IconPixelDigest – CacheHash32 of a 32-bit pixel block, chained row by
+ *                   row so strided cells and packed buffers hash alike.
  *
- * @member entries   Pointer to contiguous buffer of cache entries.
- * @member count     Number of entries currently stored.
- * @member capacity  Allocated slots in @entries.
- * @member dirty     TRUE if any entry was added or updated since last save.
+ * @param pixels  First pixel of the block.
+ * @param width   Block width in pixels.
+ * @param height  Block height in pixels.
+ * @param stride  Distance between rows, in pixels.
+ * @return        Digest value.
  */
-typedef struct {
-    IconCacheEntry *entries;
-    UINT            count;
-    UINT            capacity;
-    bool            dirty;
-} IconCache;
+static UINT32 IconPixelDigest(const UINT32 *pixels, int width, int height, int stride)
+{
+    UINT32 hash = (UINT32)width << 16 | (UINT32)height;
+    for (int y = 0; y < height; ++y, pixels += stride) {
+        hash = CacheHash32(pixels, (size_t)width * 4, hash);
+    }
+    return hash;
+}
 
-/** Global icon cache instance; only active when /C flag is passed. */
-static IconCache g_iconCache = { 0 };
+/**
+ * IconPoolCell – pixel pointer of a pooled icon's cell.
+ *
+ * @param icon  Pool slot.
+ * @return      First pixel of the cell; rows are ATLAS_PAGE_DIM apart.
+ */
+static UINT32 *IconPoolCell(const PooledIcon *icon)
+{
+    return g_iconPool.pages[icon->page].bits + (size_t)icon->y * ATLAS_PAGE_DIM + icon->x;
+}
 
-/** Whether persistent icon caching is enabled (set via /C flag). */
-static bool g_useCacheFlag = false;
+/**
+ * IconPoolSameRows – compare a pixel block with a pooled cell row by row.
+ */
+static bool IconPoolSameRows(const PooledIcon *icon, const UINT32 *pixels, int stride)
+{
+    const UINT32 *cell = IconPoolCell(icon);
+    for (int y = 0; y < icon->height; ++y) {
+        if (memcmp(cell + (size_t)y * ATLAS_PAGE_DIM, pixels + (size_t)y * stride,
+                   (size_t)icon->width * 4) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
 
 /**
- * GetFileLastWriteTime – retrieve the last-write FILETIME for a path.
+ * IconPoolFind – the pooled icon with exactly these pixels.
  *
- * @param path       Null-terminated wide string path.
- * @param outTime    Receives the FILETIME on success.
- * @return           TRUE on success, FALSE on failure.
+ * @param digest  IconPixelDigest of @pixels.
+ * @return        Its IconId (live or unreferenced), or 0 if none.
  */
-static BOOL GetFileLastWriteTime(PCWSTR path, FILETIME *outTime)
+static IconId IconPoolFind(UINT32 digest, const UINT32 *pixels, int width, int height, int stride)
 {
-    WIN32_FILE_ATTRIBUTE_DATA attrs;
-    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attrs)) {
-        return FALSE;
+    if (!g_iconPool.indexMask) {
+        return 0;
     }
-    *outTime = attrs.ftLastWriteTime;
-    return TRUE;
+
+    for (UINT slot = digest & g_iconPool.indexMask; g_iconPool.index[slot];
+         slot = (slot + 1) & g_iconPool.indexMask) {
+        const PooledIcon *icon = &g_iconPool.icons[g_iconPool.index[slot] - 1];
+        if (icon->digest == digest && icon->width == width && icon->height == height &&
+            IconPoolSameRows(icon, pixels, stride)) {
+            return g_iconPool.index[slot];
+        }
+    }
+    return 0;
 }
 
 /**
- * ResolveCacheFilePath – build the path to "sendto.cache" next to the executable.
- *
- * @param outPath  Buffer of at least MAX_PATH WCHARs to receive the result.
- * @return         TRUE on success, FALSE on failure.
+ * IconPoolIndexPut – place @id in the index at the first empty slot of
+ *                    its probe sequence.  The table must have room.
  */
-static BOOL ResolveCacheFilePath(WCHAR outPath[MAX_PATH])
+static void IconPoolIndexPut(IconId id)
 {
-    if (!GetModuleFileNameW(NULL, outPath, MAX_PATH)) {
-        return FALSE;
+    UINT slot = g_iconPool.icons[id - 1].digest & g_iconPool.indexMask;
+    while (g_iconPool.index[slot]) {
+        slot = (slot + 1) & g_iconPool.indexMask;
     }
-    PathRemoveFileSpecW(outPath);
-    return PathAppendW(outPath, L"sendto.cache");
+    g_iconPool.index[slot] = id;
 }
 
 /**
- * IconCacheLoad – read the cache file from disk into g_iconCache.
+ * IconPoolIndexAdd – index @id under its digest, growing the table to
+ *                    keep it at most half full.
  *
- * Silently succeeds (with zero entries) if the file doesn't exist or is
- * corrupt.  Only entries whose on-disk format matches CACHE_VERSION are loaded.
- *
- * On partial reads (corrupt file mid-stream), only the successfully-parsed
- * entries are kept and capacity is trimmed to match, so IconCacheSave will
- * not write a stale header count.
+ * On OOM the icon simply stays unindexed: it is drawn as usual, later
+ * copies of it are not shared.
  */
-static void IconCacheLoad(void)
+static void IconPoolIndexAdd(IconId id)
 {
-    WCHAR cacheFile[MAX_PATH];
-    if (!ResolveCacheFilePath(cacheFile)) {
-        return;
+    if ((g_iconPool.indexCount + 1) * 2 > g_iconPool.indexMask + 1) {
+        const UINT slots = g_iconPool.indexMask ? (g_iconPool.indexMask + 1) * 2 : ICON_INDEX_INITIAL_SLOTS;
+        IconId *index = calloc(slots, sizeof *index);
+        if (!index) {
+            return;
+        }
+
+        IconId    *old     = g_iconPool.index;
+        const UINT oldMask = g_iconPool.indexMask;
+        g_iconPool.index     = index;
+        g_iconPool.indexMask = slots - 1;
+        for (UINT i = 0; old && i <= oldMask; ++i) {
+            if (old[i]) {
+                IconPoolIndexPut(old[i]);
+            }
+        }
+        free(old);
     }
 
-    HANDLE hFile = CreateFileW(
-        cacheFile, GENERIC_READ, FILE_SHARE_READ, NULL,
-        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
-    );
+    IconPoolIndexPut(id);
+    g_iconPool.indexCount++;
+}
 
-    if (hFile == INVALID_HANDLE_VALUE) {
+/**
+ * IconPoolIndexRemove – drop @id from the index (before its cell takes a
+ *                       new icon), shifting later entries of the probe
+ *                       run back so no lookup stops early.
+ */
+static void IconPoolIndexRemove(IconId id)
+{
+    if (!g_iconPool.indexMask) {
         return;
     }
 
-    // read and validate header
-    DWORD bytesRead;
-    DWORD magic = 0, version = 0, entryCount = 0;
-    if (!ReadFile(hFile, &magic, sizeof magic, &bytesRead, NULL) || magic != CACHE_MAGIC) {
-        goto done;
-    }
-
-    if (!ReadFile(hFile, &version, sizeof version, &bytesRead, NULL) || version != CACHE_VERSION) {
-        goto done;
+    const UINT mask = g_iconPool.indexMask;
+    UINT hole = g_iconPool.icons[id - 1].digest & mask;
+    while (g_iconPool.index[hole] && g_iconPool.index[hole] != id) {
+        hole = (hole + 1) & mask;
     }
-
-    if (!ReadFile(hFile, &entryCount, sizeof entryCount, &bytesRead, NULL)) {
-        goto done;
+    if (!g_iconPool.index[hole]) {
+        return;    // never indexed (OOM)
     }
 
-    // allocate entries
-    g_iconCache.entries = calloc(entryCount, sizeof *g_iconCache.entries);
-    if (!g_iconCache.entries) {
-        goto done;
+    for (UINT next = (hole + 1) & mask; g_iconPool.index[next]; next = (next + 1) & mask) {
+        // an entry may fill the hole unless its home lies between hole and it
+        const UINT home = g_iconPool.icons[g_iconPool.index[next] - 1].digest & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            g_iconPool.index[hole] = g_iconPool.index[next];
+            hole = next;
+        }
     }
+    g_iconPool.index[hole] = 0;
+    g_iconPool.indexCount--;
+}
 
-    g_iconCache.capacity = entryCount;
-    for (DWORD i = 0; i < entryCount; ++i) {
-        IconCacheEntry *e = &g_iconCache.entries[i];
-
-        // read path length (in WCHARs including null terminator)
-        DWORD pathLen = 0;
-        if (!ReadFile(hFile, &pathLen, sizeof pathLen, &bytesRead, NULL)) goto done;
-        if (pathLen == 0 || pathLen > MAX_PATH) goto done;
-
-        // read path
-        if (!ReadFile(hFile, e->path, pathLen * sizeof(WCHAR), &bytesRead, NULL)) goto done;
+/**
+ * IconPoolFreeLink – put unreferenced @id on its page's free-cell list.
+ */
+static void IconPoolFreeLink(IconId id)
+{
+    PooledIcon *icon = &g_iconPool.icons[id - 1];
+    AtlasPage  *page = &g_iconPool.pages[icon->page];
 
-        // read timestamp
-        if (!ReadFile(hFile, &e->lastWrite, sizeof e->lastWrite, &bytesRead, NULL)) goto done;
+    icon->prevFree = 0;
+    icon->nextFree = page->freeCells;
+    if (page->freeCells) {
+        g_iconPool.icons[page->freeCells - 1].prevFree = id;
+    }
+    page->freeCells = id;
+}
 
-        // read dimensions
-        if (!ReadFile(hFile, &e->width, sizeof e->width, &bytesRead, NULL)) goto done;
-        if (!ReadFile(hFile, &e->height, sizeof e->height, &bytesRead, NULL)) goto done;
+/**
+ * IconPoolFreeUnlink – take @id off its page's free-cell list (the icon
+ *                      is revived or its cell recycled).
+ */
+static void IconPoolFreeUnlink(IconId id)
+{
+    PooledIcon *icon = &g_iconPool.icons[id - 1];
 
-        if (e->width <= 0 || e->height <= 0 || e->width > 256 || e->height > 256) goto done;
+    if (icon->prevFree) {
+        g_iconPool.icons[icon->prevFree - 1].nextFree = icon->nextFree;
+    } else {
+        g_iconPool.pages[icon->page].freeCells = icon->nextFree;
+    }
+    if (icon->nextFree) {
+        g_iconPool.icons[icon->nextFree - 1].prevFree = icon->prevFree;
+    }
+    icon->prevFree = icon->nextFree = 0;
+}
 
-        // read pixel data
-        DWORD pixelSize = (DWORD)(e->width * e->height * 4);
-        e->pixels = malloc(pixelSize);
-        if (!e->pixels) goto done;
-        if (!ReadFile(hFile, e->pixels, pixelSize, &bytesRead, NULL) || bytesRead != pixelSize) {
-            free(e->pixels);
-            e->pixels = NULL;
-            goto done;
+/**
+ * IconPoolAddPage – allocate one more atlas page.
+ *
+ * @return  The new page, or NULL on failure.
+ */
+static AtlasPage *IconPoolAddPage(void)
+{
+    if (g_iconPool.pageCount >= g_iconPool.pageCapacity) {
+        UINT newCap = g_iconPool.pageCapacity ? g_iconPool.pageCapacity * 2 : 4;
+        AtlasPage *tmp = realloc(g_iconPool.pages, newCap * sizeof *tmp);
+        if (!tmp) {
+            return NULL;
         }
+        g_iconPool.pages        = tmp;
+        g_iconPool.pageCapacity = newCap;
+    }
 
-        g_iconCache.count++;
+    AtlasPage page = { 0 };
+    page.bitmap = CreateDIBSection32(ATLAS_PAGE_DIM, ATLAS_PAGE_DIM, (PVOID *)&page.bits);
+    page.dc     = CreateCompatibleDC(NULL);
+    if (!page.bitmap || !page.bits || !page.dc) {
+        if (page.bitmap) DeleteObject(page.bitmap);
+        if (page.dc) DeleteDC(page.dc);
+        return NULL;
     }
 
-done:
-    CloseHandle(hFile);
+    page.oldBitmap = SelectObject(page.dc, page.bitmap);
+    g_iconPool.pages[g_iconPool.pageCount] = page;
 
-    // Trim capacity to match the number of entries actually loaded.
-    // If the file was truncated mid-stream, capacity was set to the header's
-    // entryCount but only count entries were parsed successfully.  Aligning
-    // the two prevents IconCacheSave from writing a misleading header count.
-    g_iconCache.capacity = g_iconCache.count;
+    return &g_iconPool.pages[g_iconPool.pageCount++];
 }
 
 /**
- * IconCacheSave – write the current g_iconCache contents to disk.
+ * IconPoolAllocCell – find room for a @width x @height icon.
+ *
+ * Recycles the cell of an unreferenced icon of the same size first (only
+ * the pages' free-cell lists are walked), then packs into existing pages,
+ * then opens a new page.  A recycled slot leaves the index and its list.
  *
- * Only writes if the cache has been marked dirty (new or updated entries).
- * The header entry-count reflects only entries with valid pixel data, so
- * the reader will never expect more records than were actually written.
+ * @param width   Icon width.
+ * @param height  Icon height.
+ * @return        Slot to (re)use with page/x/y filled in, or NULL on failure.
  */
-static void IconCacheSave(void)
+static PooledIcon *IconPoolAllocCell(int width, int height)
 {
-    if (!g_iconCache.dirty || g_iconCache.count == 0) {
-        return;
+    for (UINT page = 0; page < g_iconPool.pageCount; ++page) {
+        for (IconId id = g_iconPool.pages[page].freeCells; id; id = g_iconPool.icons[id - 1].nextFree) {
+            PooledIcon *icon = &g_iconPool.icons[id - 1];
+            if (icon->width == width && icon->height == height) {
+                IconPoolFreeUnlink(id);
+                IconPoolIndexRemove(id);
+                return icon;
+            }
+        }
     }
 
-    WCHAR cacheFile[MAX_PATH];
-    if (!ResolveCacheFilePath(cacheFile)) {
-        return;
+    if (g_iconPool.count >= g_iconPool.capacity) {
+        UINT newCap = g_iconPool.capacity ? g_iconPool.capacity * 2 : MENU_POOL_SIZE;
+        PooledIcon *tmp = realloc(g_iconPool.icons, newCap * sizeof *tmp);
+        if (!tmp) {
+            return NULL;
+        }
+        g_iconPool.icons    = tmp;
+        g_iconPool.capacity = newCap;
     }
 
-    HANDLE hFile = CreateFileW(
-        cacheFile, GENERIC_WRITE, 0, NULL,
-        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
-    );
-    if (hFile == INVALID_HANDLE_VALUE) {
-        return;
+    int x, y;
+    UINT page = 0;
+    while (page < g_iconPool.pageCount &&
+           !AtlasPackerAlloc(&g_iconPool.pages[page].packer, ATLAS_PAGE_DIM, width, height, &x, &y)) {
+        page++;
     }
 
-    // Count entries with valid pixel data — only these will be serialised.
-    // Entries with NULL pixels (e.g. from a partially-loaded cache or a
-    // failed IconCacheStore) are skipped during writing, so the header must
-    // advertise the real number of records the reader will encounter.
-    DWORD validCount = 0;
-    for (UINT i = 0; i < g_iconCache.count; ++i) {
-        if (g_iconCache.entries[i].pixels) {
-            validCount++;
+    if (page == g_iconPool.pageCount) {
+        AtlasPage *fresh = IconPoolAddPage();
+        if (!fresh || !AtlasPackerAlloc(&fresh->packer, ATLAS_PAGE_DIM, width, height, &x, &y)) {
+            return NULL;
         }
     }
 
-    if (validCount == 0) {
-        CloseHandle(hFile);
-        return;
-    }
+    PooledIcon *icon = &g_iconPool.icons[g_iconPool.count++];
+    *icon = (PooledIcon){ 0, width, height, 0, page, x, y, 0, 0 };
 
-    DWORD written;
+    return icon;
+}
 
-    // write header
-    DWORD magic   = CACHE_MAGIC;
-    DWORD version = CACHE_VERSION;
-    WriteFile(hFile, &magic,      sizeof magic,      &written, NULL);
-    WriteFile(hFile, &version,    sizeof version,    &written, NULL);
-    WriteFile(hFile, &validCount, sizeof validCount, &written, NULL);
+/**
+ * IconPoolInternPixels – add a premultiplied 32-bit icon to the pool.
+ *
+ * If an icon with identical pixels is pooled, it gains a reference and its
+ * id is returned; otherwise the pixels are copied into a free atlas cell.
+ *
+ * @param pixels  First pixel of the icon (top-down BGRA, premultiplied).
+ * @param width   Icon width in pixels.
+ * @param height  Icon height in pixels.
+ * @param stride  Distance between rows of @pixels, in pixels.
+ * @return        IconId (one reference owned by the caller), or 0 on failure.
+ */
+static IconId IconPoolInternPixels(const UINT32 *pixels, int width, int height, int stride)
+{
+    if (!pixels || width <= 0 || height <= 0 || width > ATLAS_PAGE_DIM || height > ATLAS_PAGE_DIM) {
+        return 0;
+    }
 
-    for (UINT i = 0; i < g_iconCache.count; ++i) {
-        IconCacheEntry *e = &g_iconCache.entries[i];
-        if (!e->pixels) continue;
+    const UINT32 digest = IconPixelDigest(pixels, width, height, stride);
 
-        // write path length + path
-        DWORD pathLen = (DWORD)(wcslen(e->path) + 1);
-        WriteFile(hFile, &pathLen, sizeof pathLen, &written, NULL);
-        WriteFile(hFile, e->path, pathLen * sizeof(WCHAR), &written, NULL);
+    const IconId found = IconPoolFind(digest, pixels, width, height, stride);
+    if (found) {
+        PooledIcon *icon = &g_iconPool.icons[found - 1];
+        if (icon->refs++ == 0) {
+            IconPoolFreeUnlink(found);    // revived
+        }
+        return found;
+    }
 
-        // write timestamp
-        WriteFile(hFile, &e->lastWrite, sizeof e->lastWrite, &written, NULL);
+    PooledIcon *icon = IconPoolAllocCell(width, height);
+    if (!icon) {
+        return 0;
+    }
 
-        // write dimensions
-        WriteFile(hFile, &e->width,  sizeof e->width,  &written, NULL);
-        WriteFile(hFile, &e->height, sizeof e->height, &written, NULL);
+    CopyPixelRows(IconPoolCell(icon), ATLAS_PAGE_DIM, pixels, stride, width, height);
 
-        // write pixel data
-        DWORD pixelSize = (DWORD)(e->width * e->height * 4);
-        WriteFile(hFile, e->pixels, pixelSize, &written, NULL);
-    }
+    icon->digest = digest;
+    icon->refs   = 1;
 
-    CloseHandle(hFile);
+    const IconId id = (IconId)(icon - g_iconPool.icons) + 1;
+    IconPoolIndexAdd(id);
+    return id;
 }
 
 /**
- * IconCacheDestroy – free all heap memory held by g_iconCache.
+ * IconPoolGet – slot of a live icon id.
+ *
+ * @param id  IconId (may be 0).
+ * @return    Slot pointer, or NULL for 0 / unknown ids.
  */
-static void IconCacheDestroy(void)
+static PooledIcon *IconPoolGet(IconId id)
 {
-    for (UINT i = 0; i < g_iconCache.count; ++i) {
-        free(g_iconCache.entries[i].pixels);
-    }
-    free(g_iconCache.entries);
-    ZeroMemory(&g_iconCache, sizeof g_iconCache);
+    return (id && id <= g_iconPool.count) ? &g_iconPool.icons[id - 1] : NULL;
 }
 
 /**
- * IconCacheEnsureCapacity – make room for at least @need entries in g_iconCache.
+ * IconPoolAddRef – take an extra reference on a pooled icon.
  *
- * Mirrors the amortised-doubling strategy of VectorEnsureCapacity, starting
- * at 128 slots when the cache is empty.
- *
- * @param need  Desired minimum capacity.
- * @return      true on success, false on OOM (existing data is untouched).
+ * @param id  IconId (may be 0).
+ * @return    @id, for call chaining.
  */
-static bool IconCacheEnsureCapacity(UINT need)
+static IconId IconPoolAddRef(IconId id)
 {
-    if (need <= g_iconCache.capacity) {
-        return true;
+    PooledIcon *icon = IconPoolGet(id);
+    if (icon && icon->refs++ == 0) {
+        IconPoolFreeUnlink(id);
     }
+    return icon ? id : 0;
+}
 
-    UINT newCap = g_iconCache.capacity ? g_iconCache.capacity * 2 : 128;
-    if (newCap < need) {
-        newCap = need;
+/**
+ * IconPoolRelease – drop one reference.  At zero the cell stays intact
+ *                   (and indexed) on its page's free-cell list until it
+ *                   is revived or recycled by a same-size icon.
+ *
+ * @param id  IconId (may be 0).
+ */
+static void IconPoolRelease(IconId id)
+{
+    PooledIcon *icon = IconPoolGet(id);
+    if (icon && icon->refs && --icon->refs == 0) {
+        IconPoolFreeLink(id);
     }
+}
 
-    IconCacheEntry *tmp = realloc(g_iconCache.entries, newCap * sizeof *tmp);
-    if (!tmp) {
-        return false;
+/**
+ * IconPoolPixels – read access to a pooled icon's pixels.
+ *
+ * @param id         IconId.
+ * @param outWidth   Receives the icon width.
+ * @param outHeight  Receives the icon height.
+ * @param outStride  Receives the row distance in pixels.
+ * @return           First pixel of the icon, or NULL for an invalid id.
+ */
+static const UINT32 *IconPoolPixels(IconId id, int *outWidth, int *outHeight, int *outStride)
+{
+    PooledIcon *icon = IconPoolGet(id);
+    if (!icon || !icon->refs) {
+        return NULL;
     }
 
-    ZeroMemory(tmp + g_iconCache.capacity,
-               (newCap - g_iconCache.capacity) * sizeof *tmp);
+    *outWidth  = icon->width;
+    *outHeight = icon->height;
+    *outStride = ATLAS_PAGE_DIM;
 
-    g_iconCache.entries  = tmp;
-    g_iconCache.capacity = newCap;
+    return IconPoolCell(icon);
+}
 
-    return true;
+/**
+ * IconPoolSize – dimensions of a pooled icon (0 x 0 for an invalid id).
+ */
+static void IconPoolSize(IconId id, int *outWidth, int *outHeight)
+{
+    PooledIcon *icon = IconPoolGet(id);
+    *outWidth  = icon ? icon->width : 0;
+    *outHeight = icon ? icon->height : 0;
 }
 
 /**
- * IconCacheLookup – search for a cached icon matching @path and its current
- *                   last-write timestamp.
+ * IconPoolDraw – alpha-blend a pooled icon from its atlas page onto @hdc.
  *
- * @param path   Null-terminated wide string path of the file to look up.
- * @return       A new HBITMAP created from cached pixel data if a valid entry
- *               exists, or NULL if not found or stale.
+ * @param id   IconId (no-op for 0).
+ * @param hdc  Destination DC.
+ * @param x    Destination left edge.
+ * @param y    Destination top edge.
  */
-static HBITMAP IconCacheLookup(PCWSTR path)
+static void IconPoolDraw(IconId id, HDC hdc, int x, int y)
 {
-    FILETIME ft;
-    if (!GetFileLastWriteTime(path, &ft)) {
-        return NULL;
+    PooledIcon *icon = IconPoolGet(id);
+    if (!icon) {
+        return;
     }
 
-    for (UINT i = 0; i < g_iconCache.count; ++i) {
-        IconCacheEntry *e = &g_iconCache.entries[i];
-        if (_wcsicmp(e->path, path) != 0) {
-            continue;
-        }
+    const BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+    AlphaBlend(hdc, x, y, icon->width, icon->height,
+               g_iconPool.pages[icon->page].dc, icon->x, icon->y,
+               icon->width, icon->height, blend);
+}
 
-        if (CompareFileTime(&e->lastWrite, &ft) != 0) {
-            continue;
-        }
+/**
+ * IconPoolDestroy – free every atlas page and the slot table.
+ */
+static void IconPoolDestroy(void)
+{
+    for (UINT i = 0; i < g_iconPool.pageCount; ++i) {
+        AtlasPage *page = &g_iconPool.pages[i];
+        SelectObject(page->dc, page->oldBitmap);
+        DeleteDC(page->dc);
+        DeleteObject(page->bitmap);
+        AtlasPackerFree(&page->packer);
+    }
+    free(g_iconPool.pages);
+    free(g_iconPool.icons);
+    free(g_iconPool.index);
+    ZeroMemory(&g_iconPool, sizeof g_iconPool);
+}
 
-        if (!e->pixels) {
-            continue;
-        }
 
-        // rebuild HBITMAP from cached pixels via shared helper
-        PVOID pBits = NULL;
-        HBITMAP hbm = CreateDIBSection32(e->width, e->height, &pBits);
-        if (hbm && pBits) {
-            memcpy(pBits, e->pixels, (size_t)(e->width * e->height * 4));
-        }
+/* -------------------------------------------------------------------------- */
+/* Dynamic array for menu items                                               */
+/* -------------------------------------------------------------------------- */
 
-        return hbm;
-    }
+/** MenuVector.parents value of items directly in the SendTo root. */
+#define MENU_NO_PARENT ((UINT)-1)
 
-    return NULL;
-}
+/** MenuVector.flags: the item is a folder (a submenu). */
+#define MENU_ITEM_DIRECTORY 0x01
 
 /**
- * IconCacheStore – add or update a cache entry for the given path and bitmap.
+ * PopupRange – a run of vector items shown consecutively in one popup.
  *
- * Extracts the raw 32-bit pixel data from @hbm via GetDIBits and stores it
- * alongside the file's current last-write timestamp.  Marks the cache dirty.
+ * Items [@first, @first + @count) sit at positions [@position,
+ * @position + @count) of @menu, so WM_INITMENUPOPUP can go straight to
+ * them without asking user32 about every item.
  *
- * @param path  Null-terminated wide string path of the file.
- * @param hbm   32-bit ARGB HBITMAP whose pixels will be copied into the cache.
+ * @member menu      Popup (folder submenu or page) showing the items.
+ * @member first     Vector index of the first item.
+ * @member position  Zero-based position of that item inside @menu.
+ * @member count     Items in the run.
+ * @member next      Index of the next range of @menu, or POPUP_NO_RANGE.
  */
-static void IconCacheStore(PCWSTR path, HBITMAP hbm)
-{
-    if (!hbm) return;
+typedef struct {
+    HMENU menu;
+    UINT  first;
+    UINT  position;
+    UINT  count;
+    UINT  next;
+} PopupRange;
 
-    FILETIME ft;
-    if (!GetFileLastWriteTime(path, &ft)) {
-        return;
-    }
+/** PopupRange.next value of the last range of a popup. */
+#define POPUP_NO_RANGE ((UINT)-1)
 
-    // get bitmap dimensions
-    BITMAP bm;
-    if (!GetObject(hbm, sizeof bm, &bm)) return;
-    if (bm.bmWidth <= 0 || bm.bmHeight <= 0) return;
+/**
+ * PopupSlot – hash table slot leading from a popup to its ranges.
+ *
+ * @member menu   Popup; NULL marks an empty slot.
+ * @member first  Index of its first PopupRange.
+ * @member last   Index of its last PopupRange (where the chain grows).
+ */
+typedef struct {
+    HMENU menu;
+    UINT  first;
+    UINT  last;
+} PopupSlot;
 
-    DWORD pixelSize = (DWORD)(bm.bmWidth * bm.bmHeight * 4);
-    BYTE *pixels = malloc(pixelSize);
-    if (!pixels) return;
+/** Initial PopupSlot count of a MenuVector (power of two). */
+#define POPUP_INITIAL_SLOTS 64
 
-    // extract pixel data from the HBITMAP via shared helper
-    BITMAPINFO bmi;
-    InitBitmapInfo32(&bmi, bm.bmWidth, bm.bmHeight);
+/**
+ * MenuVector – the "Send To" items, stored as parallel arrays.
+ *
+ * Item i is command ID i + 1.  Instead of a heap path per item, each item
+ * keeps the index of its parent folder item and its name in one shared
+ * @names pool; VectorItemPath rebuilds the absolute path from @root when
+ * it is needed (icon resolution, the selected target).  Per-popup work
+ * such as finding the items without an icon scans small contiguous arrays.
+ *
+ * @member parents        Index of the folder item containing the item, or
+ *                        MENU_NO_PARENT for the root.
+ * @member nameOffsets    Offset of the item's name in @names.
+ * @member flags          MENU_ITEM_* bits.
+ * @member icons          Icon shown for the item (0 = none yet); one reference
+ *                        into g_iconPool, released by VectorDestroy.
+ * @member lastWrites     Last-write time reported by the folder enumeration;
+ *                        the persistent icon cache is validated against it.
+ * @member count          Items currently stored.
+ * @member capacity       Allocated slots in each per-item array.
+ * @member names          Pool of NUL-terminated entry names.
+ * @member namesUsed      WCHARs used in @names.
+ * @member namesCapacity  WCHARs allocated in @names.
+ * @member root           Heap copy of the SendTo root the paths hang off.
+ * @member ranges         Where the items are shown; see VectorNoteRange.
+ * @member rangeCount     Used slots in @ranges.
+ * @member rangeCapacity  Allocated slots in @ranges.
+ * @member popups         Open-addressing table from popup to its chain of
+ *                        @ranges; see VectorFindPopup.
+ * @member popupMask      Slot count - 1 (power of two), 0 before the first range.
+ * @member popupCount     Occupied slots.
+ */
+typedef struct {
+    UINT       *parents;
+    UINT       *nameOffsets;
+    BYTE       *flags;
+    IconId     *icons;
+    FILETIME   *lastWrites;
+    UINT        count;
+    UINT        capacity;
+    WCHAR      *names;
+    UINT        namesUsed;
+    UINT        namesCapacity;
+    PWSTR       root;
+    PopupRange *ranges;
+    UINT        rangeCount;
+    UINT        rangeCapacity;
+    PopupSlot  *popups;
+    UINT        popupMask;
+    UINT        popupCount;
+} MenuVector;
 
-    HDC hdc = GetDC(NULL);
-    int scanlines = GetDIBits(hdc, hbm, 0, bm.bmHeight, pixels, &bmi, DIB_RGB_COLORS);
-    ReleaseDC(NULL, hdc);
+/**
+ * Pointer to the active menu-item vector; used by SendToWndProc to
+ * lazily resolve icons on WM_INITMENUPOPUP. Set once in RunSendTo().
+ */
+static MenuVector *g_menuItems = NULL;
 
-    if (scanlines == 0) {
-        free(pixels);
-        return;
+/**
+ * VectorGrowArray – realloc one per-item array of @vec to @newCap slots.
+ *
+ * @return  false on OOM (the array is untouched).
+ */
+static bool VectorGrowArray(void **array, UINT newCap, size_t elementSize)
+{
+    void *tmp = realloc(*array, newCap * elementSize);
+    if (!tmp) {
+        return false;
     }
+    *array = tmp;
+    return true;
+}
 
-    // check if entry already exists (stale) and update in-place
-    for (UINT i = 0; i < g_iconCache.count; ++i) {
-        IconCacheEntry *e = &g_iconCache.entries[i];
-        if (_wcsicmp(e->path, path) != 0) continue;
+/**
+ * VectorEnsureCapacity – make room for at least @need elements.
+ *
+ * @param vec   Target vector.
+ * @param need  Desired minimum capacity.
+ * @return      true on success, false on OOM.
+ */
+static bool VectorEnsureCapacity(MenuVector *vec, UINT need)
+{
+    if (need <= vec->capacity) {
+        return true;
+    }
 
-        free(e->pixels);
-        e->lastWrite = ft;
-        e->width     = bm.bmWidth;
-        e->height    = bm.bmHeight;
-        e->pixels    = pixels;
-        g_iconCache.dirty = true;
-        return;
+    // Amortized growth: double current capacity (or start at 64), but at least 'need'
+    UINT newCap = vec->capacity ? vec->capacity * 2 : MENU_POOL_SIZE;
+    if (newCap < need) {
+        newCap = need;
     }
 
-    // new entry — grow array if needed
-    if (!IconCacheEnsureCapacity(g_iconCache.count + 1)) {
-        free(pixels);
-        return;
+    // arrays grown before a failure simply stay larger
+    if (!VectorGrowArray((void **)&vec->parents,     newCap, sizeof *vec->parents)     ||
+        !VectorGrowArray((void **)&vec->nameOffsets, newCap, sizeof *vec->nameOffsets) ||
+        !VectorGrowArray((void **)&vec->flags,       newCap, sizeof *vec->flags)       ||
+        !VectorGrowArray((void **)&vec->icons,       newCap, sizeof *vec->icons)       ||
+        !VectorGrowArray((void **)&vec->lastWrites,  newCap, sizeof *vec->lastWrites)) {
+        return false;
     }
 
-    IconCacheEntry *e = &g_iconCache.entries[g_iconCache.count++];
-    StringCchCopyW(e->path, MAX_PATH, path);
-    e->lastWrite = ft;
-    e->width     = bm.bmWidth;
-    e->height    = bm.bmHeight;
-    e->pixels    = pixels;
-    g_iconCache.dirty = true;
+    vec->capacity = newCap;
+    return true;
 }
 
 /**
- * CachedIconForItem – resolve a file or directory icon, using the persistent
- *                     cache when available.  On cache miss, falls back to
- *                     IconForItem() and stores the result for next time.
+ * VectorAddName – copy @name into the shared name pool.
  *
- * @param filePath  Null-terminated wide string path to a file or directory.
- * @return          32-bit ARGB HBITMAP, or NULL on failure.
+ * @param outOffset  Receives the offset of the copy in vec->names.
+ * @return           false on OOM.
  */
-static HBITMAP CachedIconForItem(PCWSTR filePath)
+static bool VectorAddName(MenuVector *vec, PCWSTR name, UINT *outOffset)
 {
-    if (g_useCacheFlag) {
-        HBITMAP cached = IconCacheLookup(filePath);
-        if (cached) return cached;
-    }
-
-    HBITMAP icon = IconForItem(filePath);
-    if (icon && g_useCacheFlag) {
-        IconCacheStore(filePath, icon);
+    const UINT len = (UINT)wcslen(name) + 1;
+    if (vec->namesUsed + len > vec->namesCapacity) {
+        UINT newCap = vec->namesCapacity ? vec->namesCapacity * 2 : MENU_POOL_SIZE * 32;
+        while (newCap < vec->namesUsed + len) {
+            newCap *= 2;
+        }
+        WCHAR *tmp = realloc(vec->names, newCap * sizeof *tmp);
+        if (!tmp) {
+            return false;
+        }
+        vec->names         = tmp;
+        vec->namesCapacity = newCap;
     }
 
-    return icon;
+    memcpy(vec->names + vec->namesUsed, name, len * sizeof *name);
+    *outOffset = vec->namesUsed;
+    vec->namesUsed += len;
+    return true;
 }
 
+/**
+ * VectorPush – append a new entry (takes ownership of the icon reference).
+ *
+ * @param vec          Vector to modify.
+ * @param parent       Index of the containing folder item, or MENU_NO_PARENT.
+ * @param name         Entry name (copied into the name pool).
+ * @param isDirectory  The entry is a folder.
+ * @param lastWrite    Last-write time from the enumeration.
+ * @param icon         Pooled icon (may be 0, reference transferred).
+ * @return      true on success, false on OOM — if false the caller still
+ *              owns @icon and must release it.
+ */
+static bool VectorPush(MenuVector *vec, UINT parent, PCWSTR name, bool isDirectory,
+                       const FILETIME *lastWrite, IconId icon)
+{
+    // If capacity growth fails, we do *not* consume the resources.
+    UINT nameOffset;
+    if (!VectorEnsureCapacity(vec, vec->count + 1) || !VectorAddName(vec, name, &nameOffset)) {
+        return false;
+    }
 
-/* -------------------------------------------------------------------------- */
-/* Foreground window helpers                                                  */
-/* -------------------------------------------------------------------------- */
+    const UINT i = vec->count++;
+    vec->parents[i]     = parent;
+    vec->nameOffsets[i] = nameOffset;
+    vec->flags[i]       = isDirectory ? MENU_ITEM_DIRECTORY : 0;
+    vec->icons[i]       = icon;
+    vec->lastWrites[i]  = *lastWrite;
+
+    return true;
+}
 
 /**
- * FindMainWindowCtx – EnumWindows callback context for FindMainWindowByPid.
- *
- * @member pid     Target process ID to search for.
- * @member result  Receives the first matching HWND, or NULL if not found yet.
+ * VectorPopupSlot – the slot of @menu in @vec->popups, or the empty slot
+ *                   where it would go (linear probing).  The table must exist.
  */
-typedef struct {
-    DWORD pid;
-    HWND  result;
-} FindMainWindowCtx;
+static PopupSlot *VectorPopupSlot(const MenuVector *vec, HMENU menu)
+{
+    UINT slot = (UINT)(((UINT64)(UINT_PTR)menu * 0x9E3779B97F4A7C15ull) >> 32) & vec->popupMask;
+    while (vec->popups[slot].menu && vec->popups[slot].menu != menu) {
+        slot = (slot + 1) & vec->popupMask;
+    }
+    return &vec->popups[slot];
+}
 
 /**
- * FindMainWindowCb – EnumWindows callback: finds the first visible, ownerless
- *                    top-level window belonging to @ctx->pid.
- *
- * "Main window" heuristic: visible + no owner + matching PID.
- * Stops enumeration as soon as a match is found.
+ * VectorGrowPopups – double the popup table (or create it) and rehash.
  *
- * @param hwnd  Handle to the window currently being enumerated.
- * @param lp    Pointer to a FindMainWindowCtx cast to LPARAM.
- * @return      FALSE to stop enumeration (match found), TRUE to continue.
+ * @return  false on OOM (the old table is kept).
  */
-static BOOL CALLBACK FindMainWindowCb(HWND hwnd, LPARAM lp)
+static bool VectorGrowPopups(MenuVector *vec)
 {
-    FindMainWindowCtx *ctx = (FindMainWindowCtx *)lp;
-
-    DWORD wPid = 0;
-    GetWindowThreadProcessId(hwnd, &wPid);
-
-    // visible, no owner, owned by the target PID → this is the main window
-    if (wPid == ctx->pid && IsWindowVisible(hwnd) && !GetWindow(hwnd, GW_OWNER)) {
-        ctx->result = hwnd;
-        return FALSE; // stop enumeration
+    const UINT slots = vec->popupMask ? (vec->popupMask + 1) * 2 : POPUP_INITIAL_SLOTS;
+    PopupSlot *popups = calloc(slots, sizeof *popups);
+    if (!popups) {
+        return false;
     }
 
-    return TRUE;
+    PopupSlot *old     = vec->popups;
+    const UINT oldMask = vec->popupMask;
+    vec->popups    = popups;
+    vec->popupMask = slots - 1;
+    for (UINT i = 0; old && i <= oldMask; ++i) {
+        if (old[i].menu) {
+            *VectorPopupSlot(vec, old[i].menu) = old[i];
+        }
+    }
+    free(old);
+    return true;
 }
 
 /**
- * FindMainWindowByPid – locate the main visible top-level window of a process.
+ * VectorFindPopup – the ranges of @menu, in insertion order.
  *
- * @param pid  Process ID to search for.
- * @return     HWND on success, NULL if no matching window was found.
+ * @return  The popup's slot (walk @first through PopupRange.next), or
+ *          NULL if no item was noted in @menu.
  */
-static HWND FindMainWindowByPid(DWORD pid)
+static const PopupSlot *VectorFindPopup(const MenuVector *vec, HMENU menu)
 {
-    FindMainWindowCtx ctx = { pid, NULL };
-    EnumWindows(FindMainWindowCb, (LPARAM)&ctx);
-    return ctx.result;
+    if (!vec->popupMask) {
+        return NULL;
+    }
+    const PopupSlot *slot = VectorPopupSlot(vec, menu);
+    return slot->menu ? slot : NULL;
 }
 
 /**
- * ForceWindowToForeground – bring @hwnd to the foreground, bypassing Windows'
- *                           foreground-lock restrictions.
- *
- * Windows normally blocks SetForegroundWindow() unless the calling thread
- * already owns the foreground.  Temporarily attaching our thread's input to
- * the target thread's input queue satisfies that restriction and lets the
- * call succeed.
+ * VectorNoteRange – record that item @index was inserted at @position of
+ *                   @menu, extending the last range when it continues it.
  *
- * @param hwnd  Window to activate.  No-op if NULL or no longer valid.
+ * Items whose note is lost to OOM simply get no icon.
  */
-static void ForceWindowToForeground(HWND hwnd)
+static void VectorNoteRange(MenuVector *vec, HMENU menu, UINT index, UINT position)
 {
-    if (!hwnd || !IsWindow(hwnd)) {
+    if (vec->rangeCount) {
+        PopupRange *last = &vec->ranges[vec->rangeCount - 1];
+        if (last->menu == menu && last->first + last->count == index &&
+            last->position + last->count == position) {
+            last->count++;
+            return;
+        }
+    }
+
+    if (vec->rangeCount == vec->rangeCapacity) {
+        UINT newCap = vec->rangeCapacity ? vec->rangeCapacity * 2 : MENU_POOL_SIZE;
+        PopupRange *tmp = realloc(vec->ranges, newCap * sizeof *tmp);
+        if (!tmp) {
+            return;
+        }
+        vec->ranges        = tmp;
+        vec->rangeCapacity = newCap;
+    }
+    if ((vec->popupCount + 1) * 2 > vec->popupMask + 1 && !VectorGrowPopups(vec)) {
         return;
     }
 
-    HWND  hwndFg    = GetForegroundWindow();
-    DWORD fgThread  = hwndFg ? GetWindowThreadProcessId(hwndFg, NULL) : 0;
-    DWORD tgtThread = GetWindowThreadProcessId(hwnd, NULL);
+    // chain the new range behind the popup's previous one
+    const UINT range = vec->rangeCount++;
+    vec->ranges[range] = (PopupRange){ menu, index, position, 1, POPUP_NO_RANGE };
 
-    // attach input queues so SetForegroundWindow is not rejected
-    BOOL attached = FALSE;
-    if (fgThread && fgThread != tgtThread) {
-        attached = AttachThreadInput(fgThread, tgtThread, TRUE);
+    PopupSlot *slot = VectorPopupSlot(vec, menu);
+    if (slot->menu) {
+        vec->ranges[slot->last].next = range;
+        slot->last = range;
+    } else {
+        *slot = (PopupSlot){ menu, range, range };
+        vec->popupCount++;
     }
+}
 
-    ShowWindow(hwnd, SW_RESTORE);
-    SetForegroundWindow(hwnd);
-    BringWindowToTop(hwnd);
+/**
+ * VectorItemPath – rebuild the absolute path of item @index.
+ *
+ * @param vec    Vector holding the item.
+ * @param index  Item index.
+ * @param out    Buffer receiving the path.
+ * @param cch    Capacity of @out in WCHARs.
+ * @return       TRUE on success, FALSE if the path does not fit.
+ */
+static BOOL VectorItemPath(const MenuVector *vec, UINT index, PWSTR out, size_t cch)
+{
+    // the chain is at most ENUM_MAX_DEPTH_CAP folders deep
+    UINT chain[ENUM_MAX_DEPTH_CAP + 1];
+    UINT depth = 0;
+    for (UINT i = index; i != MENU_NO_PARENT && depth < ARRAYSIZE(chain); i = vec->parents[i]) {
+        chain[depth++] = i;
+    }
 
-    // always detach, even if SetForegroundWindow failed
-    if (attached) {
-        AttachThreadInput(fgThread, tgtThread, FALSE);
+    if (FAILED(StringCchCopyW(out, cch, vec->root))) {
+        return FALSE;
+    }
+    while (depth--) {
+        const size_t len = wcslen(out);
+        if ((len && out[len - 1] != L'\\' && FAILED(StringCchCatW(out, cch, L"\\"))) ||
+            FAILED(StringCchCatW(out, cch, vec->names + vec->nameOffsets[chain[depth]]))) {
+            return FALSE;
+        }
     }
+    return TRUE;
 }
 
 /**
- * ActivateTargetWindow – find and bring to the foreground the window of a
- *                        newly-spawned process (no-args / HandleOpenTarget branch).
+ * VectorDestroy – release the icon references, free all arrays and reset
+ *                 the vector to zero.
  *
- * Waits for @hProcess to become idle, then locates its main window by PID.
- * Retries up to ~2 s to allow slow apps to create their window after idle.
- * Once found, activates it via ForceWindowToForeground.
- *
- * @param hProcess  Handle of the newly-spawned process (must be non-NULL).
+ * @param vec  Vector to wipe.
  */
-static void ActivateTargetWindow(HANDLE hProcess)
+static void VectorDestroy(MenuVector *vec)
+{
+    for (UINT i = 0; i < vec->count; ++i) {
+        IconPoolRelease(vec->icons[i]);
+    }
+    free(vec->parents);
+    free(vec->nameOffsets);
+    free(vec->flags);
+    free(vec->icons);
+    free(vec->lastWrites);
+    free(vec->names);
+    free(vec->root);
+    free(vec->ranges);
+    free(vec->popups);
+    ZeroMemory(vec, sizeof *vec);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Icons tools                                                                */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * IconScratch – reusable DIB that icons are rendered into before their
+ *               pixels are copied to an atlas cell.
+ *
+ * @member bitmap  Scratch DIB section (NULL until first use).
+ * @member bits    Pixel pointer of @bitmap.
+ * @member width   Current scratch width.
+ * @member height  Current scratch height.
+ */
+typedef struct {
+    HBITMAP bitmap;
+    UINT32  *bits;
+    int     width;
+    int     height;
+} IconScratch;
+
+static IconScratch g_iconScratch = { 0 };
+
+/** Edge length of menu icons this run, chosen by SetIconPixelSize. */
+static int g_iconPixelSize = 16;
+
+/** Shell image list icons are taken from, chosen for g_shellImageListSize. */
+static IImageList *g_shellImageList     = NULL;
+static int         g_shellImageListSize = 0;
+
+/**
+ * IconScratchPixels – cleared scratch pixels of at least the given size.
+ *
+ * The scratch DIB is only reallocated when the requested size changes,
+ * which in practice happens once per run (all small icons match).
+ *
+ * @param width   Required width.
+ * @param height  Required height.
+ * @return        Zeroed pixel buffer (stride = @width), or NULL on failure.
+ */
+static UINT32 *IconScratchPixels(int width, int height)
+{
+    if (!g_iconScratch.bitmap || g_iconScratch.width != width || g_iconScratch.height != height) {
+        if (g_iconScratch.bitmap) {
+            DeleteObject(g_iconScratch.bitmap);
+        }
+
+        g_iconScratch.bitmap = CreateDIBSection32(width, height, (PVOID *)&g_iconScratch.bits);
+        if (!g_iconScratch.bitmap || !g_iconScratch.bits) {
+            ZeroMemory(&g_iconScratch, sizeof g_iconScratch);
+            return NULL;
+        }
+
+        g_iconScratch.width  = width;
+        g_iconScratch.height = height;
+    }
+
+    ZeroMemory(g_iconScratch.bits, (size_t)width * height * 4);
+    return g_iconScratch.bits;
+}
+
+/**
+ * IconScratchDestroy – release the scratch DIB.
+ */
+static void IconScratchDestroy(void)
+{
+    if (g_iconScratch.bitmap) {
+        DeleteObject(g_iconScratch.bitmap);
+    }
+    ZeroMemory(&g_iconScratch, sizeof g_iconScratch);
+}
+
+/**
+ * ApplyMaskAlpha – give a legacy (alpha-less) icon real transparency.
+ *
+ * DrawIconEx leaves the alpha byte at zero for icons without an alpha
+ * channel, which AlphaBlend would render fully transparent.  The AND mask
+ * is rendered at the same (possibly scaled) size onto white and read back
+ * as 32-bit pixels: white marks transparent pixels, black opaque ones.
+ *
+ * @param pixels  Rendered icon pixels (stride = @width), updated in place.
+ * @param width   Rendered width.
+ * @param height  Rendered height.
+ * @param icon    Source icon.
+ */
+static void ApplyMaskAlpha(UINT32 *pixels, int width, int height, HICON icon)
+{
+    const size_t count = (size_t)width * height;
+
+    UINT32 *maskBits = NULL;
+    HBITMAP maskDib = CreateDIBSection32(width, height, (PVOID *)&maskBits);
+    if (!maskDib || !maskBits) {
+        // no usable mask: treat the icon as fully opaque
+        for (size_t i = 0; i < count; ++i) {
+            pixels[i] |= 0xFF000000u;
+        }
+        if (maskDib) {
+            DeleteObject(maskDib);
+        }
+        return;
+    }
+
+    // DI_MASK ANDs the mask onto the target, so start from white
+    FillMemory(maskBits, count * 4, 0xFF);
+
+    HGDIOBJ oldObj = SelectObject(hdcIconCache, maskDib);
+    DrawIconEx(hdcIconCache, 0, 0, icon, width, height, 0, NULL, DI_MASK);
+    SelectObject(hdcIconCache, oldObj);
+    GdiFlush();
+
+    MaskToAlphaRow(pixels, maskBits, count);
+    DeleteObject(maskDib);
+}
+
+/**
+ * IconFromHicon – render an HICON and add it to the icon pool.
+ *
+ * @param iconHandle  Source HICON (ownership transferred; this function destroys it).
+ * @param size        Edge length to render at (DrawIconEx scales), or 0 for
+ *                    the icon's own size.
+ * @return            IconId (one reference owned by the caller), or 0 on failure.
+ */
+static IconId IconFromHicon(HICON iconHandle, int size)
+{
+    if (!iconHandle) {
+        return 0;
+    }
+
+    ICONINFO iconInfo;
+    if (!GetIconInfo(iconHandle, &iconInfo)) {
+        // failed to extract bitmap handles
+        DestroyIcon(iconHandle);
+        return 0;
+    }
+
+    IconId id = 0;
+
+    // get dimensions from the color bitmap
+    BITMAP bmpMetrics;
+    if (GetObject(iconInfo.hbmColor, sizeof bmpMetrics, &bmpMetrics)) {
+        const int width  = size > 0 ? size : bmpMetrics.bmWidth;
+        const int height = size > 0 ? size : bmpMetrics.bmHeight;
+
+        UINT32 *pixels = IconScratchPixels(width, height);
+        if (pixels) {
+            // render through the global temporary DC, then copy into the atlas
+            HGDIOBJ oldObj = SelectObject(hdcIconCache, g_iconScratch.bitmap);
+            DrawIconEx(hdcIconCache, 0, 0, iconHandle, width, height, 0, NULL, DI_NORMAL);
+            SelectObject(hdcIconCache, oldObj);
+            GdiFlush();
+
+            if (!HasAlphaRow(pixels, (size_t)width * height)) {
+                ApplyMaskAlpha(pixels, width, height, iconHandle);
+            }
+
+            id = IconPoolInternPixels(pixels, width, height, width);
+        }
+    }
+
+    // Cleanup original icon and bitmaps
+    DeleteObject(iconInfo.hbmColor);
+    DeleteObject(iconInfo.hbmMask);
+    DestroyIcon(iconHandle);
+
+    return id;
+}
+
+/**
+ * ShellImageListFor – shell system image list best suited to @size.
+ *
+ * Picks the smallest of SHIL_SMALL / SHIL_LARGE / SHIL_EXTRALARGE /
+ * SHIL_JUMBO whose icons are at least @size pixels, so icons are only ever
+ * scaled down.  The choice is cached until the size changes.
+ *
+ * @param size  Requested icon edge length in pixels.
+ * @return      Borrowed IImageList (owned by g_shellImageList), or NULL.
+ */
+static IImageList *ShellImageListFor(int size)
+{
+    if (g_shellImageList && g_shellImageListSize == size) {
+        return g_shellImageList;
+    }
+
+    SAFE_RELEASE(g_shellImageList);
+
+    static const int lists[] = { SHIL_SMALL, SHIL_LARGE, SHIL_EXTRALARGE, SHIL_JUMBO };
+    for (size_t i = 0; i < ARRAYSIZE(lists); ++i) {
+        IImageList *list = NULL;
+        if (FAILED(SHGetImageList(lists[i], &IID_IImageList, (void **)&list))) {
+            continue;
+        }
+
+        int cx = 0, cy = 0;
+        list->lpVtbl->GetIconSize(list, &cx, &cy);
+
+        // keep the largest list as a fallback in case none is big enough
+        SAFE_RELEASE(g_shellImageList);
+        g_shellImageList = list;
+        if (cx >= size) {
+            break;
+        }
+    }
+
+    g_shellImageListSize = size;
+    return g_shellImageList;
+}
+
+/**
+ * ShellIconIndex – system image list index of the icon for a file or directory.
+ *
+ * Works for both files and directories: SHGetFileInfoW resolves the index
+ * in either case, including custom folder icons set via desktop.ini and
+ * shortcut (.lnk) target icons.  Touches no resolver state, so the cache
+ * warm-up calls it from worker threads (each with COM initialised).
+ *
+ * @param filePath    Null-terminated wide string path to a file or directory.
+ * @param shellCalls  Counter to bump per SHGetFileInfoW call.
+ * @return            Image list index, or -1 on failure.
+ */
+static int ShellIconIndex(PCWSTR filePath, UINT *shellCalls)
+{
+    SHFILEINFOW info;
+    UINT flags;
+
+    // primary: the item itself (resolves .lnk targets, desktop.ini, etc.)
+    flags = SHGFI_SYSICONINDEX;
+    (*shellCalls)++;
+    if (!SHGetFileInfoW(filePath, FILE_ATTRIBUTE_NORMAL, &info, sizeof(info), flags)) {
+        // fallback: by type only (includes non-existent/virtual items)
+        flags = SHGFI_USEFILEATTRIBUTES | SHGFI_SYSICONINDEX;
+        (*shellCalls)++;
+        if (!SHGetFileInfoW(filePath, FILE_ATTRIBUTE_NORMAL, &info, sizeof(info), flags)) {
+            return -1;
+        }
+    }
+
+    return info.iIcon;
+}
+
+/**
+ * ShellIconFromIndex – icon at system image list index @index, taken from
+ *                      the image list closest to g_iconPixelSize and scaled.
+ *
+ * @param index  Index returned by ShellIconIndex.
+ * @return       IconId (one reference owned by the caller), or 0 on failure.
+ */
+static IconId ShellIconFromIndex(int index)
+{
+    IImageList *imageList = ShellImageListFor(g_iconPixelSize);
+    HICON icon = NULL;
+    if (index < 0 || !imageList ||
+        FAILED(imageList->lpVtbl->GetIcon(imageList, index, ILD_TRANSPARENT, &icon))) {
+        return 0;
+    }
+
+    return IconFromHicon(icon, g_iconPixelSize);
+}
+
+/**
+ * ShellIconForPath – retrieve the shell icon for a file or directory at
+ *                    the current icon size (g_iconPixelSize).
+ *
+ * @param filePath  Null-terminated wide string path to a file or directory.
+ * @return          IconId (one reference owned by the caller), or 0 on failure.
+ */
+static IconId ShellIconForPath(PCWSTR filePath)
+{
+    return ShellIconFromIndex(ShellIconIndex(filePath, &g_iconStats.shellCalls));
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Icon memoization                                                           */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * IconMemoEntry – one memoized icon.
+ *
+ * @member hash         IconMemoHash of @key, checked before the string compare.
+ * @member key          Heap-alloc'd key: an extension (".txt") or a link
+ *                      identity ("target|iconfile,index").
+ * @member icon         Pooled icon reference held by the memo; hits take
+ *                      another reference.  0 for extensions whose icon
+ *                      is per-file.
+ * @member perInstance  Extension memo only: icon depends on the file itself
+ *                      (.exe, .ico, "%1" DefaultIcon, IconHandler), so the
+ *                      extension must not be used as a key.
+ */
+typedef struct {
+    UINT    hash;
+    PWSTR   key;
+    IconId  icon;
+    bool    perInstance;
+} IconMemoEntry;
+
+/**
+ * IconMemo – grow-only table of memoized icons (few distinct keys per run).
+ *
+ * @member entries   Pointer to contiguous buffer (realloc'd).
+ * @member count     Elements currently stored.
+ * @member capacity  Allocated slots in @entries.
+ */
+typedef struct {
+    IconMemoEntry *entries;
+    UINT           count;
+    UINT           capacity;
+} IconMemo;
+
+/** Second level: icons shared by every file of a given type. */
+static IconMemo g_extensionMemo = { 0 };
+
+/** Third level: icons shared by shortcuts with the same target and icon location. */
+static IconMemo g_linkMemo = { 0 };
+
+/** Reusable ShellLink object used to read .lnk targets (created on first use). */
+static IShellLinkW  *g_shellLink     = NULL;
+static IPersistFile *g_shellLinkFile = NULL;
+
+/**
+ * IconMemoFind – look up @key in @memo.
+ *
+ * @param memo  Memo table to search.
+ * @param key   Key to find (case-insensitive).
+ * @return      Matching entry, or NULL if absent.
+ */
+static IconMemoEntry *IconMemoFind(IconMemo *memo, PCWSTR key)
+{
+    const UINT hash = IconMemoHash(key);
+    for (UINT i = 0; i < memo->count; ++i) {
+        IconMemoEntry *e = &memo->entries[i];
+        if (e->hash == hash && _wcsicmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * IconMemoAdd – append a new entry for @key (no duplicate check).
+ *
+ * @param memo  Memo table to modify.
+ * @param key   Key to copy into the table.
+ * @return      The new entry (icon 0, perInstance false), or NULL on OOM.
+ */
+static IconMemoEntry *IconMemoAdd(IconMemo *memo, PCWSTR key)
+{
+    if (memo->count >= memo->capacity) {
+        UINT newCap = memo->capacity ? memo->capacity * 2 : 32;
+        IconMemoEntry *tmp = realloc(memo->entries, newCap * sizeof *tmp);
+        if (!tmp) {
+            return NULL;
+        }
+        memo->entries  = tmp;
+        memo->capacity = newCap;
+    }
+
+    PWSTR dupKey = _wcsdup(key);
+    if (!dupKey) {
+        return NULL;
+    }
+
+    IconMemoEntry *e = &memo->entries[memo->count++];
+    e->hash        = IconMemoHash(key);
+    e->key         = dupKey;
+    e->icon        = 0;
+    e->perInstance = false;
+
+    return e;
+}
+
+/**
+ * IconMemoDestroy – free all keys and release the icons held by @memo.
+ *
+ * @param memo  Memo table to wipe.
+ */
+static void IconMemoDestroy(IconMemo *memo)
+{
+    for (UINT i = 0; i < memo->count; ++i) {
+        free(memo->entries[i].key);
+        IconPoolRelease(memo->entries[i].icon);
+    }
+    free(memo->entries);
+    ZeroMemory(memo, sizeof *memo);
+}
+
+/**
+ * IsPerInstanceIconType – decide whether files of type @ext carry their own
+ *                         icon, so the extension cannot be used as a key.
+ *
+ * Well-known per-file types are listed explicitly; anything else is looked
+ * up in the registry: a DefaultIcon of "%1" or a registered IconHandler
+ * shell extension means the icon is computed per file.
+ *
+ * @param ext  Extension including the leading dot.
+ * @return     TRUE if the icon depends on the file, not just its type.
+ */
+static BOOL IsPerInstanceIconType(PCWSTR ext)
+{
+    static const PCWSTR perInstance[] = {
+        L".exe", L".lnk", L".ico", L".cur", L".ani", L".url",
+        L".scf", L".pif", L".msc", L".dll", L".cpl", L".website",
+        L".appref-ms", L".library-ms"
+    };
+
+    for (size_t i = 0; i < ARRAYSIZE(perInstance); ++i) {
+        if (_wcsicmp(ext, perInstance[i]) == 0) {
+            return TRUE;
+        }
+    }
+
+    WCHAR value[MAX_PATH];
+    DWORD cch = ARRAYSIZE(value);
+    if (SUCCEEDED(AssocQueryStringW(ASSOCF_NONE, ASSOCSTR_DEFAULTICON, ext, NULL, value, &cch)) &&
+        wcsstr(value, L"%1")) {
+        return TRUE;
+    }
+
+    // IExtractIconW handler => icon is computed per file
+    cch = ARRAYSIZE(value);
+    return SUCCEEDED(AssocQueryStringW(ASSOCF_NONE, ASSOCSTR_SHELLEXTENSION, ext,
+                                       L"{000214FA-0000-0000-C000-000000000046}",
+                                       value, &cch));
+}
+
+/**
+ * LinkIconKey – build the third-level memo key of a shortcut from its
+ *               target path and icon location.
+ *
+ * @param linkPath  Path of the .lnk file.
+ * @param key       Output buffer.
+ * @param cch       Size of @key in WCHARs.
+ * @return          TRUE if a key was built; FALSE if the link could not be
+ *                  read or has neither a file-system target nor an icon
+ *                  location (e.g. shell namespace targets).
+ */
+static BOOL LinkIconKey(PCWSTR linkPath, PWSTR key, size_t cch)
+{
+    if (!g_shellLink) {
+        HRESULT hr = CoCreateInstance(&CLSID_ShellLink, NULL, CLSCTX_INPROC_SERVER,
+                                      &IID_IShellLinkW, (void**)&g_shellLink);
+        if (FAILED(hr)) {
+            return FALSE;
+        }
+
+        hr = g_shellLink->lpVtbl->QueryInterface(g_shellLink, &IID_IPersistFile,
+                                                  (void**)&g_shellLinkFile);
+        if (FAILED(hr)) {
+            SAFE_RELEASE(g_shellLink);
+            return FALSE;
+        }
+    }
+
+    if (FAILED(g_shellLinkFile->lpVtbl->Load(g_shellLinkFile, linkPath, STGM_READ))) {
+        return FALSE;
+    }
+
+    WCHAR target[MAX_PATH]   = L"";
+    WCHAR iconFile[MAX_PATH] = L"";
+    int   iconIndex          = 0;
+
+    g_shellLink->lpVtbl->GetPath(g_shellLink, target, ARRAYSIZE(target), NULL, SLGP_RAWPATH);
+    g_shellLink->lpVtbl->GetIconLocation(g_shellLink, iconFile, ARRAYSIZE(iconFile), &iconIndex);
+
+    if (!target[0] && !iconFile[0]) {
+        return FALSE;
+    }
+
+    return SUCCEEDED(StringCchPrintfW(key, cch, L"%s|%s,%d", target, iconFile, iconIndex));
+}
+
+/**
+ * MemoizedIcon – serve @filePath from @memo under @key, or resolve it via
+ *                the shell and remember the result.
+ *
+ * @param memo      Memo level to use.
+ * @param entry     Existing entry for @key, or NULL to create one.
+ * @param key       Memo key.
+ * @param filePath  File to resolve on a miss.
+ * @param hits      Hit counter to bump.
+ * @param misses    Miss counter to bump.
+ * @return          IconId (one reference owned by the caller), or 0.
+ */
+static IconId MemoizedIcon(
+    IconMemo        *memo,
+    IconMemoEntry   *entry,
+    PCWSTR          key,
+    PCWSTR          filePath,
+    UINT            *hits,
+    UINT            *misses
+) {
+    if (entry && entry->icon) {
+        (*hits)++;
+        return IconPoolAddRef(entry->icon);
+    }
+
+    (*misses)++;
+    IconId icon = ShellIconForPath(filePath);
+    if (!icon) {
+        return 0;
+    }
+
+    if (!entry) {
+        entry = IconMemoAdd(memo, key);
+    }
+    if (entry) {
+        entry->icon = IconPoolAddRef(icon);
+    }
+
+    return icon;
+}
+
+/**
+ * ExtensionMemoEntry – extension memo entry for @ext, classifying the
+ *                      extension (IsPerInstanceIconType) on first sight.
+ *
+ * @param ext  Extension including the dot.
+ * @return     Memo entry, or NULL on OOM.
+ */
+static IconMemoEntry *ExtensionMemoEntry(PCWSTR ext)
+{
+    // classify each extension once; the decision itself is memoized
+    IconMemoEntry *entry = IconMemoFind(&g_extensionMemo, ext);
+    if (!entry) {
+        entry = IconMemoAdd(&g_extensionMemo, ext);
+        if (entry) {
+            entry->perInstance = IsPerInstanceIconType(ext) != FALSE;
+        }
+    }
+    return entry;
+}
+
+/**
+ * IconForItem – retrieve the small icon for a file or directory, sharing
+ *               work between files whose icon is known to be identical.
+ *
+ * Lookup order:
+ *   1. .lnk files: memo keyed by resolved target plus icon location.
+ *   2. Files whose icon depends only on the extension: per-extension memo.
+ *   3. Everything else (directories, .exe, ...): ShellIconForPath.
+ *
+ * @param filePath     Null-terminated wide string path to a file or directory.
+ * @param isDirectory  TRUE for directories (never memoized: desktop.ini).
+ * @return             IconId (one reference owned by the caller), or 0.
+ */
+static IconId IconForItem(PCWSTR filePath, BOOL isDirectory)
+{
+    PCWSTR ext = PathFindExtensionW(filePath);
+    if (isDirectory || !*ext) {
+        return ShellIconForPath(filePath);
+    }
+
+    if (_wcsicmp(ext, L".lnk") == 0) {
+        WCHAR key[2 * MAX_PATH + 16];
+        if (!LinkIconKey(filePath, key, ARRAYSIZE(key))) {
+            return ShellIconForPath(filePath);
+        }
+
+        return MemoizedIcon(&g_linkMemo, IconMemoFind(&g_linkMemo, key), key, filePath,
+                            &g_iconStats.linkHits, &g_iconStats.linkMisses);
+    }
+
+    IconMemoEntry *entry = ExtensionMemoEntry(ext);
+    if (!entry || entry->perInstance) {
+        return ShellIconForPath(filePath);
+    }
+
+    return MemoizedIcon(&g_extensionMemo, entry, ext, filePath,
+                        &g_iconStats.extHits, &g_iconStats.extMisses);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Icon size (per-monitor DPI)                                                */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * IconPixelSizeAt – menu icon size for the monitor containing @pt.
+ *
+ * The process is per-monitor DPI aware, so the small-icon metric (which is
+ * reported at the system DPI) is rescaled to the monitor's effective DPI.
+ * GetDpiForMonitor lives in shcore.dll (Windows 8.1+); older systems have
+ * a single DPI and keep the metric as is.
+ *
+ * @param pt  Screen point, normally where the menu opens.
+ * @return    Icon edge length in pixels.
+ */
+static int IconPixelSizeAt(POINT pt)
+{
+    const int systemSize = GetSystemMetrics(SM_CXSMICON);
+
+    HDC screen = GetDC(NULL);
+    const int systemDpi = screen ? GetDeviceCaps(screen, LOGPIXELSX) : USER_DEFAULT_SCREEN_DPI;
+    if (screen) {
+        ReleaseDC(NULL, screen);
+    }
+
+    HMODULE shcoreModule = LoadLibraryW(L"shcore.dll");
+    if (!shcoreModule) {
+        return systemSize;
+    }
+
+    typedef HRESULT (WINAPI *GetDpiForMonitor_t)(HMONITOR, int, UINT *, UINT *);
+    GetDpiForMonitor_t pGetDpiForMonitor =
+        (GetDpiForMonitor_t)GetProcAddress(shcoreModule, "GetDpiForMonitor");
+
+    int size = systemSize;
+    UINT dpiX, dpiY;
+    if (pGetDpiForMonitor && systemDpi > 0 &&
+        SUCCEEDED(pGetDpiForMonitor(MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST),
+                                    0 /* MDT_EFFECTIVE_DPI */, &dpiX, &dpiY))) {
+        size = MulDiv(systemSize, (int)dpiX, systemDpi);
+    }
+
+    FreeLibrary(shcoreModule);
+    return size;
+}
+
+/**
+ * SetIconPixelSize – select the edge length icons are resolved at.
+ *
+ * The memos hold icons of the previous size, so they are flushed when the
+ * size changes.  Persistent cache entries are keyed on (path, size) and
+ * need no flushing.
+ *
+ * @param size  Icon edge length in pixels.
+ */
+static void SetIconPixelSize(int size)
+{
+    if (size <= 0 || size > ATLAS_PAGE_DIM || size == g_iconPixelSize) {
+        return;
+    }
+
+    IconMemoDestroy(&g_extensionMemo);
+    IconMemoDestroy(&g_linkMemo);
+    g_iconPixelSize = size;
+
+    TraceF(L"icons: %d px", size);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Persistent icon cache                                                      */
+/* -------------------------------------------------------------------------- */
+
+/** Whether persistent icon caching is enabled (set via /C flag). */
+static bool g_useCacheFlag = false;
+
+/** Shared cache file given with /cache, or NULL for "sendto.cache" next to the executable. */
+static PCWSTR g_cacheFileOverride = NULL;
+
+/** TRUE when the shared file itself is the writable layer: /warm builds it,
+ *  /cachestat with /cache inspects it. */
+static bool g_cacheWriteShared = false;
+
+/**
+ * GetFileLastWriteTime – retrieve the last-write FILETIME for a path.
+ *
+ * Only used when no enumeration timestamp is at hand; counted in
+ * g_iconStats.statCalls.
+ *
+ * @param path       Null-terminated wide string path.
+ * @param outTime    Receives the FILETIME on success.
+ * @return           TRUE on success, FALSE on failure.
+ */
+static BOOL GetFileLastWriteTime(PCWSTR path, FILETIME *outTime)
+{
+    g_iconStats.statCalls++;
+
+    WIN32_FILE_ATTRIBUTE_DATA attrs;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attrs)) {
+        return FALSE;
+    }
+    *outTime = attrs.ftLastWriteTime;
+    return TRUE;
+}
+
+/**
+ * QueryFileIdentity – retrieve the volume serial and file index of a path.
+ *
+ * Costs a handle open.  Directories are opened with
+ * FILE_FLAG_BACKUP_SEMANTICS, which needs no backup privilege for
+ * FILE_READ_ATTRIBUTES access; reparse points are followed, so a junction
+ * reports the identity of its target.
+ *
+ * @param path       Null-terminated wide string path.
+ * @param outVolume  Receives the volume serial number.
+ * @param outFileId  Receives the 64-bit file index.
+ * @return           TRUE if the file system reported a non-zero identity.
+ */
+static BOOL QueryFileIdentity(PCWSTR path, DWORD *outVolume, UINT64 *outFileId)
+{
+    HANDLE hFile = CreateFileW(
+        path, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL
+    );
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info;
+    const BOOL ok = GetFileInformationByHandle(hFile, &info);
+    CloseHandle(hFile);
+    if (!ok) {
+        return FALSE;
+    }
+
+    *outVolume = info.dwVolumeSerialNumber;
+    *outFileId = ((UINT64)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    return *outFileId != 0;
+}
+
+/**
+ * GetFileIdentity – QueryFileIdentity for the icon cache.
+ *
+ * Only used after a cache miss by path; counted in g_iconStats.statCalls.
+ */
+static BOOL GetFileIdentity(PCWSTR path, DWORD *outVolume, UINT64 *outFileId)
+{
+    g_iconStats.statCalls++;
+    return QueryFileIdentity(path, outVolume, outFileId);
+}
+
+/**
+ * ResolveSharedCacheFilePath – build the path of the read-only shared cache
+ *                              layer: "sendto.cache" next to the executable,
+ *                              or the absolute form of the /cache path.
+ *
+ * @param outPath  Buffer of at least MAX_PATH WCHARs to receive the result.
+ * @return         TRUE on success, FALSE on failure.
+ */
+static BOOL ResolveSharedCacheFilePath(WCHAR outPath[MAX_PATH])
+{
+    if (g_cacheFileOverride) {
+        const DWORD len = GetFullPathNameW(g_cacheFileOverride, MAX_PATH, outPath, NULL);
+        return len > 0 && len < MAX_PATH;
+    }
+
+    if (!GetModuleFileNameW(NULL, outPath, MAX_PATH)) {
+        return FALSE;
+    }
+    PathRemoveFileSpecW(outPath);
+    return PathAppendW(outPath, L"sendto.cache");
+}
+
+/**
+ * ResolveLocalDataPath – build "%LOCALAPPDATA%\SendTo+\<fileName>",
+ *                        creating the directory if needed.
+ *
+ * @param fileName  File name within the per-user data directory.
+ * @param outPath   Buffer of at least MAX_PATH WCHARs to receive the result.
+ * @return          TRUE on success, FALSE on failure.
+ */
+static BOOL ResolveLocalDataPath(PCWSTR fileName, WCHAR outPath[MAX_PATH])
+{
+    PWSTR localAppData = NULL;
+    if (FAILED(SHGetKnownFolderPath(&FOLDERID_LocalAppData, 0, NULL, &localAppData))) {
+        return FALSE;
+    }
+
+    const BOOL ok = PathCombineW(outPath, localAppData, L"SendTo+") != NULL;
+    CoTaskMemFree(localAppData);
+    if (!ok) {
+        return FALSE;
+    }
+
+    if (!CreateDirectoryW(outPath, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        return FALSE;
+    }
+    return PathAppendW(outPath, fileName);
+}
+
+/**
+ * ResolveCacheFilePath – build the path of the writable cache layer,
+ *                        "%LOCALAPPDATA%\SendTo+\sendto.cache".
+ *
+ * Keeps per-user writes on fast local storage even when the executable
+ * lives in Program Files or on a network share.  Under /warm (and
+ * /cachestat with /cache) the shared file itself is the one written.
+ *
+ * @param outPath  Buffer of at least MAX_PATH WCHARs to receive the result.
+ * @return         TRUE on success, FALSE on failure.
+ */
+static BOOL ResolveCacheFilePath(WCHAR outPath[MAX_PATH])
+{
+    if (g_cacheWriteShared) {
+        return ResolveSharedCacheFilePath(outPath);
+    }
+    return ResolveLocalDataPath(L"sendto.cache", outPath);
+}
+
+/**
+ * IconCacheRememberFile – record which file @fileEnd refers to.
+ *
+ * Another instance may compact (replace) the journal at any time; the
+ * volume serial and file index tell a later save whether its offsets still
+ * apply.
+ */
+static void IconCacheRememberFile(const BY_HANDLE_FILE_INFORMATION *info)
+{
+    g_iconCache.fileVolume = info->dwVolumeSerialNumber;
+    g_iconCache.fileIndex  = ((UINT64)info->nFileIndexHigh << 32) | info->nFileIndexLow;
+}
+
+/**
+ * IconCacheIsRememberedFile – TRUE if @info describes the file IconCacheRememberFile saw.
+ */
+static BOOL IconCacheIsRememberedFile(const BY_HANDLE_FILE_INFORMATION *info)
+{
+    return info->dwVolumeSerialNumber == g_iconCache.fileVolume &&
+           (((UINT64)info->nFileIndexHigh << 32) | info->nFileIndexLow) == g_iconCache.fileIndex;
+}
+
+/**
+ * IconCacheLoad – read the cache journal from disk into g_iconCache.
+ *
+ * The file is a header (magic, version) followed by size-prefixed records,
+ * replayed in order.  Reading takes no lock: the file is opened with full
+ * sharing and mapped read-only, and a record another instance is appending
+ * at that moment simply looks like a torn tail.  @fileEnd marks the end of
+ * the last good record.  A missing file, foreign header or wrong
+ * CACHE_VERSION leaves @fileEnd at 0, so the next save rewrites the file;
+ * a CACHE_PREVIOUS_VERSION journal is replayed first, so that rewrite
+ * converts its entries.  Anything older is dropped and its icons resolved
+ * again.
+ */
+static void IconCacheLoad(void)
+{
+    WCHAR cacheFile[MAX_PATH];
+    if (!ResolveCacheFilePath(cacheFile)) {
+        return;
+    }
+
+    HANDLE hFile = CreateFileW(
+        cacheFile, GENERIC_READ, CACHE_SHARE_MODE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    HANDLE mapping = NULL;
+    const BYTE *view = NULL;
+    UINT64 blobBytes = 0, rawBytes = 0;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    LARGE_INTEGER fileSize;
+    if (!GetFileInformationByHandle(hFile, &info) || !GetFileSizeEx(hFile, &fileSize) ||
+        fileSize.QuadPart < CACHE_HEADER_SIZE || fileSize.QuadPart > CACHE_MAX_FILE_SIZE) {
+        goto done;
+    }
+
+    // map a snapshot of the journal; appends by other instances land past it
+    const DWORD size = (DWORD)fileSize.QuadPart;
+    mapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, size, NULL);
+    if (!mapping) {
+        goto done;
+    }
+
+    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    if (!view) {
+        goto done;
+    }
+
+    if (IconCacheHeaderValid(view, size)) {
+        g_iconCache.fileEnd = IconCacheReplayRecords(view, size, CACHE_HEADER_SIZE);
+        IconCacheRememberFile(&info);
+    } else if (IconCacheConvertPrevious(view, size)) {
+        TraceF(L"cache: v%u journal, %u records to convert on save", CACHE_PREVIOUS_VERSION, g_iconCache.fileRecords);
+    } else {
+        goto done;
+    }
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        const IconCacheEntry *e = &g_iconCache.entries[i];
+        blobBytes += e->blobSize;
+        rawBytes  += (UINT64)e->width * e->height * 4;
+    }
+
+done:
+    // records were copied out, so the view is not kept (it would block compaction)
+    if (view) {
+        UnmapViewOfFile(view);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(hFile);
+
+    if (g_iconCache.count) {
+        TraceF(L"cache: loaded %u icons from %u records, %I64u bytes of pixels (%.0f%% of unpacked)",
+               g_iconCache.count, g_iconCache.fileRecords, blobBytes,
+               rawBytes ? 100.0 * (double)blobBytes / (double)rawBytes : 0.0);
+    }
+}
+
+/**
+ * WriteAll – WriteFile that reports short writes as failure.
+ */
+static BOOL WriteAll(HANDLE hFile, const void *data, DWORD size)
+{
+    DWORD written = 0;
+    return WriteFile(hFile, data, size, &written, NULL) && written == size;
+}
+
+/**
+ * IconCacheWriteRecord – append one entry to @hFile as a journal record.
+ *
+ * The record is assembled in memory (IconCacheEncodeRecord) and issued as
+ * a single WriteFile so a crash leaves at most one torn record at the tail.
+ *
+ * @param hFile    Cache file positioned at the append point.
+ * @param e        Entry to write (must have a blob).
+ * @param outSize  Receives the number of bytes written.
+ * @return         TRUE if the whole record was written.
+ */
+static BOOL IconCacheWriteRecord(HANDLE hFile, const IconCacheEntry *e, DWORD *outSize)
+{
+    BYTE *record = IconCacheEncodeRecord(e, outSize);
+    if (!record) {
+        return FALSE;
+    }
+
+    const BOOL ok = WriteAll(hFile, record, *outSize);
+    free(record);
+    return ok;
+}
+
+/**
+ * IconCacheLock – take the cross-process writer lock of @cacheFile.
+ *
+ * The lock is an exclusive LockFileEx on "<cache>.lock", a companion file
+ * that stays empty and is never replaced.  Keeping it apart from the
+ * journal matters: Windows refuses to rename a compacted file over one
+ * that is still open, so the journal itself must be closed before
+ * IconCacheCompact swaps it, while the lock stays held.  Readers never
+ * look at the lock file.
+ *
+ * @param cacheFile  Path of the cache file.
+ * @return           Locked handle (release with IconCacheUnlock), or
+ *                   INVALID_HANDLE_VALUE on failure.
+ */
+static HANDLE IconCacheLock(PCWSTR cacheFile)
+{
+    WCHAR lockFile[MAX_PATH];
+    if (FAILED(StringCchPrintfW(lockFile, ARRAYSIZE(lockFile), L"%s.lock", cacheFile))) {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    HANDLE hLock = CreateFileW(
+        lockFile, GENERIC_READ | GENERIC_WRITE, CACHE_SHARE_MODE, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (hLock == INVALID_HANDLE_VALUE) {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    OVERLAPPED lockRange = { 0 };
+    if (!LockFileEx(hLock, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &lockRange)) {
+        CloseHandle(hLock);
+        return INVALID_HANDLE_VALUE;
+    }
+    return hLock;
+}
+
+/**
+ * IconCacheUnlock – release the writer lock and close the lock file.
+ */
+static void IconCacheUnlock(HANDLE hLock)
+{
+    OVERLAPPED lockRange = { 0 };
+    UnlockFileEx(hLock, 0, 1, 0, &lockRange);
+    CloseHandle(hLock);
+}
+
+/**
+ * IconCacheOpenJournal – open the existing journal for merging and appending.
+ *
+ * Called with the writer lock held, so no other writer can replace the file
+ * while the handle is open.
+ *
+ * @param cacheFile  Path of the cache file.
+ * @param outInfo    Receives the identity of the opened file.
+ * @return           Handle, or INVALID_HANDLE_VALUE if the file is missing
+ *                   or cannot be opened (the save then compacts).
+ */
+static HANDLE IconCacheOpenJournal(PCWSTR cacheFile, BY_HANDLE_FILE_INFORMATION *outInfo)
+{
+    HANDLE hFile = CreateFileW(
+        cacheFile, GENERIC_READ | GENERIC_WRITE, CACHE_SHARE_MODE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (hFile != INVALID_HANDLE_VALUE && !GetFileInformationByHandle(hFile, outInfo)) {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+    return hFile;
+}
+
+/**
+ * IconCacheMergeTail – under the writer lock, pick up records that other
+ *                      instances appended since this one loaded the journal.
+ *
+ * If the file is still the one IconCacheLoad saw, only the bytes past
+ * @fileEnd are read; if it was replaced or truncated in the meantime, it is
+ * re-read from its header.  Either way @fileEnd ends up just past the last
+ * good record of the locked file, which is where this instance appends.
+ *
+ * @param hFile  Locked cache file.
+ * @param info   Identity of @hFile.
+ * @return       TRUE if the file holds a valid journal to append to.
+ */
+static BOOL IconCacheMergeTail(HANDLE hFile, const BY_HANDLE_FILE_INFORMATION *info)
+{
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart > CACHE_MAX_FILE_SIZE) {
+        return FALSE;
+    }
+
+    const DWORD size  = (DWORD)fileSize.QuadPart;
+    const DWORD start = IconCacheMergeOffset(size, IconCacheIsRememberedFile(info));
+
+    BOOL ok = FALSE;
+    const UINT before = g_iconCache.fileRecords;
+    BYTE *data = malloc(size - start + 1);
+    if (!data) {
+        return FALSE;
+    }
+
+    LARGE_INTEGER from;
+    from.QuadPart = start;
+    DWORD bytesRead = 0;
+    if (!SetFilePointerEx(hFile, from, NULL, FILE_BEGIN) ||
+        !ReadFile(hFile, data, size - start, &bytesRead, NULL) || bytesRead != size - start ||
+        !IconCacheMergeRecords(data, size, start)) {
+        goto done;
+    }
+    IconCacheRememberFile(info);
+
+    if (start && g_iconCache.fileRecords > before) {
+        TraceF(L"cache: merged %u records appended by other instances", g_iconCache.fileRecords - before);
+    }
+    ok = TRUE;
+
+done:
+    free(data);
+    return ok;
+}
+
+/**
+ * IconCacheAppend – write only the dirty entries to the end of the journal.
+ *
+ * Appends start at @fileEnd, overwriting any torn tail left by a crashed
+ * writer; the file is then cut there if no other instance has it mapped.
+ * Existing records are never rewritten, so a crash here can at worst lose
+ * the records being appended.
+ *
+ * @param hFile  Cache file holding the writer lock.
+ * @return       TRUE if every dirty entry was appended.
+ */
+static BOOL IconCacheAppend(HANDLE hFile)
+{
+    LARGE_INTEGER end;
+    end.QuadPart = g_iconCache.fileEnd;
+    if (!SetFilePointerEx(hFile, end, NULL, FILE_BEGIN)) {
+        return FALSE;
+    }
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        IconCacheEntry *e = &g_iconCache.entries[i];
+        if (!e->dirty || !e->blob) continue;
+
+        DWORD recordSize;
+        if (!IconCacheWriteRecord(hFile, e, &recordSize)) return FALSE;
+
+        e->dirty = false;
+        g_iconCache.fileEnd += recordSize;
+        g_iconCache.fileRecords++;
+    }
+
+    // drop leftovers of a longer torn tail; harmless if a reader's view prevents it
+    SetEndOfFile(hFile);
+    return TRUE;
+}
+
+/**
+ * IconCacheCompact – rewrite the journal with one record per live entry.
+ *
+ * The new journal is written to "<cache>.tmp", flushed, and swapped in with
+ * MoveFileExW, so readers and crashes only ever see the complete old file
+ * or the complete new one.  Called with the writer lock held and the
+ * journal closed; the swap still fails while another instance has the
+ * old file open (a reader mid-load, or the shared layer mapping it).
+ *
+ * @param cacheFile  Path of the cache file.
+ * @return           TRUE if the compacted file replaced the old one.
+ */
+static BOOL IconCacheCompact(PCWSTR cacheFile)
+{
+    WCHAR tempFile[MAX_PATH];
+    if (FAILED(StringCchPrintfW(tempFile, ARRAYSIZE(tempFile), L"%s.tmp", cacheFile))) {
+        return FALSE;
+    }
+
+    HANDLE hFile = CreateFileW(
+        tempFile, GENERIC_WRITE, 0, NULL,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    UINT64 fileEnd = CACHE_HEADER_SIZE;
+    UINT records = 0;
+
+    // write header
+    DWORD header[CACHE_HEADER_SIZE / sizeof(DWORD)];
+    IconCacheHeader(header);
+    if (!WriteAll(hFile, header, sizeof header)) goto fail;
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        const IconCacheEntry *e = &g_iconCache.entries[i];
+        if (!e->blob) continue;
+
+        DWORD recordSize;
+        if (!IconCacheWriteRecord(hFile, e, &recordSize)) goto fail;
+
+        fileEnd += recordSize;
+        records++;
+    }
+
+    // the data must be durable before the rename makes it the cache
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!FlushFileBuffers(hFile) || !GetFileInformationByHandle(hFile, &info)) goto fail;
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+
+    if (!MoveFileExW(tempFile, cacheFile, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) goto fail;
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        g_iconCache.entries[i].dirty = false;
+    }
+    g_iconCache.fileEnd     = fileEnd;
+    g_iconCache.fileRecords = records;
+    g_iconCache.compact    = false;
+    IconCacheRememberFile(&info);
+
+    return TRUE;
+
+fail:
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+    }
+    DeleteFileW(tempFile);
+    return FALSE;
+}
+
+/**
+ * IconCacheSweep – background existence check of the cached paths.
+ *
+ * The sweep works on a private, heap-allocated copy of the paths loaded
+ * from disk (entry indices stay stable until IconCacheSave, which is the
+ * only place that removes entries) and reports its findings in @missing.
+ *
+ * @member thread   Sweep thread.
+ * @member paths    Heap copies of the loaded entry paths.
+ * @member missing  Per path: 1 if the file is known to be gone.
+ * @member count    Number of @paths.
+ * @member cancel   Set to stop a sweep that is still running at teardown.
+ */
+typedef struct {
+    HANDLE        thread;
+    PWSTR         *paths;
+    BYTE          *missing;
+    UINT          count;
+    volatile LONG cancel;
+} IconCacheSweep;
+
+/** Running or finished sweep (NULL if none). */
+static IconCacheSweep *g_cacheSweep = NULL;
+
+/**
+ * IconCacheNow – current time as a UINT64 FILETIME, for @lastHit stamps.
+ */
+static UINT64 IconCacheNow(void)
+{
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    return ((UINT64)now.dwHighDateTime << 32) | now.dwLowDateTime;
+}
+
+/**
+ * IconCacheSweepProc – thread body: flag paths that no longer exist.
+ *
+ * Runs in background mode (low CPU and I/O priority).  Only "not found"
+ * errors count as missing, so an unreachable network share does not wipe
+ * its entries.
+ */
+static DWORD WINAPI IconCacheSweepProc(LPVOID param)
+{
+    IconCacheSweep *sweep = param;
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    for (UINT i = 0; i < sweep->count && !sweep->cancel; ++i) {
+        if (GetFileAttributesW(sweep->paths[i]) == INVALID_FILE_ATTRIBUTES) {
+            const DWORD error = GetLastError();
+            sweep->missing[i] = error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * IconCacheSweepFree – release a sweep that is not (or no longer) running.
+ */
+static void IconCacheSweepFree(IconCacheSweep *sweep)
+{
+    if (!sweep) {
+        return;
+    }
+
+    for (UINT i = 0; i < sweep->count; ++i) {
+        free(sweep->paths[i]);
+    }
+    free(sweep->paths);
+    free(sweep->missing);
+    free(sweep);
+}
+
+/**
+ * IconCacheStartSweep – start checking the loaded entries for deleted or
+ *                       renamed targets while the menu is in use.
+ */
+static void IconCacheStartSweep(void)
+{
+    const UINT count = g_iconCache.count;
+    if (count == 0) {
+        return;
+    }
+
+    IconCacheSweep *sweep = calloc(1, sizeof *sweep);
+    if (!sweep) {
+        return;
+    }
+
+    sweep->paths   = calloc(count, sizeof *sweep->paths);
+    sweep->missing = calloc(count, sizeof *sweep->missing);
+    if (!sweep->paths || !sweep->missing) {
+        goto fail;
+    }
+
+    for (UINT i = 0; i < count; ++i) {
+        sweep->paths[i] = _wcsdup(g_iconCache.entries[i].path);
+        if (!sweep->paths[i]) {
+            goto fail;
+        }
+        sweep->count++;
+    }
+
+    sweep->thread = CreateThread(NULL, 0, IconCacheSweepProc, sweep, 0, NULL);
+    if (!sweep->thread) {
+        goto fail;
+    }
+
+    g_cacheSweep = sweep;
+    return;
+
+fail:
+    IconCacheSweepFree(sweep);
+}
+
+/**
+ * IconCacheFinishSweep – collect the sweep result, waiting at most @waitMs.
+ *
+ * A sweep that has not finished by then is cancelled and abandoned: its
+ * memory is deliberately leaked (the thread may still read it) and no
+ * entries are pruned this run.
+ *
+ * @param waitMs  Longest time to wait for the sweep thread.
+ * @return        TRUE if the sweep completed and found missing paths.
+ */
+static BOOL IconCacheFinishSweep(DWORD waitMs)
+{
+    IconCacheSweep *sweep = g_cacheSweep;
+    if (!sweep || !sweep->thread) {
+        return FALSE;
+    }
+
+    if (WaitForSingleObject(sweep->thread, waitMs) != WAIT_OBJECT_0) {
+        InterlockedExchange(&sweep->cancel, 1);
+        CloseHandle(sweep->thread);
+        g_cacheSweep = NULL;
+        return FALSE;
+    }
+
+    CloseHandle(sweep->thread);
+    sweep->thread = NULL;
+
+    for (UINT i = 0; i < sweep->count; ++i) {
+        if (sweep->missing[i]) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * IconCacheSave – persist dirty entries to disk.
+ *
+ * Runs under the cross-process writer lock, so simultaneous instances
+ * serialise their saves instead of overwriting each other.  Records other
+ * instances appended since load are merged first; then only the changed
+ * entries are appended, so a save costs O(changes).  The journal is
+ * compacted instead when it has no valid header yet, when superseded
+ * records would outnumber live ones (and exceed CACHE_COMPACT_SLACK), or
+ * when entries were dropped – for paths the background sweep found gone,
+ * or by LRU eviction to stay within the cache budget.
+ */
+static void IconCacheSave(void)
+{
+    const BOOL swept = IconCacheFinishSweep(CACHE_SWEEP_WAIT_MS);
+
+    if (!g_iconCache.dirty && !swept && !g_iconCache.compact && g_iconCache.count <= CACHE_MAX_ENTRIES) {
+        return;
+    }
+
+    WCHAR cacheFile[MAX_PATH];
+    if (!ResolveCacheFilePath(cacheFile)) {
+        return;
+    }
+
+    HANDLE hLock = IconCacheLock(cacheFile);
+    if (hLock == INVALID_HANDLE_VALUE) {
+        OutputDebugStringW(L"[SendTo+] Failed to lock the icon cache\n");
+        return;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info;
+    HANDLE hFile = IconCacheOpenJournal(cacheFile, &info);
+    const BOOL journalOk = hFile != INVALID_HANDLE_VALUE && IconCacheMergeTail(hFile, &info);
+
+    const UINT pruned  = swept ? IconCachePruneMissing((const PCWSTR *)g_cacheSweep->paths, g_cacheSweep->missing,
+                                                        g_cacheSweep->count) : 0;
+    const UINT evicted = IconCacheEvictLru(CACHE_MAX_ENTRIES, CACHE_MAX_BLOB_BYTES);
+    if (pruned || evicted) {
+        IconCacheRemoveDropped();
+        TraceF(L"cache: pruned %u missing, evicted %u least recently hit", pruned, evicted);
+    }
+
+    UINT pending = 0;
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        if (g_iconCache.entries[i].dirty && g_iconCache.entries[i].blob) {
+            pending++;
+        }
+    }
+
+    // records that will be dead once @pending more are appended
+    const UINT total = g_iconCache.fileRecords + pending;
+    const UINT dead  = total > g_iconCache.count ? total - g_iconCache.count : 0;
+
+    BOOL saved = FALSE;
+    if (!journalOk || pruned || evicted || g_iconCache.compact ||
+        (dead > CACHE_COMPACT_SLACK && dead > g_iconCache.count)) {
+        // the journal must not be open while the compacted file replaces it
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+        }
+        saved = IconCacheCompact(cacheFile);
+        if (!saved) {
+            TraceF(L"cache: compaction failed (error %lu)%s", GetLastError(),
+                   journalOk ? L", appending instead" : L"");
+        }
+    }
+    if (!saved && journalOk) {
+        // still the merged file: the lock kept other writers out
+        if (hFile == INVALID_HANDLE_VALUE) {
+            hFile = IconCacheOpenJournal(cacheFile, &info);
+        }
+        saved = hFile != INVALID_HANDLE_VALUE && IconCacheAppend(hFile);
+    }
+
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+    }
+    IconCacheUnlock(hLock);
+
+    if (saved) {
+        g_iconCache.dirty = false;
+    } else {
+        OutputDebugStringW(L"[SendTo+] Failed to save the icon cache\n");
+    }
+}
+
+/**
+ * IconCacheDestroy – free all heap memory held by g_iconCache.
+ */
+static void IconCacheDestroy(void)
+{
+    IconCacheFree();
+
+    // a sweep still running was abandoned by IconCacheFinishSweep
+    if (g_cacheSweep && !g_cacheSweep->thread) {
+        IconCacheSweepFree(g_cacheSweep);
+    }
+    g_cacheSweep = NULL;
+}
+
+/**
+ * IconCacheDecodePixels – unpack a cached blob into the scratch buffer and
+ *                         restore premultiplied alpha.
+ *
+ * @param blob      Pixel blob (need not be aligned).
+ * @param blobSize  Size of @blob; width*height*4 means unpacked.
+ * @param width     Bitmap width in pixels.
+ * @param height    Bitmap height in pixels.
+ * @return          Scratch pixels (tightly packed), or NULL on OOM or a
+ *                  corrupt blob.
+ */
+static UINT32 *IconCacheDecodePixels(const BYTE *blob, DWORD blobSize, int width, int height)
+{
+    UINT32 *pixels = IconScratchPixels(width, height);
+    if (!pixels) {
+        return NULL;
+    }
+
+    const size_t count = (size_t)width * height;
+    if (blobSize == count * 4) {
+        memcpy(pixels, blob, blobSize);
+    } else if (!BlobDecode(blob, blobSize, pixels, count)) {
+        return NULL;
+    }
+
+    PremultiplyRow(pixels, count);
+    return pixels;
+}
+
+/**
+ * IconCacheShared – read-only shared cache layer (e.g. a pre-warmed
+ *                   machine-wide file), mapped for the whole run.
+ *
+ * Nothing is copied out of the mapping: the index holds only the offsets
+ * of the live records, so opening even a large shared cache costs one
+ * pass over its record headers and a few bytes per entry.  It is never
+ * written, swept or evicted.
+ *
+ * @member file       Shared cache file (opened for reading).
+ * @member mapping    Read-only file mapping of @file.
+ * @member view       Mapped journal bytes.
+ * @member size       Size of @view in bytes.
+ * @member records    Per live record: offset of its size prefix in @view.
+ * @member hashes     Per live record: IconCacheKeyHash of (path, width).
+ * @member count      Number of live records.
+ * @member index      Open-addressing table of record positions + 1.
+ * @member indexMask  Size of @index minus one, 0 if the layer is absent.
+ */
+typedef struct {
+    HANDLE      file;
+    HANDLE      mapping;
+    const BYTE  *view;
+    DWORD       size;
+    DWORD       *records;
+    UINT        *hashes;
+    UINT        count;
+    UINT        *index;
+    UINT        indexMask;
+} IconCacheShared;
+
+/** The shared layer, consulted before g_iconCache. */
+static IconCacheShared g_sharedCache = { 0 };
+
+/**
+ * IconCacheSharedRecord – parse the shared record at @offset.
+ *
+ * @param offset   Offset of the record's size prefix in the view.
+ * @param out      Receives the scalar fields.
+ * @param path     Receives a copy of the (possibly unaligned) path.
+ * @param outBlob  Receives a pointer to the blob inside the view.
+ * @param outEnd   Receives the offset just past the record (may be NULL).
+ * @return         TRUE if a well-formed record starts at @offset.
+ */
+static BOOL IconCacheSharedRecord(
+    DWORD           offset,
+    IconCacheEntry  *out,
+    WCHAR           path[MAX_PATH],
+    const BYTE      **outBlob,
+    DWORD           *outEnd
+) {
+    const DWORD size = g_sharedCache.size;
+    DWORD recordSize;
+    if (size - offset < sizeof recordSize) return FALSE;
+    memcpy(&recordSize, g_sharedCache.view + offset, sizeof recordSize);
+    if (recordSize > size - offset - sizeof recordSize) return FALSE;
+
+    const BYTE *pathBytes;
+    DWORD pathLen;
+    if (!IconCacheParseFields(g_sharedCache.view + offset + sizeof recordSize, recordSize,
+                              out, &pathBytes, &pathLen, outBlob)) {
+        return FALSE;
+    }
+
+    memcpy(path, pathBytes, pathLen * sizeof(WCHAR));
+    if (outEnd) {
+        *outEnd = offset + sizeof recordSize + recordSize;
+    }
+    return TRUE;
+}
+
+/**
+ * IconCacheSharedFind – position of the live shared record for (@path, @size).
+ *
+ * @return  Index into g_sharedCache.records, or (UINT)-1 if absent.
+ */
+static UINT IconCacheSharedFind(PCWSTR path, int size)
+{
+    if (!g_sharedCache.indexMask) {
+        return (UINT)-1;
+    }
+
+    const UINT hash = IconCacheKeyHash(path, size);
+    for (UINT slot = hash & g_sharedCache.indexMask; g_sharedCache.index[slot];
+         slot = (slot + 1) & g_sharedCache.indexMask) {
+        const UINT i = g_sharedCache.index[slot] - 1;
+        if (g_sharedCache.hashes[i] != hash) continue;
+
+        IconCacheEntry fields;
+        WCHAR recordPath[MAX_PATH];
+        const BYTE *blob;
+        if (IconCacheSharedRecord(g_sharedCache.records[i], &fields, recordPath, &blob, NULL) &&
+            fields.width == size && _wcsicmp(recordPath, path) == 0) {
+            return i;
+        }
+    }
+    return (UINT)-1;
+}
+
+/**
+ * IconCacheSharedClose – unmap the shared layer and free its index.
+ */
+static void IconCacheSharedClose(void)
+{
+    if (g_sharedCache.view) {
+        UnmapViewOfFile(g_sharedCache.view);
+    }
+    if (g_sharedCache.mapping) {
+        CloseHandle(g_sharedCache.mapping);
+    }
+    if (g_sharedCache.file && g_sharedCache.file != INVALID_HANDLE_VALUE) {
+        CloseHandle(g_sharedCache.file);
+    }
+    free(g_sharedCache.records);
+    free(g_sharedCache.hashes);
+    free(g_sharedCache.index);
+    ZeroMemory(&g_sharedCache, sizeof g_sharedCache);
+}
+
+/**
+ * IconCacheSharedOpen – map the shared cache layer, if there is one, and
+ *                       index its records in place.
+ *
+ * The first pass counts the well-formed records (stopping at a torn tail
+ * like IconCacheReplayRecords, and at CACHE_MAX_LOAD_ENTRIES so a crafted
+ * file cannot size the index); the second indexes them, a later record
+ * for the same (path, size) replacing the earlier one.  The shared file is
+ * expected to be written rarely (by /warm on a deployment image).  While
+ * any process maps it, Windows refuses to replace it, so such a writer's
+ * compaction fails and IconCacheSave falls back to appending past the
+ * mapped range, provided the file holds a valid journal.  A writer whose
+ * save needs a compaction (no valid header, entries pruned or evicted)
+ * fails until the file is no longer mapped.
+ */
+static void IconCacheSharedOpen(void)
+{
+    WCHAR sharedFile[MAX_PATH];
+    if (!ResolveSharedCacheFilePath(sharedFile)) {
+        return;
+    }
+
+    g_sharedCache.file = CreateFileW(
+        sharedFile, GENERIC_READ, CACHE_SHARE_MODE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (g_sharedCache.file == INVALID_HANDLE_VALUE) {
+        g_sharedCache.file = NULL;
+        return;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(g_sharedCache.file, &fileSize) ||
+        fileSize.QuadPart < CACHE_HEADER_SIZE || fileSize.QuadPart > CACHE_MAX_FILE_SIZE) {
+        goto fail;
+    }
+
+    g_sharedCache.size    = (DWORD)fileSize.QuadPart;
+    g_sharedCache.mapping = CreateFileMappingW(g_sharedCache.file, NULL, PAGE_READONLY, 0, g_sharedCache.size, NULL);
+    if (!g_sharedCache.mapping) {
+        goto fail;
+    }
+    g_sharedCache.view = MapViewOfFile(g_sharedCache.mapping, FILE_MAP_READ, 0, 0, g_sharedCache.size);
+    if (!g_sharedCache.view || !IconCacheHeaderValid(g_sharedCache.view, g_sharedCache.size)) {
+        goto fail;
+    }
+
+    // pass 1: count well-formed records
+    IconCacheEntry fields;
+    WCHAR path[MAX_PATH];
+    const BYTE *blob;
+    UINT records = 0;
+    for (DWORD offset = CACHE_HEADER_SIZE, end; records < CACHE_MAX_LOAD_ENTRIES &&
+         IconCacheSharedRecord(offset, &fields, path, &blob, &end); offset = end) {
+        records++;
+    }
+    if (records == 0) {
+        goto fail;
+    }
+
+    UINT tableSize = 256;
+    while (tableSize < records * 2 + 2) {
+        tableSize *= 2;
+    }
+    g_sharedCache.records = malloc(records * sizeof *g_sharedCache.records);
+    g_sharedCache.hashes  = malloc(records * sizeof *g_sharedCache.hashes);
+    g_sharedCache.index   = calloc(tableSize, sizeof *g_sharedCache.index);
+    if (!g_sharedCache.records || !g_sharedCache.hashes || !g_sharedCache.index) {
+        goto fail;
+    }
+    g_sharedCache.indexMask = tableSize - 1;
+
+    // pass 2: index them; later records supersede earlier ones
+    DWORD offset = CACHE_HEADER_SIZE, end;
+    for (UINT r = 0; r < records && IconCacheSharedRecord(offset, &fields, path, &blob, &end); ++r, offset = end) {
+        const UINT existing = IconCacheSharedFind(path, fields.width);
+        if (existing != (UINT)-1) {
+            g_sharedCache.records[existing] = offset;
+            continue;
+        }
+
+        const UINT i = g_sharedCache.count++;
+        g_sharedCache.records[i] = offset;
+        g_sharedCache.hashes[i]  = IconCacheKeyHash(path, fields.width);
+
+        UINT slot = g_sharedCache.hashes[i] & g_sharedCache.indexMask;
+        while (g_sharedCache.index[slot]) {
+            slot = (slot + 1) & g_sharedCache.indexMask;
+        }
+        g_sharedCache.index[slot] = i + 1;
+    }
+
+    TraceF(L"cache: shared layer maps %u icons from %s", g_sharedCache.count, sharedFile);
+    return;
+
+fail:
+    IconCacheSharedClose();
+}
+
+/**
+ * IconCacheSharedLookup – serve (@path, @size) from the shared layer if its
+ *                         record matches the file's last-write timestamp.
+ *
+ * @return  IconId (one reference owned by the caller), or 0 on a miss.
+ */
+static IconId IconCacheSharedLookup(PCWSTR path, int size, const FILETIME *lastWrite)
+{
+    const UINT i = IconCacheSharedFind(path, size);
+    if (i == (UINT)-1) {
+        return 0;
+    }
+
+    IconCacheEntry fields;
+    WCHAR recordPath[MAX_PATH];
+    const BYTE *blob;
+    if (!IconCacheSharedRecord(g_sharedCache.records[i], &fields, recordPath, &blob, NULL) ||
+        CompareFileTime(&fields.lastWrite, lastWrite) != 0) {
+        return 0;
+    }
+
+    // the mapping is never trusted: verify the blob on every use
+    if (CacheHash32(blob, fields.blobSize, 0) != fields.blobHash) {
+        TraceF(L"cache: checksum mismatch in shared layer for %s", path);
+        return 0;
+    }
+
+    UINT32 *pixels = IconCacheDecodePixels(blob, fields.blobSize, fields.width, fields.height);
+    if (!pixels) {
+        return 0;
+    }
+    return IconPoolInternPixels(pixels, fields.width, fields.height, fields.width);
+}
+
+/**
+ * IconCacheServe – intern the pixels of cache entry @e.
+ *
+ * @param e  Live entry already validated against the file's timestamp.
+ * @return   IconId (one reference owned by the caller), or 0 on failure.
+ */
+static IconId IconCacheServe(IconCacheEntry *e)
+{
+    // verify a loaded blob on first use; a corrupt one is dropped, so the
+    // caller's miss path re-resolves the icon and IconCacheStore replaces it
+    if (!IconCacheVerifyBlob(e)) {
+        TraceF(L"cache: checksum mismatch, dropped icon for %s", e->path);
+        free(e->blob);
+        e->blob = NULL;
+        return 0;
+    }
+
+    // unpack into the scratch, then copy into the atlas (or share a match);
+    // a corrupt blob is treated as a miss and replaced by IconCacheStore
+    UINT32 *pixels = IconCacheDecodePixels(e->blob, e->blobSize, e->width, e->height);
+    if (!pixels) {
+        return 0;
+    }
+
+    // refresh the LRU stamp; re-persisting it is worth a record at most daily
+    const UINT64 now = IconCacheNow();
+    if (now - e->lastHit > CACHE_HIT_RESOLUTION) {
+        e->dirty = true;
+        g_iconCache.dirty = true;
+    }
+    e->lastHit = now;
+
+    return IconPoolInternPixels(pixels, e->width, e->height, e->width);
+}
+
+/**
+ * IconCacheLookup – search for a cached icon matching @path, the requested
+ *                   size and the file's current last-write timestamp.
+ *
+ * @param path       Null-terminated wide string path of the file to look up.
+ * @param size       Icon edge length in pixels.
+ * @param lastWrite  Current last-write time of @path.
+ * @return           IconId interned from the cached pixel data if a valid
+ *                   entry exists, or 0 if not found or stale.
+ */
+static IconId IconCacheLookup(PCWSTR path, int size, const FILETIME *lastWrite)
+{
+    IconCacheEntry *e = IconCacheFind(path, size);
+    if (!e || !e->blob || CompareFileTime(&e->lastWrite, lastWrite) != 0) {
+        return 0;
+    }
+    return IconCacheServe(e);
+}
+
+/**
+ * IconCacheLookupMoved – after a miss by path, serve the same file cached
+ *                        under another path (renamed or moved), copied to
+ *                        @path by IconCacheCopyMoved.
+ *
+ * @param path       Path that missed.
+ * @param size       Icon edge length in pixels.
+ * @param lastWrite  Current last-write time of @path.
+ * @param volume     Volume serial number of @path.
+ * @param fileId     File index of @path.
+ * @return           IconId on a hit, or 0.
+ */
+static IconId IconCacheLookupMoved(PCWSTR path, int size, const FILETIME *lastWrite,
+                                   DWORD volume, UINT64 fileId)
+{
+    IconCacheEntry *added = IconCacheCopyMoved(path, size, lastWrite, volume, fileId);
+    if (!added) {
+        return 0;
+    }
+    g_iconStats.movedHits++;
+
+    return IconCacheServe(added);
+}
+
+/**
+ * IconCacheStore – add or update a cache entry for the given path and icon.
+ *
+ * Copies the 32-bit pixel data of @icon out of its atlas cell, converts it
+ * to straight alpha (the on-disk format, independent of how the atlas
+ * blends), packs it with BlobEncode when that is smaller and stores it
+ * alongside the file's current last-write timestamp and identity.  Marks
+ * the cache dirty.
+ *
+ * @param path       Null-terminated wide string path of the file.
+ * @param icon       Pooled icon whose pixels will be copied into the cache.
+ * @param lastWrite  Current last-write time of @path.
+ * @param volume     Volume serial number of @path (0 if unknown).
+ * @param fileId     File index of @path (0 if unknown).
+ */
+static void IconCacheStore(PCWSTR path, IconId icon, const FILETIME *lastWrite,
+                           DWORD volume, UINT64 fileId)
+{
+    int width, height, stride;
+    const UINT32 *source = IconPoolPixels(icon, &width, &height, &stride);
+    if (!source || width != height) return;
+
+    const size_t count = (size_t)width * height;
+    DWORD blobSize = (DWORD)(count * 4);
+    BYTE *blob = malloc(blobSize);
+    if (!blob) return;
+
+    // atlas cells are rows of a larger page; pack them tightly
+    CopyPixelRows((UINT32 *)blob, width, source, stride, width, height);
+    UnpremultiplyRow((UINT32 *)blob, count);
+
+    // keep the packed form only when it is actually smaller
+    BYTE *packed = malloc(BLOB_MAX_SIZE(count));
+    if (packed) {
+        const size_t packedSize = BlobEncode((const UINT32 *)blob, count, packed);
+        if (packedSize < blobSize) {
+            BYTE *shrunk = realloc(packed, packedSize);
+            free(blob);
+            blob     = shrunk ? shrunk : packed;
+            blobSize = (DWORD)packedSize;
+        } else {
+            free(packed);
+        }
+    }
+
+    const UINT32 blobHash = CacheHash32(blob, blobSize, 0);
+
+    // check if this variant already exists (stale) and update in-place
+    IconCacheEntry *existing = IconCacheFind(path, width);
+    if (existing) {
+        const BOOL moved = existing->volume != volume || existing->fileId != fileId;
+        free(existing->blob);
+        existing->volume    = volume;
+        existing->fileId    = fileId;
+        existing->lastWrite = *lastWrite;
+        existing->lastHit   = IconCacheNow();
+        existing->width     = width;
+        existing->height    = height;
+        existing->blob      = blob;
+        existing->blobSize  = blobSize;
+        existing->blobHash  = blobHash;
+        existing->verified  = true;
+        existing->dirty     = true;
+        g_iconCache.dirty = true;
+        if (moved) {
+            IconCacheRebuildIndex();  // another file now lives at this path
+        }
+        return;
+    }
+
+    // new entry (or new size variant of a cached path)
+    IconCacheEntry entry = { 0 };
+    entry.path      = _wcsdup(path);
+    entry.volume    = volume;
+    entry.fileId    = fileId;
+    entry.lastWrite = *lastWrite;
+    entry.lastHit   = IconCacheNow();
+    entry.width     = width;
+    entry.height    = height;
+    entry.blob      = blob;
+    entry.blobSize  = blobSize;
+    entry.blobHash  = blobHash;
+    entry.verified  = true;
+    entry.dirty     = true;
+
+    if (!entry.path || !IconCacheAdd(&entry)) {
+        free(entry.path);
+        free(blob);
+        return;
+    }
+    g_iconCache.dirty = true;
+}
+
+/**
+ * CachedIconForItem – resolve a file or directory icon, using the persistent
+ *                     cache when available.  On cache miss, falls back to
+ *                     IconForItem() and stores the result for next time.
+ *
+ * Cache entries are validated against @lastWrite, normally the timestamp
+ * the folder enumeration already returned, so a lookup costs no metadata
+ * call.  Without one the file is queried once for both lookup and store.
+ * The read-only shared layer is consulted first, then the writable one.
+ * On a miss the file identity is queried once, to find the icon of a
+ * renamed target and to record it with the new entry.
+ *
+ * @param filePath     Null-terminated wide string path to a file or directory.
+ * @param isDirectory  TRUE if @filePath is a directory.
+ * @param lastWrite    Last-write time of @filePath, or NULL if unknown.
+ * @return             IconId (one reference owned by the caller), or 0 on failure.
+ */
+static IconId CachedIconForItem(PCWSTR filePath, BOOL isDirectory, const FILETIME *lastWrite)
+{
+    FILETIME queried;
+    if (g_useCacheFlag && !lastWrite && GetFileLastWriteTime(filePath, &queried)) {
+        lastWrite = &queried;
+    }
+
+    DWORD  volume = 0;
+    UINT64 fileId = 0;
+    if (g_useCacheFlag && lastWrite) {
+        IconId cached = IconCacheSharedLookup(filePath, g_iconPixelSize, lastWrite);
+        if (cached) return cached;
+
+        cached = IconCacheLookup(filePath, g_iconPixelSize, lastWrite);
+        if (cached) return cached;
+
+        if (GetFileIdentity(filePath, &volume, &fileId)) {
+            cached = IconCacheLookupMoved(filePath, g_iconPixelSize, lastWrite, volume, fileId);
+            if (cached) return cached;
+        } else {
+            volume = 0;
+            fileId = 0;
+        }
+    }
+
+    IconId icon = IconForItem(filePath, isDirectory);
+    if (icon && g_useCacheFlag && lastWrite) {
+        IconCacheStore(filePath, icon, lastWrite, volume, fileId);
+    }
+
+    return icon;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Foreground window helpers                                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * FindMainWindowCtx – EnumWindows callback context for FindMainWindowByPid.
+ *
+ * @member pid     Target process ID to search for.
+ * @member result  Receives the first matching HWND, or NULL if not found yet.
+ */
+typedef struct {
+    DWORD pid;
+    HWND  result;
+} FindMainWindowCtx;
+
+/**
+ * FindMainWindowCb – EnumWindows callback: finds the first visible, ownerless
+ *                    top-level window belonging to @ctx->pid.
+ *
+ * "Main window" heuristic: visible + no owner + matching PID.
+ * Stops enumeration as soon as a match is found.
+ *
+ * @param hwnd  Handle to the window currently being enumerated.
+ * @param lp    Pointer to a FindMainWindowCtx cast to LPARAM.
+ * @return      FALSE to stop enumeration (match found), TRUE to continue.
+ */
+static BOOL CALLBACK FindMainWindowCb(HWND hwnd, LPARAM lp)
+{
+    FindMainWindowCtx *ctx = (FindMainWindowCtx *)lp;
+
+    DWORD wPid = 0;
+    GetWindowThreadProcessId(hwnd, &wPid);
+
+    // visible, no owner, owned by the target PID → this is the main window
+    if (wPid == ctx->pid && IsWindowVisible(hwnd) && !GetWindow(hwnd, GW_OWNER)) {
+        ctx->result = hwnd;
+        return FALSE; // stop enumeration
+    }
+
+    return TRUE;
+}
+
+/**
+ * FindMainWindowByPid – locate the main visible top-level window of a process.
+ *
+ * @param pid  Process ID to search for.
+ * @return     HWND on success, NULL if no matching window was found.
+ */
+static HWND FindMainWindowByPid(DWORD pid)
+{
+    FindMainWindowCtx ctx = { pid, NULL };
+    EnumWindows(FindMainWindowCb, (LPARAM)&ctx);
+    return ctx.result;
+}
+
+/**
+ * ForceWindowToForeground – bring @hwnd to the foreground, bypassing Windows'
+ *                           foreground-lock restrictions.
+ *
+ * Windows normally blocks SetForegroundWindow() unless the calling thread
+ * already owns the foreground.  Temporarily attaching our thread's input to
+ * the target thread's input queue satisfies that restriction and lets the
+ * call succeed.
+ *
+ * @param hwnd  Window to activate.  No-op if NULL or no longer valid.
+ */
+static void ForceWindowToForeground(HWND hwnd)
+{
+    if (!hwnd || !IsWindow(hwnd)) {
+        return;
+    }
+
+    HWND  hwndFg    = GetForegroundWindow();
+    DWORD fgThread  = hwndFg ? GetWindowThreadProcessId(hwndFg, NULL) : 0;
+    DWORD tgtThread = GetWindowThreadProcessId(hwnd, NULL);
+
+    // attach input queues so SetForegroundWindow is not rejected
+    BOOL attached = FALSE;
+    if (fgThread && fgThread != tgtThread) {
+        attached = AttachThreadInput(fgThread, tgtThread, TRUE);
+    }
+
+    ShowWindow(hwnd, SW_RESTORE);
+    SetForegroundWindow(hwnd);
+    BringWindowToTop(hwnd);
+
+    // always detach, even if SetForegroundWindow failed
+    if (attached) {
+        AttachThreadInput(fgThread, tgtThread, FALSE);
+    }
+}
+
+/**
+ * ActivateTargetWindow – find and bring to the foreground the window of a
+ *                        newly-spawned process (no-args / HandleOpenTarget branch).
+ *
+ * Waits for @hProcess to become idle, then locates its main window by PID.
+ * Retries up to ~2 s to allow slow apps to create their window after idle.
+ * Once found, activates it via ForceWindowToForeground.
+ *
+ * @param hProcess  Handle of the newly-spawned process (must be non-NULL).
+ */
+static void ActivateTargetWindow(HANDLE hProcess)
 {
     // Wait until the app is ready for input, then find its main window.
     // Retry loop covers apps that create their window slightly after
     // WaitForInputIdle returns.
     WaitForInputIdle(hProcess, 3000);
 
-    HWND hwndTarget = NULL;
-    DWORD pid = GetProcessId(hProcess);
-    for (int retry = 0; retry < 20 && !hwndTarget; ++retry) {
-        hwndTarget = FindMainWindowByPid(pid);
-        if (!hwndTarget) {
-            Sleep(100); // 20 × 100 ms = 2 s max wait
+    HWND hwndTarget = NULL;
+    DWORD pid = GetProcessId(hProcess);
+    for (int retry = 0; retry < 20 && !hwndTarget; ++retry) {
+        hwndTarget = FindMainWindowByPid(pid);
+        if (!hwndTarget) {
+            Sleep(100); // 20 × 100 ms = 2 s max wait
+        }
+    }
+
+    ForceWindowToForeground(hwndTarget);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Foreground event hook (drag-and-drop activation)                           */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * HWND captured by the WinEvent hook when a window takes the foreground
+ * during or immediately after a COM drag-and-drop operation.
+ *
+ * Set by ForegroundEventHookProc, consumed by HandleSendFiles.
+ * Protected by single-threaded apartment — no synchronisation needed.
+ */
+static HWND g_dropForegroundHwnd = NULL;
+
+/**
+ * ForegroundEventHookProc – WinEvent callback that records the most recent
+ *                           window to receive foreground activation.
+ *
+ * Installed just before ExecuteDragDrop and uninstalled right after the
+ * message-pump wait.  Captures any window that the shell (or the launched
+ * application) activates as a result of the drop operation, covering both
+ * new processes and already-running apps that merely raise their window.
+ *
+ * @param hWinEventHook  Handle to the installed event hook (unused).
+ * @param event          Event constant (always EVENT_SYSTEM_FOREGROUND here).
+ * @param hwnd           Window that received the foreground.
+ * @param idObject       Object identifier (unused).
+ * @param idChild        Child identifier (unused).
+ * @param dwEventThread  Thread that generated the event (unused).
+ * @param dwmsEventTime  Timestamp of the event in milliseconds (unused).
+ */
+static void CALLBACK ForegroundEventHookProc(
+    HWINEVENTHOOK hWinEventHook,
+    DWORD         event,
+    HWND          hwnd,
+    LONG          idObject,
+    LONG          idChild,
+    DWORD         dwEventThread,
+    DWORD         dwmsEventTime
+) {
+    // suppress unused-parameter warnings
+    (void)hWinEventHook;
+    (void)event;
+    (void)idObject;
+    (void)idChild;
+    (void)dwEventThread;
+    (void)dwmsEventTime;
+
+    // only record visible top-level windows (ignore transient popups)
+    if (hwnd && IsWindowVisible(hwnd)) {
+        g_dropForegroundHwnd = hwnd;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Incremental icon resolution                                                */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * SetMenuItemIconInfo – fill the bitmap part of a MENUITEMINFOW for @icon.
+ *
+ * Icons live in the shared atlas, so items use HBMMENU_CALLBACK and carry
+ * their IconId in dwItemData; SendToWndProc answers WM_MEASUREITEM and
+ * WM_DRAWITEM by blitting the cell.  Items without an icon get no bitmap.
+ *
+ * @param mii   Structure to update (fMask is OR-ed, not replaced).
+ * @param icon  IconId, or 0 for none.
+ */
+static void SetMenuItemIconInfo(MENUITEMINFOW *mii, IconId icon)
+{
+    mii->fMask     |= MIIM_BITMAP | MIIM_DATA;
+    mii->hbmpItem   = icon ? HBMMENU_CALLBACK : NULL;
+    mii->dwItemData = icon;
+}
+
+/**
+ * PendingIcon – a menu item whose icon has not been resolved yet.
+ *
+ * @member menu      Popup that displays the item.
+ * @member position  Zero-based item position inside @menu.
+ * @member index     Index into g_menuItems.
+ */
+typedef struct {
+    HMENU menu;
+    UINT  position;
+    UINT  index;
+} PendingIcon;
+
+/**
+ * PendingIconQueue – items waiting for icon resolution, highest priority
+ *                    first (most recently opened popup, top to bottom).
+ *
+ * @member items     Pointer to contiguous buffer (realloc'd).
+ * @member count     Elements currently queued.
+ * @member capacity  Allocated slots in @items.
+ * @member resolved  Icons resolved so far (for the per-icon cost trace).
+ * @member totalMs   Time spent resolving them.
+ */
+typedef struct {
+    PendingIcon *items;
+    UINT         count;
+    UINT         capacity;
+    UINT         resolved;
+    double       totalMs;
+} PendingIconQueue;
+
+/** Global queue drained by WM_INITMENUPOPUP and the ICON_TIMER_ID timer. */
+static PendingIconQueue g_pendingIcons = { 0 };
+
+/**
+ * PendingIconsEnsureCapacity – make room for at least @need queued items.
+ *
+ * @param need  Desired minimum capacity.
+ * @return      true on success, false on OOM (queue is untouched).
+ */
+static bool PendingIconsEnsureCapacity(UINT need)
+{
+    if (need <= g_pendingIcons.capacity) {
+        return true;
+    }
+
+    UINT newCap = g_pendingIcons.capacity ? g_pendingIcons.capacity * 2 : MENU_PAGE_SIZE;
+    if (newCap < need) {
+        newCap = need;
+    }
+
+    PendingIcon *tmp = realloc(g_pendingIcons.items, newCap * sizeof *tmp);
+    if (!tmp) {
+        return false;
+    }
+
+    g_pendingIcons.items    = tmp;
+    g_pendingIcons.capacity = newCap;
+
+    return true;
+}
+
+/**
+ * PendingIconsDropMenu – remove every queued item that belongs to @menu
+ *                        (the popup was closed or is being re-queued).
+ *
+ * @param menu  Popup whose items are dropped.
+ */
+static void PendingIconsDropMenu(HMENU menu)
+{
+    UINT kept = 0;
+    for (UINT i = 0; i < g_pendingIcons.count; ++i) {
+        if (g_pendingIcons.items[i].menu != menu) {
+            g_pendingIcons.items[kept++] = g_pendingIcons.items[i];
+        }
+    }
+    g_pendingIcons.count = kept;
+}
+
+/**
+ * PendingIconsQueueMenu – queue all undecorated file items of @menu ahead
+ *                         of anything already pending, in visible order.
+ *
+ * The items are found through the popup's chain of ranges (VectorFindPopup),
+ * so neither a menu item nor the ranges of other popups are looked at.
+ *
+ * @param menu  Popup about to be displayed.
+ * @return      Number of items queued.
+ */
+static UINT PendingIconsQueueMenu(HMENU menu)
+{
+    PendingIconsDropMenu(menu);
+
+    const MenuVector *vec = g_menuItems;
+    const PopupSlot *popup = VectorFindPopup(vec, menu);
+    if (!popup) {
+        return 0;
+    }
+
+    UINT count = 0;
+    for (UINT r = popup->first; r != POPUP_NO_RANGE; r = vec->ranges[r].next) {
+        count += vec->ranges[r].count;
+    }
+    if (!PendingIconsEnsureCapacity(g_pendingIcons.count + count)) {
+        return 0;
+    }
+
+    // shift older entries back; the new popup is what the user looks at now
+    PendingIcon *front = g_pendingIcons.items;
+    memmove(front + count, front, g_pendingIcons.count * sizeof *front);
+
+    UINT queued = 0;
+    for (UINT r = popup->first; r != POPUP_NO_RANGE; r = vec->ranges[r].next) {
+        const PopupRange *range = &vec->ranges[r];
+
+        // Skip directories (icons come with the enumeration) and iconified items
+        for (UINT i = 0; i < range->count; ++i) {
+            const UINT idx = range->first + i;
+            if (!(vec->flags[idx] & MENU_ITEM_DIRECTORY) && !vec->icons[idx]) {
+                front[queued++] = (PendingIcon){ menu, range->position + i, idx };
+            }
+        }
+    }
+
+    // close the gap left by skipped items
+    memmove(front + queued, front + count, g_pendingIcons.count * sizeof *front);
+    g_pendingIcons.count += queued;
+    return queued;
+}
+
+/**
+ * FindMenuWindowCtx – EnumThreadWindows context for InvalidateMenuWindow.
+ *
+ * @member menu  Popup being searched for.
+ */
+typedef struct {
+    HMENU menu;
+} FindMenuWindowCtx;
+
+/**
+ * InvalidateMenuWindowCb – repaint the popup window ("#32768") showing
+ *                          @ctx->menu, if it belongs to this thread.
+ *
+ * @param hwnd  Window currently being enumerated.
+ * @param lp    Pointer to a FindMenuWindowCtx cast to LPARAM.
+ * @return      FALSE once the window was found, TRUE to continue.
+ */
+static BOOL CALLBACK InvalidateMenuWindowCb(HWND hwnd, LPARAM lp)
+{
+    FindMenuWindowCtx *ctx = (FindMenuWindowCtx *)lp;
+
+    WCHAR className[16];
+    if (!GetClassNameW(hwnd, className, ARRAYSIZE(className)) ||
+        wcscmp(className, L"#32768") != 0) {
+        return TRUE;
+    }
+
+    if ((HMENU)SendMessageW(hwnd, MN_GETHMENU, 0, 0) != ctx->menu) {
+        return TRUE;
+    }
+
+    InvalidateRect(hwnd, NULL, FALSE);
+    return FALSE;
+}
+
+/**
+ * InvalidateMenuWindow – force an open popup to repaint after its item
+ *                        bitmaps were changed behind its back.
+ *
+ * @param menu  Popup whose window should be redrawn.
+ */
+static void InvalidateMenuWindow(HMENU menu)
+{
+    FindMenuWindowCtx ctx = { menu };
+    EnumThreadWindows(GetCurrentThreadId(), InvalidateMenuWindowCb, (LPARAM)&ctx);
+}
+
+/**
+ * ResolvePendingIcons – resolve queued icons until @budgetMs is spent.
+ *
+ * At least one icon is resolved per call so the queue always drains.
+ * Each finished item is updated in place with SetMenuItemInfoW.
+ *
+ * @param budgetMs  Time budget in milliseconds.
+ * @param repaint   TRUE if the affected popups are already on screen and
+ *                  must be invalidated (timer path); FALSE while they are
+ *                  still being initialised (WM_INITMENUPOPUP path).
+ */
+static void ResolvePendingIcons(double budgetMs, BOOL repaint)
+{
+    if (g_pendingIcons.count == 0) {
+        return;
+    }
+
+    const LONGLONG start = QpcNow();
+    HMENU lastMenu = NULL;
+    UINT done = 0;
+
+    while (done < g_pendingIcons.count) {
+        PendingIcon *pending = &g_pendingIcons.items[done++];
+        IconId      *icon    = &g_menuItems->icons[pending->index];
+
+        WCHAR path[MAX_LOCAL_PATH];
+        if (!*icon && VectorItemPath(g_menuItems, pending->index, path, ARRAYSIZE(path))) {
+            *icon = CachedIconForItem(path, FALSE, &g_menuItems->lastWrites[pending->index]);
+        }
+
+        MENUITEMINFOW mii = { sizeof(mii) };
+        SetMenuItemIconInfo(&mii, *icon);
+        SetMenuItemInfoW(pending->menu, pending->position, TRUE, &mii);
+
+        if (repaint && pending->menu != lastMenu) {
+            if (lastMenu) {
+                InvalidateMenuWindow(lastMenu);
+            }
+            lastMenu = pending->menu;
+        }
+
+        if (QpcElapsedMs(start) >= budgetMs) {
+            break;
+        }
+    }
+
+    if (lastMenu) {
+        InvalidateMenuWindow(lastMenu);
+    }
+
+    // drop the resolved head of the queue
+    g_pendingIcons.count -= done;
+    memmove(g_pendingIcons.items, g_pendingIcons.items + done,
+            g_pendingIcons.count * sizeof *g_pendingIcons.items);
+
+    const double elapsed = QpcElapsedMs(start);
+    g_pendingIcons.resolved += done;
+    g_pendingIcons.totalMs  += elapsed;
+
+    TraceF(L"icons: %u resolved in %.2f ms (budget %u ms, avg %.2f ms/icon), %u pending",
+           done, elapsed, ICON_BUDGET_MS,
+           g_pendingIcons.totalMs / g_pendingIcons.resolved,
+           g_pendingIcons.count);
+}
+
+/**
+ * PendingIconsDestroy – free the queue; called once the menu is dismissed.
+ */
+static void PendingIconsDestroy(void)
+{
+    free(g_pendingIcons.items);
+    ZeroMemory(&g_pendingIcons, sizeof g_pendingIcons);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Settings (sendto.ini)                                                      */
+/* -------------------------------------------------------------------------- */
+
+/** Active limits; defaults apply when sendto.ini is absent. */
+static EnumLimits g_enumLimits = {
+    MAX_DEPTH, ENUM_FOLDER_ENTRIES, ENUM_TOTAL_ENTRIES, ENUM_BUDGET_MS, true, true
+};
+
+/**
+ * SnapshotPolicy – staleness policy of the persisted menu snapshot, read
+ *                  from the [Snapshot] section of sendto.ini.
+ *
+ * @member use            SNAPSHOT_USE_* (Use).
+ * @member maxAgeMinutes  A snapshot whose tree was last walked in full
+ *                        longer ago than this is not served (MaxAgeMinutes).
+ */
+typedef struct {
+    UINT use;
+    UINT maxAgeMinutes;
+} SnapshotPolicy;
+
+/** Active snapshot policy; defaults apply when sendto.ini is absent. */
+static SnapshotPolicy g_snapshotPolicy = { SNAPSHOT_USE_NETWORK, SNAPSHOT_MAX_AGE };
+
+/**
+ * ResolveSettingsFilePath – build the path to "sendto.ini" next to the executable.
+ *
+ * @param outPath  Buffer of at least MAX_PATH WCHARs to receive the result.
+ * @return         TRUE on success, FALSE on failure.
+ */
+static BOOL ResolveSettingsFilePath(WCHAR outPath[MAX_PATH])
+{
+    if (!GetModuleFileNameW(NULL, outPath, MAX_PATH)) {
+        return FALSE;
+    }
+    PathRemoveFileSpecW(outPath);
+    return PathAppendW(outPath, L"sendto.ini");
+}
+
+/**
+ * ReadIniInt – SettingReader over GetPrivateProfileIntW.
+ *
+ * @param context  Path of the ini file.
+ */
+static INT ReadIniInt(PCWSTR section, PCWSTR key, INT fallback, const void *context)
+{
+    return (INT)GetPrivateProfileIntW(section, key, fallback, (PCWSTR)context);
+}
+
+/**
+ * ReadClampedInt – GetPrivateProfileIntW clamped to [@low, @high].
+ */
+static UINT ReadClampedInt(PCWSTR iniFile, PCWSTR section, PCWSTR key, UINT fallback, UINT low, UINT high)
+{
+    return ClampSetting(ReadIniInt(section, key, (INT)fallback, iniFile), low, high);
+}
+
+/** [Exclude] patterns: matching entries are hidden. */
+static FilterList g_excludeRules = { 0 };
+
+/** [Include] patterns: re-show entries an [Exclude] pattern hid. */
+static FilterList g_includeRules = { 0 };
+
+/**
+ * FilterCompile – read @section of @iniFile and compile its lines into
+ *                 @list with FilterCompileLines.
+ */
+static void FilterCompile(FilterList *list, PCWSTR iniFile, PCWSTR section)
+{
+    // GetPrivateProfileSectionW reports a full buffer as size - 2
+    DWORD size = 1024;
+    PWSTR pool = NULL;
+    for (;;) {
+        PWSTR grown = realloc(pool, size * sizeof(WCHAR));
+        if (!grown) {
+            free(pool);
+            return;
+        }
+        pool = grown;
+        if (GetPrivateProfileSectionW(section, pool, size, iniFile) < size - 2) {
+            break;
+        }
+        size *= 2;
+    }
+
+    FilterCompileLines(list, pool);
+}
+
+/**
+ * LoadSettings – read sendto.ini (if present) into g_enumLimits,
+ *                g_snapshotPolicy and the [Exclude] / [Include] filter lists.
+ */
+static void LoadSettings(void)
+{
+    WCHAR iniFile[MAX_PATH];
+    if (!ResolveSettingsFilePath(iniFile) || !PathFileExistsW(iniFile)) {
+        return;
+    }
+
+    EnumLimitsLoad(&g_enumLimits, ReadIniInt, iniFile);
+
+    g_snapshotPolicy.use           = ReadClampedInt(iniFile, L"Snapshot", L"Use",
+                                                    SNAPSHOT_USE_NETWORK, SNAPSHOT_USE_NEVER, SNAPSHOT_USE_ALWAYS);
+    g_snapshotPolicy.maxAgeMinutes = ReadClampedInt(iniFile, L"Snapshot", L"MaxAgeMinutes",
+                                                    SNAPSHOT_MAX_AGE, 1, SNAPSHOT_MAX_AGE_CAP);
+
+    FilterCompile(&g_excludeRules, iniFile, L"Exclude");
+    if (g_excludeRules.count) {
+        FilterCompile(&g_includeRules, iniFile, L"Include");
+    }
+
+    TraceF(L"settings: depth %u, %u per folder, %u total, %u ms, reparse %s, %s",
+           g_enumLimits.maxDepth, g_enumLimits.maxFolderEntries,
+           g_enumLimits.maxTotalEntries, g_enumLimits.budgetMs,
+           g_enumLimits.followReparse ? L"followed" : L"skipped",
+           g_enumLimits.background ? L"background" : L"blocking");
+    TraceF(L"settings: %u exclude, %u include patterns",
+           g_excludeRules.count, g_includeRules.count);
+}
+
+/** Set when a background walk was abandoned at exit; it may still read the settings. */
+static bool g_settingsInUse = false;
+
+/**
+ * FreeSettings – release the filter lists loaded by LoadSettings (unless an
+ *                abandoned worker may still be matching against them).
+ */
+static void FreeSettings(void)
+{
+    if (g_settingsInUse) {
+        return;
+    }
+    FilterFree(&g_excludeRules);
+    FilterFree(&g_includeRules);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Menu population                                                            */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * SkipEntry – filter out "." / "..", hidden or system files and entries
+ *             hidden by the sendto.ini [Exclude] / [Include] patterns.
+ *
+ * @param  findData  WIN32_FIND_DATA of current entry.
+ * @return           TRUE if the entry must be ignored.
+ */
+static BOOL SkipEntry(const WIN32_FIND_DATAW *findData)
+{
+    if ((findData->dwFileAttributes &
+         (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM)) ||
+        wcscmp(findData->cFileName, L".")  == 0 ||
+        wcscmp(findData->cFileName, L"..") == 0) {
+        return TRUE;
+    }
+    if (!g_excludeRules.count) {
+        return FALSE;
+    }
+
+    const size_t nameLen     = wcslen(findData->cFileName);
+    const bool   isDirectory = (findData->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    return FilterMatches(&g_excludeRules, findData->cFileName, nameLen, isDirectory) &&
+           !FilterMatches(&g_includeRules, findData->cFileName, nameLen, isDirectory);
+}
+
+/**
+ * AddFileItem – insert a leaf item with icon into a menu and track it in a vector.
+ *
+ * @param parentMenu Target HMENU to receive the new item.
+ * @param fileName   Null-terminated wide string of the file name (with extension).
+ * @param icon       IconId to display, or 0 for no icon.
+ * @param commandId  Unique command identifier for the menu entry.
+ * @param vec        Pointer to a MenuVector to store the item in.
+ * @param parent     Vector index of the containing folder, or MENU_NO_PARENT.
+ * @param lastWrite  Last-write time from the enumeration (cache validation).
+ * @return           void; on push failure, releases the icon reference.
+ */
+static void AddFileItem(
+    HMENU           parentMenu,
+    PCWSTR          fileName,
+    IconId          icon,
+    UINT            commandId,
+    MenuVector      *vec,
+    UINT            parent,
+    const FILETIME  *lastWrite
+) {
+    // vectorPush may fail; then we must clean up our resources
+    if (!VectorPush(vec, parent, fileName, false, lastWrite, icon)) {
+        IconPoolRelease(icon);
+        return;
+    }
+
+    // Caption without extension
+    WCHAR caption[MAX_PATH];
+    StringCchCopyW(caption, ARRAYSIZE(caption), fileName);
+    PWSTR ext = PathFindExtensionW(caption);
+    if (ext && ext > caption) {
+        *ext = L'\0';
+    }
+
+    // Prepare the MENUITEMINFO structure for a bitmap + submenu entry
+    MENUITEMINFOW itemInfo = { 0 };
+    itemInfo.cbSize     = sizeof(itemInfo);
+    itemInfo.fMask      = MIIM_ID | MIIM_STRING;
+    itemInfo.wID        = commandId;
+    itemInfo.dwTypeData = caption;
+    SetMenuItemIconInfo(&itemInfo, icon);
+
+    InsertMenuItemW(parentMenu, commandId, FALSE, &itemInfo);
+}
+
+/**
+ * AddDirectoryItem – insert a submenu entry with icon and context help ID.
+ *
+ * @param parentMenu    HMENU to append the new directory item.
+ * @param directoryName Null-terminated wide string of the directory label.
+ * @param icon          IconId to display alongside the label (0 = none).
+ * @param subMenu       HMENU handle for the drop-down submenu.
+ * @param helpId        DWORD context-help identifier for the submenu.
+ * @return              void.
+ */
+static void AddDirectoryItem(
+    HMENU       parentMenu,
+    PCWSTR      directoryName,
+    IconId      icon,
+    HMENU       subMenu,
+    UINT        helpId
+) {
+    // Prepare the MENUITEMINFO structure for a bitmap + submenu entry
+    MENUITEMINFOW itemInfo = { 0 };
+    itemInfo.cbSize      = sizeof(itemInfo);
+    itemInfo.fMask       = MIIM_SUBMENU | MIIM_STRING;
+    itemInfo.hSubMenu    = subMenu;                 // the submenu that drops down
+    itemInfo.dwTypeData  = (LPWSTR)directoryName;   // display text
+    SetMenuItemIconInfo(&itemInfo, icon);           // atlas icon (owner-drawn)
+
+    // Insert the menu item at the end of parentMenu
+    InsertMenuItemW(
+        parentMenu,
+        GetMenuItemCount(parentMenu),  // position = end
+        TRUE,                          // interpret wIDOrPosition as position
+        &itemInfo
+    );
+
+    // Associate a help/context-ID with the submenu itself
+    MENUINFO menuInfo        = { sizeof(menuInfo) };
+    menuInfo.fMask           = MIM_HELPID | MIM_STYLE; // we're setting dwContextHelpID
+    menuInfo.dwContextHelpID = helpId;                 // ID used to look up real path
+    menuInfo.dwStyle         = MNS_AUTODISMISS
+                               | MNS_NOTIFYBYPOS;
+
+    SetMenuInfo(subMenu, &menuInfo);
+}
+
+/**
+ * CompareFindData – qsort comparator for WIN32_FIND_DATAW entries.
+ *
+ * Sorts directories before files; within each group, sorts by file name
+ * using StrCmpLogicalW (natural ordering: file1, file2, file10).
+ *
+ * @param a  Pointer to first WIN32_FIND_DATAW.
+ * @param b  Pointer to second WIN32_FIND_DATAW.
+ * @return   Negative if a < b, zero if equal, positive if a > b.
+ */
+static int CompareFindData(const void *a, const void *b)
+{
+    const WIN32_FIND_DATAW *fa = (const WIN32_FIND_DATAW *)a;
+    const WIN32_FIND_DATAW *fb = (const WIN32_FIND_DATAW *)b;
+
+    BOOL dirA = (fa->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    BOOL dirB = (fb->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+
+    // directories come first
+    if (dirA != dirB) {
+        return dirB - dirA;
+    }
+
+    return StrCmpLogicalW(fa->cFileName, fb->cFileName);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Overflow paging                                                            */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * DistinctPrefixLength – number of characters of @name needed to tell it
+ *                        apart from @neighbour (case-insensitive).
+ *
+ * @param name       Name being labelled.
+ * @param neighbour  Adjacent name on the other side of a page boundary,
+ *                   or NULL if there is none.
+ * @return           Prefix length in [1, MENU_PAGE_LABEL_MAX].
+ */
+static size_t DistinctPrefixLength(PCWSTR name, PCWSTR neighbour)
+{
+    size_t len = 1;
+    if (neighbour) {
+        while (len < MENU_PAGE_LABEL_MAX && name[len - 1] &&
+               _wcsnicmp(name, neighbour, len) == 0) {
+            len++;
+        }
+    }
+
+    size_t nameLen = wcslen(name);
+    return len < nameLen ? len : nameLen;
+}
+
+/**
+ * FormatPageLabel – build the caption of a page submenu, e.g. "A – C" or
+ *                   "Sa – Sm" when neighbouring pages share an initial.
+ *
+ * @param label    Output buffer.
+ * @param cch      Size of @label in WCHARs.
+ * @param entries  Sorted entry array.
+ * @param start    First index of the page.
+ * @param end      One past the last index of the page.
+ * @param count    Total number of entries.
+ */
+static void FormatPageLabel(
+    PWSTR                   label,
+    size_t                  cch,
+    const WIN32_FIND_DATAW  *entries,
+    UINT                    start,
+    UINT                    end,
+    UINT                    count
+) {
+    PCWSTR first = entries[start].cFileName;
+    PCWSTR last  = entries[end - 1].cFileName;
+
+    size_t firstLen = DistinctPrefixLength(first, start > 0 ? entries[start - 1].cFileName : NULL);
+    size_t lastLen  = DistinctPrefixLength(last, end < count ? entries[end].cFileName : NULL);
+
+    WCHAR from[MENU_PAGE_LABEL_MAX + 1];
+    WCHAR to[MENU_PAGE_LABEL_MAX + 1];
+    StringCchCopyNW(from, ARRAYSIZE(from), first, firstLen);
+    StringCchCopyNW(to, ARRAYSIZE(to), last, lastLen);
+    CharUpperBuffW(from, 1);
+    CharUpperBuffW(to, 1);
+
+    if (_wcsicmp(from, to) == 0) {
+        StringCchCopyW(label, cch, from);
+    } else {
+        StringCchPrintfW(label, cch, L"%s \u2013 %s", from, to);
+    }
+}
+
+/**
+ * AddPageSubmenu – append a page submenu covering entries [@start, @end) to
+ *                  @menu.  Page submenus carry no icon and no vector entry,
+ *                  so WM_INITMENUPOPUP skips them like any other submenu.
+ *
+ * @param menu     Parent HMENU of the paged folder.
+ * @param entries  Sorted entry array.
+ * @param start    First index of the page.
+ * @param end      One past the last index of the page.
+ * @param count    Total number of entries.
+ * @return         HMENU of the new page, or NULL on failure.
+ */
+static HMENU AddPageSubmenu(
+    HMENU                   menu,
+    const WIN32_FIND_DATAW  *entries,
+    UINT                    start,
+    UINT                    end,
+    UINT                    count
+) {
+    HMENU pageMenu = CreatePopupMenu();
+    if (!pageMenu) {
+        return NULL;
+    }
+
+    WCHAR label[2 * MENU_PAGE_LABEL_MAX + 8];
+    FormatPageLabel(label, ARRAYSIZE(label), entries, start, end, count);
+    AddDirectoryItem(menu, label, 0, pageMenu, 0);
+
+    return pageMenu;
+}
+
+/** Directories entered by the current menu walk or /warm walk (the
+ *  snapshot revalidation keeps its own set); a menu walk's set is kept
+ *  until the menu closes, for the pages filled on demand. */
+static VisitedSet g_enumVisited = { 0 };
+
+/**
+ * EnterDirectory – decide whether the walk descends into @path.
+ *
+ * Reparse points are refused when FollowReparsePoints=0.  Otherwise the
+ * directory is entered unless its identity was already visited by this
+ * walk; a directory whose identity cannot be read is entered (the depth
+ * limit still applies).
+ *
+ * @param visited     Identities entered by this walk.
+ * @param path        Absolute directory path.
+ * @param attributes  dwFileAttributes from the enumeration.
+ * @return            true to enter (and list) the directory.
+ */
+static bool EnterDirectory(VisitedSet *visited, PCWSTR path, DWORD attributes)
+{
+    const bool reparse = (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    if (reparse && !g_enumLimits.followReparse) {
+        TraceF(L"enum: %s is a reparse point, skipped", path);
+        return false;
+    }
+
+    DWORD  volume = 0;
+    UINT64 fileId = 0;
+    if (!QueryFileIdentity(path, &volume, &fileId)) {
+        return true;
+    }
+    if (!VisitedAdd(visited, volume, fileId)) {
+        TraceF(L"enum: %s repeats a visited folder, skipped", path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * VisitedReset – start a walk of @root: clear @visited and record the
+ *                root itself, so a link back to it is caught.
+ */
+static void VisitedReset(VisitedSet *visited, PCWSTR root)
+{
+    VisitedFree(visited);
+
+    DWORD  volume = 0;
+    UINT64 fileId = 0;
+    if (QueryFileIdentity(root, &volume, &fileId)) {
+        VisitedAdd(visited, volume, fileId);
+    }
+}
+
+/**
+ * VisitedAddAncestors – record @directory and the @depth folders above it
+ *                       (up to the walk's root), so a link from a page's
+ *                       subfolder back to any of them is caught even when
+ *                       the walk took their listings from a snapshot.
+ */
+static void VisitedAddAncestors(VisitedSet *visited, PCWSTR directory, UINT depth)
+{
+    PWSTR path = _wcsdup(directory);
+    if (!path) {
+        return;
+    }
+
+    for (UINT level = 0; level <= depth; ++level) {
+        DWORD  volume = 0;
+        UINT64 fileId = 0;
+        if (QueryFileIdentity(path, &volume, &fileId)) {
+            VisitedAdd(visited, volume, fileId);
+        }
+        PWSTR slash = wcsrchr(path, L'\\');
+        if (!slash) {
+            break;
+        }
+        *slash = L'\0';
+    }
+    free(path);
+}
+
+/** Start of the current menu walk (QpcNow), for g_enumLimits.budgetMs. */
+static LONGLONG g_enumStart = 0;
+
+/**
+ * EnumBudgetExhausted – TRUE once the walk has used up its total-entry or
+ *                       wall-clock budget.
+ *
+ * @param listed  Entries listed (or added to the menu) so far.
+ * @param start   QpcNow() at the start of the walk, or 0 for no time budget.
+ */
+static bool EnumBudgetExhausted(UINT listed, LONGLONG start)
+{
+    return EnumBudgetReached(&g_enumLimits, listed, start ? QpcElapsedMs(start) : 0.0);
+}
+
+/**
+ * AddMarkerItem – append a disabled text item to @menu, e.g. "more…" when a
+ *                 limit cut the listing short or "loading…" while it is
+ *                 still being enumerated in the background.
+ */
+static void AddMarkerItem(HMENU menu, PCWSTR text)
+{
+    MENUITEMINFOW itemInfo = { 0 };
+    itemInfo.cbSize     = sizeof(itemInfo);
+    itemInfo.fMask      = MIIM_STRING | MIIM_STATE;
+    itemInfo.fState     = MFS_GRAYED;
+    itemInfo.dwTypeData = (LPWSTR)text;
+
+    InsertMenuItemW(menu, GetMenuItemCount(menu), TRUE, &itemInfo);
+}
+
+/**
+ * ListFolder – read, filter and sort the entries of @directory.
+ *
+ * Subfolders are checked with EnterDirectory here, so the identity
+ * queries (and @visited) stay on the thread doing the listing.
+ *
+ * @param directory  Folder to list.
+ * @param visited    Identities entered by this walk.
+ * @param listed     Entries already listed by this walk (total limit).
+ * @param start      Start of the walk for the time budget (0 = none).
+ * @param cancel     Optional flag; a non-zero value stops the listing.
+ * @param out        Receives the listing; free out->entries when done.
+ * @return           S_OK, or an HRESULT error (out is then empty).
+ */
+static HRESULT ListFolder(PCWSTR directory, VisitedSet *visited, UINT listed, LONGLONG start,
+                          const volatile LONG *cancel, FolderListing *out)
+{
+    *out = (FolderListing){ 0 };
+
+    // One heap buffer for the search pattern, then for each child path:
+    // 64 KB of stack per call adds up along a deep walk.
+    PWSTR path = malloc(MAX_LOCAL_PATH * sizeof(WCHAR));
+    if (!path) {
+        return E_OUTOFMEMORY;
+    }
+
+    // Build the search pattern "directory\\*"
+    if (!PathCombineW(path, directory, L"*")) {
+        free(path);
+        return E_FAIL;
+    }
+
+    // Begin file enumeration
+    WIN32_FIND_DATAW findData;
+    HANDLE hFind = FindFirstFileExW(
+        path,
+        FindExInfoBasic,
+        &findData,
+        FindExSearchNameMatch,
+        NULL,
+        FIND_FIRST_EX_LARGE_FETCH
+    );
+    if (hFind == INVALID_HANDLE_VALUE) {
+        const HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        free(path);
+        return hr;
+    }
+
+    // --- Phase 1: collect all valid entries into a temporary heap array ---
+    UINT entryCount = 0;
+    UINT entryCapacity = 32;
+    WIN32_FIND_DATAW *entries = malloc(entryCapacity * sizeof *entries);
+    if (!entries) {
+        FindClose(hFind);
+        free(path);
+        return E_OUTOFMEMORY;
+    }
+
+    do {
+        if (SkipEntry(&findData)) {
+            continue;
+        }
+
+        if ((cancel && *cancel) ||
+            entryCount >= g_enumLimits.maxFolderEntries ||
+            EnumBudgetExhausted(listed + entryCount, start)) {
+            out->truncated = true;
+            break;
+        }
+
+        // Skip cycles, repeats and (by policy) reparse points
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!PathCombineW(path, directory, findData.cFileName) ||
+                !EnterDirectory(visited, path, findData.dwFileAttributes)) {
+                continue;
+            }
+        }
+
+        // grow array if needed
+        if (entryCount >= entryCapacity) {
+            UINT newCap = entryCapacity * 2;
+            WIN32_FIND_DATAW *tmp = realloc(entries, newCap * sizeof *tmp);
+            if (!tmp) {
+                break;  // process what we have so far
+            }
+            entries = tmp;
+            entryCapacity = newCap;
+        }
+
+        entries[entryCount++] = findData;
+    } while (FindNextFileW(hFind, &findData));
+
+    FindClose(hFind);
+    free(path);
+
+    // --- Phase 2: sort — directories first, then alphabetical within each group ---
+    if (entryCount > 1) {
+        qsort(entries, entryCount, sizeof *entries, CompareFindData);
+    }
+
+    out->entries = entries;
+    out->count   = entryCount;
+    return S_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Menu snapshot (stale-while-revalidate)                                     */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * MenuSnapshotState – the snapshot of the current run.
+ *
+ * Either @serving (a fresh snapshot of this root was loaded: the menu is
+ * built from it and a worker revalidates it) or @capturing (listings made
+ * by PopulateFolder are recorded and saved at exit), or neither.
+ *
+ * @member root       Heap-alloc'd SendTo root.
+ * @member loaded     Snapshot served to ObtainListing.
+ * @member captured   Listings recorded while capturing.
+ * @member serving    Build the menu from @loaded.
+ * @member capturing  Record listings into @captured.
+ * @member thread     Revalidation worker (NULL if none).
+ * @member cancel     Set to stop the revalidation at exit.
+ */
+typedef struct {
+    PWSTR          root;
+    MenuSnapshot   loaded;
+    MenuSnapshot   captured;
+    bool           serving;
+    bool           capturing;
+    HANDLE         thread;
+    volatile LONG  cancel;
+} MenuSnapshotState;
+
+/** Snapshot state of this run. */
+static MenuSnapshotState g_menuSnapshot = { 0 };
+
+/**
+ * SnapshotFolderStamp – current last-write time of a folder, or 0.
+ */
+static UINT64 SnapshotFolderStamp(PCWSTR path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attrs;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attrs)) {
+        return 0;
+    }
+    return ((UINT64)attrs.ftLastWriteTime.dwHighDateTime << 32) | attrs.ftLastWriteTime.dwLowDateTime;
+}
+
+/**
+ * SnapshotStampFromParents – fill in the @lastWrite of captured folders.
+ *
+ * A subfolder's time comes from its entry in the parent listing, so
+ * capturing costs no extra round trip; only the root is queried.
+ */
+static void SnapshotStampFromParents(MenuSnapshot *snapshot, PCWSTR root)
+{
+    for (UINT i = 0; i < snapshot->count; ++i) {
+        SnapshotFolder *folder = &snapshot->folders[i];
+        if (folder->lastWrite) {
+            continue;
+        }
+        if (folder->depth == 0) {
+            folder->lastWrite = SnapshotFolderStamp(root);
+            continue;
+        }
+
+        PWSTR parentPath = _wcsdup(folder->path);
+        if (!parentPath) {
+            continue;
+        }
+        PWSTR name = PathFindFileNameW(folder->path);
+        PathRemoveFileSpecW(parentPath);
+
+        const SnapshotFolder *parent = SnapshotFind(snapshot, parentPath);
+        for (UINT j = 0; parent && j < parent->listing.count; ++j) {
+            const WIN32_FIND_DATAW *entry = &parent->listing.entries[j];
+            if (_wcsicmp(entry->cFileName, name) == 0) {
+                folder->lastWrite = ((UINT64)entry->ftLastWriteTime.dwHighDateTime << 32) |
+                                    entry->ftLastWriteTime.dwLowDateTime;
+                break;
+            }
+        }
+        free(parentPath);
+    }
+}
+
+/**
+ * SnapshotSettingsHash – fingerprint of the settings that shape a listing
+ *                        (limits, reparse policy, filter patterns).  A
+ *                        snapshot taken under other settings is not served.
+ */
+static UINT32 SnapshotSettingsHash(void)
+{
+    const UINT limits[] = {
+        g_enumLimits.maxDepth, g_enumLimits.maxFolderEntries,
+        g_enumLimits.maxTotalEntries, g_enumLimits.followReparse
+    };
+    UINT32 hash = CacheHash32(limits, sizeof limits, 0);
+
+    const FilterList *lists[] = { &g_excludeRules, &g_includeRules };
+    for (UINT l = 0; l < ARRAYSIZE(lists); ++l) {
+        for (UINT i = 0; i < lists[l]->count; ++i) {
+            const FilterRule *rule = &lists[l]->rules[i];
+            hash = CacheHash32(rule->text, wcslen(rule->text) * sizeof(WCHAR), hash + l + rule->dirOnly);
+        }
+    }
+    return hash;
+}
+
+/**
+ * SnapshotSave – write @snapshot of @root to "%LOCALAPPDATA%\SendTo+\sendto.menu".
+ *
+ * The image (see SnapshotEncode) is written to "<file>.tmp" and swapped in
+ * with MoveFileExW, like a cache compaction.
+ *
+ * @return  TRUE if the new snapshot replaced the old one.
+ */
+static BOOL SnapshotSave(const MenuSnapshot *snapshot, PCWSTR root)
+{
+    WCHAR snapshotFile[MAX_PATH], tempFile[MAX_PATH];
+    if (!ResolveLocalDataPath(L"sendto.menu", snapshotFile) ||
+        FAILED(StringCchPrintfW(tempFile, ARRAYSIZE(tempFile), L"%s.tmp", snapshotFile))) {
+        return FALSE;
+    }
+
+    BYTE *data;
+    DWORD size;
+    if (!SnapshotEncode(snapshot, root, SnapshotSettingsHash(), &data, &size)) {
+        return FALSE;
+    }
+
+    HANDLE hFile = CreateFileW(
+        tempFile, GENERIC_WRITE, 0, NULL,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    BOOL ok = hFile != INVALID_HANDLE_VALUE &&
+              WriteAll(hFile, data, size) &&
+              FlushFileBuffers(hFile);
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+    }
+    free(data);
+
+    ok = ok && MoveFileExW(tempFile, snapshotFile, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    if (!ok) {
+        DeleteFileW(tempFile);
+    }
+
+    TraceF(L"snapshot: %s %u folders", ok ? L"saved" : L"failed to save", snapshot->count);
+    return ok;
+}
+
+/**
+ * SnapshotLoad – read the snapshot file if it matches @root and is fresh.
+ *
+ * @param maxAgeMinutes  [Snapshot] MaxAgeMinutes.
+ * @return               true if @out was filled.
+ */
+static bool SnapshotLoad(PCWSTR root, UINT maxAgeMinutes, MenuSnapshot *out)
+{
+    WCHAR snapshotFile[MAX_PATH];
+    if (!ResolveLocalDataPath(L"sendto.menu", snapshotFile)) {
+        return false;
+    }
+
+    HANDLE hFile = CreateFileW(
+        snapshotFile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    BYTE *data = NULL;
+    bool ok = false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) ||
+        fileSize.QuadPart < SNAPSHOT_HEADER_SIZE || fileSize.QuadPart > SNAPSHOT_MAX_FILE_SIZE) {
+        goto done;
+    }
+
+    const DWORD size = (DWORD)fileSize.QuadPart;
+    DWORD bytesRead = 0;
+    data = malloc(size);
+    if (!data || !ReadFile(hFile, data, size, &bytesRead, NULL) || bytesRead != size) {
+        goto done;
+    }
+
+    const UINT64 maxAge = (UINT64)maxAgeMinutes * 60 * 10000000;
+    ok = SnapshotDecode(data, size, root, SnapshotSettingsHash(), IconCacheNow(), maxAge, out);
+
+done:
+    free(data);
+    CloseHandle(hFile);
+    return ok;
+}
+
+/**
+ * SnapshotServed – the served snapshot's listing of @directory, or NULL if
+ *                  no snapshot is served or it lacks that folder.
+ */
+static const SnapshotFolder *SnapshotServed(PCWSTR directory)
+{
+    return g_menuSnapshot.serving ? SnapshotFind(&g_menuSnapshot.loaded, directory) : NULL;
+}
+
+/**
+ * ObtainListing – the listing of @directory for the menu walk: from the
+ *                 served snapshot when it has one, otherwise from disk.
+ *
+ * @param directory  Folder to list.
+ * @param listed     Entries already in the menu (total limit).
+ * @param out        Receives the listing; free out->entries when done.
+ * @return           S_OK, or an HRESULT error (out is then empty).
+ */
+static HRESULT ObtainListing(PCWSTR directory, UINT listed, FolderListing *out)
+{
+    const SnapshotFolder *folder = SnapshotServed(directory);
+    if (!folder) {
+        return ListFolder(directory, &g_enumVisited, listed, g_enumStart, NULL, out);
+    }
+
+    *out = (FolderListing){ .count = folder->listing.count };
+    if (folder->listing.count) {
+        out->entries = malloc(folder->listing.count * sizeof *out->entries);
+        if (!out->entries) {
+            *out = (FolderListing){ 0 };
+            return E_OUTOFMEMORY;
+        }
+        memcpy(out->entries, folder->listing.entries, folder->listing.count * sizeof *out->entries);
+    }
+    return S_OK;
+}
+
+/**
+ * SnapshotRecord – keep a copy of a listing PopulateFolder is adding, when
+ *                  this run captures a snapshot (UI thread).  A truncated
+ *                  listing is left out; the next launch lists that folder.
+ */
+static void SnapshotRecord(PCWSTR directory, UINT depth, const FolderListing *listing)
+{
+    if (g_menuSnapshot.capturing && !listing->truncated &&
+        !SnapshotAdd(&g_menuSnapshot.captured, directory, depth, 0, listing)) {
+        g_menuSnapshot.capturing = false;   // an incomplete capture is not saved
+        SnapshotFree(&g_menuSnapshot.captured);
+    }
+}
+
+/**
+ * SnapshotReadStamp – SnapshotStampReader over GetFileAttributesExW.
+ */
+static UINT64 SnapshotReadStamp(PCWSTR path, void *context)
+{
+    (void)context;
+    return SnapshotFolderStamp(path);
+}
+
+/**
+ * SnapshotRelist – SnapshotLister over ListFolder; @context is the pass's
+ *                  VisitedSet.  Stops when the revalidation is cancelled.
+ */
+static bool SnapshotRelist(PCWSTR path, UINT listed, void *context, FolderListing *out)
+{
+    return SUCCEEDED(ListFolder(path, context, listed, 0, &g_menuSnapshot.cancel, out));
+}
+
+/**
+ * SnapshotRevalidateProc – thread body: compare every served folder's
+ *                          last-write time with the file system, re-list
+ *                          the ones that changed and save the result for
+ *                          the next launch if anything did.
+ */
+static DWORD WINAPI SnapshotRevalidateProc(LPVOID param)
+{
+    (void)param;
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+    // apart from g_enumVisited, which the menu walk may be using
+    VisitedSet visited = { 0 };
+    const LONGLONG start = QpcNow();
+    SnapshotRevalidation pass = {
+        .loaded  = &g_menuSnapshot.loaded,
+        .limits  = &g_enumLimits,
+        .stamp   = SnapshotReadStamp,
+        .list    = SnapshotRelist,
+        .context = &visited,
+        .cancel  = &g_menuSnapshot.cancel,
+        .next    = { .savedAt = g_menuSnapshot.loaded.savedAt }
+    };
+
+    VisitedReset(&visited, g_menuSnapshot.root);
+    const bool done = SnapshotRevalidateFolder(&pass, g_menuSnapshot.root, 0, 0);
+    VisitedFree(&visited);
+
+    const bool changed = pass.relisted || pass.next.count != g_menuSnapshot.loaded.count;
+    TraceF(L"snapshot: %u folders checked, %u re-listed in %.2f ms%s",
+           pass.checked, pass.relisted, QpcElapsedMs(start), done ? L"" : L" (cancelled)");
+
+    if (done && changed) {
+        SnapshotSave(&pass.next, g_menuSnapshot.root);
+    }
+    SnapshotFree(&pass.next);
+    return 0;
+}
+
+/**
+ * StartSnapshotRevalidation – once the menu is built from a served
+ *                             snapshot, recheck it in the background.
+ *
+ * The pass keeps its own VisitedSet, so it can run next to the
+ * enumeration worker listing the folders the snapshot lacks.
+ */
+static void StartSnapshotRevalidation(void)
+{
+    if (g_menuSnapshot.serving) {
+        g_menuSnapshot.thread = CreateThread(NULL, 0, SnapshotRevalidateProc, NULL, 0, NULL);
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Menu building                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * EnumPipeline – background enumeration: the UI thread queues subfolders,
+ *                a worker lists them (ListFolder) and posts each listing
+ *                back to the owner window as WM_ENUM_LISTED.
+ *
+ * Only @queue (under @lock) and @cancel are shared; menus, the item vector
+ * and command IDs stay on the UI thread, and g_enumVisited belongs to the
+ * worker while it runs.
+ *
+ * @member queue      Submenus still to be listed.
+ * @member lock       Guards @queue.
+ * @member wake       Signalled when a job is queued or on cancellation.
+ * @member thread     Worker thread (NULL when not running).
+ * @member owner      Window receiving WM_ENUM_LISTED.
+ * @member listed     Worker only: entries listed so far (total limit).
+ * @member cancel     Set when the menu is dismissed.
+ * @member abandoned  A stopped worker did not exit in time and still uses
+ *                    its queue and g_enumVisited.
+ */
+typedef struct {
+    EnumQueue           queue;
+    SRWLOCK             lock;
+    CONDITION_VARIABLE  wake;
+    HANDLE              thread;
+    HWND                owner;
+    UINT                listed;
+    volatile LONG       cancel;
+    bool                abandoned;
+} EnumPipeline;
+
+/** The background enumeration of the current menu. */
+static EnumPipeline g_enumPipeline = { 0 };
+
+/**
+ * EnumPipelineQueue – hand a new submenu to the worker (UI thread).
+ *
+ * @return  false on OOM; the submenu is then left empty.
+ */
+static bool EnumPipelineQueue(EnumPipeline *pipeline, HMENU menu, PCWSTR path, UINT parent,
+                              UINT depth)
+{
+    PWSTR copy = _wcsdup(path);
+    if (!copy) {
+        return false;
+    }
+
+    AcquireSRWLockExclusive(&pipeline->lock);
+    const bool ok = EnumQueuePush(&pipeline->queue, &(EnumJob){ menu, copy, parent, depth });
+    if (ok) {
+        WakeConditionVariable(&pipeline->wake);
+    }
+    ReleaseSRWLockExclusive(&pipeline->lock);
+
+    if (!ok) {
+        free(copy);
+        return false;
+    }
+
+    AddMarkerItem(menu, L"loading\u2026");
+    return true;
+}
+
+/**
+ * EnumPipelinePromote – move the job of @menu to the front of the queue,
+ *                       because the user just opened it (UI thread).
+ */
+static void EnumPipelinePromote(EnumPipeline *pipeline, HMENU menu)
+{
+    AcquireSRWLockExclusive(&pipeline->lock);
+    EnumQueuePromote(&pipeline->queue, menu);
+    ReleaseSRWLockExclusive(&pipeline->lock);
+}
+
+/**
+ * DeferredFolder – a subfolder of a synchronous walk, filled once its
+ *                  parent's own items are all in the vector.
+ *
+ * @member menu   Submenu of the subfolder.
+ * @member self   Vector index of the subfolder's item.
+ * @member entry  Index of the subfolder in the parent's listing.
+ */
+typedef struct {
+    HMENU menu;
+    UINT  self;
+    UINT  entry;
+} DeferredFolder;
+
+/**
+ * PagedFolder – a folder split into page submenus; kept until the menu
+ *               closes so its leaf pages can be filled when first opened.
+ *
+ * @member directory  Heap-alloc'd folder path.
+ * @member parent     Vector index of the folder's item, or MENU_NO_PARENT.
+ * @member depth      Depth of the folder (root = 0).
+ * @member listing    The folder's entries (owned).
+ */
+typedef struct {
+    PWSTR         directory;
+    UINT          parent;
+    UINT          depth;
+    FolderListing listing;
+} PagedFolder;
+
+/**
+ * LazyPage – a leaf page whose items are added on its first
+ *            WM_INITMENUPOPUP; the page's MENUINFO.dwMenuData holds its
+ *            index in MenuPages.pages + 1 until then.
+ *
+ * @member folder  Index of the paged folder in MenuPages.folders.
+ * @member start   First entry of the page.
+ * @member end     One past the last entry of the page.
+ */
+typedef struct {
+    UINT folder;
+    UINT start;
+    UINT end;
+} LazyPage;
+
+/**
+ * MenuPages – the paged folders and leaf pages of the current menu.
+ *
+ * @member folders         Heap array of paged folders.
+ * @member folderCount     Used slots in @folders.
+ * @member folderCapacity  Allocated slots in @folders.
+ * @member pages           Heap array of leaf pages.
+ * @member pageCount       Used slots in @pages.
+ * @member pageCapacity    Allocated slots in @pages.
+ */
+typedef struct {
+    PagedFolder *folders;
+    UINT         folderCount;
+    UINT         folderCapacity;
+    LazyPage    *pages;
+    UINT         pageCount;
+    UINT         pageCapacity;
+} MenuPages;
+
+/** Paged folders of the current menu (UI thread only). */
+static MenuPages g_menuPages = { 0 };
+
+/**
+ * MenuPagesAddFolder – take over @listing->entries for a folder about to
+ *                      be paged.
+ *
+ * @param index  Receives the index of the paged folder.
+ * @return       false on OOM (@listing is then untouched).
+ */
+static bool MenuPagesAddFolder(PCWSTR directory, UINT parent, UINT depth, FolderListing *listing,
+                               UINT *index)
+{
+    MenuPages *pages = &g_menuPages;
+    if (pages->folderCount == pages->folderCapacity) {
+        const UINT newCap = pages->folderCapacity ? pages->folderCapacity * 2 : 8;
+        PagedFolder *tmp = realloc(pages->folders, newCap * sizeof *tmp);
+        if (!tmp) {
+            return false;
+        }
+        pages->folders        = tmp;
+        pages->folderCapacity = newCap;
+    }
+
+    PWSTR copy = _wcsdup(directory);
+    if (!copy) {
+        return false;
+    }
+
+    *index = pages->folderCount++;
+    pages->folders[*index] = (PagedFolder){ copy, parent, depth, *listing };
+    listing->entries = NULL;
+    listing->count   = 0;
+    return true;
+}
+
+/**
+ * MenuPagesAddLeaf – register @menu as a leaf page of entries [@start,
+ *                    @end) of paged folder @folder; it shows a
+ *                    "loading…" marker until it is filled.
+ *
+ * @return  false on OOM.
+ */
+static bool MenuPagesAddLeaf(HMENU menu, UINT folder, UINT start, UINT end)
+{
+    MenuPages *pages = &g_menuPages;
+    if (pages->pageCount == pages->pageCapacity) {
+        const UINT newCap = pages->pageCapacity ? pages->pageCapacity * 2 : MENU_PAGE_SIZE;
+        LazyPage *tmp = realloc(pages->pages, newCap * sizeof *tmp);
+        if (!tmp) {
+            return false;
+        }
+        pages->pages        = tmp;
+        pages->pageCapacity = newCap;
+    }
+
+    MENUINFO menuInfo   = { sizeof(menuInfo) };
+    menuInfo.fMask      = MIM_MENUDATA;
+    menuInfo.dwMenuData = pages->pageCount + 1;
+    if (!SetMenuInfo(menu, &menuInfo)) {
+        return false;
+    }
+
+    pages->pages[pages->pageCount++] = (LazyPage){ folder, start, end };
+    AddMarkerItem(menu, L"loading\u2026");
+    return true;
+}
+
+/**
+ * MenuPagesFree – release the paged folders once the menu is gone.
+ */
+static void MenuPagesFree(void)
+{
+    MenuPages *pages = &g_menuPages;
+    for (UINT i = 0; i < pages->folderCount; ++i) {
+        free(pages->folders[i].directory);
+        free(pages->folders[i].listing.entries);
+    }
+    free(pages->folders);
+    free(pages->pages);
+    *pages = (MenuPages){ 0 };
+}
+
+/**
+ * AddPages – split entries [@start, @end) of paged folder @folder into
+ *            page submenus of @menu.
+ *
+ * Every level holds at most MENU_PAGE_SIZE pages (PageSpan); a page with
+ * more than MENU_PAGE_SIZE entries is split again inside its own submenu,
+ * so no popup of the folder exceeds MENU_PAGE_SIZE items.  Leaf pages are
+ * left empty until first opened (MenuPagesFill): a huge folder costs a
+ * few dozen popups up front instead of one menu item per entry.
+ *
+ * @return  false if some pages could not be created (their entries are
+ *          left out).
+ */
+static bool AddPages(HMENU menu, UINT folder, UINT start, UINT end)
+{
+    const FolderListing *listing = &g_menuPages.folders[folder].listing;
+    const UINT span = PageSpan(end - start);
+
+    bool ok = true;
+    for (UINT first = start; first < end; ) {
+        const UINT last = NextPageEnd(listing->entries, first, end, span);
+        HMENU page = AddPageSubmenu(menu, listing->entries, first, last, listing->count);
+        if (!page) {
+            ok = false;
+        } else if (last - first > MENU_PAGE_SIZE) {
+            ok = AddPages(page, folder, first, last) && ok;
+        } else if (!MenuPagesAddLeaf(page, folder, first, last)) {
+            // also destroys the page
+            DeleteMenu(menu, (UINT)GetMenuItemCount(menu) - 1, MF_BYPOSITION);
+            ok = false;
+        }
+        first = last;
+    }
+    return ok;
+}
+
+/**
+ * PopulateFolder – add the entries of @listing to @menu and @items.
+ *
+ * Folders larger than MENU_PAGE_THRESHOLD are split into page submenus
+ * (AddPages) and take over @listing->entries; the items of a page are
+ * added when it is first opened, by calling back here with @leafPage set.
+ * A truncated listing ends with a "more…" marker.  Subfolders are listed
+ * and populated after the folder's own items or, with a @pipeline,
+ * queued for the background worker; a subfolder the served snapshot has
+ * is filled from memory right away even then.  Either way the items of
+ * each popup form one contiguous range, recorded with VectorNoteRange.
+ * Item i of @items is command ID i + 1.
+ *
+ * @param menu       HMENU to which items and submenus will be added.
+ * @param directory  Folder the listing belongs to.
+ * @param parent     Vector index of @directory's item, or MENU_NO_PARENT.
+ * @param listing    Entries from ListFolder, or the slice of one leaf page.
+ * @param depth      Depth of @directory; subfolders stop at g_enumLimits.maxDepth.
+ * @param items      Vector where the items are stored.
+ * @param pipeline   Background enumeration, or NULL for a synchronous walk.
+ * @param leafPage   @listing is a leaf page of a paged folder: it was
+ *                   already recorded and counted against the limits.
+ */
+static void PopulateFolder(
+    HMENU               menu,
+    PCWSTR              directory,
+    UINT                parent,
+    FolderListing       *listing,
+    UINT                depth,
+    MenuVector          *items,
+    EnumPipeline        *pipeline,
+    bool                leafPage
+) {
+    bool truncated = listing->truncated;
+
+    if (!leafPage) {
+        SnapshotRecord(directory, depth, listing);
+
+        // Large folders go into page submenus (or flat if that runs out of memory)
+        UINT paged;
+        if (listing->count > MENU_PAGE_THRESHOLD &&
+            MenuPagesAddFolder(directory, parent, depth, listing, &paged)) {
+            const UINT count = g_menuPages.folders[paged].listing.count;
+            if (!AddPages(menu, paged, 0, count)) {
+                truncated = true;
+            }
+            if (truncated) {
+                AddMarkerItem(menu, L"more\u2026");
+                TraceF(L"enum: listing of %s cut short by a limit", directory);
+            }
+            TraceF(L"enum: %u entries of %s paged", count, directory);
+            return;
+        }
+    }
+
+    const WIN32_FIND_DATAW *entries = listing->entries;
+    const UINT entryCount           = listing->count;
+
+    // Subfolders filled on this thread (all of them in a synchronous walk,
+    // those the snapshot has otherwise) wait until this folder is complete
+    const bool recurse      = EnumDescends(&g_enumLimits, depth);
+    DeferredFolder *deferred = (!pipeline || g_menuSnapshot.serving) && recurse && entryCount
+                             ? malloc(entryCount * sizeof *deferred) : NULL;
+    UINT deferredCount      = 0;
+
+    // Heap, not stack: this recurses once per folder level.  Without it
+    // subfolders are skipped.
+    PWSTR childPath = malloc(MAX_LOCAL_PATH * sizeof(WCHAR));
+
+    // --- Phase 3: add sorted entries to the menu and vector ---
+    // @position is the position of the next item inside @menu.
+    UINT position = 0;
+
+    for (UINT i = 0; i < entryCount; ++i) {
+        const WIN32_FIND_DATAW *entry = &entries[i];
+
+        // subfolders walked so far may have used up the budget
+        if (!pipeline && !leafPage && EnumBudgetExhausted(items->count, g_enumStart)) {
+            truncated = true;
+            break;
+        }
+
+        const UINT before = items->count;
+        if (entry->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            // For subdirectories, create a new submenu
+            HMENU subMenu = CreatePopupMenu();
+            if (!subMenu) {
+                continue;
+            }
+
+            // Build full child path
+            if (!childPath || !PathCombineW(childPath, directory, entry->cFileName)) {
+                DestroyMenu(subMenu);
+                continue;
+            }
+
+            // Retrieve icon bitmap via unified cache-aware resolver
+            IconId icon = CachedIconForItem(childPath, TRUE, &entry->ftLastWriteTime);
+
+            // Store in vector first — if this fails, nothing was added to the
+            // menu yet so we can cleanly bail out without orphaning resources.
+            if (!VectorPush(items, parent, entry->cFileName, true, &entry->ftLastWriteTime, icon)) {
+                IconPoolRelease(icon);
+                DestroyMenu(subMenu);
+                continue;
+            }
+
+            // Insert directory item with icon and context-help ID
+            AddDirectoryItem(menu, entry->cFileName, icon, subMenu, before + 1);
+
+            // Fill the subdirectory in the background or after this folder
+            // (left empty on OOM)
+            if (pipeline && recurse && !SnapshotServed(childPath)) {
+                EnumPipelineQueue(pipeline, subMenu, childPath, before, depth + 1);
+            } else if (deferred) {
+                deferred[deferredCount++] = (DeferredFolder){ subMenu, before, i };
+            }
+        } else {
+            // Icon resolved lazily in WM_INITMENUPOPUP via CachedIconForItem
+            IconId icon = 0;
+
+            // For files, insert a regular file item
+            AddFileItem(menu, entry->cFileName, icon, before + 1,
+                        items, parent, &entry->ftLastWriteTime);
+        }
+
+        if (items->count > before) {
+            VectorNoteRange(items, menu, before, position++);
         }
     }
 
-    ForceWindowToForeground(hwndTarget);
-}
+    for (UINT i = 0; i < deferredCount; ++i) {
+        const DeferredFolder *sub = &deferred[i];
 
+        FolderListing child;
+        if (PathCombineW(childPath, directory, entries[sub->entry].cFileName) &&
+            SUCCEEDED(ObtainListing(childPath, items->count, &child))) {
+            PopulateFolder(sub->menu, childPath, sub->self, &child, depth + 1, items, pipeline, false);
+            free(child.entries);
+        }
+    }
+    free(deferred);
+    free(childPath);
 
-/* -------------------------------------------------------------------------- */
-/* Foreground event hook (drag-and-drop activation)                           */
-/* -------------------------------------------------------------------------- */
+    if (truncated) {
+        AddMarkerItem(menu, L"more\u2026");
+        TraceF(L"enum: listing of %s cut short by a limit", directory);
+    }
+}
 
 /**
- * HWND captured by the WinEvent hook when a window takes the foreground
- * during or immediately after a COM drag-and-drop operation.
+ * MenuPagesFill – WM_INITMENUPOPUP: add the items of a leaf page the first
+ *                 time it opens (UI thread).
  *
- * Set by ForegroundEventHookProc, consumed by HandleSendFiles.
- * Protected by single-threaded apartment — no synchronisation needed.
+ * Subfolders on the page are filled like those of any other folder: by
+ * the background worker, or right here in a synchronous walk, within a
+ * fresh time budget.  Either way they are checked against the walk's
+ * VisitedSet, which lives until the menu closes, so a junction back to the
+ * folder or one of its ancestors is not descended again.
+ *
+ * @param menu  Popup about to be displayed.
+ * @return      Entries added, or 0 if @menu is not an unfilled page.
  */
-static HWND g_dropForegroundHwnd = NULL;
+static UINT MenuPagesFill(HMENU menu)
+{
+    MENUINFO menuInfo = { sizeof(menuInfo) };
+    menuInfo.fMask    = MIM_MENUDATA;
+    if (!g_menuItems || !GetMenuInfo(menu, &menuInfo) || !menuInfo.dwMenuData ||
+        menuInfo.dwMenuData > g_menuPages.pageCount) {
+        return 0;
+    }
+
+    const LazyPage page = g_menuPages.pages[menuInfo.dwMenuData - 1];
+    menuInfo.dwMenuData = 0;
+    SetMenuInfo(menu, &menuInfo);
+    DeleteMenu(menu, 0, MF_BYPOSITION);   // the "loading…" marker
+
+    // A subfolder on the page may be paged in turn and move
+    // g_menuPages.folders; the path and the entries stay where they are
+    const PagedFolder folder = g_menuPages.folders[page.folder];
+    FolderListing slice = {
+        .entries = folder.listing.entries + page.start,
+        .count   = page.end - page.start
+    };
+
+    // a synchronous walk lists the page's subfolders here
+    EnumPipeline *pipeline = g_enumPipeline.thread ? &g_enumPipeline : NULL;
+    g_enumStart = QpcNow();
+    if (!pipeline) {
+        // the worker owns the set while it runs; the ancestors are in it
+        // unless a snapshot listed them
+        VisitedAddAncestors(&g_enumVisited, folder.directory, folder.depth);
+    }
+    PopulateFolder(menu, folder.directory, folder.parent, &slice, folder.depth,
+                   g_menuItems, pipeline, true);
+    return slice.count;
+}
 
 /**
- * ForegroundEventHookProc – WinEvent callback that records the most recent
- *                           window to receive foreground activation.
+ * EnumerateFolder – enumerate a directory, sort the entries alphabetically
+ *                   (directories first), and add them to a menu.
  *
- * Installed just before ExecuteDragDrop and uninstalled right after the
- * message-pump wait.  Captures any window that the shell (or the launched
- * application) activates as a result of the drop operation, covering both
- * new processes and already-running apps that merely raise their window.
+ * Collects all valid entries into a temporary heap array (ListFolder),
+ * sorts with StrCmpLogicalW for natural ordering, then adds them in order
+ * (PopulateFolder).  A folder listing that hits one of g_enumLimits
+ * (entries per folder, total entries, time budget) ends with a "more…"
+ * marker.  Subfolders already visited by this walk (junction loops) are
+ * left out; see EnterDirectory.
  *
- * @param hWinEventHook  Handle to the installed event hook (unused).
- * @param event          Event constant (always EVENT_SYSTEM_FOREGROUND here).
- * @param hwnd           Window that received the foreground.
- * @param idObject       Object identifier (unused).
- * @param idChild        Child identifier (unused).
- * @param dwEventThread  Thread that generated the event (unused).
- * @param dwmsEventTime  Timestamp of the event in milliseconds (unused).
+ * @param menu        HMENU to which items and submenus will be added.
+ * @param directory   Wide‐string path of the folder to enumerate.
+ * @param items       Pointer to a vector where (path, bitmap) pairs are stored.
+ * @param pipeline    Background enumeration that fills the subfolders, or
+ *                    NULL to walk the whole tree before returning.
+ * @return            S_OK on success, or an HRESULT error code on failure.
  */
-static void CALLBACK ForegroundEventHookProc(
-    HWINEVENTHOOK hWinEventHook,
-    DWORD         event,
-    HWND          hwnd,
-    LONG          idObject,
-    LONG          idChild,
-    DWORD         dwEventThread,
-    DWORD         dwmsEventTime
+static HRESULT EnumerateFolder(
+    HMENU         menu,
+    PCWSTR        directory,
+    MenuVector    *items,
+    EnumPipeline  *pipeline
 ) {
-    // suppress unused-parameter warnings
-    (void)hWinEventHook;
-    (void)event;
-    (void)idObject;
-    (void)idChild;
-    (void)dwEventThread;
-    (void)dwmsEventTime;
-
-    // only record visible top-level windows (ignore transient popups)
-    if (hwnd && IsWindowVisible(hwnd)) {
-        g_dropForegroundHwnd = hwnd;
+    FolderListing listing;
+    const HRESULT hr = ObtainListing(directory, items->count, &listing);
+    if (FAILED(hr)) {
+        return hr;
     }
+
+    PopulateFolder(menu, directory, MENU_NO_PARENT, &listing, 0, items, pipeline, false);
+    free(listing.entries);
+
+    return S_OK;
 }
 
 
 /* -------------------------------------------------------------------------- */
-/* Window procedure                                                           */
+/* Background enumeration                                                     */
 /* -------------------------------------------------------------------------- */
 
 /**
- * SendToWndProc – window procedure for the hidden owner window.
- *
- * Handles WM_INITMENUPOPUP to lazily resolve shell icons for file items
- * just before each popup/submenu is displayed, avoiding the upfront cost
- * of resolving all icons at enumeration time.
+ * EnumResult – a listing posted from the worker to the UI thread.
  *
- * @param hwnd    Handle to the owner window.
- * @param msg     Message identifier.
- * @param wParam  Additional message information (HMENU for WM_INITMENUPOPUP).
- * @param lParam  Additional message information.
- * @return        Result of message processing; 0 for handled messages,
- *                otherwise the result from DefWindowProcW.
+ * @member job      The job that was listed (owns job.path).
+ * @member listing  Its entries (owns listing.entries).
  */
-static LRESULT CALLBACK SendToWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
-{
-    // Forward all unhandled messages to the default procedure
-    if (msg != WM_INITMENUPOPUP) {
-        return DefWindowProcW(hwnd, msg, wParam, lParam);
-    }
+typedef struct {
+    EnumJob       job;
+    FolderListing listing;
+} EnumResult;
 
-    HMENU hMenu = (HMENU)wParam;
-    int count = GetMenuItemCount(hMenu);
+/**
+ * EnumResultFree – release a result and everything it owns.
+ */
+static void EnumResultFree(EnumResult *result)
+{
+    free(result->job.path);
+    free(result->listing.entries);
+    free(result);
+}
 
-    // Show loading cursor while shell icons are being resolved
-    HCURSOR hPrev = SetCursor(LoadCursor(NULL, IDC_APPSTARTING));
+/**
+ * EnumWorkerProc – thread body: list queued folders until cancelled.
+ *
+ * Each listing is posted to the owner window; if the post fails (or the
+ * menu was dismissed meanwhile) the result is freed here instead.  The
+ * wall-clock budget only bounds the synchronous walk before the menu is
+ * shown, so listings made here have none: they are limited by the entry
+ * counts and stop when the menu is dismissed.
+ */
+static DWORD WINAPI EnumWorkerProc(LPVOID param)
+{
+    EnumPipeline *pipeline = param;
 
-    // Lazily resolve shell icons for each undecorated file item in this popup
-    for (int i = 0; i < count; i++) {
-        MENUITEMINFOW mii = { sizeof(mii) };
-        mii.fMask = MIIM_ID | MIIM_BITMAP | MIIM_SUBMENU;
-        if (!GetMenuItemInfoW(hMenu, i, TRUE, &mii)) {
-            continue;
+    for (;;) {
+        EnumJob job;
+        AcquireSRWLockExclusive(&pipeline->lock);
+        while (!pipeline->cancel && !EnumQueueTake(&pipeline->queue, &job)) {
+            SleepConditionVariableSRW(&pipeline->wake, &pipeline->lock, INFINITE, 0);
+        }
+        if (pipeline->cancel) {
+            ReleaseSRWLockExclusive(&pipeline->lock);
+            break;
         }
+        ReleaseSRWLockExclusive(&pipeline->lock);
 
-        // Skip submenus (directories), already-iconified items, and separators
-        if (mii.hSubMenu || mii.hbmpItem || mii.wID == 0) {
+        EnumResult *result = calloc(1, sizeof *result);
+        if (!result) {
+            free(job.path);
             continue;
         }
+        result->job = job;
 
-        // wID is 1-based; map to 0-based vector index
-        UINT idx = mii.wID - 1;
-        if (idx < g_menuItems->count && !g_menuItems->items[idx].icon) {
-            HBITMAP icon = CachedIconForItem(g_menuItems->items[idx].path);
-            g_menuItems->items[idx].icon = icon;
-            mii.fMask    = MIIM_BITMAP;
-            mii.hbmpItem = icon;
-            SetMenuItemInfoW(hMenu, i, TRUE, &mii);
+        const LONGLONG start = QpcNow();
+        ListFolder(job.path, &g_enumVisited, pipeline->listed, 0, &pipeline->cancel, &result->listing);
+        pipeline->listed += result->listing.count;
+        TraceF(L"enum: %u entries of %s listed in %.2f ms",
+               result->listing.count, job.path, QpcElapsedMs(start));
+
+        if (pipeline->cancel ||
+            !PostMessageW(pipeline->owner, WM_ENUM_LISTED, 0, (LPARAM)result)) {
+            EnumResultFree(result);
         }
     }
 
-    // Restore the cursor that was active before icon resolution
-    SetCursor(hPrev);
-
     return 0;
 }
 
+/**
+ * EnumPipelineStart – set up g_enumPipeline with a suspended worker, so the
+ *                     root listing can queue subfolders before it runs.
+ *
+ * @param owner  Window that receives WM_ENUM_LISTED.
+ * @return       The pipeline, or NULL (walk synchronously) on failure.
+ */
+static EnumPipeline *EnumPipelineStart(HWND owner)
+{
+    EnumPipeline *pipeline = &g_enumPipeline;
+    *pipeline = (EnumPipeline){ .owner = owner };
+    InitializeSRWLock(&pipeline->lock);
+    InitializeConditionVariable(&pipeline->wake);
 
-/* -------------------------------------------------------------------------- */
-/* Menu population                                                            */
-/* -------------------------------------------------------------------------- */
+    pipeline->thread = CreateThread(NULL, 0, EnumWorkerProc, pipeline, CREATE_SUSPENDED, NULL);
+    return pipeline->thread ? pipeline : NULL;
+}
 
 /**
- * SkipEntry – filter out "." / ".." and hidden or system files.
+ * EnumPipelineRun – let the worker loose on the queued subfolders.
  *
- * @param  findData  WIN32_FIND_DATA of current entry.
- * @return           TRUE if the entry must be ignored.
+ * @param listed  Entries the root listing added (total limit).
  */
-static BOOL SkipEntry(const WIN32_FIND_DATAW *findData)
+static void EnumPipelineRun(EnumPipeline *pipeline, UINT listed)
 {
-    return (findData->dwFileAttributes &
-            (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM)) ||
-           wcscmp(findData->cFileName, L".")  == 0 ||
-           wcscmp(findData->cFileName, L"..") == 0;
+    pipeline->listed = listed;
+    ResumeThread(pipeline->thread);
 }
 
 /**
- * AddFileItem – insert a leaf item with icon into a menu and track it in a vector.
+ * EnumPipelineReceive – WM_ENUM_LISTED: replace the "loading…" marker of
+ *                       the job's submenu with its listing (UI thread).
  *
- * @param parentMenu Target HMENU to receive the new item.
- * @param fileName   Null-terminated wide string of the file name (with extension).
- * @param bitmap     HBITMAP icon to display, or NULL for no icon.
- * @param commandId  Unique command identifier for the menu entry.
- * @param vec        Pointer to a MenuVector to store the path and bitmap.
- * @param path       File path (stack buffer); copied internally by VectorPush.
- * @return           void; on push failure, frees pathCopy and bitmap if set.
+ * A submenu that is already on screen does not grow while open; it shows
+ * the listing the next time it is opened.
  */
-static void AddFileItem(
-    HMENU       parentMenu,
-    PCWSTR      fileName,
-    HBITMAP     bitmap,
-    UINT        commandId,
-    MenuVector  *vec,
-    PCWSTR      path
-) {
-    // vectorPush may fail; then we must clean up our resources
-    if (!VectorPush(vec, path, bitmap)) {
-        if (bitmap) DeleteObject(bitmap);
+static void EnumPipelineReceive(EnumResult *result)
+{
+    EnumPipeline *pipeline = &g_enumPipeline;
+    if (pipeline->cancel || !g_menuItems) {
+        EnumResultFree(result);
         return;
     }
 
-    // Caption without extension
-    WCHAR caption[MAX_PATH];
-    StringCchCopyW(caption, ARRAYSIZE(caption), fileName);
-    PWSTR ext = PathFindExtensionW(caption);
-    if (ext && ext > caption) {
-        *ext = L'\0';
+    DeleteMenu(result->job.menu, 0, MF_BYPOSITION);
+    PopulateFolder(result->job.menu, result->job.path, result->job.parent, &result->listing,
+                   result->job.depth, g_menuItems, pipeline, false);
+    EnumResultFree(result);
+}
+
+/**
+ * EnumPipelineStop – cancel the background enumeration (menu dismissed).
+ *
+ * Safe to call when no pipeline is running; the VisitedSet a synchronous
+ * walk kept for filling pages is freed then.  A worker still blocked in a
+ * listing after ENUM_STOP_WAIT_MS (a slow share) is abandoned, like a late
+ * cache sweep: its queue and g_enumVisited are then deliberately leaked.
+ */
+static void EnumPipelineStop(void)
+{
+    EnumPipeline *pipeline = &g_enumPipeline;
+    if (!pipeline->thread) {
+        if (!pipeline->abandoned) {
+            VisitedFree(&g_enumVisited);
+        }
+        return;
     }
 
-    // Prepare the MENUITEMINFO structure for a bitmap + submenu entry
-    MENUITEMINFOW itemInfo = { 0 };
-    itemInfo.cbSize     = sizeof(itemInfo);
-    itemInfo.fMask      = MIIM_ID | MIIM_STRING | MIIM_BITMAP;
-    itemInfo.wID        = commandId;
-    itemInfo.dwTypeData = caption;
-    itemInfo.hbmpItem   = bitmap;
+    AcquireSRWLockExclusive(&pipeline->lock);
+    InterlockedExchange(&pipeline->cancel, 1);
+    WakeConditionVariable(&pipeline->wake);
+    ReleaseSRWLockExclusive(&pipeline->lock);
 
-    InsertMenuItemW(parentMenu, commandId, FALSE, &itemInfo);
+    const bool joined = WaitForSingleObject(pipeline->thread, ENUM_STOP_WAIT_MS) == WAIT_OBJECT_0;
+    CloseHandle(pipeline->thread);
+    pipeline->thread = NULL;
+
+    // listings posted but never received
+    MSG msg;
+    while (PeekMessageW(&msg, pipeline->owner, WM_ENUM_LISTED, WM_ENUM_LISTED, PM_REMOVE)) {
+        EnumResultFree((EnumResult *)msg.lParam);
+    }
+
+    if (!joined) {
+        TraceF(L"enum: background listing abandoned");
+        pipeline->abandoned = true;
+        g_settingsInUse = true;
+        return;
+    }
+
+    EnumQueueFree(&pipeline->queue);
+    VisitedFree(&g_enumVisited);
 }
 
+
+/* -------------------------------------------------------------------------- */
+/* Window procedure                                                           */
+/* -------------------------------------------------------------------------- */
+
 /**
- * AddDirectoryItem – insert a submenu entry with icon and context help ID.
+ * SendToWndProc – window procedure for the hidden owner window.
  *
- * @param parentMenu    HMENU to append the new directory item.
- * @param directoryName Null-terminated wide string of the directory label.
- * @param bitmap        HBITMAP icon to display alongside the label.
- * @param subMenu       HMENU handle for the drop-down submenu.
- * @param helpId        DWORD context-help identifier for the submenu.
- * @return              void.
+ * Handles WM_INITMENUPOPUP to lazily resolve shell icons for file items
+ * just before each popup/submenu is displayed, avoiding the upfront cost
+ * of resolving all icons at enumeration time.  Only ICON_BUDGET_MS worth
+ * of icons is resolved before the popup appears; the rest are finished
+ * by the ICON_TIMER_ID timer while the popup is already visible.  The
+ * popup's items are found through the item vector's popup ranges, and the
+ * time until the popup can be shown is traced.
+ * WM_MEASUREITEM / WM_DRAWITEM draw the HBMMENU_CALLBACK item bitmaps
+ * from the icon atlas.  WM_ENUM_LISTED delivers subfolder listings from
+ * the background enumeration.  A leaf page of a large folder gets its
+ * items on its first WM_INITMENUPOPUP (MenuPagesFill).
+ *
+ * @param hwnd    Handle to the owner window.
+ * @param msg     Message identifier.
+ * @param wParam  Additional message information (HMENU for WM_INITMENUPOPUP).
+ * @param lParam  Additional message information.
+ * @return        Result of message processing; 0 for handled messages,
+ *                otherwise the result from DefWindowProcW.
  */
-static void AddDirectoryItem(
-    HMENU       parentMenu,
-    PCWSTR      directoryName,
-    HBITMAP     bitmap,
-    HMENU       subMenu,
-    UINT        helpId
-) {
-    // Prepare the MENUITEMINFO structure for a bitmap + submenu entry
-    MENUITEMINFOW itemInfo = { 0 };
-    itemInfo.cbSize      = sizeof(itemInfo);
-    itemInfo.fMask       = MIIM_SUBMENU | MIIM_STRING | MIIM_BITMAP;
-    itemInfo.hSubMenu    = subMenu;                 // the submenu that drops down
-    itemInfo.dwTypeData  = (LPWSTR)directoryName;   // display text
-    itemInfo.hbmpItem    = bitmap;                  // icon image (32-bit ARGB)
+static LRESULT CALLBACK SendToWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    switch (msg) {
+    case WM_INITMENUPOPUP: {
+        const LONGLONG start = QpcNow();
 
-    // Insert the menu item at the end of parentMenu
-    InsertMenuItemW(
-        parentMenu,
-        GetMenuItemCount(parentMenu),  // position = end
-        TRUE,                          // interpret wIDOrPosition as position
-        &itemInfo
-    );
+        // A page opened for the first time gets its items now
+        MenuPagesFill((HMENU)wParam);
 
-    // Associate a help/context-ID with the submenu itself
-    MENUINFO menuInfo        = { sizeof(menuInfo) };
-    menuInfo.fMask           = MIM_HELPID | MIM_STYLE; // we're setting dwContextHelpID
-    menuInfo.dwContextHelpID = helpId;                 // ID used to look up real path
-    menuInfo.dwStyle         = MNS_AUTODISMISS
-                               | MNS_NOTIFYBYPOS;
+        // A folder the user opens is listed next, ahead of the others
+        if (g_enumPipeline.thread) {
+            EnumPipelinePromote(&g_enumPipeline, (HMENU)wParam);
+        }
 
-    SetMenuInfo(subMenu, &menuInfo);
+        // Show loading cursor while shell icons are being resolved
+        HCURSOR hPrev = SetCursor(LoadCursor(NULL, IDC_APPSTARTING));
+
+        // Queue this popup's undecorated file items and resolve what fits
+        const UINT queued = PendingIconsQueueMenu((HMENU)wParam);
+        ResolvePendingIcons(ICON_BUDGET_MS, FALSE);
+
+        // Anything left over is finished while the popup is on screen
+        if (g_pendingIcons.count) {
+            SetTimer(hwnd, ICON_TIMER_ID, USER_TIMER_MINIMUM, NULL);
+        }
+
+        // Restore the cursor that was active before icon resolution
+        SetCursor(hPrev);
+
+        TraceF(L"popup: opened in %.2f ms (%u icons queued, %u pending)",
+               QpcElapsedMs(start), queued, g_pendingIcons.count);
+        return 0;
+    }
+
+    case WM_UNINITMENUPOPUP:
+        // Closed popups no longer need their icons right now
+        PendingIconsDropMenu((HMENU)wParam);
+        if (!g_pendingIcons.count) {
+            KillTimer(hwnd, ICON_TIMER_ID);
+        }
+        return 0;
+
+    case WM_MEASUREITEM: {
+        MEASUREITEMSTRUCT *mis = (MEASUREITEMSTRUCT *)lParam;
+        if (mis->CtlType != ODT_MENU) {
+            break;
+        }
+
+        int width, height;
+        IconPoolSize((IconId)mis->itemData, &width, &height);
+        mis->itemWidth  = (UINT)width;
+        mis->itemHeight = (UINT)height;
+        return TRUE;
+    }
+
+    case WM_DRAWITEM: {
+        const DRAWITEMSTRUCT *dis = (const DRAWITEMSTRUCT *)lParam;
+        if (dis->CtlType != ODT_MENU) {
+            break;
+        }
+
+        // centre the icon vertically in the bitmap area of the item
+        int width, height;
+        IconPoolSize((IconId)dis->itemData, &width, &height);
+        const int top = dis->rcItem.top + (dis->rcItem.bottom - dis->rcItem.top - height) / 2;
+        IconPoolDraw((IconId)dis->itemData, dis->hDC, dis->rcItem.left, top);
+        return TRUE;
+    }
+
+    case WM_ENUM_LISTED:
+        EnumPipelineReceive((EnumResult *)lParam);
+        return 0;
+
+    case WM_TIMER:
+        if (wParam != ICON_TIMER_ID) {
+            break;
+        }
+
+        ResolvePendingIcons(ICON_BUDGET_MS, TRUE);
+        if (!g_pendingIcons.count) {
+            KillTimer(hwnd, ICON_TIMER_ID);
+        }
+        return 0;
+    }
+
+    // Forward all unhandled messages to the default procedure
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
 }
 
+
+/* -------------------------------------------------------------------------- */
+/* Cache warm-up (/warm)                                                      */
+/* -------------------------------------------------------------------------- */
+
+/** Upper bound on warm-up worker threads. */
+#define WARM_MAX_THREADS 8
+
 /**
- * CompareFindData – qsort comparator for WIN32_FIND_DATAW entries.
+ * WarmItem – one menu item whose icon the warm-up has to resolve.
  *
- * Sorts directories before files; within each group, sorts by file name
- * using StrCmpLogicalW (natural ordering: file1, file2, file10).
+ * @member path         Heap-alloc'd absolute path.
+ * @member lastWrite    Last-write time from the enumeration.
+ * @member isDirectory  TRUE for folders (submenus).
+ * @member shell        TRUE if the icon needs a shell call of its own; other
+ *                      items share a per-extension icon via IconForItem.
+ * @member iconIndex    System image list index filled in by a worker
+ *                      (-1 until then, or on failure).
+ */
+typedef struct {
+    PWSTR    path;
+    FILETIME lastWrite;
+    bool     isDirectory;
+    bool     shell;
+    int      iconIndex;
+} WarmItem;
+
+/**
+ * WarmList – items collected from the SendTo tree plus the shared worker state.
  *
- * @param a  Pointer to first WIN32_FIND_DATAW.
- * @param b  Pointer to second WIN32_FIND_DATAW.
- * @return   Negative if a < b, zero if equal, positive if a > b.
+ * Workers only claim items (@next) and write the @iconIndex of the items
+ * they claimed; everything else stays on the main thread, since the icon
+ * pool, memos and cache are single-threaded.
+ *
+ * @member items       Heap array of items.
+ * @member count       Number of items.
+ * @member capacity    Allocated slots in @items.
+ * @member cached      Items skipped because the cache is already current.
+ * @member next        Index of the next item a worker claims.
+ * @member shellCalls  SHGetFileInfoW calls made by all workers.
  */
-static int CompareFindData(const void *a, const void *b)
-{
-    const WIN32_FIND_DATAW *fa = (const WIN32_FIND_DATAW *)a;
-    const WIN32_FIND_DATAW *fb = (const WIN32_FIND_DATAW *)b;
+typedef struct {
+    WarmItem      *items;
+    UINT          count;
+    UINT          capacity;
+    UINT          cached;
+    volatile LONG next;
+    volatile LONG shellCalls;
+} WarmList;
 
-    BOOL dirA = (fa->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-    BOOL dirB = (fb->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+/**
+ * WarmAdd – queue @path unless the cache already holds a current icon for it.
+ *
+ * @return  false on OOM.
+ */
+static bool WarmAdd(WarmList *list, PCWSTR path, const FILETIME *lastWrite, BOOL isDirectory)
+{
+    const IconCacheEntry *e = IconCacheFind(path, g_iconPixelSize);
+    if (e && e->blob && CompareFileTime(&e->lastWrite, lastWrite) == 0) {
+        list->cached++;
+        return true;
+    }
 
-    // directories come first
-    if (dirA != dirB) {
-        return dirB - dirA;
+    if (list->count >= list->capacity) {
+        UINT newCap = list->capacity ? list->capacity * 2 : 256;
+        WarmItem *tmp = realloc(list->items, newCap * sizeof *tmp);
+        if (!tmp) {
+            return false;
+        }
+        list->items    = tmp;
+        list->capacity = newCap;
+    }
+
+    WarmItem *item = &list->items[list->count];
+    item->path = _wcsdup(path);
+    if (!item->path) {
+        return false;
+    }
+    item->lastWrite   = *lastWrite;
+    item->isDirectory = isDirectory != FALSE;
+    item->iconIndex   = -1;
+
+    // mirror IconForItem: only extension-shared icons can skip the shell
+    PCWSTR ext = PathFindExtensionW(path);
+    if (isDirectory || !*ext || _wcsicmp(ext, L".lnk") == 0) {
+        item->shell = true;
+    } else {
+        const IconMemoEntry *entry = ExtensionMemoEntry(ext);
+        item->shell = !entry || entry->perInstance;
     }
 
-    return StrCmpLogicalW(fa->cFileName, fb->cFileName);
+    list->count++;
+    return true;
 }
 
 /**
- * EnumerateFolder – recursively enumerate a directory, sort the entries
- *                   alphabetically (directories first), and add them to a menu.
+ * WarmCollect – walk @directory the way EnumerateFolder does (same skip
+ *               rules, reparse policy, depth and per-folder limits) and
+ *               queue every item.
+ *               The time budget is not applied: warming is a batch job.
  *
- * Collects all valid entries into a temporary heap array, sorts with
- * StrCmpLogicalW for natural ordering, then processes them in order.
- *
- * @param menu        HMENU to which items and submenus will be added.
- * @param directory   Wide‐string path of the folder to enumerate.
- * @param nextCmdId   Pointer to the next command ID; incremented for each item.
- * @param depth       Current recursion depth; stops at MAX_DEPTH.
- * @param items       Pointer to a vector where (path, bitmap) pairs are stored.
- * @return            S_OK on success, or an HRESULT error code on failure.
+ * @return  false on OOM.
  */
-static HRESULT EnumerateFolder(
-    HMENU       menu,
-    PCWSTR      directory,
-    UINT        *nextCmdId,
-    UINT        depth,
-    MenuVector  *items
-) {
-    // Stop if we've reached maximum allowed depth
-    if (depth >= MAX_DEPTH) {
-        return S_OK;
+static bool WarmCollect(WarmList *list, PCWSTR directory, UINT depth)
+{
+    if (depth >= g_enumLimits.maxDepth) {
+        return true;
     }
 
-    // Build the search pattern "directory\\*"
-    WCHAR pattern[MAX_LOCAL_PATH];
-    if (!PathCombineW(pattern, directory, L"*")) {
-        return E_FAIL;
+    // Heap, not stack: this recurses once per folder level
+    PWSTR path = malloc(MAX_LOCAL_PATH * sizeof(WCHAR));
+    if (!path) {
+        return false;
+    }
+    if (!PathCombineW(path, directory, L"*")) {
+        free(path);
+        return true;
     }
 
-    // Begin file enumeration
     WIN32_FIND_DATAW findData;
     HANDLE hFind = FindFirstFileExW(
-        pattern,
+        path,
         FindExInfoBasic,
         &findData,
         FindExSearchNameMatch,
@@ -1172,94 +5338,410 @@ static HRESULT EnumerateFolder(
         FIND_FIRST_EX_LARGE_FETCH
     );
     if (hFind == INVALID_HANDLE_VALUE) {
-        return HRESULT_FROM_WIN32(GetLastError());
-    }
-
-    // --- Phase 1: collect all valid entries into a temporary heap array ---
-    UINT entryCount = 0;
-    UINT entryCapacity = 32;
-    WIN32_FIND_DATAW *entries = malloc(entryCapacity * sizeof *entries);
-    if (!entries) {
-        FindClose(hFind);
-        return E_OUTOFMEMORY;
+        free(path);
+        return true;
     }
 
+    bool ok = true;
+    UINT seen = 0;
     do {
         if (SkipEntry(&findData)) {
             continue;
         }
+        if (seen++ >= g_enumLimits.maxFolderEntries) {
+            break;
+        }
 
-        // grow array if needed
-        if (entryCount >= entryCapacity) {
-            UINT newCap = entryCapacity * 2;
-            WIN32_FIND_DATAW *tmp = realloc(entries, newCap * sizeof *tmp);
-            if (!tmp) {
-                break;  // process what we have so far
-            }
-            entries = tmp;
-            entryCapacity = newCap;
+        if (!PathCombineW(path, directory, findData.cFileName)) {
+            continue;
         }
 
-        entries[entryCount++] = findData;
-    } while (FindNextFileW(hFind, &findData));
+        const BOOL isDirectory = (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        if (isDirectory && !EnterDirectory(&g_enumVisited, path, findData.dwFileAttributes)) {
+            continue;
+        }
+        ok = WarmAdd(list, path, &findData.ftLastWriteTime, isDirectory) &&
+             (!isDirectory || WarmCollect(list, path, depth + 1));
+    } while (ok && FindNextFileW(hFind, &findData));
 
     FindClose(hFind);
+    free(path);
+    return ok;
+}
 
-    // --- Phase 2: sort — directories first, then alphabetical within each group ---
-    if (entryCount > 1) {
-        qsort(entries, entryCount, sizeof *entries, CompareFindData);
+/**
+ * WarmWorkerProc – thread body: resolve image list indices for claimed items.
+ */
+static DWORD WINAPI WarmWorkerProc(LPVOID param)
+{
+    WarmList *list = param;
+    const HRESULT hrCom = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
+
+    UINT shellCalls = 0;
+    for (;;) {
+        const UINT i = (UINT)InterlockedIncrement(&list->next) - 1;
+        if (i >= list->count) {
+            break;
+        }
+        if (list->items[i].shell) {
+            list->items[i].iconIndex = ShellIconIndex(list->items[i].path, &shellCalls);
+        }
     }
 
-    // --- Phase 3: add sorted entries to the menu and vector ---
-    for (UINT i = 0; i < entryCount; ++i) {
-        WIN32_FIND_DATAW *entry = &entries[i];
+    InterlockedExchangeAdd(&list->shellCalls, (LONG)shellCalls);
+    if (SUCCEEDED(hrCom)) {
+        CoUninitialize();
+    }
+    return 0;
+}
+
+/**
+ * WarmRunWorkers – run the shell calls for @list on up to WARM_MAX_THREADS
+ *                  threads (one per processor) and wait for them.
+ *
+ * @return  Number of threads used; 0 means the calls ran on this thread.
+ */
+static UINT WarmRunWorkers(WarmList *list)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    UINT wanted = si.dwNumberOfProcessors;
+    if (wanted > WARM_MAX_THREADS) wanted = WARM_MAX_THREADS;
+    if (wanted > list->count)      wanted = list->count;
+
+    HANDLE threads[WARM_MAX_THREADS];
+    UINT started = 0;
+    while (started < wanted) {
+        threads[started] = CreateThread(NULL, 0, WarmWorkerProc, list, 0, NULL);
+        if (!threads[started]) {
+            break;
+        }
+        started++;
+    }
+
+    if (started == 0) {
+        WarmWorkerProc(list);  // no threads: this thread already has COM
+    } else {
+        WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+        for (UINT t = 0; t < started; ++t) {
+            CloseHandle(threads[t]);
+        }
+    }
+    return started;
+}
 
-        // Build full child path
-        WCHAR childPath[MAX_LOCAL_PATH];
-        if (!PathCombineW(childPath, directory, entry->cFileName)) {
+/**
+ * WarmIconCache – resolve every icon of the SendTo tree into the cache file.
+ *
+ * Used by /warm to pre-build the cache for a deployment image, so the first
+ * launch on each desktop pays no shell calls.  The tree is collected on this
+ * thread, items whose cached icon is still current are skipped, and the
+ * shell calls run in parallel on worker threads; interning and storing
+ * stay on this thread.  Throughput is reported via TraceF.
+ *
+ * @param sendToDir  Root of the SendTo tree.
+ * @return           TRUE if the tree was walked and the cache saved.
+ */
+static BOOL WarmIconCache(PCWSTR sendToDir)
+{
+    const LONGLONG start = QpcNow();
+    WarmList list = { 0 };
+
+    VisitedReset(&g_enumVisited, sendToDir);
+    BOOL ok = WarmCollect(&list, sendToDir, 0);
+    VisitedFree(&g_enumVisited);
+    const UINT threads = ok ? WarmRunWorkers(&list) : 0;
+    g_iconStats.shellCalls += (UINT)list.shellCalls;
+
+    UINT resolved = 0;
+    for (UINT i = 0; ok && i < list.count; ++i) {
+        const WarmItem *item = &list.items[i];
+
+        IconId icon = item->shell ? ShellIconFromIndex(item->iconIndex) : 0;
+        if (!icon) {
+            icon = IconForItem(item->path, item->isDirectory);
+        }
+        if (!icon) {
             continue;
         }
 
-        if (entry->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            // For subdirectories, create a new submenu
-            HMENU subMenu = CreatePopupMenu();
-            if (!subMenu) {
-                continue;
-            }
+        DWORD  volume = 0;
+        UINT64 fileId = 0;
+        if (!GetFileIdentity(item->path, &volume, &fileId)) {
+            volume = 0;
+            fileId = 0;
+        }
+        IconCacheStore(item->path, icon, &item->lastWrite, volume, fileId);
+        IconPoolRelease(icon);
+        resolved++;
+    }
 
-            // Retrieve icon bitmap via unified cache-aware resolver
-            HBITMAP icon = CachedIconForItem(childPath);
+    if (ok) {
+        IconCacheSave();
+        ok = !g_iconCache.dirty;
+    }
 
-            // Store in vector first — if this fails, nothing was added to the
-            // menu yet so we can cleanly bail out without orphaning resources.
-            if (!VectorPush(items, childPath, icon)) {
-                if (icon) DeleteObject(icon);
-                DestroyMenu(subMenu);
-                continue;
-            }
+    const double ms = QpcElapsedMs(start);
+    TraceF(L"warm: %u icons resolved (%u already cached) in %.0f ms on %u threads, %.0f icons/s",
+           resolved, list.cached, ms, threads, ms > 0.0 ? 1000.0 * resolved / ms : 0.0);
 
-            // Insert directory item with icon and context-help ID
-            AddDirectoryItem(menu, entry->cFileName,
-                             icon, subMenu, *nextCmdId);
-            (*nextCmdId)++;
+    for (UINT i = 0; i < list.count; ++i) {
+        free(list.items[i].path);
+    }
+    free(list.items);
+    return ok;
+}
 
-            // Recurse into the subdirectory
-            EnumerateFolder(subMenu, childPath, nextCmdId, depth + 1, items);
-        } else {
-            // Icon resolved lazily in WM_INITMENUPOPUP via CachedIconForItem
-            HBITMAP icon = NULL;
+/* -------------------------------------------------------------------------- */
+/* Cache inspection (/cachestat)                                              */
+/* -------------------------------------------------------------------------- */
 
-            // For files, insert a regular file item
-            AddFileItem(menu, entry->cFileName, icon, (*nextCmdId)++,
-                        items, childPath);
+/** /cachestat modes: report only, or report and rewrite the journal. */
+#define CACHESTAT_REPORT  1
+#define CACHESTAT_COMPACT 2
+
+/** Entries not hit for this long count as idle (30 days, 100 ns units). */
+#define CACHESTAT_IDLE_AGE (30ull * 24 * 60 * 60 * 10000000)
+
+/**
+ * CacheReport – text of a /cachestat report, built line by line.
+ *
+ * @member text  Report text, lines separated by CRLF (truncated when full).
+ */
+typedef struct {
+    WCHAR text[8192];
+} CacheReport;
+
+/**
+ * CacheReportLine – append one printf-style line to @report (and the trace).
+ */
+static void CacheReportLine(CacheReport *report, PCWSTR format, ...)
+{
+    WCHAR line[512];
+    va_list args;
+    va_start(args, format);
+    StringCchVPrintfW(line, ARRAYSIZE(line), format, args);
+    va_end(args);
+
+    TraceF(L"cachestat: %s", line);
+
+    StringCchCatW(report->text, ARRAYSIZE(report->text), line);
+    StringCchCatW(report->text, ARRAYSIZE(report->text), L"\r\n");
+}
+
+/**
+ * CacheReportShow – write the report to stdout if it is redirected (so
+ *                   scripts can capture it), otherwise show a message box.
+ */
+static void CacheReportShow(const CacheReport *report)
+{
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (out && out != INVALID_HANDLE_VALUE) {
+        const int length = (int)wcslen(report->text);
+        const int bytes  = WideCharToMultiByte(CP_UTF8, 0, report->text, length, NULL, 0, NULL, NULL);
+        char *utf8 = bytes > 0 ? malloc(bytes) : NULL;
+        if (utf8) {
+            WideCharToMultiByte(CP_UTF8, 0, report->text, length, utf8, bytes, NULL, NULL);
+            const BOOL written = WriteAll(out, utf8, (DWORD)bytes);
+            free(utf8);
+            if (written) {
+                return;
+            }
         }
     }
 
-    free(entries);
+    MessageBoxW(NULL, report->text, L"SendTo+ cache", MB_OK | MB_ICONINFORMATION);
+}
+
+/**
+ * CompareBlobKey – qsort comparator over (blobHash, blobSize) pairs packed
+ *                  into a UINT64, for duplicate detection.
+ */
+static int CompareBlobKey(const void *a, const void *b)
+{
+    const UINT64 ka = *(const UINT64 *)a;
+    const UINT64 kb = *(const UINT64 *)b;
+    return (ka > kb) - (ka < kb);
+}
 
-    return S_OK;
+/**
+ * CacheStatHeader – describe the header of @cacheFile in @report.
+ *
+ * @return  TRUE if the file is missing or has this build's header.
+ */
+static BOOL CacheStatHeader(CacheReport *report, PCWSTR cacheFile)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attrs;
+    if (!GetFileAttributesExW(cacheFile, GetFileExInfoStandard, &attrs)) {
+        CacheReportLine(report, L"file:        %s (not present)", cacheFile);
+        return TRUE;
+    }
+
+    const UINT64 fileSize = ((UINT64)attrs.nFileSizeHigh << 32) | attrs.nFileSizeLow;
+    CacheReportLine(report, L"file:        %s, %I64u bytes", cacheFile, fileSize);
+
+    BYTE header[CACHE_HEADER_SIZE] = { 0 };
+    DWORD bytesRead = 0;
+    HANDLE hFile = CreateFileW(cacheFile, GENERIC_READ, CACHE_SHARE_MODE, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile != INVALID_HANDLE_VALUE) {
+        ReadFile(hFile, header, sizeof header, &bytesRead, NULL);
+        CloseHandle(hFile);
+    }
+
+    DWORD magic, version;
+    memcpy(&magic,   header,                sizeof magic);
+    memcpy(&version, header + sizeof magic, sizeof version);
+
+    if (IconCacheHeaderValid(header, bytesRead)) {
+        CacheReportLine(report, L"format:      v%u (current)", version);
+        return TRUE;
+    }
+    if (bytesRead >= 2 * sizeof(DWORD) && magic == CACHE_MAGIC && version == CACHE_PREVIOUS_VERSION) {
+        CacheReportLine(report, L"format:      v%u; compact (or the next save) converts it to v%u",
+                        version, CACHE_VERSION);
+    } else if (bytesRead >= 2 * sizeof(DWORD) && magic == CACHE_MAGIC && version != CACHE_VERSION) {
+        CacheReportLine(report, L"format:      v%u, too old to convert; compact resets it to an empty v%u "
+                        L"(its icons are resolved again)", version, CACHE_VERSION);
+    } else {
+        CacheReportLine(report, L"format:      not a SendTo+ cache, or a corrupt header");
+    }
+    return FALSE;
 }
 
+/**
+ * CacheStat – report on the cache file (entry counts, stale and corrupt
+ *             entries, duplicate pixel blobs, size breakdown) and, in
+ *             CACHESTAT_COMPACT mode, rewrite it without the dead weight.
+ *
+ * Inspects the per-user cache, or with /cache the shared file.  Every blob
+ * is checksummed and decoded, and every path is checked on disk, so this
+ * costs what the menu itself avoids – it is a maintenance command.
+ * Compacting drops corrupt entries and entries for missing files, applies
+ * the LRU budget and writes the journal in the current format: a
+ * CACHE_PREVIOUS_VERSION journal keeps its entries, an older one is reset.
+ *
+ * @param cacheFile  Path given with /cache, or NULL.
+ * @param mode       CACHESTAT_REPORT or CACHESTAT_COMPACT.
+ * @return           EXIT_SUCCESS if the file is healthy (or was compacted),
+ *                   EXIT_FAILURE otherwise.
+ */
+static int CacheStat(PCWSTR cacheFile, int mode)
+{
+    static CacheReport report;
+    report.text[0] = L'\0';
+
+    g_cacheFileOverride = cacheFile;
+    g_cacheWriteShared  = cacheFile != NULL;
+
+    WCHAR path[MAX_PATH];
+    if (!ResolveCacheFilePath(path)) {
+        ERR_BOX(L"Cannot resolve the icon cache path.");
+        return EXIT_FAILURE;
+    }
+
+    const BOOL headerOk = CacheStatHeader(&report, path);
+    IconCacheLoad();
+
+    UINT   corrupt = 0, missing = 0, stale = 0, idle = 0, packed = 0, duplicates = 0;
+    UINT64 pathBytes = 0, blobBytes = 0, rawBytes = 0, duplicateBytes = 0;
+    int    widths[8] = { 0 };
+    UINT   widthCounts[8] = { 0 };
+    const UINT64 now = IconCacheNow();
+
+    UINT64 *blobKeys = g_iconCache.count ? malloc(g_iconCache.count * sizeof *blobKeys) : NULL;
+    UINT keyCount = 0;
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        IconCacheEntry *e = &g_iconCache.entries[i];
+
+        pathBytes += (wcslen(e->path) + 1) * sizeof(WCHAR);
+        blobBytes += e->blobSize;
+        rawBytes  += (UINT64)e->width * e->height * 4;
+        packed    += e->blobSize != (DWORD)(e->width * e->height * 4);
+        idle      += now - e->lastHit > CACHESTAT_IDLE_AGE;
+
+        for (size_t w = 0; w < ARRAYSIZE(widths); ++w) {
+            if (widths[w] == e->width || widths[w] == 0) {
+                widths[w] = e->width;
+                widthCounts[w]++;
+                break;
+            }
+        }
+
+        if (!IconCacheVerifyBlob(e) || !IconCacheDecodePixels(e->blob, e->blobSize, e->width, e->height)) {
+            corrupt++;
+            free(e->blob);
+            e->blob = NULL;
+            continue;
+        }
+        if (blobKeys) {
+            blobKeys[keyCount++] = ((UINT64)e->blobHash << 32) | e->blobSize;
+        }
+
+        WIN32_FILE_ATTRIBUTE_DATA attrs;
+        if (!GetFileAttributesExW(e->path, GetFileExInfoStandard, &attrs)) {
+            const DWORD error = GetLastError();
+            if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) {
+                missing++;
+                free(e->blob);
+                e->blob = NULL;
+            }
+        } else if (CompareFileTime(&attrs.ftLastWriteTime, &e->lastWrite) != 0) {
+            stale++;
+        }
+    }
+
+    // identical pixel blobs stored more than once (same icon under many paths)
+    if (keyCount > 1) {
+        qsort(blobKeys, keyCount, sizeof *blobKeys, CompareBlobKey);
+        for (UINT i = 1; i < keyCount; ++i) {
+            if (blobKeys[i] == blobKeys[i - 1]) {
+                duplicates++;
+                duplicateBytes += (DWORD)blobKeys[i];
+            }
+        }
+    }
+    free(blobKeys);
+
+    const UINT dead = g_iconCache.fileRecords > g_iconCache.count ? g_iconCache.fileRecords - g_iconCache.count : 0;
+    CacheReportLine(&report, L"journal:     %u records, %u live entries, %u superseded%s",
+                    g_iconCache.fileRecords, g_iconCache.count, dead,
+                    g_iconCache.compact ? L" (load limit reached)" : L"");
+    CacheReportLine(&report, L"budget:      %u / %u entries, %I64u / %u blob bytes",
+                    g_iconCache.count, CACHE_MAX_ENTRIES, blobBytes, CACHE_MAX_BLOB_BYTES);
+    CacheReportLine(&report, L"bytes:       %I64u paths, %I64u pixels (%.0f%% of %I64u unpacked, %u of %u packed)",
+                    pathBytes, blobBytes, rawBytes ? 100.0 * (double)blobBytes / (double)rawBytes : 0.0,
+                    rawBytes, packed, g_iconCache.count);
+    for (size_t w = 0; w < ARRAYSIZE(widths) && widths[w]; ++w) {
+        CacheReportLine(&report, L"size %3d px: %u entries", widths[w], widthCounts[w]);
+    }
+    CacheReportLine(&report, L"duplicates:  %u blobs repeat an earlier one (%I64u bytes)", duplicates, duplicateBytes);
+    CacheReportLine(&report, L"stale:       %u changed on disk, %u missing, %u idle for 30+ days",
+                    stale, missing, idle);
+    CacheReportLine(&report, L"corrupt:     %u entries fail their checksum or decode", corrupt);
+
+    int exitCode = headerOk && corrupt == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (mode == CACHESTAT_COMPACT) {
+        IconCacheRemoveDropped();
+        g_iconCache.compact = true;
+        IconCacheSave();
+
+        WIN32_FILE_ATTRIBUTE_DATA attrs;
+        if (!g_iconCache.compact && GetFileAttributesExW(path, GetFileExInfoStandard, &attrs)) {
+            CacheReportLine(&report, L"compacted:   %u entries, %u bytes", g_iconCache.count, attrs.nFileSizeLow);
+            exitCode = EXIT_SUCCESS;
+        } else {
+            CacheReportLine(&report, L"compact failed");
+            exitCode = EXIT_FAILURE;
+        }
+    }
+
+    IconCacheDestroy();
+    CacheReportShow(&report);
+    return exitCode;
+}
 
 /* -------------------------------------------------------------------------- */
 /* IDataObject builder & drop helpers                                         */
@@ -1469,14 +5951,14 @@ static void ExecuteDropOperation(IDataObject *dataObj, IDropTarget *dropTarget)
 
 /**
  * ExecuteDragDrop - Perform a COM drag-and-drop of the files passed in argv[1…argc-1]
- *                   onto the target described by @entry.
+ *                   onto the target at @target.
  *
  * @param owner   HWND of the hidden owner window for COM calls.
- * @param entry   Pointer to the MenuEntry containing the target .path.
+ * @param target  Absolute path of the selected item.
  * @param argc    Argument count (program name + file paths).
  * @param argv    Array of PWSTR; argv[1…] are source file paths.
  */
-static void ExecuteDragDrop(HWND owner, const MenuEntry *entry, int argc, PWSTR *argv)
+static void ExecuteDragDrop(HWND owner, PCWSTR target, int argc, PWSTR *argv)
 {
     IDataObject *pDataObj    = NULL;
     IDropTarget *pDropTarget = NULL;
@@ -1496,7 +5978,7 @@ static void ExecuteDragDrop(HWND owner, const MenuEntry *entry, int argc, PWSTR
     // Retrieve the IDropTarget for the destination folder/link
     hr = GetShellInterfaceForPaths(
         owner,
-        (PCWSTR[]){ entry->path },  // address of the single target path
+        (PCWSTR[]){ target },       // address of the single target path
         1,                          // one drop target
         &IID_IDropTarget,
         (void**)&pDropTarget
@@ -1562,13 +6044,21 @@ failed:
  * Recognised switches:
  *   /D <dir>  – override the SendTo directory.
  *   /C        – enable persistent icon cache (sendto.cache).
+ *   /warm     – resolve every icon into the cache file, then exit.
+ *   /cache <file> – shared read-only cache layer; the file /warm writes.
+ *   /cachestat [compact] – report on (and optionally compact) the cache, then exit.
  *   /?  -?    – show usage and exit.
  *
  * @param  rawArgc      Argument count from CommandLineToArgvW().
  * @param  rawArgv      Argument vector from CommandLineToArgvW().
  * @param  outDir       Receives a malloc'd wide string if "/D <dir>" was supplied.
  *                      Caller must free() it when done.  May be NULL.
- * @param  outUseCache  Receives TRUE if "/C" was supplied.
+ * @param  outUseCache  Receives TRUE if "/C", "/warm" or "/cache" was supplied.
+ * @param  outWarm      Receives TRUE if "/warm" was supplied.
+ * @param  outCacheFile Receives a malloc'd wide string if "/cache <file>" was
+ *                      supplied.  Caller must free() it when done.
+ * @param  outCacheStat Receives CACHESTAT_REPORT or CACHESTAT_COMPACT if
+ *                      "/cachestat" was supplied, 0 otherwise.
  * @param  outArgc      Receives the new argument count.
  * @param  outArgv      Receives a malloc'd PWSTR[] of length outArgc:
  *                      [0] = rawArgv[0] (exe path)
@@ -1582,11 +6072,17 @@ static bool ParseCommandLine(
     PWSTR   *rawArgv,
     PWSTR   *outDir,
     bool    *outUseCache,
+    bool    *outWarm,
+    PWSTR   *outCacheFile,
+    int     *outCacheStat,
     int     *outArgc,
     PWSTR   **outArgv
 ) {
-    *outDir      = NULL;
-    *outUseCache = false;
+    *outDir       = NULL;
+    *outUseCache  = false;
+    *outWarm      = false;
+    *outCacheFile = NULL;
+    *outCacheStat = 0;
     *outArgc     = 1;                   // always keep exe @ index 0
     *outArgv     = NULL;
 
@@ -1605,9 +6101,14 @@ static bool ParseCommandLine(
 
         // help?
         if (_wcsicmp(param, L"/?")==0 || _wcsicmp(param, L"-?")==0) {
-            ERR_BOX(L"Usage: SendTo+ [/D <directory>] [/C] [<file1> <file2> ...]\n\n"
-                    L"  /D <dir>  Override the SendTo folder path.\n"
-                    L"  /C        Enable persistent icon cache.");
+            ERR_BOX(L"Usage: SendTo+ [/D <directory>] [/C] [/cache <file>] [<file1> <file2> ...]\n"
+                    L"       SendTo+ /warm [/D <directory>] [/cache <file>]\n"
+                    L"       SendTo+ /cachestat [compact] [/cache <file>]\n\n"
+                    L"  /D <dir>       Override the SendTo folder path.\n"
+                    L"  /C             Enable persistent icon cache.\n"
+                    L"  /warm          Resolve all icons into the cache file and exit.\n"
+                    L"  /cache <file>  Shared read-only cache layer (written by /warm).\n"
+                    L"  /cachestat     Report on the cache file; \"compact\" also rewrites it.");
             goto failed;
         }
 
@@ -1633,6 +6134,41 @@ static bool ParseCommandLine(
             continue;
         }
 
+        // pre-build the icon cache?
+        if (_wcsicmp(param, L"/warm")==0) {
+            *outUseCache = true;
+            *outWarm     = true;
+            continue;
+        }
+
+        // inspect the cache file?
+        if (_wcsicmp(param, L"/cachestat")==0) {
+            *outCacheStat = CACHESTAT_REPORT;
+            if (paramIndex + 1 < rawArgc && _wcsicmp(rawArgv[paramIndex + 1], L"compact")==0) {
+                *outCacheStat = CACHESTAT_COMPACT;
+                ++paramIndex;
+            }
+            continue;
+        }
+
+        // shared cache file?
+        if (_wcsicmp(param, L"/cache")==0) {
+            if (paramIndex + 1 < rawArgc) {
+                free(*outCacheFile);
+                *outCacheFile = _wcsdup(rawArgv[++paramIndex]);
+                if (!*outCacheFile) {
+                    goto failed;
+                }
+            } else {
+                ERR_BOX(L"Error: /cache requires a file path.\n"
+                        L"Usage: SendTo+ [/D <directory>] [/C] [/cache <file>] [<file1> <file2> ...]");
+                goto failed;
+            }
+
+            *outUseCache = true;
+            continue;
+        }
+
         // otherwise treat as file
         temp[(*outArgc)++] = param;
     }
@@ -1649,9 +6185,11 @@ static bool ParseCommandLine(
     return true;
 
 failed:
-    // clean up /D allocation if it was set before the error
+    // clean up /D and /cache allocations if they were set before the error
     free(*outDir);
     *outDir = NULL;
+    free(*outCacheFile);
+    *outCacheFile = NULL;
 
     free(temp);
     return false;
@@ -1709,29 +6247,52 @@ static BOOL ValidateSendToDirectory(PCWSTR path)
 /**
  * BuildSendToMenu – create popup menu and populate it from sendto folder.
  *
+ * With background enumeration (the default) only the root folder is
+ * listed here; subfolders are filled in by the EnumPipeline worker while
+ * the menu is already on screen.  A served menu snapshot replaces the
+ * listings altogether and is revalidated in the background instead.
+ *
  * @param sendToDir directory to enumerate.
+ * @param owner     window receiving the background listings.
  * @param outPopup  receives HMENU of created popup.
  * @param outItems  receives MenuVector of menu items.
  * @return TRUE on success; FALSE on failure.
  */
-static BOOL BuildSendToMenu(PCWSTR sendToDir, HMENU *outPopup, MenuVector *outItems)
+static BOOL BuildSendToMenu(PCWSTR sendToDir, HWND owner, HMENU *outPopup, MenuVector *outItems)
 {
     // create empty popup
     *outPopup = CreatePopupMenu();
     *outItems = (MenuVector){ 0 };
 
+    // item paths are rebuilt from the root and the stored names
+    outItems->root = _wcsdup(sendToDir);
+    if (!*outPopup || !outItems->root) {
+        ERR_BOX(L"Out of memory while building the menu.");
+        return FALSE;
+    }
+
     // pre-reserve capacity in one go to avoid repeated reallocs
     VectorEnsureCapacity(outItems, MENU_POOL_SIZE);
 
-    // recursively fill menu and items vector
-    UINT initialCmdId = 1; // start command IDs at 1
+    // fill menu and items vector (the root, or the whole tree), within g_enumLimits
+    g_enumStart = QpcNow();
+    VisitedReset(&g_enumVisited, sendToDir);
+    // folders a served snapshot has are filled from memory; the worker
+    // lists the rest
+    EnumPipeline *pipeline = g_enumLimits.background ? EnumPipelineStart(owner) : NULL;
     const HRESULT hr = EnumerateFolder(
         *outPopup,
         sendToDir,
-        &initialCmdId,     // pass address of a real variable
-        0,
-        outItems
+        outItems,
+        pipeline
     );
+    if (pipeline) {
+        EnumPipelineRun(pipeline, outItems->count);
+    }
+    // without a worker the set stays for MenuPagesFill until EnumPipelineStop
+    StartSnapshotRevalidation();
+    TraceF(L"enum: %u entries in %.2f ms%s", outItems->count,
+           QpcElapsedMs(g_enumStart), pipeline ? L", subfolders in background" : L"");
 
     if (FAILED(hr)) {
         ERR_BOX(L"Failed to enumerate the SendTo folder.");
@@ -1827,9 +6388,9 @@ static UINT DisplaySendToMenu(HMENU popup, HWND owner)
  * foreground via ActivateTargetWindow.
  *
  * @param owner  HWND of the hidden owner window (used as ShellExecute context).
- * @param item   Selected MenuEntry whose .path is the file/folder to open.
+ * @param target Absolute path of the selected file/folder to open.
  */
-static void HandleOpenTarget(HWND owner, const MenuEntry *item)
+static void HandleOpenTarget(HWND owner, PCWSTR target)
 {
     OutputDebugStringW(L"[SendTo+] no args: open folder/link\n");
 
@@ -1839,7 +6400,7 @@ static void HandleOpenTarget(HWND owner, const MenuEntry *item)
     SHELLEXECUTEINFOW sei  = { sizeof(sei) };
     sei.fMask  = SEE_MASK_NOCLOSEPROCESS | SEE_MASK_NOASYNC;
     sei.hwnd   = owner;
-    sei.lpFile = item->path;
+    sei.lpFile = target;
     sei.nShow  = SW_SHOWNORMAL;
 
     if (ShellExecuteExW(&sei) && sei.hProcess) {
@@ -1864,11 +6425,11 @@ static void HandleOpenTarget(HWND owner, const MenuEntry *item)
  * application and have it take the foreground.
  *
  * @param owner  HWND of the hidden owner window (used as COM context).
- * @param item   Selected MenuEntry whose .path is the drop-target folder/app.
+ * @param target Absolute path of the selected drop-target folder/app.
  * @param argc   Full argument count (argv[0] = exe, argv[1…] = source files).
  * @param argv   Argument vector; argv[1…argc-1] are the files to send.
  */
-static void HandleSendFiles(HWND owner, const MenuEntry *item, int argc, PWSTR *argv)
+static void HandleSendFiles(HWND owner, PCWSTR target, int argc, PWSTR *argv)
 {
     OutputDebugStringW(L"[SendTo+] with args: perform drag-and-drop\n");
 
@@ -1895,7 +6456,7 @@ static void HandleSendFiles(HWND owner, const MenuEntry *item, int argc, PWSTR *
     }
 
     // Perform the actual COM drag-and-drop operation
-    ExecuteDragDrop(owner, item, argc, argv);
+    ExecuteDragDrop(owner, target, argc, argv);
 
     // Pump messages briefly so the hook callback can fire.
     // The shell may need a moment to launch the target process and have it
@@ -1917,25 +6478,100 @@ static void HandleSendFiles(HWND owner, const MenuEntry *item, int argc, PWSTR *
     ForceWindowToForeground(g_dropForegroundHwnd);
 }
 
+/**
+ * SetupMenuSnapshot – decide how this run uses the menu snapshot of @root.
+ *
+ * Per g_snapshotPolicy, a fresh snapshot taken under the same settings is
+ * served (the menu appears without touching the share; a worker started
+ * by StartSnapshotRevalidation checks it afterwards).  Otherwise the
+ * listings of this run are captured and saved at exit.
+ */
+static void SetupMenuSnapshot(PCWSTR root)
+{
+    g_menuSnapshot = (MenuSnapshotState){ 0 };
+
+    const UINT use = g_snapshotPolicy.use;
+    if (use == SNAPSHOT_USE_NEVER || (use == SNAPSHOT_USE_NETWORK && !PathIsNetworkPathW(root))) {
+        return;
+    }
+
+    g_menuSnapshot.root = _wcsdup(root);
+    if (!g_menuSnapshot.root) {
+        return;
+    }
+
+    g_menuSnapshot.serving   = SnapshotLoad(root, g_snapshotPolicy.maxAgeMinutes, &g_menuSnapshot.loaded);
+    g_menuSnapshot.capturing = !g_menuSnapshot.serving;
+    TraceF(L"snapshot: %s", g_menuSnapshot.serving ? L"serving saved menu" : L"capturing");
+}
+
+/**
+ * TeardownMenuSnapshot – save a captured snapshot, or give a running
+ *                        revalidation SNAPSHOT_WAIT_MS to finish (it saves
+ *                        its own result); then release the state.
+ *
+ * A revalidation still running after that is cancelled and abandoned with
+ * its memory, like a late cache sweep; the next launch revalidates again.
+ */
+static void TeardownMenuSnapshot(void)
+{
+    if (g_menuSnapshot.capturing && g_menuSnapshot.captured.count) {
+        g_menuSnapshot.captured.savedAt = IconCacheNow();
+        SnapshotStampFromParents(&g_menuSnapshot.captured, g_menuSnapshot.root);
+        SnapshotSave(&g_menuSnapshot.captured, g_menuSnapshot.root);
+    }
+    SnapshotFree(&g_menuSnapshot.captured);
+
+    if (g_menuSnapshot.thread) {
+        const bool joined = WaitForSingleObject(g_menuSnapshot.thread, SNAPSHOT_WAIT_MS) == WAIT_OBJECT_0;
+        if (!joined) {
+            InterlockedExchange(&g_menuSnapshot.cancel, 1);
+        }
+        CloseHandle(g_menuSnapshot.thread);
+        g_menuSnapshot.thread = NULL;
+        if (!joined) {
+            TraceF(L"snapshot: revalidation abandoned");
+            g_settingsInUse = true;
+            return;
+        }
+    }
+
+    SnapshotFree(&g_menuSnapshot.loaded);
+    free(g_menuSnapshot.root);
+    g_menuSnapshot = (MenuSnapshotState){ 0 };
+}
+
 /**
  * SetupIconCache – apply the /C flag globally and load the cache file from disk.
  *
- * Centralises the two-step setup so RunSendTo stays at the orchestration level.
+ * Centralises the setup (load, then start the background sweep for deleted
+ * targets) so RunSendTo stays at the orchestration level.  The shared
+ * layer is mapped read-only next to the per-user cache, except under /warm,
+ * which builds the shared file itself.
  *
- * @param useCache  TRUE if the /C flag was passed on the command line.
+ * @param useCache   TRUE if the /C flag was passed on the command line.
+ * @param cacheFile  Shared cache path given with /cache, or NULL.
+ * @param warm       TRUE if /warm was passed.
  */
-static void SetupIconCache(bool useCache)
+static void SetupIconCache(bool useCache, PCWSTR cacheFile, bool warm)
 {
-    g_useCacheFlag = useCache;
+    g_useCacheFlag      = useCache;
+    g_cacheFileOverride = cacheFile;
+    g_cacheWriteShared  = warm;
     if (g_useCacheFlag) {
+        if (!warm) {
+            IconCacheSharedOpen();
+        }
         IconCacheLoad();
+        IconCacheStartSweep();
     }
 }
 
 /**
  * TeardownIconCache – persist any dirty cache entries to disk and free memory.
  *
- * No-op when caching is disabled (g_useCacheFlag == FALSE).
+ * No-op when caching is disabled (g_useCacheFlag == FALSE).  The shared
+ * layer is only unmapped.
  */
 static void TeardownIconCache(void)
 {
@@ -1945,6 +6581,52 @@ static void TeardownIconCache(void)
 
     IconCacheSave();
     IconCacheDestroy();
+    IconCacheSharedClose();
+}
+
+/**
+ * HitRatePercent – @hits as a percentage of @hits + @misses (0 when idle).
+ */
+static double HitRatePercent(UINT hits, UINT misses)
+{
+    const UINT total = hits + misses;
+    return total ? 100.0 * hits / total : 0.0;
+}
+
+/**
+ * TraceIconStats – dump g_iconStats and the icon pool usage through TraceF.
+ */
+static void TraceIconStats(void)
+{
+    TraceF(L"stats: %u shell icon calls, %u cache metadata calls, %u hits by file identity",
+           g_iconStats.shellCalls, g_iconStats.statCalls, g_iconStats.movedHits);
+    TraceF(L"stats: extension memo %u hits / %u misses (%.1f%%)",
+           g_iconStats.extHits, g_iconStats.extMisses,
+           HitRatePercent(g_iconStats.extHits, g_iconStats.extMisses));
+    TraceF(L"stats: link memo %u hits / %u misses (%.1f%%)",
+           g_iconStats.linkHits, g_iconStats.linkMisses,
+           HitRatePercent(g_iconStats.linkHits, g_iconStats.linkMisses));
+
+    // shared bytes vs. what one bitmap per reference would have cost
+    UINT   unique      = 0;
+    UINT   references  = 0;
+    size_t bytes       = 0;
+    size_t bytesShared = 0;
+    for (UINT i = 0; i < g_iconPool.count; ++i) {
+        const PooledIcon *icon = &g_iconPool.icons[i];
+        const size_t      size = (size_t)icon->width * icon->height * 4;
+        if (icon->refs) {
+            unique++;
+            references  += icon->refs;
+            bytes       += size;
+            bytesShared += size * icon->refs;
+        }
+    }
+
+    TraceF(L"stats: icon pool %u unique / %u references, %Iu bytes (%Iu unshared)",
+           unique, references, bytes, bytesShared);
+    TraceF(L"stats: icon atlas %u pages of %dx%d, %u cells",
+           g_iconPool.pageCount, ATLAS_PAGE_DIM, ATLAS_PAGE_DIM, g_iconPool.count);
 }
 
 /**
@@ -1955,12 +6637,23 @@ static void TeardownIconCache(void)
  */
 static void ShutdownApplication(void)
 {
-    // release the temporary DC used by DibFromIcon for icon rendering
+    // release the temporary DC used by IconFromHicon for icon rendering
     if (hdcIconCache) {
         DeleteDC(hdcIconCache);
         hdcIconCache = NULL;
     }
 
+    // drop memoized master bitmaps and the reusable ShellLink reader
+    IconMemoDestroy(&g_extensionMemo);
+    IconMemoDestroy(&g_linkMemo);
+    SAFE_RELEASE(g_shellLinkFile);
+    SAFE_RELEASE(g_shellLink);
+    SAFE_RELEASE(g_shellImageList);
+
+    // menu items and memos have released their references by now
+    IconPoolDestroy();
+    IconScratchDestroy();
+
     SAFE_RELEASE(desktopShellFolder);
     OleUninitialize();
 }
@@ -1983,16 +6676,32 @@ static int RunSendTo(HINSTANCE hInstance, int argc, PWSTR *argv)
     int cleanArgc        = 0;
     PWSTR *cleanArgv     = NULL;
     PWSTR sendToDir      = NULL;
+    PWSTR cacheFile      = NULL;
     bool useCache        = false;
+    bool warm            = false;
+    int cacheStat        = 0;
     HMENU popupMenu      = NULL;
     HWND owner           = NULL;
     MenuVector menuItems = { 0 };
 
-    if (!ParseCommandLine(argc, argv, &sendToDir, &useCache, &cleanArgc, &cleanArgv)) {
+    if (!ParseCommandLine(argc, argv, &sendToDir, &useCache, &warm, &cacheFile, &cacheStat, &cleanArgc, &cleanArgv)) {
+        goto cleanup;
+    }
+
+    // /cachestat: inspect (and optionally compact) the cache file, no menu
+    if (cacheStat) {
+        exitCode = CacheStat(cacheFile, cacheStat);
         goto cleanup;
     }
 
-    SetupIconCache(useCache);
+    LoadSettings();
+    SetupIconCache(useCache, cacheFile, warm);
+
+    // resolve icons at the size the monitor under the cursor needs
+    POINT cursor;
+    if (GetCursorPos(&cursor)) {
+        SetIconPixelSize(IconPixelSizeAt(cursor));
+    }
 
     if (!sendToDir) {
         sendToDir = ResolveSendToDirectory();
@@ -2002,37 +6711,62 @@ static int RunSendTo(HINSTANCE hInstance, int argc, PWSTR *argv)
         goto cleanup;
     }
 
-    // build popup menu and items
-    if (!BuildSendToMenu(sendToDir, &popupMenu, &menuItems)) {
+    // /warm: fill the cache file and exit without showing the menu
+    if (warm) {
+        exitCode = WarmIconCache(sendToDir) ? EXIT_SUCCESS : EXIT_FAILURE;
         goto cleanup;
     }
 
-    // create hidden owner window
+    // create hidden owner window (it also receives background listings)
     owner = CreateHiddenOwnerWindow(hInstance);
     if (!owner) {
         goto cleanup;
     }
 
+    // build popup menu and items (from the menu snapshot when one is served)
+    TraceMemory(L"before the menu");
+    SetupMenuSnapshot(sendToDir);
+    if (!BuildSendToMenu(sendToDir, owner, &popupMenu, &menuItems)) {
+        goto cleanup;
+    }
+    TraceMemory(L"menu built");
+
     // display menu and handle selection
     g_menuItems = &menuItems;
     UINT choice = DisplaySendToMenu(popupMenu, owner);
-    if (choice) {
-        MenuEntry *item = &menuItems.items[choice - 1];
 
+    // the menu is gone: stop filling it
+    EnumPipelineStop();
+    MenuPagesFree();
+    TraceF(L"items: %u in the menu", menuItems.count);
+    TraceMemory(L"menu closed");
+
+    // icons still queued when the menu closed are no longer needed
+    KillTimer(owner, ICON_TIMER_ID);
+    PendingIconsDestroy();
+    WCHAR target[MAX_LOCAL_PATH];
+    if (choice && choice <= menuItems.count &&
+        VectorItemPath(&menuItems, choice - 1, target, ARRAYSIZE(target))) {
         if (cleanArgc > 1) {
             // with args: perform drag-and-drop
-            HandleSendFiles(owner, item, cleanArgc, cleanArgv);
+            HandleSendFiles(owner, target, cleanArgc, cleanArgv);
         } else {
             // no args: open folder/link
-            HandleOpenTarget(owner, item);
+            HandleOpenTarget(owner, target);
         }
     }
 
     exitCode = EXIT_SUCCESS;
 
 cleanup:
+    EnumPipelineStop();
+    MenuPagesFree();
+    TeardownMenuSnapshot();
+    TraceIconStats();
+
     // persist icon cache to disk if it was modified
     TeardownIconCache();
+    FreeSettings();
 
     // destroy menu tree and item vector (safe even if never initialised)
     if (popupMenu) {
@@ -2040,8 +6774,9 @@ cleanup:
     }
     VectorDestroy(&menuItems);
 
-    // free heap-allocated argument data
+    // free heap-allocated argument data (the cache path is no longer in use)
     free(sendToDir);
+    free(cacheFile);
     free(cleanArgv);
 
     // destroy hidden owner window
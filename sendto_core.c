@@ -0,0 +1,2376 @@
+/*
+ * sendto_core.c – portable core of SendTo+ (see sendto_core.h)
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ * based on https://github.com/lifenjoiner/sendto-plus
+ */
+
+#include "sendto_core.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SENDTO_SSE2
+#include <emmintrin.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Hashing                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * IconMemoHash – case-insensitive FNV-1a hash of a memo key.
+ *
+ * @param key  Null-terminated wide string.
+ * @return     32-bit hash.
+ */
+UINT IconMemoHash(PCWSTR key)
+{
+    UINT hash = 2166136261u;
+    for (; *key; ++key) {
+        WCHAR ch = *key;
+        if (ch >= L'a' && ch <= L'z') {
+            ch = (WCHAR)(ch - L'a' + L'A');
+        }
+        hash = (hash ^ ch) * 16777619u;
+    }
+    return hash;
+}
+
+/** xxHash32 primes (CacheHash32). */
+#define CACHE_HASH_PRIME1 0x9E3779B1u
+#define CACHE_HASH_PRIME2 0x85EBCA77u
+#define CACHE_HASH_PRIME3 0xC2B2AE3Du
+#define CACHE_HASH_PRIME4 0x27D4EB2Fu
+#define CACHE_HASH_PRIME5 0x165667B1u
+#define CACHE_HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+/**
+ * CacheHashRead32 – unaligned little-endian 32-bit load.
+ */
+static UINT32 CacheHashRead32(const BYTE *p)
+{
+    UINT32 v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+/**
+ * CacheHashRound – one xxHash32 lane step.
+ */
+static UINT32 CacheHashRound(UINT32 acc, UINT32 lane)
+{
+    acc += lane * CACHE_HASH_PRIME2;
+    acc  = CACHE_HASH_ROTL(acc, 13);
+    return acc * CACHE_HASH_PRIME1;
+}
+
+/**
+ * CacheHash32 – xxHash32 of a byte range, the cache's integrity checksum.
+ *
+ * Non-cryptographic and fast: the bulk loop runs four independent lanes
+ * over 16-byte stripes, which keeps the multipliers busy and lets the
+ * compiler vectorise it.  Bit-compatible with the reference XXH32.
+ *
+ * @param data  Bytes to hash (no alignment required).
+ * @param size  Number of bytes.
+ * @param seed  Hash seed.
+ * @return      32-bit hash.
+ */
+UINT32 CacheHash32(const void *data, size_t size, UINT32 seed)
+{
+    const BYTE *p   = data;
+    const BYTE *end = p + size;
+    UINT32 h;
+
+    if (size >= 16) {
+        UINT32 v1 = seed + CACHE_HASH_PRIME1 + CACHE_HASH_PRIME2;
+        UINT32 v2 = seed + CACHE_HASH_PRIME2;
+        UINT32 v3 = seed;
+        UINT32 v4 = seed - CACHE_HASH_PRIME1;
+        for (; end - p >= 16; p += 16) {
+            v1 = CacheHashRound(v1, CacheHashRead32(p));
+            v2 = CacheHashRound(v2, CacheHashRead32(p + 4));
+            v3 = CacheHashRound(v3, CacheHashRead32(p + 8));
+            v4 = CacheHashRound(v4, CacheHashRead32(p + 12));
+        }
+        h = CACHE_HASH_ROTL(v1, 1) + CACHE_HASH_ROTL(v2, 7) + CACHE_HASH_ROTL(v3, 12) + CACHE_HASH_ROTL(v4, 18);
+    } else {
+        h = seed + CACHE_HASH_PRIME5;
+    }
+    h += (UINT32)size;
+
+    for (; end - p >= 4; p += 4) {
+        h += CacheHashRead32(p) * CACHE_HASH_PRIME3;
+        h  = CACHE_HASH_ROTL(h, 17) * CACHE_HASH_PRIME4;
+    }
+    for (; p < end; ++p) {
+        h += *p * CACHE_HASH_PRIME5;
+        h  = CACHE_HASH_ROTL(h, 11) * CACHE_HASH_PRIME1;
+    }
+
+    h ^= h >> 15;
+    h *= CACHE_HASH_PRIME2;
+    h ^= h >> 13;
+    h *= CACHE_HASH_PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Icon cache journal                                                         */
+/* -------------------------------------------------------------------------- */
+
+/** Global icon cache instance; only active when /C flag is passed. */
+IconCache g_iconCache = { 0 };
+
+/**
+ * IconCacheEnsureCapacity – make room for at least @need entries in g_iconCache.
+ *
+ * Mirrors the amortised-doubling strategy of VectorEnsureCapacity, starting
+ * at 128 slots when the cache is empty.
+ *
+ * @param need  Desired minimum capacity.
+ * @return      true on success, false on OOM (existing data is untouched).
+ */
+static bool IconCacheEnsureCapacity(UINT need)
+{
+    if (need <= g_iconCache.capacity) {
+        return true;
+    }
+
+    UINT newCap = g_iconCache.capacity ? g_iconCache.capacity * 2 : 128;
+    if (newCap < need) {
+        newCap = need;
+    }
+
+    IconCacheEntry *tmp = realloc(g_iconCache.entries, newCap * sizeof *tmp);
+    if (!tmp) {
+        return false;
+    }
+
+    ZeroMemory(tmp + g_iconCache.capacity,
+               (newCap - g_iconCache.capacity) * sizeof *tmp);
+
+    g_iconCache.entries  = tmp;
+    g_iconCache.capacity = newCap;
+
+    return true;
+}
+
+/**
+ * IconCacheKeyHash – hash of a (path, icon size) cache key.
+ */
+UINT IconCacheKeyHash(PCWSTR path, int size)
+{
+    return IconMemoHash(path) ^ ((UINT)size * 0x9E3779B1u);
+}
+
+/**
+ * IconCacheIdHash – hash of a (file identity, icon size) cache key.
+ */
+UINT IconCacheIdHash(DWORD volume, UINT64 fileId, int size)
+{
+    const UINT64 mixed = (fileId ^ ((UINT64)volume << 32)) * 0x9E3779B97F4A7C15ull;
+    return (UINT)(mixed >> 32) ^ ((UINT)size * 0x9E3779B1u);
+}
+
+/**
+ * IconCacheIndexSlot – place entry @i in one of the hash tables (linear probing).
+ *
+ * @param table  g_iconCache.index or g_iconCache.idIndex.
+ * @param hash   Key hash of entry @i for that table.
+ * @param i      Entry position.
+ */
+static void IconCacheIndexSlot(UINT *table, UINT hash, UINT i)
+{
+    UINT slot = hash & g_iconCache.indexMask;
+    while (table[slot]) {
+        slot = (slot + 1) & g_iconCache.indexMask;
+    }
+    table[slot] = i + 1;
+}
+
+/**
+ * IconCacheIndexEntry – add entry @i to the path table and, if it has a
+ *                       file identity, to the identity table.
+ */
+static void IconCacheIndexEntry(UINT i)
+{
+    const IconCacheEntry *e = &g_iconCache.entries[i];
+    IconCacheIndexSlot(g_iconCache.index, e->hash, i);
+    if (e->fileId) {
+        IconCacheIndexSlot(g_iconCache.idIndex, IconCacheIdHash(e->volume, e->fileId, e->width), i);
+    }
+}
+
+/**
+ * IconCacheRebuildIndex – rebuild both hash tables for the current entries,
+ *                         sized to stay at most half full.
+ *
+ * @return  true on success, false on OOM (the old tables are kept).
+ */
+bool IconCacheRebuildIndex(void)
+{
+    UINT size = 256;
+    while (size < g_iconCache.count * 2 + 2) {
+        size *= 2;
+    }
+
+    UINT *table   = calloc(size, sizeof *table);
+    UINT *idTable = calloc(size, sizeof *idTable);
+    if (!table || !idTable) {
+        free(table);
+        free(idTable);
+        return false;
+    }
+
+    free(g_iconCache.index);
+    free(g_iconCache.idIndex);
+    g_iconCache.index     = table;
+    g_iconCache.idIndex   = idTable;
+    g_iconCache.indexMask = size - 1;
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        IconCacheIndexEntry(i);
+    }
+    return true;
+}
+
+/**
+ * IconCacheFind – entry for (@path, @size), if any.
+ *
+ * @param path  Null-terminated wide string path (compared case-insensitively).
+ * @param size  Icon edge length in pixels.
+ * @return      Entry pointer, or NULL if that variant is not cached.
+ */
+IconCacheEntry *IconCacheFind(PCWSTR path, int size)
+{
+    if (!g_iconCache.indexMask) {
+        return NULL;
+    }
+
+    const UINT hash = IconCacheKeyHash(path, size);
+    for (UINT slot = hash & g_iconCache.indexMask; g_iconCache.index[slot];
+         slot = (slot + 1) & g_iconCache.indexMask) {
+        IconCacheEntry *e = &g_iconCache.entries[g_iconCache.index[slot] - 1];
+        if (e->hash == hash && e->width == size && _wcsicmp(e->path, path) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * IconCacheFindId – live entry for (@volume, @fileId, @size), if any.
+ *
+ * @param volume  Volume serial number.
+ * @param fileId  File index on that volume (must be non-zero).
+ * @param size    Icon edge length in pixels.
+ * @return        Entry pointer, or NULL if no variant of that file is cached.
+ */
+IconCacheEntry *IconCacheFindId(DWORD volume, UINT64 fileId, int size)
+{
+    if (!g_iconCache.indexMask) {
+        return NULL;
+    }
+
+    const UINT hash = IconCacheIdHash(volume, fileId, size);
+    for (UINT slot = hash & g_iconCache.indexMask; g_iconCache.idIndex[slot];
+         slot = (slot + 1) & g_iconCache.indexMask) {
+        IconCacheEntry *e = &g_iconCache.entries[g_iconCache.idIndex[slot] - 1];
+        if (e->fileId == fileId && e->volume == volume && e->width == size && e->blob) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * IconCacheAdd – append @entry (copied) and index it.
+ *
+ * @param entry  New entry; its @hash is filled in here.  The cache takes
+ *               over @path and @blob only on success.
+ * @return       The stored entry, or NULL on OOM (nothing is taken over).
+ */
+IconCacheEntry *IconCacheAdd(const IconCacheEntry *entry)
+{
+    if (!IconCacheEnsureCapacity(g_iconCache.count + 1)) {
+        return NULL;
+    }
+    if ((g_iconCache.count + 1) * 2 > g_iconCache.indexMask && !IconCacheRebuildIndex()) {
+        return NULL;
+    }
+
+    const UINT i = g_iconCache.count++;
+    IconCacheEntry *e = &g_iconCache.entries[i];
+    *e = *entry;
+    e->hash = IconCacheKeyHash(e->path, e->width);
+    IconCacheIndexEntry(i);
+
+    return e;
+}
+
+/**
+ * IconCacheCopyMoved – after a miss by path, copy the entry of the same file
+ *                      cached under another path (renamed or moved) to @path.
+ *
+ * A rename keeps the file identity and last-write time, so a match on both
+ * is the same content.  The entry is copied rather than re-keyed: a hard
+ * link may legitimately keep using the old path, and a truly stale old path
+ * is pruned by the background sweep.
+ *
+ * @param path       Path that missed.
+ * @param size       Icon edge length in pixels.
+ * @param lastWrite  Current last-write time of @path.
+ * @param volume     Volume serial number of @path.
+ * @param fileId     File index of @path.
+ * @return           The new (dirty) entry, or NULL if there is no match.
+ */
+IconCacheEntry *IconCacheCopyMoved(PCWSTR path, int size, const FILETIME *lastWrite,
+                                   DWORD volume, UINT64 fileId)
+{
+    IconCacheEntry *e = IconCacheFindId(volume, fileId, size);
+    if (!e || !e->blob || e->lastWrite.dwLowDateTime != lastWrite->dwLowDateTime ||
+        e->lastWrite.dwHighDateTime != lastWrite->dwHighDateTime || IconCacheFind(path, size)) {
+        return NULL;
+    }
+
+    IconCacheEntry copy = *e;
+    copy.path  = _wcsdup(path);
+    copy.blob  = malloc(e->blobSize);
+    copy.dirty = true;
+    if (!copy.path || !copy.blob) {
+        goto fail;
+    }
+    memcpy(copy.blob, e->blob, e->blobSize);
+
+    IconCacheEntry *added = IconCacheAdd(&copy);
+    if (!added) {
+        goto fail;
+    }
+    g_iconCache.dirty = true;
+    return added;
+
+fail:
+    free(copy.path);
+    free(copy.blob);
+    return NULL;
+}
+
+/**
+ * IconCacheParseLayout – IconCacheParseFields for either record layout.
+ *
+ * CACHE_PREVIOUS_VERSION records lack blobHash and metaHash; the remaining
+ * fields get the same range checks, and @out->blobHash is left 0.
+ *
+ * @param version  CACHE_VERSION or CACHE_PREVIOUS_VERSION.
+ */
+static BOOL IconCacheParseLayout(
+    const BYTE      *data,
+    DWORD           size,
+    DWORD           version,
+    IconCacheEntry  *out,
+    const BYTE      **outPath,
+    DWORD           *outPathLen,
+    const BYTE      **outBlob
+) {
+    const bool current = version == CACHE_VERSION;
+    UINT32 metaHash;
+    const DWORD fixedTail = sizeof out->volume + sizeof out->fileId + sizeof out->lastWrite +
+                            sizeof out->lastHit + sizeof out->width + sizeof out->height + sizeof out->blobSize +
+                            (current ? sizeof out->blobHash + sizeof metaHash : 0);
+    DWORD pathLen, offset = 0;
+
+    ZeroMemory(out, sizeof *out);
+
+    if (size < sizeof pathLen) return FALSE;
+    memcpy(&pathLen, data, sizeof pathLen);
+    offset += sizeof pathLen;
+
+    if (pathLen == 0 || pathLen > MAX_PATH) return FALSE;
+    if (size - offset < pathLen * sizeof(WCHAR) + fixedTail) return FALSE;
+
+    WCHAR terminator;
+    memcpy(&terminator, data + offset + (pathLen - 1) * sizeof(WCHAR), sizeof terminator);
+    if (terminator != L'\0') return FALSE;
+    const BYTE *path = data + offset;
+    offset += pathLen * sizeof(WCHAR);
+
+    memcpy(&out->volume, data + offset, sizeof out->volume);
+    offset += sizeof out->volume;
+    memcpy(&out->fileId, data + offset, sizeof out->fileId);
+    offset += sizeof out->fileId;
+    memcpy(&out->lastWrite, data + offset, sizeof out->lastWrite);
+    offset += sizeof out->lastWrite;
+    memcpy(&out->lastHit, data + offset, sizeof out->lastHit);
+    offset += sizeof out->lastHit;
+    memcpy(&out->width, data + offset, sizeof out->width);
+    offset += sizeof out->width;
+    memcpy(&out->height, data + offset, sizeof out->height);
+    offset += sizeof out->height;
+    memcpy(&out->blobSize, data + offset, sizeof out->blobSize);
+    offset += sizeof out->blobSize;
+    if (current) {
+        memcpy(&out->blobHash, data + offset, sizeof out->blobHash);
+        offset += sizeof out->blobHash;
+        memcpy(&metaHash, data + offset, sizeof metaHash);
+        if (CacheHash32(data, offset, 0) != metaHash) return FALSE;
+        offset += sizeof metaHash;
+    }
+
+    if (out->width <= 0 || out->height <= 0 || out->width > 256 || out->height > 256) return FALSE;
+    if (out->blobSize == 0 || out->blobSize > (DWORD)(out->width * out->height * 4)) return FALSE;
+    if (size - offset != out->blobSize) return FALSE;
+
+    *outPath    = path;
+    *outPathLen = pathLen;
+    *outBlob    = data + offset;
+    return TRUE;
+}
+
+/**
+ * IconCacheParseFields – validate one journal record payload in place.
+ *
+ * Layout: pathLen (WCHARs incl. null), path, volume, fileId, lastWrite,
+ * lastHit, width, height, blobSize, blobHash, metaHash, blob.  Every field
+ * is range-checked against @size, so a torn or corrupt record is rejected
+ * instead of read past, and metaHash (CacheHash32 of everything before it)
+ * catches corruption the range checks cannot.  The blob is not hashed
+ * here: its blobHash is verified lazily, when the icon is first served.
+ *
+ * @param data     Record payload (after the size prefix).
+ * @param size     Payload size in bytes.
+ * @param out      Receives the scalar fields; @out->path and @out->blob
+ *                 stay NULL.
+ * @param outPath  Receives a pointer to the (possibly unaligned) path
+ *                 inside @data, @outPathLen WCHARs including the null.
+ * @param outBlob  Receives a pointer to the blob inside @data.
+ * @return         TRUE if the record is well-formed.
+ */
+BOOL IconCacheParseFields(
+    const BYTE      *data,
+    DWORD           size,
+    IconCacheEntry  *out,
+    const BYTE      **outPath,
+    DWORD           *outPathLen,
+    const BYTE      **outBlob
+) {
+    return IconCacheParseLayout(data, size, CACHE_VERSION, out, outPath, outPathLen, outBlob);
+}
+
+/**
+ * IconCacheParseRecord – decode one journal record payload into @out.
+ *
+ * @param data     Record payload (after the size prefix).
+ * @param size     Payload size in bytes.
+ * @param version  Layout of the record (see IconCacheParseLayout).  A
+ *                 CACHE_PREVIOUS_VERSION blob has no stored checksum, so
+ *                 its blobHash is computed here and it counts as verified.
+ * @param out      Receives the entry; @out->path and @out->blob are
+ *                 heap-allocated on success.
+ * @return         TRUE if the record is well-formed.
+ */
+static BOOL IconCacheParseRecord(const BYTE *data, DWORD size, DWORD version, IconCacheEntry *out)
+{
+    const BYTE *path, *blob;
+    DWORD pathLen;
+    if (!IconCacheParseLayout(data, size, version, out, &path, &pathLen, &blob)) {
+        return FALSE;
+    }
+
+    out->path = malloc(pathLen * sizeof(WCHAR));
+    out->blob = malloc(out->blobSize);
+    if (!out->path || !out->blob) {
+        free(out->path);
+        free(out->blob);
+        return FALSE;
+    }
+    memcpy(out->path, path, pathLen * sizeof(WCHAR));
+    memcpy(out->blob, blob, out->blobSize);
+
+    if (version != CACHE_VERSION) {
+        out->blobHash = CacheHash32(out->blob, out->blobSize, 0);
+        out->verified = true;
+    }
+    return TRUE;
+}
+
+/**
+ * IconCacheReplay – apply a parsed record: later records for the same path
+ *                   supersede earlier ones, except that an entry changed in
+ *                   this process (dirty) wins over records from elsewhere –
+ *                   it is about to be appended after them anyway.
+ *
+ * @param record  Parsed entry; ownership of its path and blob moves into
+ *                the cache.
+ * @return        TRUE on success, FALSE on OOM (path and blob are freed).
+ */
+static BOOL IconCacheReplay(IconCacheEntry *record)
+{
+    IconCacheEntry *e = IconCacheFind(record->path, record->width);
+    if (e) {
+        if (e->dirty) {
+            free(record->path);
+            free(record->blob);
+        } else {
+            const BOOL moved = e->volume != record->volume || e->fileId != record->fileId;
+            free(record->path);
+            record->path = e->path;
+            record->hash = e->hash;
+            free(e->blob);
+            *e = *record;
+            if (moved) {
+                IconCacheRebuildIndex();
+            }
+        }
+        return TRUE;
+    }
+
+    if (!IconCacheAdd(record)) {
+        free(record->path);
+        free(record->blob);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * IconCacheReplayLayout – IconCacheReplayRecords for either record layout
+ *                         (see IconCacheParseLayout).
+ */
+static DWORD IconCacheReplayLayout(const BYTE *data, DWORD size, DWORD offset, DWORD version)
+{
+    for (;;) {
+        DWORD recordSize;
+        if (size - offset < sizeof recordSize) break;
+        memcpy(&recordSize, data + offset, sizeof recordSize);
+        if (recordSize > size - offset - sizeof recordSize) break;  // torn tail
+
+        const BYTE *payload = data + offset + sizeof recordSize;
+        IconCacheEntry record;
+        if (g_iconCache.count >= CACHE_MAX_LOAD_ENTRIES) {
+            const BYTE *pathBytes, *blob;
+            DWORD pathLen;
+            WCHAR path[MAX_PATH];
+            if (!IconCacheParseLayout(payload, recordSize, version, &record, &pathBytes, &pathLen, &blob)) break;
+
+            memcpy(path, pathBytes, pathLen * sizeof(WCHAR));
+            if (!IconCacheFind(path, record.width)) {
+                g_iconCache.compact = true;
+                offset += sizeof recordSize + recordSize;
+                g_iconCache.fileRecords++;
+                continue;
+            }
+        }
+
+        if (!IconCacheParseRecord(payload, recordSize, version, &record)) break;
+        if (!IconCacheReplay(&record)) break;
+
+        offset += sizeof recordSize + recordSize;
+        g_iconCache.fileRecords++;
+    }
+
+    return offset;
+}
+
+/**
+ * IconCacheReplayRecords – replay the journal records in a byte range.
+ *
+ * Replay stops at the first record that is truncated or malformed: the torn
+ * tail of an interrupted append, or one still being written by another
+ * instance.  Allocations are bounded by the data itself: a record only
+ * allocates what it contains, and once CACHE_MAX_LOAD_ENTRIES entries
+ * exist, records for new keys are validated in place and stepped over
+ * (so @fileEnd still lands past them) instead of being materialised.
+ *
+ * @param data    Journal bytes.
+ * @param size    Number of bytes in @data.
+ * @param offset  Offset of the first record within @data.
+ * @return        Offset just past the last good record.
+ */
+DWORD IconCacheReplayRecords(const BYTE *data, DWORD size, DWORD offset)
+{
+    return IconCacheReplayLayout(data, size, offset, CACHE_VERSION);
+}
+
+/**
+ * IconCacheConvertPrevious – replay a CACHE_PREVIOUS_VERSION journal, so
+ *                            the next save rewrites its entries in this
+ *                            build's format instead of dropping them.
+ *
+ * The records replay as IconCacheReplayRecords does; afterwards every
+ * entry is marked dirty.  @fileEnd is left alone: the file still has the
+ * old header, so it can only be replaced (compacted), never appended to.
+ * Older versions than this are not read; their icons are resolved again.
+ *
+ * @param data  Journal bytes, from the header on.
+ * @param size  Number of bytes in @data.
+ * @return      Offset just past the last good record, or 0 if @data is
+ *              not a CACHE_PREVIOUS_VERSION journal.
+ */
+DWORD IconCacheConvertPrevious(const BYTE *data, DWORD size)
+{
+    const DWORD header[2] = { CACHE_MAGIC, CACHE_PREVIOUS_VERSION };
+    if (size < CACHE_PREVIOUS_HEADER_SIZE || memcmp(data, header, sizeof header) != 0) {
+        return 0;
+    }
+
+    const DWORD end = IconCacheReplayLayout(data, size, CACHE_PREVIOUS_HEADER_SIZE, CACHE_PREVIOUS_VERSION);
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        g_iconCache.entries[i].dirty = true;
+    }
+    g_iconCache.dirty = g_iconCache.count > 0;
+    return end;
+}
+
+/**
+ * IconCacheHeader – fill @header with this build's journal header.
+ */
+void IconCacheHeader(DWORD header[CACHE_HEADER_SIZE / sizeof(DWORD)])
+{
+    header[0] = CACHE_MAGIC;
+    header[1] = CACHE_VERSION;
+    header[2] = CacheHash32(header, 2 * sizeof(DWORD), 0);
+}
+
+/**
+ * IconCacheHeaderValid – TRUE if @data starts with this build's journal header.
+ */
+BOOL IconCacheHeaderValid(const BYTE *data, DWORD size)
+{
+    DWORD header[CACHE_HEADER_SIZE / sizeof(DWORD)];
+    if (size < CACHE_HEADER_SIZE) {
+        return FALSE;
+    }
+
+    IconCacheHeader(header);
+    return memcmp(data, header, CACHE_HEADER_SIZE) == 0;
+}
+
+/**
+ * IconCacheMergeOffset – where a writer holding the lock resumes reading
+ *                        the journal to pick up other instances' appends.
+ *
+ * @param size      Current size of the journal.
+ * @param sameFile  The journal is still the file @fileEnd refers to (not
+ *                  replaced by a compaction since).
+ * @return          @fileEnd if only the bytes past it are new, or 0 if the
+ *                  file must be re-read from its header.
+ */
+DWORD IconCacheMergeOffset(DWORD size, bool sameFile)
+{
+    const bool known = g_iconCache.fileEnd && sameFile && size >= g_iconCache.fileEnd;
+    return known ? (DWORD)g_iconCache.fileEnd : 0;
+}
+
+/**
+ * IconCacheMergeRecords – replay journal bytes read from IconCacheMergeOffset
+ *                         on, leaving @fileEnd just past the last good record.
+ *
+ * @param data   Bytes [@start, @size) of the journal.
+ * @param size   Size of the journal.
+ * @param start  IconCacheMergeOffset; 0 means @data is the whole file and
+ *               @fileRecords is recounted.
+ * @return       FALSE if a whole file does not start with this build's header.
+ */
+BOOL IconCacheMergeRecords(const BYTE *data, DWORD size, DWORD start)
+{
+    if (!start) {
+        if (!IconCacheHeaderValid(data, size)) {
+            return FALSE;
+        }
+        g_iconCache.fileRecords = 0;
+        g_iconCache.fileEnd = IconCacheReplayRecords(data, size, CACHE_HEADER_SIZE);
+    } else {
+        g_iconCache.fileEnd = start + IconCacheReplayRecords(data, size - start, 0);
+    }
+    return TRUE;
+}
+
+/**
+ * IconCacheEncodeRecord – serialise one entry as a journal record.
+ *
+ * The record is the size prefix followed by the payload IconCacheParseFields
+ * reads back, so a writer can issue it as a single write and a crash leaves
+ * at most one torn record at the tail.
+ *
+ * @param e        Entry to encode (must have a blob).
+ * @param outSize  Receives the record size in bytes.
+ * @return         Heap-allocated record (free it), or NULL on OOM.
+ */
+BYTE *IconCacheEncodeRecord(const IconCacheEntry *e, DWORD *outSize)
+{
+    const DWORD pathLen = (DWORD)(wcslen(e->path) + 1);
+    UINT32 metaHash;
+    const DWORD payload = sizeof pathLen + pathLen * sizeof(WCHAR) + sizeof e->volume + sizeof e->fileId +
+                          sizeof e->lastWrite + sizeof e->lastHit + sizeof e->width + sizeof e->height +
+                          sizeof e->blobSize + sizeof e->blobHash + sizeof metaHash + e->blobSize;
+    const DWORD total   = sizeof payload + payload;
+
+    BYTE *record = malloc(total);
+    if (!record) {
+        return NULL;
+    }
+
+    BYTE *p = record;
+    memcpy(p, &payload,      sizeof payload);           p += sizeof payload;
+    memcpy(p, &pathLen,      sizeof pathLen);           p += sizeof pathLen;
+    memcpy(p, e->path,       pathLen * sizeof(WCHAR));  p += pathLen * sizeof(WCHAR);
+    memcpy(p, &e->volume,    sizeof e->volume);         p += sizeof e->volume;
+    memcpy(p, &e->fileId,    sizeof e->fileId);         p += sizeof e->fileId;
+    memcpy(p, &e->lastWrite, sizeof e->lastWrite);      p += sizeof e->lastWrite;
+    memcpy(p, &e->lastHit,   sizeof e->lastHit);        p += sizeof e->lastHit;
+    memcpy(p, &e->width,     sizeof e->width);          p += sizeof e->width;
+    memcpy(p, &e->height,    sizeof e->height);         p += sizeof e->height;
+    memcpy(p, &e->blobSize,  sizeof e->blobSize);       p += sizeof e->blobSize;
+    memcpy(p, &e->blobHash,  sizeof e->blobHash);       p += sizeof e->blobHash;
+    metaHash = CacheHash32(record + sizeof payload, (size_t)(p - record) - sizeof payload, 0);
+    memcpy(p, &metaHash,     sizeof metaHash);          p += sizeof metaHash;
+    memcpy(p, e->blob,       e->blobSize);
+
+    *outSize = total;
+    return record;
+}
+
+/**
+ * IconCacheRemoveDropped – compact g_iconCache, removing entries whose blob
+ *                          was freed by pruning or eviction.
+ */
+void IconCacheRemoveDropped(void)
+{
+    UINT kept = 0;
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        if (g_iconCache.entries[i].blob) {
+            g_iconCache.entries[kept++] = g_iconCache.entries[i];
+        } else {
+            free(g_iconCache.entries[i].path);
+        }
+    }
+
+    ZeroMemory(g_iconCache.entries + kept, (g_iconCache.count - kept) * sizeof *g_iconCache.entries);
+    g_iconCache.count = kept;
+
+    // positions moved; on OOM drop the index (lookups miss until the next add)
+    if (!IconCacheRebuildIndex()) {
+        free(g_iconCache.index);
+        free(g_iconCache.idIndex);
+        g_iconCache.index     = NULL;
+        g_iconCache.idIndex   = NULL;
+        g_iconCache.indexMask = 0;
+    }
+}
+
+/**
+ * IconCachePruneMissing – drop entries a sweep found to be gone.
+ *
+ * The sweep ran over a snapshot of the entry paths; an entry is only
+ * dropped if it still sits at the same position with the same path and
+ * was not refreshed since.  Dropped entries keep their slot (blob NULL)
+ * until IconCacheRemoveDropped.
+ *
+ * @param paths    Entry paths at the time the sweep started.
+ * @param missing  Per path: non-zero if the file is known to be gone.
+ * @param count    Number of @paths.
+ * @return         Number of entries dropped.
+ */
+UINT IconCachePruneMissing(const PCWSTR *paths, const BYTE *missing, UINT count)
+{
+    UINT pruned = 0;
+
+    for (UINT i = 0; i < count && i < g_iconCache.count; ++i) {
+        IconCacheEntry *e = &g_iconCache.entries[i];
+        if (missing[i] && !e->dirty && e->blob &&
+            _wcsicmp(e->path, paths[i]) == 0) {
+            free(e->blob);
+            e->blob = NULL;
+            pruned++;
+        }
+    }
+
+    return pruned;
+}
+
+/**
+ * CompareLastHit – qsort comparator: least recently hit entry first.
+ */
+static int CompareLastHit(const void *a, const void *b)
+{
+    const IconCacheEntry *ea = *(const IconCacheEntry * const *)a;
+    const IconCacheEntry *eb = *(const IconCacheEntry * const *)b;
+    return (ea->lastHit > eb->lastHit) - (ea->lastHit < eb->lastHit);
+}
+
+/**
+ * IconCacheEvictLru – drop least-recently-hit entries until the cache fits
+ *                     the budget (CACHE_MAX_ENTRIES and CACHE_MAX_BLOB_BYTES).
+ *
+ * @param maxEntries  Live entries to keep at most.
+ * @param maxBytes    Blob bytes to keep at most.
+ * @return            Number of entries dropped.
+ */
+UINT IconCacheEvictLru(UINT maxEntries, UINT64 maxBytes)
+{
+    UINT64 bytes = 0;
+    UINT   live  = 0;
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        if (g_iconCache.entries[i].blob) {
+            bytes += g_iconCache.entries[i].blobSize;
+            live++;
+        }
+    }
+
+    if (live <= maxEntries && bytes <= maxBytes) {
+        return 0;
+    }
+
+    IconCacheEntry **order = malloc(live * sizeof *order);
+    if (!order) {
+        return 0;
+    }
+
+    UINT n = 0;
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        if (g_iconCache.entries[i].blob) {
+            order[n++] = &g_iconCache.entries[i];
+        }
+    }
+    qsort(order, n, sizeof *order, CompareLastHit);
+
+    UINT evicted = 0;
+    for (UINT i = 0; i < n && (live - evicted > maxEntries || bytes > maxBytes); ++i) {
+        bytes -= order[i]->blobSize;
+        free(order[i]->blob);
+        order[i]->blob = NULL;
+        evicted++;
+    }
+
+    free(order);
+    return evicted;
+}
+
+/**
+ * IconCacheFree – free every entry and index of g_iconCache and reset it.
+ */
+void IconCacheFree(void)
+{
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        free(g_iconCache.entries[i].path);
+        free(g_iconCache.entries[i].blob);
+    }
+    free(g_iconCache.entries);
+    free(g_iconCache.index);
+    free(g_iconCache.idIndex);
+    ZeroMemory(&g_iconCache, sizeof g_iconCache);
+}
+
+
+/**
+ * IconCacheVerifyBlob – check @e's blob against its blobHash, once.
+ *
+ * @return  TRUE if the blob is intact (or was stored by this process).
+ */
+BOOL IconCacheVerifyBlob(IconCacheEntry *e)
+{
+    if (!e->verified) {
+        if (CacheHash32(e->blob, e->blobSize, 0) != e->blobHash) {
+            return FALSE;
+        }
+        e->verified = true;
+    }
+    return TRUE;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Enumeration limits                                                         */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * ClampSetting – clamp a setting read from sendto.ini to [@low, @high].
+ */
+UINT ClampSetting(INT value, UINT low, UINT high)
+{
+    if (value < (INT)low)  return low;
+    if (value > (INT)high) return high;
+    return (UINT)value;
+}
+
+/**
+ * EnumLimitsLoad – read the [Enumeration] section into @limits, clamping
+ *                  every value to its cap; unset keys keep the defaults.
+ *
+ * @param limits   Limits to fill.
+ * @param read     Reads one integer setting.
+ * @param context  Passed through to @read (the ini file on Windows).
+ */
+void EnumLimitsLoad(EnumLimits *limits, SettingReader read, const void *context)
+{
+    limits->maxDepth         = ClampSetting(read(L"Enumeration", L"MaxDepth", MAX_DEPTH, context),
+                                            1, ENUM_MAX_DEPTH_CAP);
+    limits->maxFolderEntries = ClampSetting(read(L"Enumeration", L"MaxFolderEntries", ENUM_FOLDER_ENTRIES, context),
+                                            1, ENUM_FOLDER_ENTRIES_CAP);
+    limits->maxTotalEntries  = ClampSetting(read(L"Enumeration", L"MaxTotalEntries", ENUM_TOTAL_ENTRIES, context),
+                                            1, ENUM_TOTAL_ENTRIES_CAP);
+    limits->budgetMs         = ClampSetting(read(L"Enumeration", L"BudgetMs", ENUM_BUDGET_MS, context),
+                                            ENUM_BUDGET_MS_MIN, ENUM_BUDGET_MS_CAP);
+    limits->followReparse    = ClampSetting(read(L"Enumeration", L"FollowReparsePoints", 1, context), 0, 1) != 0;
+    limits->background       = ClampSetting(read(L"Enumeration", L"Background", 1, context), 0, 1) != 0;
+}
+
+/**
+ * EnumDescends – TRUE if the subfolders of a folder at @depth (the root is
+ *                0) are still within maxDepth.
+ */
+bool EnumDescends(const EnumLimits *limits, UINT depth)
+{
+    return depth + 1 < limits->maxDepth;
+}
+
+/**
+ * EnumBudgetReached – TRUE once a walk has used up its total-entry or
+ *                     wall-clock budget.
+ *
+ * @param listed     Entries listed (or added to the menu) so far.
+ * @param elapsedMs  Time the walk has taken so far, or 0 for no time budget.
+ */
+bool EnumBudgetReached(const EnumLimits *limits, UINT listed, double elapsedMs)
+{
+    return listed >= limits->maxTotalEntries || elapsedMs > (double)limits->budgetMs;
+}
+
+/** Initial VisitedSet slot count (power of two). */
+#define VISITED_INITIAL_SLOTS 64
+
+/**
+ * VisitedFree – release the table and reset @set to empty.
+ */
+void VisitedFree(VisitedSet *set)
+{
+    free(set->volumes);
+    free(set->fileIds);
+    *set = (VisitedSet){ 0 };
+}
+
+/**
+ * VisitedGrow – double the table (or create it) and rehash.
+ *
+ * @return  false on OOM (the old table is kept).
+ */
+static bool VisitedGrow(VisitedSet *set)
+{
+    const UINT slots = set->mask ? (set->mask + 1) * 2 : VISITED_INITIAL_SLOTS;
+    DWORD  *volumes = calloc(slots, sizeof(*volumes));
+    UINT64 *fileIds = calloc(slots, sizeof(*fileIds));
+    if (!volumes || !fileIds) {
+        free(volumes);
+        free(fileIds);
+        return false;
+    }
+
+    for (UINT i = 0; set->mask && i <= set->mask; ++i) {
+        if (!set->fileIds[i]) {
+            continue;
+        }
+        UINT slot = IconCacheIdHash(set->volumes[i], set->fileIds[i], 0) & (slots - 1);
+        while (fileIds[slot]) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        volumes[slot] = set->volumes[i];
+        fileIds[slot] = set->fileIds[i];
+    }
+
+    free(set->volumes);
+    free(set->fileIds);
+    set->volumes = volumes;
+    set->fileIds = fileIds;
+    set->mask    = slots - 1;
+    return true;
+}
+
+/**
+ * VisitedAdd – record a directory identity.
+ *
+ * @return  false if it was already recorded.  On OOM the identity is not
+ *          recorded and true is returned: the depth limit still bounds the walk.
+ */
+bool VisitedAdd(VisitedSet *set, DWORD volume, UINT64 fileId)
+{
+    if ((set->count + 1) * 2 > set->mask + 1 && !VisitedGrow(set)) {
+        return true;
+    }
+
+    UINT slot = IconCacheIdHash(volume, fileId, 0) & set->mask;
+    while (set->fileIds[slot]) {
+        if (set->fileIds[slot] == fileId && set->volumes[slot] == volume) {
+            return false;
+        }
+        slot = (slot + 1) & set->mask;
+    }
+    set->volumes[slot] = volume;
+    set->fileIds[slot] = fileId;
+    set->count++;
+    return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Include / exclude filters                                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * FilterCompileRule – classify @pattern (trimmed in place) into @rule.
+ *
+ * @return  false for an empty line or a comment.
+ */
+bool FilterCompileRule(PWSTR pattern, FilterRule *rule)
+{
+    while (*pattern == L' ' || *pattern == L'\t') {
+        pattern++;
+    }
+    size_t len = wcslen(pattern);
+    while (len && (pattern[len - 1] == L' ' || pattern[len - 1] == L'\t')) {
+        pattern[--len] = L'\0';
+    }
+
+    *rule = (FilterRule){ .text = pattern };
+    if (len && (pattern[len - 1] == L'\\' || pattern[len - 1] == L'/')) {
+        pattern[--len] = L'\0';
+        rule->dirOnly = true;
+    }
+    if (!len || pattern[0] == L';' || pattern[0] == L'#') {
+        return false;
+    }
+
+    const PCWSTR star = wcschr(pattern, L'*');
+    if (wcschr(pattern, L'?') || (star && wcschr(star + 1, L'*'))) {
+        rule->kind = FILTER_GLOB;
+    } else if (star) {
+        rule->kind      = FILTER_AFFIX;
+        rule->prefixLen = (UINT)(star - pattern);
+        rule->suffix    = star + 1;
+        rule->suffixLen = (UINT)(len - rule->prefixLen - 1);
+    } else {
+        rule->kind      = FILTER_EXACT;
+        rule->prefixLen = (UINT)len;
+    }
+    return true;
+}
+
+/**
+ * FilterCompileLines – compile every line of @pool into @list, which takes
+ *                      ownership of @pool (freed on failure).
+ *
+ * Lines are glob patterns matched case-insensitively against the entry
+ * name; a trailing '\' restricts a pattern to folders.
+ *
+ * @param pool  Heap-allocated lines, each NUL-terminated, followed by an
+ *              empty line.
+ */
+void FilterCompileLines(FilterList *list, PWSTR pool)
+{
+    UINT lines = 0;
+    for (PCWSTR line = pool; *line; line += wcslen(line) + 1) {
+        lines++;
+    }
+
+    FilterRule *rules = lines ? malloc(lines * sizeof(*rules)) : NULL;
+    if (!rules) {
+        free(pool);
+        return;
+    }
+
+    UINT count = 0;
+    for (PWSTR line = pool; *line; ) {
+        PWSTR next = line + wcslen(line) + 1;   // before trimming writes NULs
+        if (FilterCompileRule(line, &rules[count])) {
+            count++;
+        }
+        line = next;
+    }
+
+    list->pool  = pool;
+    list->rules = rules;
+    list->count = count;
+}
+
+/**
+ * FilterFold – case folding of the filter compares: ASCII only, like
+ *              _wcsicmp in the "C" locale the exact and affix rules use.
+ */
+static inline WCHAR FilterFold(WCHAR ch)
+{
+    return (ch >= L'a' && ch <= L'z') ? (WCHAR)(ch - L'a' + L'A') : ch;
+}
+
+/**
+ * FilterGlobSingle – match @name against one mask ending at NUL or ';'.
+ *
+ * Greedy '*' with a single backtrack point: O(name × mask) at worst, no
+ * recursion and no allocation.  A '*' at the end of the name matches
+ * nothing, so "name.*" also matches "name" with no extension, as with
+ * PathMatchSpecW.
+ */
+static bool FilterGlobSingle(PCWSTR name, PCWSTR mask)
+{
+    PCWSTR starMask = NULL;
+    PCWSTR starName = NULL;
+
+    while (*name) {
+        if (*mask == L'*') {
+            starMask = ++mask;
+            starName = name;
+        } else if (*mask && *mask != L';' &&
+                   (*mask == L'?' || FilterFold(*mask) == FilterFold(*name))) {
+            mask++;
+            name++;
+        } else if (starMask) {
+            mask = starMask;
+            name = ++starName;
+        } else {
+            return false;
+        }
+    }
+
+    while (*mask == L'*' || *mask == L'.') {
+        // trailing "*" and ".*" match an empty remainder
+        if (*mask == L'.' && mask[1] != L'*') {
+            break;
+        }
+        mask++;
+    }
+    return !*mask || *mask == L';';
+}
+
+/**
+ * FilterGlobMatch – portable PathMatchSpecW: case-insensitive '*' and '?'
+ *                   over a ';'-separated list of masks ("*.*" matches all).
+ */
+bool FilterGlobMatch(PCWSTR name, PCWSTR spec)
+{
+    if (wcscmp(spec, L"*.*") == 0) {
+        return true;
+    }
+
+    while (*spec) {
+        while (*spec == L' ') {
+            spec++;
+        }
+        if (FilterGlobSingle(name, spec)) {
+            return true;
+        }
+        while (*spec && *spec != L';') {
+            spec++;
+        }
+        if (*spec) {
+            spec++;
+        }
+    }
+    return false;
+}
+
+/**
+ * FilterMatches – TRUE if any rule of @list matches the entry.
+ *
+ * @param name         Entry name (no path).
+ * @param nameLen      wcslen(@name).
+ * @param isDirectory  Entry is a folder (dirOnly rules need one).
+ */
+bool FilterMatches(const FilterList *list, PCWSTR name, size_t nameLen, bool isDirectory)
+{
+    for (UINT i = 0; i < list->count; ++i) {
+        const FilterRule *rule = &list->rules[i];
+        if (rule->dirOnly && !isDirectory) {
+            continue;
+        }
+
+        switch (rule->kind) {
+        case FILTER_EXACT:
+            if (nameLen == rule->prefixLen && _wcsicmp(name, rule->text) == 0) {
+                return true;
+            }
+            break;
+        case FILTER_AFFIX:
+            if (nameLen >= (size_t)rule->prefixLen + rule->suffixLen &&
+                _wcsnicmp(name, rule->text, rule->prefixLen) == 0 &&
+                _wcsicmp(name + nameLen - rule->suffixLen, rule->suffix) == 0) {
+                return true;
+            }
+            break;
+        default:
+            if (FilterGlobMatch(name, rule->text)) {
+                return true;
+            }
+            break;
+        }
+    }
+    return false;
+}
+
+/**
+ * FilterFree – release a compiled FilterList.
+ */
+void FilterFree(FilterList *list)
+{
+    free(list->rules);
+    free(list->pool);
+    *list = (FilterList){ 0 };
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Background enumeration queue                                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * EnumQueuePush – append @job; the queue owns @job->path on success.
+ *
+ * @return  false on OOM.
+ */
+bool EnumQueuePush(EnumQueue *queue, const EnumJob *job)
+{
+    if (queue->count >= queue->capacity) {
+        const UINT newCap = queue->capacity ? queue->capacity * 2 : 32;
+        EnumJob *tmp = realloc(queue->jobs, newCap * sizeof *tmp);
+        if (!tmp) {
+            return false;
+        }
+        queue->jobs     = tmp;
+        queue->capacity = newCap;
+    }
+    queue->jobs[queue->count++] = *job;
+    return true;
+}
+
+/**
+ * EnumQueuePromote – move the job of @menu to the front of the queue,
+ *                    because the user just opened it.
+ */
+void EnumQueuePromote(EnumQueue *queue, HMENU menu)
+{
+    for (UINT i = queue->head + 1; i < queue->count; ++i) {
+        if (queue->jobs[i].menu == menu) {
+            const EnumJob job = queue->jobs[i];
+            memmove(&queue->jobs[queue->head + 1], &queue->jobs[queue->head],
+                    (i - queue->head) * sizeof *queue->jobs);
+            queue->jobs[queue->head] = job;
+            break;
+        }
+    }
+}
+
+/**
+ * EnumQueueTake – remove the front job into @out (the caller now owns its
+ *                 path).
+ *
+ * @return  false if the queue is empty.
+ */
+bool EnumQueueTake(EnumQueue *queue, EnumJob *out)
+{
+    if (queue->head == queue->count) {
+        return false;
+    }
+
+    *out = queue->jobs[queue->head++];
+    if (queue->head == queue->count) {
+        queue->head  = 0;
+        queue->count = 0;
+    }
+    return true;
+}
+
+/**
+ * EnumQueueFree – free the paths of the jobs never taken and the queue.
+ */
+void EnumQueueFree(EnumQueue *queue)
+{
+    for (UINT i = queue->head; i < queue->count; ++i) {
+        free(queue->jobs[i].path);
+    }
+    free(queue->jobs);
+    *queue = (EnumQueue){ 0 };
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Menu snapshot                                                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * SnapshotFree – release every folder of @snapshot and reset it to empty.
+ */
+void SnapshotFree(MenuSnapshot *snapshot)
+{
+    for (UINT i = 0; i < snapshot->count; ++i) {
+        free(snapshot->folders[i].path);
+        free(snapshot->folders[i].listing.entries);
+    }
+    free(snapshot->folders);
+    *snapshot = (MenuSnapshot){ 0 };
+}
+
+/**
+ * SnapshotAdd – append a copy of @listing for @path.
+ *
+ * @return  false on OOM (@snapshot is unchanged).
+ */
+bool SnapshotAdd(MenuSnapshot *snapshot, PCWSTR path, UINT depth, UINT64 lastWrite,
+                 const FolderListing *listing)
+{
+    if (snapshot->count >= snapshot->capacity) {
+        const UINT newCap = snapshot->capacity ? snapshot->capacity * 2 : 32;
+        SnapshotFolder *tmp = realloc(snapshot->folders, newCap * sizeof *tmp);
+        if (!tmp) {
+            return false;
+        }
+        snapshot->folders  = tmp;
+        snapshot->capacity = newCap;
+    }
+
+    SnapshotFolder folder = {
+        .path      = _wcsdup(path),
+        .hash      = IconMemoHash(path),
+        .depth     = depth,
+        .lastWrite = lastWrite,
+        .listing   = { .count = listing->count }
+    };
+    if (listing->count) {
+        folder.listing.entries = malloc(listing->count * sizeof *listing->entries);
+        if (folder.listing.entries) {
+            memcpy(folder.listing.entries, listing->entries, listing->count * sizeof *listing->entries);
+        }
+    }
+    if (!folder.path || (listing->count && !folder.listing.entries)) {
+        free(folder.path);
+        free(folder.listing.entries);
+        return false;
+    }
+
+    snapshot->folders[snapshot->count++] = folder;
+    return true;
+}
+
+/**
+ * SnapshotFind – look up the folder recorded for @path.
+ *
+ * @return  The folder, or NULL.
+ */
+const SnapshotFolder *SnapshotFind(const MenuSnapshot *snapshot, PCWSTR path)
+{
+    const UINT hash = IconMemoHash(path);
+    for (UINT i = 0; i < snapshot->count; ++i) {
+        const SnapshotFolder *folder = &snapshot->folders[i];
+        if (folder->hash == hash && _wcsicmp(folder->path, path) == 0) {
+            return folder;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * SnapshotBuffer – growable byte buffer the snapshot file is assembled in.
+ *
+ * @member data      Heap buffer.
+ * @member size      Bytes written.
+ * @member capacity  Allocated bytes.
+ * @member failed    An allocation failed; the buffer is unusable.
+ */
+typedef struct {
+    BYTE  *data;
+    DWORD  size;
+    DWORD  capacity;
+    bool   failed;
+} SnapshotBuffer;
+
+/**
+ * SnapshotPut – append @size bytes to @buffer (sets @buffer->failed on OOM).
+ */
+static void SnapshotPut(SnapshotBuffer *buffer, const void *data, DWORD size)
+{
+    if (buffer->failed) {
+        return;
+    }
+    if (buffer->size + size > SNAPSHOT_MAX_FILE_SIZE) {
+        buffer->failed = true;
+        return;
+    }
+    if (buffer->size + size > buffer->capacity) {
+        DWORD newCap = buffer->capacity ? buffer->capacity * 2 : 64 * 1024;
+        while (newCap < buffer->size + size) {
+            newCap *= 2;
+        }
+        BYTE *tmp = realloc(buffer->data, newCap);
+        if (!tmp) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data     = tmp;
+        buffer->capacity = newCap;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+/**
+ * SnapshotPutString – append a length-prefixed string (no terminator).
+ */
+static void SnapshotPutString(SnapshotBuffer *buffer, PCWSTR text)
+{
+    const UINT32 len = (UINT32)wcslen(text);
+    SnapshotPut(buffer, &len, sizeof len);
+    SnapshotPut(buffer, text, len * sizeof(WCHAR));
+}
+
+/**
+ * SnapshotEncode – serialise @snapshot of @root into a snapshot file image.
+ *
+ * Layout: magic, version, payload size, CacheHash32(payload); the payload
+ * holds savedAt, the settings hash, the root and then per folder its path,
+ * lastWrite, depth and entries (attributes, last-write time, name).
+ *
+ * @param settings  Fingerprint of the settings the listings were made under.
+ * @param data      Receives the heap-alloc'd image; free() it.
+ * @param size      Receives its size in bytes.
+ * @return          false on OOM or past SNAPSHOT_MAX_FILE_SIZE.
+ */
+bool SnapshotEncode(const MenuSnapshot *snapshot, PCWSTR root, UINT32 settings,
+                    BYTE **data, DWORD *size)
+{
+    SnapshotBuffer buffer = { 0 };
+    DWORD header[SNAPSHOT_HEADER_SIZE / sizeof(DWORD)] = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION };
+    SnapshotPut(&buffer, header, sizeof header);
+
+    SnapshotPut(&buffer, &snapshot->savedAt, sizeof snapshot->savedAt);
+    SnapshotPut(&buffer, &settings, sizeof settings);
+    SnapshotPutString(&buffer, root);
+    SnapshotPut(&buffer, &snapshot->count, sizeof snapshot->count);
+
+    for (UINT i = 0; i < snapshot->count; ++i) {
+        const SnapshotFolder *folder = &snapshot->folders[i];
+        const UINT32 fields[] = { folder->depth, folder->listing.count };
+        SnapshotPutString(&buffer, folder->path);
+        SnapshotPut(&buffer, &folder->lastWrite, sizeof folder->lastWrite);
+        SnapshotPut(&buffer, fields, sizeof fields);
+
+        for (UINT j = 0; j < folder->listing.count; ++j) {
+            const WIN32_FIND_DATAW *entry = &folder->listing.entries[j];
+            SnapshotPut(&buffer, &entry->dwFileAttributes, sizeof entry->dwFileAttributes);
+            SnapshotPut(&buffer, &entry->ftLastWriteTime, sizeof entry->ftLastWriteTime);
+            SnapshotPutString(&buffer, entry->cFileName);
+        }
+    }
+
+    if (buffer.failed) {
+        free(buffer.data);
+        return false;
+    }
+
+    DWORD *head = (DWORD *)buffer.data;
+    head[2] = buffer.size - SNAPSHOT_HEADER_SIZE;
+    head[3] = CacheHash32(buffer.data + SNAPSHOT_HEADER_SIZE, head[2], SNAPSHOT_MAGIC);
+
+    *data = buffer.data;
+    *size = buffer.size;
+    return true;
+}
+
+/**
+ * SnapshotReader – bounds-checked cursor over a loaded snapshot file.
+ *
+ * @member data  Next unread byte.
+ * @member left  Bytes left.
+ */
+typedef struct {
+    const BYTE *data;
+    DWORD       left;
+} SnapshotReader;
+
+/**
+ * SnapshotGet – copy the next @size bytes out of @reader.
+ *
+ * @return  false if the file is too short.
+ */
+static bool SnapshotGet(SnapshotReader *reader, void *out, DWORD size)
+{
+    if (reader->left < size) {
+        return false;
+    }
+    memcpy(out, reader->data, size);
+    reader->data += size;
+    reader->left -= size;
+    return true;
+}
+
+/**
+ * SnapshotGetString – read a length-prefixed string into @out (terminated).
+ *
+ * @param cch  Capacity of @out in WCHARs; longer strings fail.
+ */
+static bool SnapshotGetString(SnapshotReader *reader, PWSTR out, DWORD cch)
+{
+    UINT32 len;
+    if (!SnapshotGet(reader, &len, sizeof len) || len >= cch ||
+        !SnapshotGet(reader, out, len * sizeof(WCHAR))) {
+        return false;
+    }
+    out[len] = L'\0';
+    return true;
+}
+
+/**
+ * SnapshotParse – decode a snapshot payload for @root into @out.
+ *
+ * @return  false if the payload is malformed, belongs to another root or
+ *          other settings, or is too old.
+ */
+static bool SnapshotParse(SnapshotReader *reader, PCWSTR root, UINT32 expected, UINT64 now,
+                          UINT64 maxAge, MenuSnapshot *out)
+{
+    UINT32 settings, folderCount;
+    if (!SnapshotGet(reader, &out->savedAt, sizeof out->savedAt) ||
+        !SnapshotGet(reader, &settings, sizeof settings) ||
+        settings != expected ||
+        now - out->savedAt > maxAge) {
+        return false;
+    }
+
+    PWSTR path = malloc(MAX_LOCAL_PATH * sizeof(WCHAR));
+    if (!path) {
+        return false;
+    }
+
+    bool ok = SnapshotGetString(reader, path, MAX_LOCAL_PATH) &&
+              _wcsicmp(path, root) == 0 &&
+              SnapshotGet(reader, &folderCount, sizeof folderCount);
+
+    for (UINT32 i = 0; ok && i < folderCount; ++i) {
+        UINT64 lastWrite;
+        UINT32 fields[2];
+        ok = SnapshotGetString(reader, path, MAX_LOCAL_PATH) &&
+             SnapshotGet(reader, &lastWrite, sizeof lastWrite) &&
+             SnapshotGet(reader, fields, sizeof fields) &&
+             fields[1] <= ENUM_FOLDER_ENTRIES_CAP;
+        if (!ok) {
+            break;
+        }
+
+        FolderListing listing = { 0 };
+        listing.entries = fields[1] ? calloc(fields[1], sizeof *listing.entries) : NULL;
+        ok = !fields[1] || listing.entries;
+
+        for (UINT32 j = 0; ok && j < fields[1]; ++j) {
+            WIN32_FIND_DATAW *entry = &listing.entries[j];
+            ok = SnapshotGet(reader, &entry->dwFileAttributes, sizeof entry->dwFileAttributes) &&
+                 SnapshotGet(reader, &entry->ftLastWriteTime, sizeof entry->ftLastWriteTime) &&
+                 SnapshotGetString(reader, entry->cFileName, ARRAYSIZE(entry->cFileName));
+            listing.count += ok;
+        }
+
+        ok = ok && SnapshotAdd(out, path, fields[0], lastWrite, &listing);
+        free(listing.entries);
+    }
+
+    free(path);
+    return ok;
+}
+
+/**
+ * SnapshotDecode – check and decode a snapshot file image for @root.
+ *
+ * @param settings  Fingerprint of the current settings; must match.
+ * @param now       Current time (FILETIME).
+ * @param maxAge    Oldest acceptable savedAt age, in FILETIME units.
+ * @return          true if @out was filled; on false it is left empty.
+ */
+bool SnapshotDecode(const BYTE *data, DWORD size, PCWSTR root, UINT32 settings,
+                    UINT64 now, UINT64 maxAge, MenuSnapshot *out)
+{
+    DWORD header[SNAPSHOT_HEADER_SIZE / sizeof(DWORD)];
+    if (size < SNAPSHOT_HEADER_SIZE || size > SNAPSHOT_MAX_FILE_SIZE) {
+        return false;
+    }
+    memcpy(header, data, sizeof header);
+    if (header[0] != SNAPSHOT_MAGIC || header[1] != SNAPSHOT_VERSION ||
+        header[2] != size - SNAPSHOT_HEADER_SIZE ||
+        header[3] != CacheHash32(data + SNAPSHOT_HEADER_SIZE, header[2], SNAPSHOT_MAGIC)) {
+        return false;
+    }
+
+    SnapshotReader reader = { data + SNAPSHOT_HEADER_SIZE, header[2] };
+    if (!SnapshotParse(&reader, root, settings, now, maxAge, out)) {
+        SnapshotFree(out);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * SnapshotChildPath – "@directory\@name" into @out (MAX_LOCAL_PATH WCHARs),
+ *                     as PathCombineW joins a folder and an entry name.
+ *
+ * @return  false if it does not fit.
+ */
+static bool SnapshotChildPath(PWSTR out, PCWSTR directory, PCWSTR name)
+{
+    const size_t dirLen  = wcslen(directory);
+    const size_t nameLen = wcslen(name);
+    const size_t slash   = dirLen && directory[dirLen - 1] != L'\\';
+    if (dirLen + slash + nameLen >= MAX_LOCAL_PATH) {
+        return false;
+    }
+
+    memcpy(out, directory, dirLen * sizeof(WCHAR));
+    if (slash) {
+        out[dirLen] = L'\\';
+    }
+    memcpy(out + dirLen + slash, name, (nameLen + 1) * sizeof(WCHAR));
+    return true;
+}
+
+/**
+ * SnapshotRevalidateFolder – keep or re-list @path, then recurse into its
+ *                            subfolders (worker thread).
+ *
+ * A folder that cannot be reached keeps its old listing, so an offline
+ * share does not wipe the snapshot.  A folder absent from the snapshot
+ * (never captured, or truncated last time) is always listed; a truncated
+ * listing is not kept, but its subfolders are still walked.
+ *
+ * Only the folder's own last-write time is compared.  Editing an entry in
+ * place (retargeting a .lnk) does not move it, so that entry keeps its old
+ * ftLastWriteTime - and with it its cached icon - until something else in
+ * the folder changes or the snapshot exceeds MaxAgeMinutes.  Stat-ing
+ * every entry would cost the round trips the snapshot exists to avoid.
+ *
+ * @param stamp  Current last-write time of @path if already known (from a
+ *               fresh parent listing), else 0 to query it.
+ * @return       false once cancelled or out of memory.
+ */
+bool SnapshotRevalidateFolder(SnapshotRevalidation *pass, PCWSTR path, UINT depth, UINT64 stamp)
+{
+    if (*pass->cancel) {
+        return false;
+    }
+
+    if (!stamp) {
+        stamp = pass->stamp(path, pass->context);
+        pass->checked++;
+    }
+
+    const SnapshotFolder *old = SnapshotFind(pass->loaded, path);
+    const FolderListing *kept = old ? &old->listing : NULL;
+    bool fresh = false;
+
+    FolderListing listing = { 0 };
+    if (!old || (stamp && old->lastWrite != stamp)) {
+        const bool listedOk = pass->list(path, pass->listed, pass->context, &listing);
+        if (*pass->cancel) {
+            free(listing.entries);
+            return false;
+        }
+        if (listedOk) {
+            kept  = &listing;
+            fresh = true;
+            pass->relisted++;
+        }
+    }
+    if (!kept) {
+        return true;
+    }
+
+    // @kept is the old snapshot's copy or the fresh listing, both stable
+    // while the subfolders are walked
+    if (!kept->truncated &&
+        !SnapshotAdd(&pass->next, path, depth, (stamp || !old) ? stamp : old->lastWrite, kept)) {
+        free(listing.entries);
+        return false;
+    }
+    pass->listed += kept->count;
+
+    // Heap, not stack: this recurses once per folder level
+    const bool recurse = EnumDescends(pass->limits, depth);
+    PWSTR childPath    = recurse ? malloc(MAX_LOCAL_PATH * sizeof(WCHAR)) : NULL;
+    bool ok            = !recurse || childPath;
+
+    for (UINT i = 0; childPath && ok && i < kept->count; ++i) {
+        const WIN32_FIND_DATAW *entry = &kept->entries[i];
+        if (!(entry->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ||
+            !SnapshotChildPath(childPath, path, entry->cFileName)) {
+            continue;
+        }
+
+        const UINT64 childStamp = fresh
+            ? ((UINT64)entry->ftLastWriteTime.dwHighDateTime << 32) | entry->ftLastWriteTime.dwLowDateTime
+            : 0;
+        ok = SnapshotRevalidateFolder(pass, childPath, depth + 1, childStamp);
+    }
+    free(childPath);
+    free(listing.entries);
+    return ok;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Overflow paging                                                            */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * PageKeyChar – case-folded first character of a name, used to find
+ *               alphabetical boundaries between pages.
+ *
+ * @param name  Null-terminated wide string.
+ * @return      Upper-cased first character, or 0 for an empty string.
+ */
+WCHAR PageKeyChar(PCWSTR name)
+{
+    // CharUpperW treats a pointer with a zero high word as a single character
+    return (WCHAR)(ULONG_PTR)CharUpperW((LPWSTR)(ULONG_PTR)name[0]);
+}
+
+/**
+ * PageSpan – largest page size used to split @count entries into one popup
+ *            of pages.
+ *
+ * Starting at MENU_PAGE_SIZE, the span doubles until the pages fit one
+ * popup: NextPageEnd keeps every page but the last more than half full,
+ * so @count / (span / 2) + 1 bounds the number of pages.  A page larger
+ * than MENU_PAGE_SIZE is split again with its own span (see AddPages), so
+ * 10000 entries become three levels of at most MENU_PAGE_SIZE items each.
+ *
+ * @param count  Entries to split.
+ * @return       Upper bound of entries per page at this level.
+ */
+UINT PageSpan(UINT count)
+{
+    UINT span = MENU_PAGE_SIZE;
+    while (count / (span / 2) + 1 > MENU_PAGE_SIZE) {
+        span *= 2;
+    }
+    return span;
+}
+
+/**
+ * NextPageEnd – pick the exclusive end index of the page starting at @start.
+ *
+ * @entries must already be in display order (CompareFindData); pages are
+ * contiguous slices of it, so natural-sort order is preserved across pages.
+ * A page holds at most @span entries.  When the hard cut would split a run
+ * of names with the same initial (or the directory/file boundary), the cut
+ * is moved back to the nearest such boundary, as long as the page stays
+ * more than half full.  This yields ranges like "A – C", "D – F" whenever
+ * the data allows it.
+ *
+ * @param entries  Sorted entry array.
+ * @param start    Index of the first entry of the page.
+ * @param end      One past the last entry being split.
+ * @param span     Upper bound of entries per page (PageSpan).
+ * @return         Index one past the last entry of the page.
+ */
+UINT NextPageEnd(const WIN32_FIND_DATAW *entries, UINT start, UINT end, UINT span)
+{
+    if (end - start <= span) {
+        return end;
+    }
+
+    // walk back towards the half-full mark looking for a natural boundary
+    for (UINT cut = start + span; cut > start + span / 2; --cut) {
+        const WIN32_FIND_DATAW *prev = &entries[cut - 1];
+        const WIN32_FIND_DATAW *next = &entries[cut];
+
+        BOOL dirPrev = (prev->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        BOOL dirNext = (next->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+
+        if (dirPrev != dirNext ||
+            PageKeyChar(prev->cFileName) != PageKeyChar(next->cFileName)) {
+            return cut;
+        }
+    }
+
+    return start + span;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Pixel blob codec                                                           */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Lossless byte codec for cached icon pixels (straight-alpha BGRA), modelled
+ * on QOI.  Every op predicts the next pixel from the previous one:
+ *
+ *   00iiiiii           INDEX – pixel from a 64-slot table of recent colours
+ *   01rrggbb           DIFF  – per-channel delta in [-2, 1], alpha unchanged
+ *   10gggggg rrrrbbbb  LUMA  – green delta in [-32, 31], red/blue in [-8, 7]
+ *                              relative to it, alpha unchanged
+ *   11nnnnnn           RUN   – previous pixel repeated 1..62 times
+ *   0xFE b g r         BGR   – literal colour, alpha unchanged
+ *   0xFF b g r a       BGRA  – literal pixel
+ *
+ * The predictor starts at fully transparent, so the empty margins around
+ * most icons collapse into a handful of RUN bytes.  Decoding is a single
+ * branchy pass with no allocation, far cheaper than the I/O it saves.
+ */
+#define BLOB_OP_INDEX  0x00
+#define BLOB_OP_DIFF   0x40
+#define BLOB_OP_LUMA   0x80
+#define BLOB_OP_RUN    0xC0
+#define BLOB_OP_BGR    0xFE
+#define BLOB_OP_BGRA   0xFF
+#define BLOB_OP_MASK   0xC0
+#define BLOB_RUN_MAX   62
+
+/**
+ * BlobHash – slot of a pixel in the 64-entry recent-colour table.
+ */
+static UINT BlobHash(UINT32 p)
+{
+    return (((p >> 16) & 0xFF) * 3 + ((p >> 8) & 0xFF) * 5 + (p & 0xFF) * 7 + (p >> 24) * 11) & 63;
+}
+
+/**
+ * BlobDelta – signed wrap-around difference of one 8-bit channel.
+ */
+static int BlobDelta(UINT32 p, UINT32 prev, int shift)
+{
+    return (signed char)(BYTE)((p >> shift) - (prev >> shift));
+}
+
+/**
+ * BlobAddDelta – apply per-channel deltas to a pixel (alpha unchanged).
+ */
+static UINT32 BlobAddDelta(UINT32 p, int dr, int dg, int db)
+{
+    return (p & 0xFF000000u)
+         | ((((p >> 16) + dr) & 0xFF) << 16)
+         | ((((p >>  8) + dg) & 0xFF) <<  8)
+         |  (((p      ) + db) & 0xFF);
+}
+
+/**
+ * BlobEncode – compress straight-alpha pixels.
+ *
+ * @param pixels  Source pixels.
+ * @param count   Number of pixels.
+ * @param out     Destination of at least BLOB_MAX_SIZE(@count) bytes.
+ * @return        Encoded size in bytes.
+ */
+size_t BlobEncode(const UINT32 *pixels, size_t count, BYTE *out)
+{
+    UINT32 index[64] = { 0 };
+    UINT32 prev = 0;
+    UINT   run  = 0;
+    size_t n    = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        const UINT32 p = pixels[i];
+
+        if (p == prev) {
+            if (++run == BLOB_RUN_MAX) {
+                out[n++] = (BYTE)(BLOB_OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run) {
+            out[n++] = (BYTE)(BLOB_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        const UINT slot = BlobHash(p);
+        if (index[slot] == p) {
+            out[n++] = (BYTE)(BLOB_OP_INDEX | slot);
+            prev = p;
+            continue;
+        }
+        index[slot] = p;
+
+        if ((p >> 24) == (prev >> 24)) {
+            const int dr = BlobDelta(p, prev, 16);
+            const int dg = BlobDelta(p, prev, 8);
+            const int db = BlobDelta(p, prev, 0);
+            const int drg = dr - dg;
+            const int dbg = db - dg;
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                out[n++] = (BYTE)(BLOB_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+            } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                out[n++] = (BYTE)(BLOB_OP_LUMA | (dg + 32));
+                out[n++] = (BYTE)(((drg + 8) << 4) | (dbg + 8));
+            } else {
+                out[n++] = BLOB_OP_BGR;
+                out[n++] = (BYTE)p;
+                out[n++] = (BYTE)(p >> 8);
+                out[n++] = (BYTE)(p >> 16);
+            }
+        } else {
+            out[n++] = BLOB_OP_BGRA;
+            out[n++] = (BYTE)p;
+            out[n++] = (BYTE)(p >> 8);
+            out[n++] = (BYTE)(p >> 16);
+            out[n++] = (BYTE)(p >> 24);
+        }
+
+        prev = p;
+    }
+
+    if (run) {
+        out[n++] = (BYTE)(BLOB_OP_RUN | (run - 1));
+    }
+
+    return n;
+}
+
+/**
+ * BlobDecode – decompress a BlobEncode stream.
+ *
+ * Every read is bounds-checked, so a corrupt or truncated stream fails
+ * cleanly instead of overrunning either buffer.
+ *
+ * @param in      Encoded bytes.
+ * @param size    Number of encoded bytes.
+ * @param pixels  Destination of @count pixels.
+ * @param count   Exact number of pixels the stream must produce.
+ * @return        TRUE if the stream decoded to exactly @count pixels.
+ */
+BOOL BlobDecode(const BYTE *in, size_t size, UINT32 *pixels, size_t count)
+{
+    UINT32 index[64] = { 0 };
+    UINT32 p = 0;
+    size_t n = 0;
+    size_t i = 0;
+
+    while (i < count) {
+        if (n >= size) {
+            return FALSE;
+        }
+
+        const BYTE op = in[n++];
+
+        if (op == BLOB_OP_BGRA) {
+            if (size - n < 4) return FALSE;
+            p = in[n] | ((UINT32)in[n + 1] << 8) | ((UINT32)in[n + 2] << 16) | ((UINT32)in[n + 3] << 24);
+            n += 4;
+        } else if (op == BLOB_OP_BGR) {
+            if (size - n < 3) return FALSE;
+            p = (p & 0xFF000000u) | in[n] | ((UINT32)in[n + 1] << 8) | ((UINT32)in[n + 2] << 16);
+            n += 3;
+        } else if ((op & BLOB_OP_MASK) == BLOB_OP_INDEX) {
+            p = index[op];
+        } else if ((op & BLOB_OP_MASK) == BLOB_OP_DIFF) {
+            p = BlobAddDelta(p, ((op >> 4) & 3) - 2, ((op >> 2) & 3) - 2, (op & 3) - 2);
+        } else if ((op & BLOB_OP_MASK) == BLOB_OP_LUMA) {
+            if (n >= size) return FALSE;
+            const int dg   = (op & 0x3F) - 32;
+            const BYTE rb  = in[n++];
+            p = BlobAddDelta(p, dg + (rb >> 4) - 8, dg, dg + (rb & 0x0F) - 8);
+        } else {
+            size_t run = (size_t)(op & 0x3F) + 1;
+            if (run > count - i) return FALSE;
+            while (run--) {
+                pixels[i++] = p;
+            }
+            continue;
+        }
+
+        index[BlobHash(p)] = p;
+        pixels[i++] = p;
+    }
+
+    return n == size;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Atlas packer                                                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * AtlasPackerAlloc – reserve a @width x @height cell inside a page.
+ *
+ * Preference order: the lowest existing shelf that fits without wasting
+ * more than half the cell height, then a new shelf, then any shelf tall
+ * enough.
+ *
+ * @param packer  Packer of the page.
+ * @param dim     Page edge length in pixels.
+ * @param width   Cell width.
+ * @param height  Cell height.
+ * @param outX    Receives the cell's left edge.
+ * @param outY    Receives the cell's top edge.
+ * @return        true on success, false if the page is full (or OOM).
+ */
+bool AtlasPackerAlloc(AtlasPacker *packer, int dim, int width, int height, int *outX, int *outY)
+{
+    if (width <= 0 || height <= 0 || width > dim || height > dim) {
+        return false;
+    }
+
+    AtlasShelf *best     = NULL;
+    AtlasShelf *fallback = NULL;
+    for (UINT i = 0; i < packer->count; ++i) {
+        AtlasShelf *shelf = &packer->shelves[i];
+        if (shelf->height < height || shelf->used + width > dim) {
+            continue;
+        }
+
+        if (shelf->height <= height + height / 2) {
+            if (!best || shelf->height < best->height) {
+                best = shelf;
+            }
+        } else if (!fallback) {
+            fallback = shelf;
+        }
+    }
+
+    // open a new shelf when no snug one is left
+    if (!best && packer->top + height <= dim) {
+        if (packer->count >= packer->capacity) {
+            UINT newCap = packer->capacity ? packer->capacity * 2 : 16;
+            AtlasShelf *tmp = realloc(packer->shelves, newCap * sizeof *tmp);
+            if (!tmp) {
+                return false;
+            }
+            packer->shelves  = tmp;
+            packer->capacity = newCap;
+        }
+
+        best = &packer->shelves[packer->count++];
+        *best = (AtlasShelf){ packer->top, height, 0 };
+        packer->top += height;
+    }
+
+    if (!best) {
+        best = fallback;
+    }
+    if (!best) {
+        return false;
+    }
+
+    *outX = best->used;
+    *outY = best->y;
+    best->used += width;
+
+    return true;
+}
+
+/**
+ * AtlasPackerFree – release the shelves of a packer (the page is empty again).
+ */
+void AtlasPackerFree(AtlasPacker *packer)
+{
+    free(packer->shelves);
+    ZeroMemory(packer, sizeof *packer);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/* Pixel kernels                                                              */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * 32-bit BGRA pixel kernels used on the icon render, cache-store and
+ * cache-restore paths.  Every kernel has a scalar reference version; SSE2
+ * versions are compiled when SENDTO_SSE2 is set, i.e. where SSE2 is part of
+ * the target baseline (all x64 builds, and x86 builds with /arch:SSE2, the
+ * MSVC default).  Icon rows are
+ * 16-64 pixels wide, so 128-bit lanes already saturate them and wider AVX2
+ * paths would not pay for their runtime dispatch.
+ */
+
+/**
+ * Div255 – exact round(x / 255) for x in [0, 255 * 255].
+ */
+static UINT32 Div255(UINT32 x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/**
+ * PremultiplyRowScalar – straight → premultiplied alpha, reference version.
+ *
+ * @param pixels  BGRA pixels, updated in place.
+ * @param count   Number of pixels.
+ */
+void PremultiplyRowScalar(UINT32 *pixels, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const UINT32 p = pixels[i];
+        const UINT32 a = p >> 24;
+        if (a == 255) {
+            continue;
+        }
+
+        pixels[i] = (a << 24)
+                  | (Div255(((p >> 16) & 0xFF) * a) << 16)
+                  | (Div255(((p >>  8) & 0xFF) * a) <<  8)
+                  |  Div255(( p        & 0xFF) * a);
+    }
+}
+
+/**
+ * UnpremultiplyReciprocal – 16.16 fixed-point 255/a table for
+ *                           UnpremultiplyRowScalar (built on first use).
+ */
+static const UINT32 *UnpremultiplyReciprocal(void)
+{
+    static UINT32 table[256];
+    if (!table[1]) {
+        for (UINT32 a = 1; a < 256; ++a) {
+            table[a] = ((255u << 16) + a / 2) / a;
+        }
+    }
+    return table;
+}
+
+/**
+ * UnpremultiplyRowScalar – premultiplied → straight alpha, reference version.
+ *
+ * Uses a reciprocal table instead of a division per channel; channels are
+ * clamped to 255 to absorb rounding on inconsistent input.  Premultiplying
+ * the result again reproduces the original pixel exactly.
+ *
+ * @param pixels  BGRA pixels, updated in place.
+ * @param count   Number of pixels.
+ */
+void UnpremultiplyRowScalar(UINT32 *pixels, size_t count)
+{
+    const UINT32 *recip = UnpremultiplyReciprocal();
+
+    for (size_t i = 0; i < count; ++i) {
+        const UINT32 p = pixels[i];
+        const UINT32 a = p >> 24;
+        if (a == 255) {
+            continue;
+        }
+        if (a == 0) {
+            pixels[i] = 0;
+            continue;
+        }
+
+        UINT32 b = (( p        & 0xFF) * recip[a] + 0x8000) >> 16;
+        UINT32 g = (((p >>  8) & 0xFF) * recip[a] + 0x8000) >> 16;
+        UINT32 r = (((p >> 16) & 0xFF) * recip[a] + 0x8000) >> 16;
+        pixels[i] = (a << 24)
+                  | ((r > 255 ? 255 : r) << 16)
+                  | ((g > 255 ? 255 : g) <<  8)
+                  |  (b > 255 ? 255 : b);
+    }
+}
+
+/**
+ * MaskToAlphaRowScalar – synthesise alpha for a legacy icon from its AND
+ *                        mask (read back as 32-bit: white = transparent).
+ *
+ * @param pixels  Rendered colour pixels, updated in place.
+ * @param mask    Mask pixels, same layout as @pixels.
+ * @param count   Number of pixels.
+ */
+void MaskToAlphaRowScalar(UINT32 *pixels, const UINT32 *mask, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        pixels[i] = (mask[i] & 0x00FFFFFFu) ? 0 : (pixels[i] | 0xFF000000u);
+    }
+}
+
+/**
+ * HasAlphaRowScalar – TRUE if any pixel carries a non-zero alpha byte.
+ */
+BOOL HasAlphaRowScalar(const UINT32 *pixels, size_t count)
+{
+    UINT32 any = 0;
+    for (size_t i = 0; i < count; ++i) {
+        any |= pixels[i];
+    }
+    return (any & 0xFF000000u) != 0;
+}
+
+#ifdef SENDTO_SSE2
+/**
+ * PremultiplyRowSse2 – SSE2 version of PremultiplyRowScalar, 4 pixels per step.
+ */
+void PremultiplyRowSse2(UINT32 *pixels, size_t count)
+{
+    const __m128i zero     = _mm_setzero_si128();
+    const __m128i keepA    = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i bias     = _mm_set1_epi16(128);
+    const __m128i opaque   = _mm_set1_epi32((int)0xFF000000);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(pixels + i));
+
+        // fully opaque quads are common and need no work
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, opaque), opaque)) == 0xFFFF) {
+            continue;
+        }
+
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+        // broadcast each pixel's alpha over its lanes; alpha lane multiplies by 255
+        __m128i aLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i aHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        aLo = _mm_or_si128(aLo, keepA);
+        aHi = _mm_or_si128(aHi, keepA);
+
+        // exact rounding division by 255: (x + 128 + ((x + 128) >> 8)) >> 8
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, aLo), bias);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, aHi), bias);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i *)(pixels + i), _mm_packus_epi16(lo, hi));
+    }
+
+    PremultiplyRowScalar(pixels + i, count - i);
+}
+
+/**
+ * UnpremultiplyRowSse2 – SSE2 front end for UnpremultiplyRowScalar.
+ *
+ * SSE2 has no 32-bit multiply or per-lane division, so only the dominant
+ * cases are vectorised: quads that are fully opaque (left untouched) or
+ * fully transparent (cleared).  Mixed quads fall back to the table.
+ */
+void UnpremultiplyRowSse2(UINT32 *pixels, size_t count)
+{
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i alpha  = _mm_set1_epi32((int)0xFF000000);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(pixels + i));
+        __m128i a = _mm_and_si128(v, alpha);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, alpha)) == 0xFFFF) {
+            continue;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)(pixels + i), zero);
+            continue;
+        }
+
+        UnpremultiplyRowScalar(pixels + i, 4);
+    }
+
+    UnpremultiplyRowScalar(pixels + i, count - i);
+}
+
+/**
+ * MaskToAlphaRowSse2 – SSE2 version of MaskToAlphaRowScalar.
+ */
+void MaskToAlphaRowSse2(UINT32 *pixels, const UINT32 *mask, size_t count)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i rgb   = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(pixels + i));
+        __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+
+        // lanes whose mask colour is black are opaque
+        __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(m, rgb), zero);
+        _mm_storeu_si128((__m128i *)(pixels + i), _mm_and_si128(_mm_or_si128(v, alpha), keep));
+    }
+
+    MaskToAlphaRowScalar(pixels + i, mask + i, count - i);
+}
+
+/**
+ * HasAlphaRowSse2 – SSE2 version of HasAlphaRowScalar.
+ */
+BOOL HasAlphaRowSse2(const UINT32 *pixels, size_t count)
+{
+    __m128i any = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        any = _mm_or_si128(any, _mm_loadu_si128((const __m128i *)(pixels + i)));
+    }
+
+    const __m128i alpha = _mm_and_si128(any, _mm_set1_epi32((int)0xFF000000));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) != 0xFFFF) {
+        return TRUE;
+    }
+
+    return HasAlphaRowScalar(pixels + i, count - i);
+}
+#endif /* SENDTO_SSE2 */
+
+/**
+ * PremultiplyRow – straight → premultiplied alpha (best available kernel).
+ */
+void PremultiplyRow(UINT32 *pixels, size_t count)
+{
+#ifdef SENDTO_SSE2
+    PremultiplyRowSse2(pixels, count);
+#else
+    PremultiplyRowScalar(pixels, count);
+#endif
+}
+
+/**
+ * UnpremultiplyRow – premultiplied → straight alpha (best available kernel).
+ */
+void UnpremultiplyRow(UINT32 *pixels, size_t count)
+{
+#ifdef SENDTO_SSE2
+    UnpremultiplyRowSse2(pixels, count);
+#else
+    UnpremultiplyRowScalar(pixels, count);
+#endif
+}
+
+/**
+ * MaskToAlphaRow – legacy-icon alpha synthesis (best available kernel).
+ */
+void MaskToAlphaRow(UINT32 *pixels, const UINT32 *mask, size_t count)
+{
+#ifdef SENDTO_SSE2
+    MaskToAlphaRowSse2(pixels, mask, count);
+#else
+    MaskToAlphaRowScalar(pixels, mask, count);
+#endif
+}
+
+/**
+ * HasAlphaRow – TRUE if any pixel has a non-zero alpha (best available kernel).
+ */
+BOOL HasAlphaRow(const UINT32 *pixels, size_t count)
+{
+#ifdef SENDTO_SSE2
+    return HasAlphaRowSse2(pixels, count);
+#else
+    return HasAlphaRowScalar(pixels, count);
+#endif
+}
+
+/**
+ * CopyPixelRows – copy a @width x @height BGRA block between buffers with
+ *                 different row strides (atlas cell ↔ packed cache blob).
+ *
+ * @param dst        Destination of the first row.
+ * @param dstStride  Destination row distance, in pixels.
+ * @param src        Source of the first row.
+ * @param srcStride  Source row distance, in pixels.
+ * @param width      Block width in pixels.
+ * @param height     Block height in pixels.
+ */
+void CopyPixelRows(UINT32 *dst, int dstStride, const UINT32 *src, int srcStride, int width, int height)
+{
+    for (int y = 0; y < height; ++y, dst += dstStride, src += srcStride) {
+        int x = 0;
+#ifdef SENDTO_SSE2
+        for (; x + 4 <= width; x += 4) {
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_loadu_si128((const __m128i *)(src + x)));
+        }
+#endif
+        for (; x < width; ++x) {
+            dst[x] = src[x];
+        }
+    }
+}
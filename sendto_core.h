@@ -0,0 +1,557 @@
+/*
+ * sendto_core.h – portable core of SendTo+: the pieces that only work on
+ * memory (icon cache journal, store and pixel codec, enumeration limits
+ * and queue, filters, menu snapshot, overflow paging, atlas packing,
+ * pixel kernels), shared by sendto.exe, the host tests and sendto-cachetool
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ *
+ * Nothing declared here calls into Win32 beyond CharUpperW; on other hosts
+ * the types (and an ASCII CharUpperW) come from the shim in host/windows.h.
+ */
+
+#ifndef SENDTO_CORE_H
+#define SENDTO_CORE_H
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* SSE2 is baseline on x64 and on x86 unless /arch:IA32 is requested. */
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define SENDTO_SSE2 1
+#endif
+
+/** Binary cache file signature: "STC\0" (SendTo Cache). */
+#define CACHE_MAGIC  0x00435453
+/** v2: straight alpha; v3: packed blobs; v4: append-only journal; v5: lastHit; v6: file identity;
+ *  v7: checksums. */
+#define CACHE_VERSION 7
+/** Journal header: magic + version + CacheHash32 of both. */
+#define CACHE_HEADER_SIZE   12
+/** The one older format still read, to convert it: a magic + version header
+ *  and records without blobHash / metaHash. */
+#define CACHE_PREVIOUS_VERSION     6
+#define CACHE_PREVIOUS_HEADER_SIZE 8
+/** Larger cache files are ignored (and replaced on the next save). */
+#define CACHE_MAX_FILE_SIZE (64u << 20)
+/** Budget enforced on save by evicting the least recently hit entries. */
+#define CACHE_MAX_ENTRIES    4096
+#define CACHE_MAX_BLOB_BYTES (8u << 20)
+/** Distinct entries materialised from a journal; bounds load time and memory
+ *  for a bloated or crafted file (a saved journal holds CACHE_MAX_ENTRIES). */
+#define CACHE_MAX_LOAD_ENTRIES (CACHE_MAX_ENTRIES * 4)
+
+/** Longest path handled, in WCHARs (the NTFS limit, for "\\?\" paths). */
+#define MAX_LOCAL_PATH 32767
+
+
+/* -------------------------------------------------------------------------- */
+/* Hashing                                                                    */
+/* -------------------------------------------------------------------------- */
+
+UINT   IconMemoHash(PCWSTR key);
+UINT32 CacheHash32(const void *data, size_t size, UINT32 seed);
+
+
+/* -------------------------------------------------------------------------- */
+/* Icon cache journal                                                         */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * IconCacheEntry – one cached icon with its invalidation key.
+ *
+ * Entries are keyed on (path, width): a target can have one variant per
+ * icon size, e.g. for monitors with different scaling.  The file identity
+ * (volume serial + file index) is a second key, consulted after a path
+ * miss, so a renamed or moved target keeps its icon.
+ *
+ * @member hash       IconCacheKeyHash of (path, width); not persisted.
+ * @member path       Heap-alloc'd absolute path of the file this icon belongs to.
+ * @member volume     Volume serial number of the file (0 if unknown).
+ * @member fileId     File index on that volume (0 if unknown).
+ * @member lastWrite  Last-write timestamp of the file when the icon was resolved.
+ * @member lastHit    Time (FILETIME as UINT64) the entry was last served or
+ *                    stored; drives LRU eviction.
+ * @member width      Bitmap width in pixels.
+ * @member height     Bitmap height in pixels.
+ * @member blob       Heap-alloc'd pixel blob: 32-bit BGRA pixels with straight
+ *                    alpha, packed with BlobEncode unless that saves nothing.
+ * @member blobSize   Size of @blob in bytes; width*height*4 means unpacked.
+ * @member blobHash   CacheHash32 of @blob as stored on disk.
+ * @member verified   TRUE once @blobHash was checked (or computed here);
+ *                    loaded blobs are only checked when first served.
+ * @member dirty      TRUE if the entry changed since it was last written.
+ */
+typedef struct {
+    UINT     hash;
+    PWSTR    path;
+    DWORD    volume;
+    UINT64   fileId;
+    FILETIME lastWrite;
+    UINT64   lastHit;
+    int      width;
+    int      height;
+    BYTE     *blob;
+    DWORD    blobSize;
+    UINT32   blobHash;
+    bool     verified;
+    bool     dirty;
+} IconCacheEntry;
+
+/**
+ * IconCache – in-memory store of cached icons loaded from / saved to disk.
+ *
+ * @member entries      Pointer to contiguous buffer of cache entries.
+ * @member count        Number of entries currently stored.
+ * @member capacity     Allocated slots in @entries.
+ * @member dirty        TRUE if any entry was added or updated since last save.
+ * @member fileEnd      Offset just past the last good journal record (0 if
+ *                      the file is missing or unusable).
+ * @member fileRecords  Records in the journal, including superseded ones.
+ * @member fileVolume   Volume serial of the journal @fileEnd refers to.
+ * @member fileIndex    File index of that journal (changes on compaction).
+ * @member compact      TRUE if the next save must compact: replay skipped
+ *                      records past CACHE_MAX_LOAD_ENTRIES, or
+ *                      "/cachestat compact" asked for it.
+ * @member index        Open-addressing hash table of entry positions + 1
+ *                      (0 = empty slot), for O(1) IconCacheFind.
+ * @member idIndex      Same, keyed on file identity, for IconCacheFindId;
+ *                      entries without an identity are left out.
+ * @member indexMask    Size of @index and @idIndex minus one (a power of
+ *                      two), 0 if no tables have been built yet.
+ */
+typedef struct {
+    IconCacheEntry *entries;
+    UINT            count;
+    UINT            capacity;
+    UINT            *index;
+    UINT            *idIndex;
+    UINT            indexMask;
+    bool            dirty;
+    UINT64          fileEnd;
+    UINT            fileRecords;
+    DWORD           fileVolume;
+    UINT64          fileIndex;
+    bool            compact;
+} IconCache;
+
+/** Global icon cache instance; only active when /C flag is passed. */
+extern IconCache g_iconCache;
+
+UINT            IconCacheKeyHash(PCWSTR path, int size);
+UINT            IconCacheIdHash(DWORD volume, UINT64 fileId, int size);
+bool            IconCacheRebuildIndex(void);
+IconCacheEntry *IconCacheFind(PCWSTR path, int size);
+IconCacheEntry *IconCacheFindId(DWORD volume, UINT64 fileId, int size);
+IconCacheEntry *IconCacheAdd(const IconCacheEntry *entry);
+IconCacheEntry *IconCacheCopyMoved(PCWSTR path, int size, const FILETIME *lastWrite,
+                                   DWORD volume, UINT64 fileId);
+BOOL            IconCacheParseFields(const BYTE *data, DWORD size, IconCacheEntry *out,
+                                     const BYTE **outPath, DWORD *outPathLen, const BYTE **outBlob);
+DWORD           IconCacheReplayRecords(const BYTE *data, DWORD size, DWORD offset);
+DWORD           IconCacheConvertPrevious(const BYTE *data, DWORD size);
+void            IconCacheHeader(DWORD header[CACHE_HEADER_SIZE / sizeof(DWORD)]);
+BOOL            IconCacheHeaderValid(const BYTE *data, DWORD size);
+DWORD           IconCacheMergeOffset(DWORD size, bool sameFile);
+BOOL            IconCacheMergeRecords(const BYTE *data, DWORD size, DWORD start);
+BYTE           *IconCacheEncodeRecord(const IconCacheEntry *e, DWORD *outSize);
+BOOL            IconCacheVerifyBlob(IconCacheEntry *e);
+void            IconCacheRemoveDropped(void);
+UINT            IconCachePruneMissing(const PCWSTR *paths, const BYTE *missing, UINT count);
+UINT            IconCacheEvictLru(UINT maxEntries, UINT64 maxBytes);
+void            IconCacheFree(void);
+
+
+/* -------------------------------------------------------------------------- */
+/* Enumeration limits                                                         */
+/* -------------------------------------------------------------------------- */
+
+#define MAX_DEPTH 5
+
+/** Enumeration defaults (sendto.ini [Enumeration] overrides them) and the
+ *  hard caps those overrides are clamped to. */
+#define ENUM_FOLDER_ENTRIES     1000
+#define ENUM_TOTAL_ENTRIES      5000
+#define ENUM_BUDGET_MS          2000
+#define ENUM_MAX_DEPTH_CAP      10
+#define ENUM_FOLDER_ENTRIES_CAP 10000
+#define ENUM_TOTAL_ENTRIES_CAP  50000
+#define ENUM_BUDGET_MS_MIN      50
+#define ENUM_BUDGET_MS_CAP      30000
+
+/**
+ * EnumLimits – guardrails for the SendTo tree walk, read from the
+ *              [Enumeration] section of sendto.ini.
+ *
+ * Every value is clamped to a sane range, so a typo in a deployment's ini
+ * cannot disable the guardrails altogether.
+ *
+ * @member maxDepth          Folder nesting levels shown (MaxDepth).
+ * @member maxFolderEntries  Entries listed per folder (MaxFolderEntries).
+ * @member maxTotalEntries   Entries in the whole menu (MaxTotalEntries).
+ * @member budgetMs          Wall-clock budget for the walk (BudgetMs).
+ * @member followReparse     Descend into junctions and directory symlinks
+ *                           (FollowReparsePoints); repeats are skipped either way.
+ * @member background        Show the menu after the root listing and fill
+ *                           subfolders on a worker thread (Background).
+ */
+typedef struct {
+    UINT maxDepth;
+    UINT maxFolderEntries;
+    UINT maxTotalEntries;
+    UINT budgetMs;
+    bool followReparse;
+    bool background;
+} EnumLimits;
+
+/**
+ * SettingReader – reads one integer setting (GetPrivateProfileIntW on
+ *                 Windows), returning @fallback if it is not set.
+ */
+typedef INT (*SettingReader)(PCWSTR section, PCWSTR key, INT fallback, const void *context);
+
+UINT ClampSetting(INT value, UINT low, UINT high);
+void EnumLimitsLoad(EnumLimits *limits, SettingReader read, const void *context);
+bool EnumDescends(const EnumLimits *limits, UINT depth);
+bool EnumBudgetReached(const EnumLimits *limits, UINT listed, double elapsedMs);
+
+/**
+ * VisitedSet – identities (volume serial + file index) of the directories
+ *              entered by the current walk, in an open-addressing table.
+ *
+ * A junction or symlink that leads back to an ancestor (or to any folder
+ * already listed) would otherwise multiply the walk up to the depth limit.
+ *
+ * @member volumes   Volume serial per slot.
+ * @member fileIds   File index per slot; 0 marks an empty slot.
+ * @member mask      Slot count - 1 (power of two), 0 before the first add.
+ * @member count     Occupied slots.
+ */
+typedef struct {
+    DWORD  *volumes;
+    UINT64 *fileIds;
+    UINT    mask;
+    UINT    count;
+} VisitedSet;
+
+void VisitedFree(VisitedSet *set);
+bool VisitedAdd(VisitedSet *set, DWORD volume, UINT64 fileId);
+
+
+/* -------------------------------------------------------------------------- */
+/* Include / exclude filters                                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * FilterKind – how a FilterRule pattern is matched.
+ *
+ * FILTER_EXACT  no wildcard: whole-name compare.
+ * FILTER_AFFIX  exactly one '*': prefix and/or suffix compare.
+ * FILTER_GLOB   anything else ('?' or several '*'): FilterGlobMatch.
+ */
+typedef enum {
+    FILTER_EXACT,
+    FILTER_AFFIX,
+    FILTER_GLOB
+} FilterKind;
+
+/**
+ * FilterRule – one compiled glob pattern.
+ *
+ * @member text       Whole pattern (points into FilterList.pool).
+ * @member suffix     FILTER_AFFIX: text after the '*'.
+ * @member prefixLen  FILTER_EXACT: pattern length; FILTER_AFFIX: chars before '*'.
+ * @member suffixLen  FILTER_AFFIX: chars after '*'.
+ * @member kind       FilterKind.
+ * @member dirOnly    Pattern ended in '\' or '/': matches folders only.
+ */
+typedef struct {
+    PCWSTR text;
+    PCWSTR suffix;
+    UINT   prefixLen;
+    UINT   suffixLen;
+    UINT8  kind;
+    bool   dirOnly;
+} FilterRule;
+
+/**
+ * FilterList – the patterns of one sendto.ini section, compiled once.
+ *
+ * @member pool   Section text (GetPrivateProfileSectionW format: lines
+ *                separated by NULs, ending with an empty one); the rules
+ *                point into it.
+ * @member rules  Heap array of compiled rules.
+ * @member count  Number of rules.
+ */
+typedef struct {
+    PWSTR       pool;
+    FilterRule *rules;
+    UINT        count;
+} FilterList;
+
+bool FilterCompileRule(PWSTR pattern, FilterRule *rule);
+void FilterCompileLines(FilterList *list, PWSTR pool);
+bool FilterGlobMatch(PCWSTR name, PCWSTR spec);
+bool FilterMatches(const FilterList *list, PCWSTR name, size_t nameLen, bool isDirectory);
+void FilterFree(FilterList *list);
+
+
+/* -------------------------------------------------------------------------- */
+/* Background enumeration queue                                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * EnumJob – a submenu whose folder still has to be listed in the background.
+ *
+ * @member menu    Submenu to fill; holds a "loading…" marker until then.
+ * @member path    Heap-alloc'd folder path.
+ * @member parent  Vector index of the folder's own item.
+ * @member depth   Depth of the folder (root = 0).
+ */
+typedef struct {
+    HMENU menu;
+    PWSTR path;
+    UINT  parent;
+    UINT  depth;
+} EnumJob;
+
+/**
+ * EnumQueue – FIFO of EnumJobs the enumeration worker takes from; the
+ *             caller serialises access (EnumPipeline's lock).
+ *
+ * @member jobs      Heap array; [head, count) are still to be taken.
+ * @member head      Next job to take.
+ * @member count     Used slots in @jobs.
+ * @member capacity  Allocated slots in @jobs.
+ */
+typedef struct {
+    EnumJob *jobs;
+    UINT     head;
+    UINT     count;
+    UINT     capacity;
+} EnumQueue;
+
+bool EnumQueuePush(EnumQueue *queue, const EnumJob *job);
+void EnumQueuePromote(EnumQueue *queue, HMENU menu);
+bool EnumQueueTake(EnumQueue *queue, EnumJob *out);
+void EnumQueueFree(EnumQueue *queue);
+
+
+/* -------------------------------------------------------------------------- */
+/* Menu snapshot                                                              */
+/* -------------------------------------------------------------------------- */
+
+/** Menu snapshot file signature: "STM\0" (SendTo Menu). */
+#define SNAPSHOT_MAGIC          0x004D5453
+#define SNAPSHOT_VERSION        2
+/** Snapshot header: magic + version + payload size + CacheHash32 of the payload. */
+#define SNAPSHOT_HEADER_SIZE    16
+/** Snapshot files larger than this are neither written nor read. */
+#define SNAPSHOT_MAX_FILE_SIZE  (32u << 20)
+
+/**
+ * FolderListing – the filtered, sorted entries of one folder.
+ *
+ * Produced by ListFolder (the file-system half of the walk, which may run
+ * on the background enumeration thread) and consumed by PopulateFolder
+ * (the menu half, always on the UI thread).
+ *
+ * @member entries    Heap array of entries, directories first.
+ * @member count      Number of entries.
+ * @member truncated  A limit or cancellation cut the listing short.
+ */
+typedef struct {
+    WIN32_FIND_DATAW *entries;
+    UINT              count;
+    bool              truncated;
+} FolderListing;
+
+/**
+ * SnapshotFolder – one folder listing kept in a MenuSnapshot.
+ *
+ * @member path       Heap-alloc'd folder path.
+ * @member hash       IconMemoHash(@path).
+ * @member depth      Depth below the SendTo root (root = 0).
+ * @member lastWrite  Last-write time of the folder itself when it was
+ *                    listed (0 until known).  It moves on whenever an entry
+ *                    is added, removed or renamed.
+ * @member listing    The entries (owned).  Never truncated: a listing cut
+ *                    short by a limit or cancellation is not kept, so the
+ *                    folder is listed again instead of served incomplete.
+ */
+typedef struct {
+    PWSTR         path;
+    UINT          hash;
+    UINT          depth;
+    UINT64        lastWrite;
+    FolderListing listing;
+} SnapshotFolder;
+
+/**
+ * MenuSnapshot – the folder listings of one walk of the SendTo tree.
+ *
+ * @member folders   Heap array of folders, root first.
+ * @member count     Number of folders.
+ * @member capacity  Allocated slots in @folders.
+ * @member savedAt   When the tree was last walked in full (FILETIME);
+ *                   revalidation keeps it, so [Snapshot] MaxAgeMinutes
+ *                   bounds how long unchanged folders are trusted.
+ */
+typedef struct {
+    SnapshotFolder *folders;
+    UINT            count;
+    UINT            capacity;
+    UINT64          savedAt;
+} MenuSnapshot;
+
+void                  SnapshotFree(MenuSnapshot *snapshot);
+bool                  SnapshotAdd(MenuSnapshot *snapshot, PCWSTR path, UINT depth, UINT64 lastWrite,
+                                  const FolderListing *listing);
+const SnapshotFolder *SnapshotFind(const MenuSnapshot *snapshot, PCWSTR path);
+bool                  SnapshotEncode(const MenuSnapshot *snapshot, PCWSTR root, UINT32 settings,
+                                     BYTE **data, DWORD *size);
+bool                  SnapshotDecode(const BYTE *data, DWORD size, PCWSTR root, UINT32 settings,
+                                     UINT64 now, UINT64 maxAge, MenuSnapshot *out);
+
+/**
+ * SnapshotStampReader – current last-write time of a folder (FILETIME), or
+ *                       0 if it cannot be reached.
+ */
+typedef UINT64 (*SnapshotStampReader)(PCWSTR path, void *context);
+
+/**
+ * SnapshotLister – list a folder (ListFolder on Windows), counting against
+ *                  @listed entries already in the pass.
+ *
+ * @return  false if the folder could not be listed (@out is then empty).
+ */
+typedef bool (*SnapshotLister)(PCWSTR path, UINT listed, void *context, FolderListing *out);
+
+/**
+ * SnapshotRevalidation – state of one revalidation pass.
+ *
+ * @member loaded   Snapshot being checked (read only).
+ * @member limits   Depth limit of the walk.
+ * @member stamp    Reads a folder's current last-write time.
+ * @member list     Lists a folder again.
+ * @member context  Passed to @stamp and @list.
+ * @member cancel   Non-zero stops the pass.
+ * @member next     Snapshot being rebuilt.
+ * @member listed   Entries in @next (total limit).
+ * @member relisted Folders whose time had moved on and were listed again.
+ * @member checked  Folders whose time was checked.
+ */
+typedef struct {
+    const MenuSnapshot  *loaded;
+    const EnumLimits    *limits;
+    SnapshotStampReader  stamp;
+    SnapshotLister       list;
+    void                *context;
+    const volatile LONG *cancel;
+    MenuSnapshot         next;
+    UINT                 listed;
+    UINT                 relisted;
+    UINT                 checked;
+} SnapshotRevalidation;
+
+bool SnapshotRevalidateFolder(SnapshotRevalidation *pass, PCWSTR path, UINT depth, UINT64 stamp);
+
+
+/* -------------------------------------------------------------------------- */
+/* Overflow paging                                                            */
+/* -------------------------------------------------------------------------- */
+
+/** Folders with more entries than this are split into page submenus. */
+#define MENU_PAGE_THRESHOLD 48
+/** Upper bound of entries per leaf page and of pages per popup. */
+#define MENU_PAGE_SIZE      32
+
+WCHAR PageKeyChar(PCWSTR name);
+UINT  PageSpan(UINT count);
+UINT  NextPageEnd(const WIN32_FIND_DATAW *entries, UINT start, UINT end, UINT span);
+
+
+/* -------------------------------------------------------------------------- */
+/* Pixel blob codec                                                           */
+/* -------------------------------------------------------------------------- */
+
+/** Worst-case encoded size of @count pixels (every pixel a BGRA literal). */
+#define BLOB_MAX_SIZE(count) ((size_t)(count) * 5)
+
+size_t BlobEncode(const UINT32 *pixels, size_t count, BYTE *out);
+BOOL   BlobDecode(const BYTE *in, size_t size, UINT32 *pixels, size_t count);
+
+
+/* -------------------------------------------------------------------------- */
+/* Atlas packer                                                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * AtlasShelf – one horizontal strip of an atlas page.
+ *
+ * @member y       Top edge of the shelf.
+ * @member height  Shelf height (height of the first cell placed on it).
+ * @member used    Width already handed out, left to right.
+ */
+typedef struct {
+    int y;
+    int height;
+    int used;
+} AtlasShelf;
+
+/**
+ * AtlasPacker – shelf allocator for one square page of @dim pixels.
+ *
+ * Pure geometry, no GDI: cells are carved left to right out of shelves,
+ * and new shelves are stacked top to bottom.  Menu icons come in one or
+ * two sizes, so shelves fill almost perfectly.
+ *
+ * @member shelves   Pointer to contiguous buffer (realloc'd).
+ * @member count     Shelves currently opened.
+ * @member capacity  Allocated slots in @shelves.
+ * @member top       First row not covered by any shelf.
+ */
+typedef struct {
+    AtlasShelf *shelves;
+    UINT        count;
+    UINT        capacity;
+    int         top;
+} AtlasPacker;
+
+bool AtlasPackerAlloc(AtlasPacker *packer, int dim, int width, int height, int *outX, int *outY);
+void AtlasPackerFree(AtlasPacker *packer);
+
+
+/* -------------------------------------------------------------------------- */
+/* Pixel kernels                                                              */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Row kernels over 32-bit BGRA pixels.  The unsuffixed names pick the best
+ * kernel of the build; the Scalar and Sse2 versions are exported so the
+ * host tests and benchmarks can hold them against each other.
+ */
+
+void PremultiplyRow(UINT32 *pixels, size_t count);
+void UnpremultiplyRow(UINT32 *pixels, size_t count);
+void MaskToAlphaRow(UINT32 *pixels, const UINT32 *mask, size_t count);
+BOOL HasAlphaRow(const UINT32 *pixels, size_t count);
+void CopyPixelRows(UINT32 *dst, int dstStride, const UINT32 *src, int srcStride, int width, int height);
+
+void PremultiplyRowScalar(UINT32 *pixels, size_t count);
+void UnpremultiplyRowScalar(UINT32 *pixels, size_t count);
+void MaskToAlphaRowScalar(UINT32 *pixels, const UINT32 *mask, size_t count);
+BOOL HasAlphaRowScalar(const UINT32 *pixels, size_t count);
+
+#ifdef SENDTO_SSE2
+void PremultiplyRowSse2(UINT32 *pixels, size_t count);
+void UnpremultiplyRowSse2(UINT32 *pixels, size_t count);
+void MaskToAlphaRowSse2(UINT32 *pixels, const UINT32 *mask, size_t count);
+BOOL HasAlphaRowSse2(const UINT32 *pixels, size_t count);
+#endif
+
+#endif /* SENDTO_CORE_H */
@@ -0,0 +1,263 @@
+/*
+ * bench_blob.c – the pixel blob codec on an icon corpus: compression
+ * ratio, encode and decode throughput, and what loading costs packed
+ * (read + decode) against reading the raw pixels from a file
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ *
+ * Usage: bench_blob [rounds] [sendto.cache]
+ *
+ * Without a cache file the corpus is synthetic (icon-shaped discs, glyphs
+ * and photo-like noise in the usual sizes); with one, its decoded blobs
+ * are the corpus.  "Cold" reads drop the file from the page cache first
+ * (posix_fadvise), which only works on a disk-backed directory.  ctest
+ * runs a short round count; every blob must round-trip.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "check.h"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Synthetic corpus: icons per size. */
+#define ICONS_PER_SIZE 256
+
+/**
+ * Corpus – icons laid end to end.
+ *
+ * @member pixels  All icons' straight-alpha pixels.
+ * @member counts  Pixels of each icon.
+ * @member icons   Number of icons.
+ * @member total   Pixels in @pixels.
+ */
+typedef struct {
+    UINT32 *pixels;
+    size_t *counts;
+    size_t  icons;
+    size_t  total;
+} Corpus;
+
+static double NowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void CorpusAdd(Corpus *corpus, const UINT32 *pixels, size_t count)
+{
+    corpus->pixels = realloc(corpus->pixels, (corpus->total + count) * sizeof *corpus->pixels);
+    corpus->counts = realloc(corpus->counts, (corpus->icons + 1) * sizeof *corpus->counts);
+    memcpy(corpus->pixels + corpus->total, pixels, count * sizeof *pixels);
+    corpus->counts[corpus->icons++] = count;
+    corpus->total += count;
+}
+
+/**
+ * SyntheticIcon – one of three shapes: a shaded disc with an anti-aliased
+ *                 rim, a flat glyph on a transparent square, or a
+ *                 photo-like thumbnail (opaque, noisy).
+ */
+static void SyntheticIcon(UINT32 *out, int dim, UINT n)
+{
+    UINT seed = n * 2654435761u;
+    for (int y = 0; y < dim; ++y) {
+        for (int x = 0; x < dim; ++x) {
+            const int dx = 2 * x + 1 - dim, dy = 2 * y + 1 - dim;
+            const int d = dx * dx + dy * dy, r2 = (dim - 4) * (dim - 4);
+            UINT32 a, r, g, b;
+            seed = seed * 1103515245u + 12345u;
+            switch (n % 3) {
+            case 0:
+                a = d <= r2 - 4 * dim ? 255 : d >= r2 ? 0 : 128;
+                r = 60 + (UINT32)(x * 150 / dim); g = 80 + (UINT32)(y * 120 / dim); b = 40 + n % 100;
+                break;
+            case 1:
+                a = (x > dim / 4 && x < dim * 3 / 4 && (y % (dim / 4)) < dim / 8) ? 255 : 0;
+                r = g = b = 30 + n % 40;
+                break;
+            default:
+                a = 255;
+                r = (UINT32)(x * 4 + (seed >> 27)) & 0xFF;
+                g = (UINT32)(y * 3 + (seed >> 26 & 7)) & 0xFF;
+                b = (UINT32)((x + y) * 2 + (seed >> 28)) & 0xFF;
+                break;
+            }
+            out[y * dim + x] = a ? a << 24 | r << 16 | g << 8 | b : 0;
+        }
+    }
+}
+
+static void SyntheticCorpus(Corpus *corpus)
+{
+    static const int dims[] = { 16, 20, 24, 32, 48 };
+    static UINT32 icon[48 * 48];
+    for (size_t d = 0; d < ARRAYSIZE(dims); ++d) {
+        for (UINT n = 0; n < ICONS_PER_SIZE; ++n) {
+            SyntheticIcon(icon, dims[d], n);
+            CorpusAdd(corpus, icon, (size_t)dims[d] * dims[d]);
+        }
+    }
+}
+
+/**
+ * CacheCorpus – the icons of a sendto.cache (this build's format).
+ *
+ * @return  false if the file cannot be read or is not a current journal.
+ */
+static bool CacheCorpus(Corpus *corpus, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    BYTE *data = malloc(CACHE_MAX_FILE_SIZE);
+    const size_t size = fread(data, 1, CACHE_MAX_FILE_SIZE, f);
+    fclose(f);
+
+    bool ok = IconCacheHeaderValid(data, (DWORD)size);
+    if (ok) {
+        IconCacheReplayRecords(data, (DWORD)size, CACHE_HEADER_SIZE);
+        for (UINT i = 0; i < g_iconCache.count; ++i) {
+            IconCacheEntry *e = &g_iconCache.entries[i];
+            const size_t count = (size_t)e->width * e->height;
+            UINT32 *pixels = malloc(count * sizeof *pixels);
+            if (!IconCacheVerifyBlob(e)) {
+                free(pixels);
+                continue;
+            }
+            if (e->blobSize == count * 4) {
+                memcpy(pixels, e->blob, e->blobSize);
+            } else if (!BlobDecode(e->blob, e->blobSize, pixels, count)) {
+                free(pixels);
+                continue;
+            }
+            CorpusAdd(corpus, pixels, count);
+            free(pixels);
+        }
+        IconCacheFree();
+    }
+    free(data);
+    return ok && corpus->icons > 0;
+}
+
+static void WriteAll(const char *path, const void *data, size_t size)
+{
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    CHECK(fd >= 0 && write(fd, data, size) == (ssize_t)size);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/**
+ * TimeRead – read @path whole into @buffer, optionally dropping it from
+ *            the page cache first.
+ *
+ * @return  Elapsed milliseconds.
+ */
+static double TimeRead(const char *path, void *buffer, size_t size, bool cold)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    if (cold) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    const double start = NowMs();
+    size_t done = 0;
+    for (ssize_t got; done < size && (got = read(fd, (BYTE *)buffer + done, size - done)) > 0; ) {
+        done += (size_t)got;
+    }
+    const double elapsed = NowMs() - start;
+    close(fd);
+    CHECK(done == size);
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    const UINT rounds = argc > 1 ? (UINT)atoi(argv[1]) : 20;
+
+    Corpus corpus = { 0 };
+    if (argc > 2) {
+        if (!CacheCorpus(&corpus, argv[2])) {
+            fprintf(stderr, "bench_blob: %s: not a readable current sendto.cache\n", argv[2]);
+            return 2;
+        }
+    } else {
+        SyntheticCorpus(&corpus);
+    }
+
+    const size_t rawBytes = corpus.total * 4;
+    BYTE   *packed  = malloc(BLOB_MAX_SIZE(corpus.total));
+    size_t *sizes   = malloc(corpus.icons * sizeof *sizes);
+    UINT32 *decoded = malloc(rawBytes);
+
+    // encode once for the ratio and the round-trip check
+    size_t packedBytes = 0;
+    for (size_t i = 0, at = 0; i < corpus.icons; at += corpus.counts[i++]) {
+        sizes[i] = BlobEncode(corpus.pixels + at, corpus.counts[i], packed + packedBytes);
+        packedBytes += sizes[i];
+    }
+    for (size_t i = 0, at = 0, n = 0; i < corpus.icons; n += sizes[i], at += corpus.counts[i++]) {
+        CHECK(BlobDecode(packed + n, sizes[i], decoded + at, corpus.counts[i]));
+    }
+    CHECK(memcmp(decoded, corpus.pixels, rawBytes) == 0);
+
+    double encodeMs = 0, decodeMs = 0;
+    for (UINT r = 0; r < rounds; ++r) {
+        double start = NowMs();
+        for (size_t i = 0, at = 0, n = 0; i < corpus.icons; at += corpus.counts[i++]) {
+            n += BlobEncode(corpus.pixels + at, corpus.counts[i], packed + n);
+        }
+        encodeMs += NowMs() - start;
+
+        start = NowMs();
+        for (size_t i = 0, at = 0, n = 0; i < corpus.icons; n += sizes[i], at += corpus.counts[i++]) {
+            BlobDecode(packed + n, sizes[i], decoded + at, corpus.counts[i]);
+        }
+        decodeMs += NowMs() - start;
+    }
+
+    // the same bytes as files, read back warm and cold
+    static const char rawPath[] = "bench_blob.raw", packedPath[] = "bench_blob.packed";
+    WriteAll(rawPath, corpus.pixels, rawBytes);
+    WriteAll(packedPath, packed, packedBytes);
+    double rawWarm = 0, rawCold = 0, packedCold = 0;
+    for (UINT r = 0; r < rounds; ++r) {
+        rawWarm    += TimeRead(rawPath, decoded, rawBytes, false);
+        rawCold    += TimeRead(rawPath, decoded, rawBytes, true);
+        packedCold += TimeRead(packedPath, packed, packedBytes, true);
+    }
+    unlink(rawPath);
+    unlink(packedPath);
+
+    const double mb = (double)rawBytes * rounds / (1024.0 * 1024.0);
+    printf("%zu icons, %zu KB raw -> %zu KB packed (ratio %.3f, %.2fx smaller) x %u rounds\n",
+           corpus.icons, rawBytes / 1024, packedBytes / 1024, (double)packedBytes / rawBytes,
+           packedBytes ? (double)rawBytes / packedBytes : 0.0, rounds);
+    printf("encode:          %8.1f MB/s of pixels\n", mb / (encodeMs / 1000.0));
+    printf("decode:          %8.1f MB/s of pixels\n", mb / (decodeMs / 1000.0));
+    printf("raw read, warm:  %8.1f MB/s\n", mb / (rawWarm / 1000.0));
+    printf("raw read, cold:  %8.1f MB/s\n", mb / (rawCold / 1000.0));
+    // reading D bytes/s: raw costs raw/D, packed costs packed/D + decode,
+    // so packed wins on media slower than (raw - packed) / decode time
+    printf("break-even read: %8.1f MB/s (packed loads faster on slower media)\n",
+           decodeMs > 0 ? (double)(rawBytes - packedBytes) * rounds / (1024.0 * 1024.0) / (decodeMs / 1000.0) : 0.0);
+    printf("load raw (cold read):              %8.2f ms per pass\n", rawCold / rounds);
+    printf("load packed (cold read + decode):  %8.2f ms per pass  -> %s\n",
+           (packedCold + decodeMs) / rounds,
+           packedCold + decodeMs < rawCold ? "packed loads faster" : "raw loads faster on this disk");
+
+    free(corpus.pixels);
+    free(corpus.counts);
+    free(packed);
+    free(sizes);
+    free(decoded);
+    return TestResult("bench_blob");
+}
@@ -0,0 +1,170 @@
+/*
+ * bench_filter.c – matching throughput of the compiled filter rules
+ * against naive glob matching (lower-cased copies of name and pattern per
+ * compare, recursive '*'), on names shaped like a SendTo folder
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ *
+ * Usage: bench_filter [rounds]   (ctest runs a short round count; both
+ * matchers must agree on every name)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "check.h"
+
+#include <time.h>
+
+#define NAMES 4096
+
+/** A deployment's [Exclude] section. */
+static const char *const g_patterns[] = {
+    "desktop.ini", "Thumbs.db", "*.bak", "*.tmp", "~*", "*.old", "scratch\\",
+    "*cache*", "backup 2???*", "*.t?p", "Old *.lnk", "*.log", "_*", "*~",
+    "*.orig", "*copy*"
+};
+
+static double NowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static WCHAR Lower(WCHAR ch)
+{
+    return (ch >= L'A' && ch <= L'Z') ? (WCHAR)(ch - L'A' + L'a') : ch;
+}
+
+static PWSTR LowerCopy(PCWSTR text)
+{
+    const size_t len = wcslen(text);
+    PWSTR copy = malloc((len + 1) * sizeof(WCHAR));
+    for (size_t i = 0; i <= len; ++i) {
+        copy[i] = Lower(text[i]);
+    }
+    return copy;
+}
+
+static bool NaiveGlob(PCWSTR name, PCWSTR mask)
+{
+    if (*mask == L'*') {
+        do {
+            if (NaiveGlob(name, mask + 1)) {
+                return true;
+            }
+        } while (*name++);
+        return false;
+    }
+    if (!*mask) {
+        return !*name;
+    }
+    if (!*name || (*mask != L'?' && *mask != *name)) {
+        // "x.*" also matches "x", as in FilterGlobMatch
+        return !*name && mask[0] == L'.' && mask[1] == L'*' && NaiveGlob(name, mask + 1);
+    }
+    return NaiveGlob(name + 1, mask + 1);
+}
+
+/**
+ * NaiveMatches – what an uncompiled filter does per entry: copy and fold
+ *                name and every pattern, then glob.
+ */
+static bool NaiveMatches(PCWSTR const *patterns, const bool *dirOnly, UINT count,
+                         PCWSTR name, bool isDirectory)
+{
+    bool hit = false;
+    PWSTR lowName = LowerCopy(name);
+    for (UINT i = 0; i < count && !hit; ++i) {
+        if (dirOnly[i] && !isDirectory) continue;
+        PWSTR lowMask = LowerCopy(patterns[i]);
+        hit = NaiveGlob(lowName, lowMask);
+        free(lowMask);
+    }
+    free(lowName);
+    return hit;
+}
+
+static void MakeName(PWSTR out, UINT i)
+{
+    static const char *const stems[] = {
+        "Notepad++", "7-Zip", "Mail Recipient", "Desktop (create shortcut)", "Compressed folder",
+        "Old Editor", "backup 2024-03-01", "IconCache", "~lock", "_draft", "Bluetooth device"
+    };
+    static const char *const exts[] = { ".lnk", ".lnk", ".lnk", ".exe", ".bat", ".bak", ".tmp", ".log", "", ".ini" };
+    char name[128];
+    snprintf(name, sizeof name, "%s %u%s", stems[i % ARRAYSIZE(stems)], i,
+             exts[(i / ARRAYSIZE(stems)) % ARRAYSIZE(exts)]);
+    Widen(out, 128, name);
+}
+
+int main(int argc, char **argv)
+{
+    const UINT rounds = argc > 1 ? (UINT)atoi(argv[1]) : 20;
+
+    // compiled rules, as LoadSettings builds them
+    size_t chars = 1;
+    for (size_t i = 0; i < ARRAYSIZE(g_patterns); ++i) {
+        chars += strlen(g_patterns[i]) + 1;
+    }
+    PWSTR pool = malloc(chars * sizeof(WCHAR));
+    PWSTR p = pool;
+    for (size_t i = 0; i < ARRAYSIZE(g_patterns); ++i) {
+        Widen(p, strlen(g_patterns[i]) + 1, g_patterns[i]);
+        p += strlen(g_patterns[i]) + 1;
+    }
+    *p = L'\0';
+    FilterList list = { 0 };
+    FilterCompileLines(&list, pool);
+    CHECK(list.count == ARRAYSIZE(g_patterns));
+
+    // the same patterns for the naive matcher
+    PCWSTR patterns[ARRAYSIZE(g_patterns)];
+    bool   dirOnly[ARRAYSIZE(g_patterns)];
+    for (UINT i = 0; i < list.count; ++i) {
+        patterns[i] = list.rules[i].text;
+        dirOnly[i]  = list.rules[i].dirOnly;
+    }
+
+    static WCHAR names[NAMES][128];
+    static size_t lengths[NAMES];
+    for (UINT i = 0; i < NAMES; ++i) {
+        MakeName(names[i], i);
+        lengths[i] = wcslen(names[i]);
+    }
+
+    UINT hidden = 0;
+    for (UINT i = 0; i < NAMES; ++i) {
+        const bool isDirectory = i % 7 == 0;
+        const bool fast  = FilterMatches(&list, names[i], lengths[i], isDirectory);
+        const bool naive = NaiveMatches(patterns, dirOnly, list.count, names[i], isDirectory);
+        CHECK(fast == naive);
+        hidden += fast;
+    }
+    CHECK(hidden > 0 && hidden < NAMES);
+
+    volatile UINT sink = 0;
+    double start = NowMs();
+    for (UINT r = 0; r < rounds; ++r) {
+        for (UINT i = 0; i < NAMES; ++i) {
+            sink += FilterMatches(&list, names[i], lengths[i], i % 7 == 0);
+        }
+    }
+    const double compiledMs = NowMs() - start;
+
+    start = NowMs();
+    for (UINT r = 0; r < rounds; ++r) {
+        for (UINT i = 0; i < NAMES; ++i) {
+            sink += NaiveMatches(patterns, dirOnly, list.count, names[i], i % 7 == 0);
+        }
+    }
+    const double naiveMs = NowMs() - start;
+
+    const double total = (double)rounds * NAMES;
+    printf("%u patterns, %u names (%u hidden) x %u rounds\n", list.count, NAMES, hidden, rounds);
+    printf("compiled: %8.1f ms  %6.2f M names/s\n", compiledMs, total / compiledMs / 1e3);
+    printf("naive:    %8.1f ms  %6.2f M names/s  (%.1fx slower)\n", naiveMs, total / naiveMs / 1e3,
+           compiledMs > 0 ? naiveMs / compiledMs : 0.0);
+
+    FilterFree(&list);
+    return TestResult("bench_filter");
+}
@@ -0,0 +1,143 @@
+/*
+ * check.h – assertion and fixture helpers shared by the core tests
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#ifndef SENDTO_TEST_CHECK_H
+#define SENDTO_TEST_CHECK_H
+
+#include "sendto_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Failed checks so far; the test's exit code. */
+static int g_failures = 0;
+
+/** Report @cond if it does not hold and keep going. */
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            g_failures++; \
+        } \
+    } while (0)
+
+/**
+ * TestResult – print the verdict of test @name and return its exit code.
+ */
+static inline int TestResult(const char *name)
+{
+    printf("%s: %s (%d failed checks)\n", name, g_failures ? "FAILED" : "ok", g_failures);
+    return g_failures ? 1 : 0;
+}
+
+/**
+ * Widen – copy narrow @text into @out one byte per WCHAR (the tests only
+ *         use ASCII names).
+ */
+static inline void Widen(PWSTR out, size_t cch, const char *text)
+{
+    size_t i = 0;
+    for (; text[i] && i + 1 < cch; ++i) {
+        out[i] = (WCHAR)(unsigned char)text[i];
+    }
+    out[i] = L'\0';
+}
+
+/**
+ * TestEntry – a cache entry for @path at @size with a blob filled from
+ *             @seed; path and blob are heap-allocated, blobHash is set.
+ */
+static inline IconCacheEntry TestEntry(const char *path, int size, UINT seed)
+{
+    WCHAR wide[MAX_PATH];
+    Widen(wide, MAX_PATH, path);
+
+    IconCacheEntry e = { 0 };
+    e.path     = _wcsdup(wide);
+    e.volume   = 0x1234;
+    e.fileId   = 0;
+    e.lastWrite.dwLowDateTime  = seed;
+    e.lastWrite.dwHighDateTime = 0x01DA0000u;
+    e.lastHit  = 1000 + seed;
+    e.width    = size;
+    e.height   = size;
+    e.blobSize = 16 + seed % 64;
+    e.blob     = malloc(e.blobSize);
+    for (DWORD i = 0; i < e.blobSize; ++i) {
+        e.blob[i] = (BYTE)(seed * 31 + i);
+    }
+    e.blobHash = CacheHash32(e.blob, e.blobSize, 0);
+    e.verified = true;
+    return e;
+}
+
+/**
+ * JournalBuffer – growable byte buffer a test assembles a journal in.
+ */
+typedef struct {
+    BYTE  *data;
+    DWORD  size;
+} JournalBuffer;
+
+static inline void JournalAppend(JournalBuffer *journal, const void *data, DWORD size)
+{
+    journal->data = realloc(journal->data, journal->size + size);
+    memcpy(journal->data + journal->size, data, size);
+    journal->size += size;
+}
+
+/** JournalStart – empty journal holding this build's header. */
+static inline JournalBuffer JournalStart(void)
+{
+    JournalBuffer journal = { 0 };
+    DWORD header[CACHE_HEADER_SIZE / sizeof(DWORD)];
+    IconCacheHeader(header);
+    JournalAppend(&journal, header, sizeof header);
+    return journal;
+}
+
+/** JournalAppendEntry – append @e as one record; returns the record size. */
+static inline DWORD JournalAppendEntry(JournalBuffer *journal, const IconCacheEntry *e)
+{
+    DWORD size = 0;
+    BYTE *record = IconCacheEncodeRecord(e, &size);
+    JournalAppend(journal, record, size);
+    free(record);
+    return size;
+}
+
+/** JournalStartPrevious – empty CACHE_PREVIOUS_VERSION journal (magic, version). */
+static inline JournalBuffer JournalStartPrevious(void)
+{
+    JournalBuffer journal = { 0 };
+    const DWORD header[CACHE_PREVIOUS_HEADER_SIZE / sizeof(DWORD)] = { CACHE_MAGIC, CACHE_PREVIOUS_VERSION };
+    JournalAppend(&journal, header, sizeof header);
+    return journal;
+}
+
+/**
+ * JournalAppendPrevious – append @e as a CACHE_PREVIOUS_VERSION record:
+ *                         the current layout without blobHash and metaHash.
+ */
+static inline void JournalAppendPrevious(JournalBuffer *journal, const IconCacheEntry *e)
+{
+    const DWORD pathLen = (DWORD)(wcslen(e->path) + 1);
+    const DWORD payload = sizeof pathLen + pathLen * sizeof(WCHAR) + sizeof e->volume + sizeof e->fileId +
+                          sizeof e->lastWrite + sizeof e->lastHit + sizeof e->width + sizeof e->height +
+                          sizeof e->blobSize + e->blobSize;
+    JournalAppend(journal, &payload, sizeof payload);
+    JournalAppend(journal, &pathLen, sizeof pathLen);
+    JournalAppend(journal, e->path, pathLen * sizeof(WCHAR));
+    JournalAppend(journal, &e->volume, sizeof e->volume);
+    JournalAppend(journal, &e->fileId, sizeof e->fileId);
+    JournalAppend(journal, &e->lastWrite, sizeof e->lastWrite);
+    JournalAppend(journal, &e->lastHit, sizeof e->lastHit);
+    JournalAppend(journal, &e->width, sizeof e->width);
+    JournalAppend(journal, &e->height, sizeof e->height);
+    JournalAppend(journal, &e->blobSize, sizeof e->blobSize);
+    JournalAppend(journal, e->blob, e->blobSize);
+}
+
+#endif /* SENDTO_TEST_CHECK_H */
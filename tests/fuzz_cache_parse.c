@@ -0,0 +1,265 @@
+/*
+ * fuzz_cache_parse.c – fuzz target for the sendto.cache parser: journal
+ * headers, record framing, IconCacheParseFields and the conversion of the
+ * previous format over arbitrary bytes
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ *
+ * Built with clang this is a libFuzzer target (-fsanitize=fuzzer, see
+ * tests/CMakeLists.txt; run it on tests/corpus/cache_parse).  Elsewhere a
+ * small driver replays the corpus plus deterministic mutations of it, so
+ * ctest exercises the same checks under any compiler.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "check.h"
+
+#include <stdint.h>
+
+/** Fixed fields after the path: volume .. blobHash, then metaHash. */
+#define FIXED_BEFORE_META (4 + 8 + 8 + 8 + 4 + 4 + 4 + 4)
+
+/**
+ * CheckFields – a record IconCacheParseFields accepts must lie wholly
+ *               inside @data and satisfy the limits the loader relies on.
+ */
+static void CheckFields(const BYTE *data, DWORD size)
+{
+    IconCacheEntry e;
+    const BYTE *path, *blob;
+    DWORD pathLen;
+    if (!IconCacheParseFields(data, size, &e, &path, &pathLen, &blob)) {
+        return;
+    }
+
+    CHECK(pathLen >= 1 && pathLen <= MAX_PATH);
+    CHECK(path >= data && path + pathLen * sizeof(WCHAR) <= data + size);
+    CHECK(e.width > 0 && e.width <= 256 && e.height > 0 && e.height <= 256);
+    CHECK(e.blobSize > 0 && e.blobSize <= (DWORD)(e.width * e.height * 4));
+    CHECK(blob >= data && blob + e.blobSize == data + size);
+    CHECK(e.path == NULL && e.blob == NULL);
+}
+
+/**
+ * CheckFieldsRepaired – same, with metaHash recomputed, so mutations reach
+ *                       the range checks behind the checksum.
+ */
+static void CheckFieldsRepaired(const BYTE *data, DWORD size)
+{
+    DWORD pathLen;
+    if (size < sizeof pathLen) {
+        return;
+    }
+    memcpy(&pathLen, data, sizeof pathLen);
+    if (pathLen == 0 || pathLen > MAX_PATH) {
+        return;
+    }
+
+    const DWORD metaAt = sizeof pathLen + pathLen * sizeof(WCHAR) + FIXED_BEFORE_META;
+    if (size < metaAt + sizeof(UINT32)) {
+        return;
+    }
+
+    BYTE *copy = malloc(size);
+    if (!copy) {
+        return;
+    }
+    memcpy(copy, data, size);
+    const UINT32 metaHash = CacheHash32(copy, metaAt, 0);
+    memcpy(copy + metaAt, &metaHash, sizeof metaHash);
+    CheckFields(copy, size);
+    free(copy);
+}
+
+/**
+ * CheckReplay – replay @data as a whole journal (if it has this build's
+ *               header) or as a tail read by IconCacheMergeTail.  What gets
+ *               materialised is bounded by the file: at most
+ *               CACHE_MAX_LOAD_ENTRIES entries, and no more path and blob
+ *               bytes than the records that carried them.
+ */
+static void CheckReplay(const BYTE *data, DWORD size)
+{
+    const DWORD start = IconCacheHeaderValid(data, size) ? CACHE_HEADER_SIZE : 0;
+    const DWORD end = IconCacheReplayRecords(data, size, start);
+    CHECK(end >= start && end <= size);
+    CHECK(g_iconCache.count <= CACHE_MAX_LOAD_ENTRIES);
+    CHECK(g_iconCache.count <= g_iconCache.fileRecords);
+
+    UINT64 heapBytes = 0;
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        const IconCacheEntry *e = &g_iconCache.entries[i];
+        CHECK(e->path && e->blob && !e->dirty);
+        heapBytes += (wcslen(e->path) + 1) * sizeof(WCHAR) + e->blobSize;
+    }
+    CHECK(heapBytes <= end - start);
+    IconCacheFree();
+}
+
+/**
+ * CheckConvert – the same bounds for IconCacheConvertPrevious, with @data
+ *                given the CACHE_PREVIOUS_VERSION header in front.
+ */
+static void CheckConvert(const BYTE *data, DWORD size)
+{
+    BYTE *copy = malloc(CACHE_PREVIOUS_HEADER_SIZE + (size_t)size);
+    if (!copy) {
+        return;
+    }
+    const DWORD header[CACHE_PREVIOUS_HEADER_SIZE / sizeof(DWORD)] = { CACHE_MAGIC, CACHE_PREVIOUS_VERSION };
+    memcpy(copy, header, sizeof header);
+    memcpy(copy + sizeof header, data, size);
+
+    const DWORD end = IconCacheConvertPrevious(copy, CACHE_PREVIOUS_HEADER_SIZE + size);
+    CHECK(end >= CACHE_PREVIOUS_HEADER_SIZE && end <= CACHE_PREVIOUS_HEADER_SIZE + size);
+    CHECK(g_iconCache.count <= CACHE_MAX_LOAD_ENTRIES);
+
+    UINT64 heapBytes = 0;
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        const IconCacheEntry *e = &g_iconCache.entries[i];
+        CHECK(e->path && e->blob && e->dirty && e->verified);
+        heapBytes += (wcslen(e->path) + 1) * sizeof(WCHAR) + e->blobSize;
+    }
+    CHECK(heapBytes <= end - CACHE_PREVIOUS_HEADER_SIZE);
+    IconCacheFree();
+    free(copy);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size > CACHE_MAX_FILE_SIZE) {
+        return 0;
+    }
+
+    CheckFields(data, (DWORD)size);
+    CheckFieldsRepaired(data, (DWORD)size);
+    CheckReplay(data, (DWORD)size);
+    CheckConvert(data, (DWORD)size);
+
+    // libFuzzer only reports crashes; turn a failed check into one
+    if (g_failures) {
+        abort();
+    }
+    return 0;
+}
+
+#ifndef SENDTO_LIBFUZZER
+
+#include <dirent.h>
+
+/** Mutations run per corpus file by the standalone driver. */
+#define MUTATIONS 3000
+
+static UINT32 g_random = 0x2545F491u;
+
+static UINT32 NextRandom(void)
+{
+    g_random ^= g_random << 13;
+    g_random ^= g_random >> 17;
+    g_random ^= g_random << 5;
+    return g_random;
+}
+
+/**
+ * RunMutations – feed @seed and MUTATIONS variants of it (flipped and
+ *                overwritten bytes, cuts, duplicated slices) to the target.
+ */
+static void RunMutations(const BYTE *seed, DWORD size)
+{
+    LLVMFuzzerTestOneInput(seed, size);
+
+    BYTE *buffer = malloc(size * 2 + 64);
+    for (UINT m = 0; buffer && m < MUTATIONS; ++m) {
+        DWORD length = size;
+        memcpy(buffer, seed, size);
+
+        const UINT edits = 1 + NextRandom() % 4;
+        for (UINT k = 0; k < edits && length; ++k) {
+            const DWORD at = NextRandom() % length;
+            switch (NextRandom() % 5) {
+            case 0:
+                buffer[at] ^= (BYTE)(1u << (NextRandom() % 8));
+                break;
+            case 1:
+                buffer[at] = (BYTE)NextRandom();
+                break;
+            case 2: {
+                // interesting little-endian DWORDs: sizes and counts
+                static const DWORD values[] = { 0, 1, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF, MAX_PATH, 257 };
+                const DWORD value = values[NextRandom() % ARRAYSIZE(values)];
+                if (at + sizeof value <= length) {
+                    memcpy(buffer + at, &value, sizeof value);
+                }
+                break;
+            }
+            case 3:
+                length = at;
+                break;
+            default: {
+                const DWORD count = NextRandom() % 64;
+                if (at + count <= length && length + count <= size * 2 + 64) {
+                    memmove(buffer + at + count, buffer + at, length - at);
+                    length += count;
+                }
+                break;
+            }
+            }
+        }
+        LLVMFuzzerTestOneInput(buffer, length);
+    }
+    free(buffer);
+}
+
+static void RunFile(const char *file)
+{
+    FILE *f = fopen(file, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", file);
+        g_failures++;
+        return;
+    }
+    BYTE *data = NULL;
+    DWORD size = 0;
+    BYTE chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof chunk, f)) > 0) {
+        data = realloc(data, size + got);
+        memcpy(data + size, chunk, got);
+        size += (DWORD)got;
+    }
+    fclose(f);
+
+    RunMutations(data ? data : chunk, size);
+    free(data);
+}
+
+/**
+ * Standalone driver: every argument is a corpus file or directory.
+ */
+int main(int argc, char **argv)
+{
+    UINT files = 0;
+    for (int i = 1; i < argc; ++i) {
+        DIR *dir = opendir(argv[i]);
+        if (!dir) {
+            RunFile(argv[i]);
+            files++;
+            continue;
+        }
+        struct dirent *item;
+        while ((item = readdir(dir)) != NULL) {
+            if (item->d_name[0] == '.') continue;
+            char path[1024];
+            snprintf(path, sizeof path, "%s/%s", argv[i], item->d_name);
+            RunFile(path);
+            files++;
+        }
+        closedir(dir);
+    }
+    CHECK(files > 0);
+    return TestResult("fuzz_cache_parse");
+}
+
+#endif /* SENDTO_LIBFUZZER */
@@ -0,0 +1,131 @@
+/*
+ * test_atlas.c – the shelf packer behind the icon atlas pages: fill order,
+ * shelf reuse and fallback, full pages and oversized icons, and that no
+ * two cells ever overlap
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#include "check.h"
+
+/** Edge of the small pages used here (the atlas uses 256). */
+#define DIM 64
+
+/** Allocate and check the cell lands at (@x, @y). */
+static void Expect(AtlasPacker *packer, int width, int height, int x, int y)
+{
+    int gotX = -1, gotY = -1;
+    CHECK(AtlasPackerAlloc(packer, DIM, width, height, &gotX, &gotY));
+    if (gotX != x || gotY != y) {
+        fprintf(stderr, "  %dx%d: expected (%d,%d), got (%d,%d)\n", width, height, x, y, gotX, gotY);
+    }
+    CHECK(gotX == x && gotY == y);
+}
+
+/** Equal cells go left to right, then a new shelf opens below. */
+static void TestFillOrder(void)
+{
+    AtlasPacker packer = { 0 };
+    for (int i = 0; i < 4; ++i) {
+        Expect(&packer, 16, 16, i * 16, 0);
+    }
+    Expect(&packer, 16, 16, 0, 16);
+    CHECK(packer.count == 2 && packer.top == 32);
+    AtlasPackerFree(&packer);
+    CHECK(packer.shelves == NULL && packer.count == 0 && packer.top == 0);
+}
+
+/** A partly filled shelf takes later cells of a fitting height. */
+static void TestShelfReuse(void)
+{
+    AtlasPacker packer = { 0 };
+    Expect(&packer, 16, 16, 0, 0);     // shelf 0, height 16
+    Expect(&packer, 32, 32, 0, 16);    // shelf 1, height 32
+    Expect(&packer, 16, 16, 16, 0);    // back on shelf 0, not on the tall one
+    Expect(&packer, 24, 24, 32, 16);   // snug on shelf 1 (32 <= 24 + 12)
+    Expect(&packer, 12, 12, 32, 0);    // shelf 0 is the lowest snug one
+    CHECK(packer.count == 2);
+    AtlasPackerFree(&packer);
+}
+
+/** With no row left for a new shelf, any tall enough shelf is used. */
+static void TestFallbackAndFull(void)
+{
+    AtlasPacker packer = { 0 };
+    int x, y;
+    Expect(&packer, 32, 48, 0, 0);     // shelf 0, height 48
+    for (int i = 0; i < 4; ++i) {      // 48 is not snug for 16: own shelf
+        Expect(&packer, 16, 16, i * 16, 48);
+    }
+    CHECK(packer.top == DIM);
+    Expect(&packer, 16, 16, 32, 0);    // fallback onto shelf 0
+    Expect(&packer, 16, 16, 48, 0);
+
+    CHECK(!AtlasPackerAlloc(&packer, DIM, 16, 16, &x, &y));
+    CHECK(!AtlasPackerAlloc(&packer, DIM, 1, 1, &x, &y));
+    CHECK(packer.count == 2);
+    AtlasPackerFree(&packer);
+}
+
+/** Cells larger than the page (or empty) are refused outright. */
+static void TestOversized(void)
+{
+    AtlasPacker packer = { 0 };
+    int x, y;
+    CHECK(!AtlasPackerAlloc(&packer, DIM, DIM + 1, 16, &x, &y));
+    CHECK(!AtlasPackerAlloc(&packer, DIM, 16, DIM + 1, &x, &y));
+    CHECK(!AtlasPackerAlloc(&packer, DIM, 0, 16, &x, &y));
+    CHECK(!AtlasPackerAlloc(&packer, DIM, 16, -1, &x, &y));
+    CHECK(packer.count == 0 && packer.top == 0);
+
+    Expect(&packer, DIM, DIM, 0, 0);   // exactly the page
+    CHECK(!AtlasPackerAlloc(&packer, DIM, 1, 1, &x, &y));
+    AtlasPackerFree(&packer);
+}
+
+/** Mixed icon sizes until the page is full: cells stay inside and disjoint. */
+static void TestNoOverlap(void)
+{
+    static const int sizes[] = { 16, 20, 24, 32, 40, 48 };
+    static BYTE owner[256][256];
+    UINT seed = 12345;
+
+    for (int round = 0; round < 50; ++round) {
+        const int dim = 256;
+        AtlasPacker packer = { 0 };
+        memset(owner, 0, sizeof owner);
+        int placed = 0, area = 0;
+
+        for (int failures = 0; failures < 20; ) {
+            seed = seed * 1103515245u + 12345u;
+            const int size = sizes[(seed >> 16) % ARRAYSIZE(sizes)];
+            int x, y;
+            if (!AtlasPackerAlloc(&packer, dim, size, size, &x, &y)) {
+                failures++;
+                continue;
+            }
+            CHECK(x >= 0 && y >= 0 && x + size <= dim && y + size <= dim);
+            placed++;
+            area += size * size;
+            for (int row = y; row < y + size && row < dim; ++row) {
+                for (int col = x; col < x + size && col < dim; ++col) {
+                    CHECK(owner[row][col] == 0);
+                    owner[row][col] = 1;
+                }
+            }
+        }
+
+        // shelves of one or two heights waste little: well over half used
+        CHECK(placed > 0 && area > dim * dim / 2);
+        AtlasPackerFree(&packer);
+    }
+}
+
+int main(void)
+{
+    TestFillOrder();
+    TestShelfReuse();
+    TestFallbackAndFull();
+    TestOversized();
+    TestNoOverlap();
+    return TestResult("atlas");
+}
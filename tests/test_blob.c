@@ -0,0 +1,186 @@
+/*
+ * test_blob.c – the pixel blob codec: round trips over transparent runs,
+ * smooth icons, opaque noise and single pixels, and BlobDecode's refusal
+ * of truncated, overlong, miscounted and mutated streams
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#include "check.h"
+
+static UINT g_seed = 1;
+
+static UINT32 Random32(void)
+{
+    g_seed = g_seed * 1103515245u + 12345u;
+    const UINT32 high = g_seed >> 16;
+    g_seed = g_seed * 1103515245u + 12345u;
+    return high << 16 | g_seed >> 16;
+}
+
+/**
+ * RoundTrip – encode @count pixels, decode them back and compare.
+ *
+ * @param outBlob  Optional; receives the encoded stream (free it).
+ * @return         Encoded size.
+ */
+static size_t RoundTrip(const UINT32 *pixels, size_t count, BYTE **outBlob)
+{
+    BYTE   *blob    = malloc(BLOB_MAX_SIZE(count) + 1);
+    UINT32 *decoded = malloc((count + 1) * sizeof *decoded);
+    const size_t size = BlobEncode(pixels, count, blob);
+    CHECK(size <= BLOB_MAX_SIZE(count));
+
+    memset(decoded, 0xA5, (count + 1) * sizeof *decoded);
+    CHECK(BlobDecode(blob, size, decoded, count));
+    CHECK(count == 0 || memcmp(decoded, pixels, count * sizeof *pixels) == 0);
+    CHECK(decoded[count] == 0xA5A5A5A5u);    // nothing written past @count
+
+    // the stream fixes the pixel count: one more or one less fails
+    CHECK(!BlobDecode(blob, size, decoded, count + 1));
+    if (count) {
+        CHECK(!BlobDecode(blob, size, decoded, count - 1));
+    }
+
+    free(decoded);
+    if (outBlob) {
+        *outBlob = blob;
+    } else {
+        free(blob);
+    }
+    return size;
+}
+
+/** Icon-shaped pixels: transparent margin, soft edge, gradient body. */
+static void MakeIcon(UINT32 *out, int dim)
+{
+    for (int y = 0; y < dim; ++y) {
+        for (int x = 0; x < dim; ++x) {
+            const int m = x < y ? x : y;
+            const int edge = m < dim - 1 - x ? (m < dim - 1 - y ? m : dim - 1 - y) : dim - 1 - x;
+            const UINT32 a = edge < 2 ? 0 : edge == 2 ? 0x80 : 0xFF;
+            out[y * dim + x] = a ? a << 24 | (UINT32)(40 + x * 3) << 16 | (UINT32)(90 + y * 2) << 8 | 200 : 0;
+        }
+    }
+}
+
+static void TestTransparent(void)
+{
+    static UINT32 pixels[48 * 48];    // all zero: the predictor's start value
+
+    // one RUN byte per BLOB_RUN_MAX (62) pixels, nothing else
+    CHECK(RoundTrip(pixels, 32 * 32, NULL) == (32 * 32 + 61) / 62);
+    CHECK(RoundTrip(pixels, 48 * 48, NULL) == (48 * 48 + 61) / 62);
+    CHECK(RoundTrip(pixels, 61, NULL) == 1);
+    CHECK(RoundTrip(pixels, 62, NULL) == 1);
+    CHECK(RoundTrip(pixels, 63, NULL) == 2);
+    CHECK(RoundTrip(pixels, 124, NULL) == 2);
+
+    // transparent runs between opaque spans come back through the index
+    for (size_t i = 0; i < 48 * 48; ++i) {
+        pixels[i] = (i / 100) % 2 ? 0xFF336699u : 0;
+    }
+    CHECK(RoundTrip(pixels, 48 * 48, NULL) < 100);
+}
+
+static void TestIcons(void)
+{
+    static const int dims[] = { 16, 20, 24, 32, 48, 64 };
+    static UINT32 pixels[64 * 64];
+    for (size_t d = 0; d < ARRAYSIZE(dims); ++d) {
+        const size_t count = (size_t)dims[d] * dims[d];
+        MakeIcon(pixels, dims[d]);
+        // margins, runs and LUMA deltas: a smooth icon packs to about half
+        CHECK(RoundTrip(pixels, count, NULL) < count * 4 * 3 / 5);
+    }
+}
+
+/** Opaque noise defeats every predictor: literals, within BLOB_MAX_SIZE. */
+static void TestNoise(void)
+{
+    static UINT32 pixels[4096];
+    for (size_t i = 0; i < ARRAYSIZE(pixels); ++i) {
+        pixels[i] = Random32();
+    }
+    const size_t size = RoundTrip(pixels, ARRAYSIZE(pixels), NULL);
+    CHECK(size > ARRAYSIZE(pixels) * 4 && size <= BLOB_MAX_SIZE(ARRAYSIZE(pixels)));
+
+    for (size_t i = 0; i < ARRAYSIZE(pixels); ++i) {
+        pixels[i] |= 0xFF000000u;    // constant alpha: BGR literals at worst
+    }
+    CHECK(RoundTrip(pixels, ARRAYSIZE(pixels), NULL) <= ARRAYSIZE(pixels) * 4 + 16);
+
+    // channel deltas that wrap around 0 / 255 stay exact
+    for (size_t i = 0; i < ARRAYSIZE(pixels); ++i) {
+        const UINT32 v = (UINT32)(i % 4) * 0x7F;
+        pixels[i] = 0xFF000000u | ((254 + v) & 0xFF) << 16 | ((1 - v) & 0xFF) << 8 | ((255 + v * 3) & 0xFF);
+    }
+    RoundTrip(pixels, ARRAYSIZE(pixels), NULL);
+}
+
+/** Length 1 and 0, for every op the first pixel can take. */
+static void TestSinglePixel(void)
+{
+    static const UINT32 values[] = {
+        0, 0x00000001u, 0x00FEFFFFu, 0x00010100u, 0x00201010u, 0x00FFFFFFu, 0xFF000000u, 0x80402010u, 0xFFFFFFFFu
+    };
+    for (size_t v = 0; v < ARRAYSIZE(values); ++v) {
+        RoundTrip(&values[v], 1, NULL);
+    }
+
+    UINT32 pixel = 0;
+    CHECK(BlobEncode(&pixel, 0, NULL) == 0);
+    CHECK(BlobDecode(NULL, 0, &pixel, 0));
+    CHECK(!BlobDecode(NULL, 0, &pixel, 1));
+}
+
+/** Every truncation and every extra byte fails; mutations never overrun. */
+static void TestMalformed(void)
+{
+    static UINT32 pixels[32 * 32], decoded[32 * 32];
+    MakeIcon(pixels, 32);
+    pixels[500] = 0x12345678u;    // force a BGRA literal in the middle
+    BYTE *blob;
+    const size_t size = RoundTrip(pixels, ARRAYSIZE(pixels), &blob);
+
+    for (size_t cut = 0; cut < size; ++cut) {
+        CHECK(!BlobDecode(blob, cut, decoded, ARRAYSIZE(decoded)));
+    }
+
+    BYTE *longer = malloc(size + 8);
+    memcpy(longer, blob, size);
+    for (size_t extra = 1; extra <= 8; ++extra) {
+        for (int byte = 0; byte < 256; byte += 51) {
+            memset(longer + size, byte, extra);
+            CHECK(!BlobDecode(longer, size + extra, decoded, ARRAYSIZE(decoded)));
+        }
+    }
+    free(longer);
+
+    // a run that would overshoot the pixel count is refused
+    const BYTE overshoot[] = { 0xC0 | 61, 0xC0 | 61 };
+    CHECK(!BlobDecode(overshoot, sizeof overshoot, decoded, 100));
+
+    // random mutations: any verdict is fine, out-of-bounds access is not
+    // (run under ASan)
+    BYTE *copy = malloc(size);
+    for (int round = 0; round < 2000; ++round) {
+        memcpy(copy, blob, size);
+        for (int flips = 1 + round % 4; flips--; ) {
+            copy[Random32() % size] ^= (BYTE)(1u << (Random32() % 8));
+        }
+        const size_t length = round % 3 ? size : Random32() % size;
+        BlobDecode(copy, length, decoded, ARRAYSIZE(decoded));
+    }
+    free(copy);
+    free(blob);
+}
+
+int main(void)
+{
+    TestTransparent();
+    TestIcons();
+    TestNoise();
+    TestSinglePixel();
+    TestMalformed();
+    return TestResult("blob");
+}
@@ -0,0 +1,318 @@
+/*
+ * test_cachetool.c – sendto-cachetool against journals built here: exit
+ * codes of stat / validate, and what compact keeps, drops, converts and
+ * resets
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ *
+ * Usage: test_cachetool <path of sendto-cachetool>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "check.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char *g_tool;
+static char g_dir[] = "/tmp/sendto-cachetool-XXXXXX";
+static char g_file[600];
+
+/** Run "sendto-cachetool @command <g_file>" and return its exit code. */
+static int Tool(const char *command)
+{
+    char line[1400];
+    snprintf(line, sizeof line, "'%s' %s '%s' >/dev/null 2>&1", g_tool, command, g_file);
+    const int status = system(line);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**
+ * IconEntry – a cache entry whose blob is a real BlobEncode stream of a
+ *             synthetic icon (transparent margin, opaque gradient).
+ */
+static IconCacheEntry IconEntry(const char *path, int size, UINT seed)
+{
+    IconCacheEntry e = TestEntry(path, size, seed);
+    free(e.blob);
+
+    const size_t count = (size_t)size * size;
+    UINT32 *pixels = calloc(count, sizeof *pixels);
+    for (int y = 2; y < size - 2; ++y) {
+        for (int x = 2; x < size - 2; ++x) {
+            pixels[y * size + x] = 0xFF000000u | ((seed * 40 + (UINT)x * 4) & 0xFF) << 16 | (UINT)y * 8 << 8 | (seed & 0xFF);
+        }
+    }
+
+    BYTE *packed = malloc(BLOB_MAX_SIZE(count));
+    e.blobSize = (DWORD)BlobEncode(pixels, count, packed);
+    e.blob     = packed;
+    e.blobHash = CacheHash32(e.blob, e.blobSize, 0);
+
+    UINT32 *decoded = malloc(count * sizeof *decoded);
+    CHECK(BlobDecode(e.blob, e.blobSize, decoded, count));
+    CHECK(memcmp(decoded, pixels, count * sizeof *pixels) == 0);
+    free(decoded);
+    free(pixels);
+    return e;
+}
+
+static void AppendIcon(JournalBuffer *journal, const char *path, int size, UINT seed)
+{
+    IconCacheEntry e = IconEntry(path, size, seed);
+    JournalAppendEntry(journal, &e);
+    free(e.path);
+    free(e.blob);
+}
+
+static void WriteFile(const void *data, size_t size)
+{
+    FILE *f = fopen(g_file, "wb");
+    CHECK(f && fwrite(data, 1, size, f) == size);
+    if (f) fclose(f);
+}
+
+static void WriteJournal(JournalBuffer *journal)
+{
+    WriteFile(journal->data, journal->size);
+    free(journal->data);
+    *journal = (JournalBuffer){ 0 };
+}
+
+/**
+ * Reload – replay g_file into g_iconCache as sendto.exe would.
+ *
+ * @return  The file size, or 0 if the header is not this build's.
+ */
+static DWORD Reload(void)
+{
+    IconCacheFree();
+    FILE *f = fopen(g_file, "rb");
+    static BYTE data[1 << 22];
+    const size_t size = f ? fread(data, 1, sizeof data, f) : 0;
+    if (f) fclose(f);
+    if (!IconCacheHeaderValid(data, (DWORD)size)) {
+        return 0;
+    }
+    g_iconCache.fileEnd = IconCacheReplayRecords(data, (DWORD)size, CACHE_HEADER_SIZE);
+    CHECK(g_iconCache.fileEnd == size);
+    return (DWORD)size;
+}
+
+static bool Cached(const char *path, int size)
+{
+    WCHAR wide[MAX_PATH];
+    Widen(wide, MAX_PATH, path);
+    return IconCacheFind(wide, size) != NULL;
+}
+
+/** A healthy journal with a superseded record and a torn tail. */
+static void TestHealthy(void)
+{
+    JournalBuffer journal = JournalStart();
+    AppendIcon(&journal, "C:\\Tools\\a.lnk", 16, 1);
+    AppendIcon(&journal, "C:\\Tools\\b.lnk", 16, 2);
+    AppendIcon(&journal, "C:\\Tools\\a.lnk", 16, 3);    // supersedes the first
+    AppendIcon(&journal, "C:\\Tools\\a.lnk", 32, 4);
+    const DWORD end = journal.size;
+    AppendIcon(&journal, "C:\\Tools\\c.lnk", 16, 5);
+    journal.size = end + 9;                              // torn append
+    WriteJournal(&journal);
+
+    CHECK(Tool("stat") == 0);
+    CHECK(Tool("validate") == 0);
+    CHECK(Tool("compact") == 0);
+    CHECK(Tool("validate") == 0);
+
+    CHECK(Reload() > 0);
+    CHECK(g_iconCache.count == 3 && g_iconCache.fileRecords == 3);
+    CHECK(Cached("C:\\Tools\\a.lnk", 16) && Cached("C:\\Tools\\a.lnk", 32) && Cached("C:\\Tools\\b.lnk", 16));
+    CHECK(IconCacheFind(L"C:\\Tools\\a.lnk", 16)->lastHit == 1000 + 3);
+    IconCacheFree();
+
+    struct stat st;
+    CHECK(stat(g_file, &st) == 0 && st.st_size < end);
+    char temp[700];
+    snprintf(temp, sizeof temp, "%s.tmp", g_file);
+    CHECK(access(temp, F_OK) != 0);
+}
+
+/** A bad checksum or an undecodable blob fails validation; compact drops them. */
+static void TestCorrupt(void)
+{
+    JournalBuffer journal = JournalStart();
+    AppendIcon(&journal, "C:\\Tools\\good.lnk", 16, 1);
+    AppendIcon(&journal, "C:\\Tools\\flipped.lnk", 16, 2);
+    journal.data[journal.size - 1] ^= 0x01;    // last blob byte: blobHash fails
+    // random bytes with a matching checksum: not a BlobEncode stream
+    IconCacheEntry junk = TestEntry("C:\\Tools\\junk.lnk", 16, 7);
+    JournalAppendEntry(&journal, &junk);
+    free(junk.path);
+    free(junk.blob);
+    AppendIcon(&journal, "C:\\Tools\\also good.lnk", 32, 3);
+    WriteJournal(&journal);
+    CHECK(Reload() > 0);
+    CHECK(g_iconCache.count == 4);
+    IconCacheFree();
+
+    CHECK(Tool("validate") == 1);
+    CHECK(Tool("stat") == 1);
+    CHECK(Tool("compact") == 0);
+    CHECK(Tool("validate") == 0);
+
+    CHECK(Reload() > 0);
+    CHECK(g_iconCache.count == 2);
+    CHECK(Cached("C:\\Tools\\good.lnk", 16) && Cached("C:\\Tools\\also good.lnk", 32));
+    IconCacheFree();
+}
+
+/** Compact applies the LRU budget: the least recently hit entries go. */
+static void TestBudget(void)
+{
+    JournalBuffer journal = JournalStart();
+    const UINT total = CACHE_MAX_ENTRIES + 10;
+    for (UINT i = 0; i < total; ++i) {
+        char path[64];
+        snprintf(path, sizeof path, "C:\\Many\\%05u.lnk", i);
+        AppendIcon(&journal, path, 8, i);    // lastHit 1000 + i
+    }
+    WriteJournal(&journal);
+
+    CHECK(Tool("compact") == 0);
+    CHECK(Reload() > 0);
+    CHECK(g_iconCache.count == CACHE_MAX_ENTRIES);
+    CHECK(!Cached("C:\\Many\\00000.lnk", 8) && !Cached("C:\\Many\\00009.lnk", 8));
+    CHECK(Cached("C:\\Many\\00010.lnk", 8));
+    IconCacheFree();
+}
+
+/**
+ * A record sendto.exe appends while compact waits for the writer lock is
+ * kept: the tool reads the file only once it holds the lock.
+ */
+static void TestAppendDuringCompact(void)
+{
+    JournalBuffer journal = JournalStart();
+    AppendIcon(&journal, "C:\\Tools\\early.lnk", 16, 1);
+    WriteJournal(&journal);
+
+    char lockPath[700];
+    snprintf(lockPath, sizeof lockPath, "%s.lock", g_file);
+    const int lock = open(lockPath, O_RDWR | O_CREAT, 0644);
+    CHECK(lock >= 0 && flock(lock, LOCK_EX) == 0);
+
+    const pid_t child = fork();
+    if (child == 0) {
+        const int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execl(g_tool, g_tool, "compact", g_file, (char *)NULL);
+        _exit(127);
+    }
+    CHECK(child > 0);
+    usleep(200 * 1000);    // let the tool reach the lock
+
+    // append as sendto.exe does, holding the writer lock
+    journal = (JournalBuffer){ 0 };
+    AppendIcon(&journal, "C:\\Tools\\late.lnk", 16, 2);
+    FILE *f = fopen(g_file, "ab");
+    CHECK(f && fwrite(journal.data, 1, journal.size, f) == journal.size);
+    if (f) fclose(f);
+    free(journal.data);
+    flock(lock, LOCK_UN);
+    close(lock);
+
+    int status = 0;
+    CHECK(child > 0 && waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    CHECK(Reload() > 0);
+    CHECK(g_iconCache.count == 2);
+    CHECK(Cached("C:\\Tools\\early.lnk", 16) && Cached("C:\\Tools\\late.lnk", 16));
+    IconCacheFree();
+}
+
+/**
+ * A v6 journal (CACHE_PREVIOUS_VERSION) is reported as older and converted
+ * by compact with its entries; an older version is reset to an empty
+ * current journal.
+ */
+static void TestOlderFormat(void)
+{
+    JournalBuffer journal = JournalStartPrevious();
+    const char *paths[] = { "C:\\Tools\\a.lnk", "C:\\Tools\\b.lnk", "C:\\Tools\\a.lnk" };
+    for (UINT i = 0; i < ARRAYSIZE(paths); ++i) {
+        IconCacheEntry e = IconEntry(paths[i], 16, i + 1);
+        JournalAppendPrevious(&journal, &e);
+        free(e.path);
+        free(e.blob);
+    }
+    WriteJournal(&journal);
+
+    CHECK(Tool("validate") == 1);
+    CHECK(Tool("stat") == 1);
+    CHECK(Tool("compact") == 0);
+    CHECK(Tool("validate") == 0);
+    CHECK(Reload() > CACHE_HEADER_SIZE);
+    CHECK(g_iconCache.count == 2 && g_iconCache.fileRecords == 2);
+    CHECK(Cached("C:\\Tools\\a.lnk", 16) && Cached("C:\\Tools\\b.lnk", 16));
+    CHECK(IconCacheFind(L"C:\\Tools\\a.lnk", 16)->lastHit == 1000 + 3);
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        CHECK(IconCacheVerifyBlob(&g_iconCache.entries[i]));
+    }
+    IconCacheFree();
+
+    const DWORD header[] = { CACHE_MAGIC, CACHE_PREVIOUS_VERSION - 1, 0, 0x12345678 };
+    WriteFile(header, sizeof header);
+
+    CHECK(Tool("validate") == 1);
+    CHECK(Tool("stat") == 1);
+    CHECK(Tool("compact") == 0);
+    CHECK(Reload() == CACHE_HEADER_SIZE);
+    CHECK(g_iconCache.count == 0);
+    CHECK(Tool("validate") == 0);
+}
+
+/** Anything else is refused and left alone; usage errors exit 2. */
+static void TestForeign(void)
+{
+    static const char text[] = "[Exclude]\r\n*.bak\r\n";
+    WriteFile(text, sizeof text - 1);
+
+    CHECK(Tool("validate") == 1);
+    CHECK(Tool("compact") == 1);
+    struct stat st;
+    CHECK(stat(g_file, &st) == 0 && st.st_size == sizeof text - 1);
+
+    CHECK(Tool("frobnicate") == 2);
+    unlink(g_file);
+    CHECK(Tool("stat") == 2);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: test_cachetool <sendto-cachetool>\n");
+        return 2;
+    }
+    g_tool = argv[1];
+    CHECK(mkdtemp(g_dir) != NULL);
+    snprintf(g_file, sizeof g_file, "%s/sendto.cache", g_dir);
+
+    TestHealthy();
+    TestCorrupt();
+    TestBudget();
+    TestAppendDuringCompact();
+    TestOlderFormat();
+    TestForeign();
+
+    char lock[700];
+    snprintf(lock, sizeof lock, "%s.lock", g_file);
+    unlink(lock);
+    unlink(g_file);
+    rmdir(g_dir);
+    return TestResult("cachetool");
+}
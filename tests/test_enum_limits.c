@@ -0,0 +1,270 @@
+/*
+ * test_enum_limits.c – enumeration guardrails: sendto.ini values clamped
+ * to their caps, and depth, per-folder, total and wall-clock limits
+ * enforced on a walk over a real directory tree
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "check.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ---- sendto.ini ---------------------------------------------------------- */
+
+typedef struct {
+    const char *key;
+    INT         value;
+} FakeSetting;
+
+/**
+ * ReadFake – SettingReader over a NULL-terminated FakeSetting table.
+ */
+static INT ReadFake(PCWSTR section, PCWSTR key, INT fallback, const void *context)
+{
+    CHECK(_wcsicmp(section, L"Enumeration") == 0);
+    for (const FakeSetting *s = context; s->key; ++s) {
+        WCHAR wide[64];
+        Widen(wide, 64, s->key);
+        if (_wcsicmp(wide, key) == 0) {
+            return s->value;
+        }
+    }
+    return fallback;
+}
+
+static void TestLoad(void)
+{
+    EnumLimits limits;
+
+    const FakeSetting none[] = { { NULL, 0 } };
+    EnumLimitsLoad(&limits, ReadFake, none);
+    CHECK(limits.maxDepth == MAX_DEPTH);
+    CHECK(limits.maxFolderEntries == ENUM_FOLDER_ENTRIES);
+    CHECK(limits.maxTotalEntries == ENUM_TOTAL_ENTRIES);
+    CHECK(limits.budgetMs == ENUM_BUDGET_MS);
+    CHECK(limits.followReparse && limits.background);
+
+    const FakeSetting inRange[] = {
+        { "MaxDepth", 3 }, { "MaxFolderEntries", 250 }, { "MaxTotalEntries", 900 },
+        { "BudgetMs", 750 }, { "FollowReparsePoints", 0 }, { "Background", 0 }, { NULL, 0 }
+    };
+    EnumLimitsLoad(&limits, ReadFake, inRange);
+    CHECK(limits.maxDepth == 3 && limits.maxFolderEntries == 250);
+    CHECK(limits.maxTotalEntries == 900 && limits.budgetMs == 750);
+    CHECK(!limits.followReparse && !limits.background);
+
+    // a typo cannot switch a guardrail off
+    const FakeSetting tooLow[] = {
+        { "MaxDepth", 0 }, { "MaxFolderEntries", -1 }, { "MaxTotalEntries", -100000 },
+        { "BudgetMs", 1 }, { "FollowReparsePoints", -1 }, { NULL, 0 }
+    };
+    EnumLimitsLoad(&limits, ReadFake, tooLow);
+    CHECK(limits.maxDepth == 1 && limits.maxFolderEntries == 1 && limits.maxTotalEntries == 1);
+    CHECK(limits.budgetMs == ENUM_BUDGET_MS_MIN);
+    CHECK(!limits.followReparse);
+
+    const FakeSetting tooHigh[] = {
+        { "MaxDepth", 99 }, { "MaxFolderEntries", 0x7FFFFFFF }, { "MaxTotalEntries", 1000000 },
+        { "BudgetMs", 3600000 }, { "FollowReparsePoints", 7 }, { NULL, 0 }
+    };
+    EnumLimitsLoad(&limits, ReadFake, tooHigh);
+    CHECK(limits.maxDepth == ENUM_MAX_DEPTH_CAP);
+    CHECK(limits.maxFolderEntries == ENUM_FOLDER_ENTRIES_CAP);
+    CHECK(limits.maxTotalEntries == ENUM_TOTAL_ENTRIES_CAP);
+    CHECK(limits.budgetMs == ENUM_BUDGET_MS_CAP);
+    CHECK(limits.followReparse);
+}
+
+/* ---- the walk ------------------------------------------------------------ */
+
+static char g_root[] = "/tmp/sendto-limits-XXXXXX";
+
+static double NowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Walk – what the walk records: how much it listed, how deep it went,
+ *        whether any folder was cut short ("more…") and whether a folder
+ *        ever listed more than maxFolderEntries.
+ */
+typedef struct {
+    const EnumLimits *limits;
+    double start;
+    UINT   delayUs;    // simulated slow file system, per entry
+    UINT   listed;
+    UINT   deepest;
+    UINT   truncated;
+    bool   overFull;
+} Walk;
+
+/**
+ * WalkFolder – ListFolder + PopulateFolder's use of the limits: stop a
+ *              listing at maxFolderEntries or when the budget is gone, and
+ *              only descend while EnumDescends.
+ */
+static void WalkFolder(Walk *walk, const char *dir, UINT depth)
+{
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+    if (depth > walk->deepest) {
+        walk->deepest = depth;
+    }
+
+    char   (*subdirs)[768] = malloc(64 * sizeof *subdirs);
+    UINT   subdirCount = 0;
+    UINT   entryCount  = 0;
+    struct dirent *item;
+    while ((item = readdir(d)) != NULL) {
+        if (item->d_name[0] == '.') continue;
+        if (walk->delayUs) usleep(walk->delayUs);
+
+        if (entryCount >= walk->limits->maxFolderEntries ||
+            EnumBudgetReached(walk->limits, walk->listed, NowMs() - walk->start)) {
+            walk->truncated++;
+            break;
+        }
+        entryCount++;
+        walk->listed++;
+
+        if (item->d_type == DT_DIR && subdirCount < 64) {
+            snprintf(subdirs[subdirCount++], sizeof *subdirs, "%.500s/%.255s", dir, item->d_name);
+        }
+    }
+    closedir(d);
+    walk->overFull = walk->overFull || entryCount > walk->limits->maxFolderEntries;
+
+    for (UINT i = 0; EnumDescends(walk->limits, depth) && i < subdirCount; ++i) {
+        WalkFolder(walk, subdirs[i], depth + 1);
+    }
+    free(subdirs);
+}
+
+static void MakeFiles(const char *dir, UINT count)
+{
+    for (UINT i = 0; i < count; ++i) {
+        char file[512];
+        snprintf(file, sizeof file, "%s/item %04u.lnk", dir, i);
+        FILE *f = fopen(file, "wb");
+        if (f) fclose(f);
+    }
+}
+
+/**
+ * BuildTree – root (20 files) with "wide" (400 files) and a chain of
+ *             "deep" folders 12 levels down (3 files each).
+ */
+static void BuildTree(void)
+{
+    char path[512];
+    CHECK(mkdtemp(g_root) != NULL);
+    MakeFiles(g_root, 20);
+
+    snprintf(path, sizeof path, "%s/wide", g_root);
+    mkdir(path, 0755);
+    MakeFiles(path, 400);
+
+    snprintf(path, sizeof path, "%s", g_root);
+    for (UINT level = 0; level < 12; ++level) {
+        strncat(path, "/deep", sizeof path - strlen(path) - 1);
+        mkdir(path, 0755);
+        MakeFiles(path, 3);
+    }
+}
+
+static void RemoveTree(const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *item;
+    while (d && (item = readdir(d)) != NULL) {
+        if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) continue;
+        char path[1024];
+        snprintf(path, sizeof path, "%s/%s", dir, item->d_name);
+        if (item->d_type == DT_DIR) {
+            RemoveTree(path);
+        } else {
+            unlink(path);
+        }
+    }
+    if (d) closedir(d);
+    rmdir(dir);
+}
+
+static Walk RunWalk(const EnumLimits *limits, UINT delayUs)
+{
+    Walk walk = { limits, NowMs(), delayUs, 0, 0, 0, false };
+    WalkFolder(&walk, g_root, 0);
+    return walk;
+}
+
+/** Defaults: the whole test tree fits except the depth cut. */
+static void TestDefaults(void)
+{
+    const EnumLimits limits = { MAX_DEPTH, ENUM_FOLDER_ENTRIES, ENUM_TOTAL_ENTRIES, ENUM_BUDGET_MS, true, true };
+    const Walk walk = RunWalk(&limits, 0);
+    CHECK(walk.deepest == MAX_DEPTH - 1);
+    CHECK(walk.truncated == 0 && !walk.overFull);
+    CHECK(walk.listed == 22 + 400 + (MAX_DEPTH - 1) * 4);
+}
+
+/** Depth and per-folder caps: "wide" is cut, nothing deeper than maxDepth. */
+static void TestDepthAndFanOut(void)
+{
+    const EnumLimits limits = { 3, 100, ENUM_TOTAL_ENTRIES, ENUM_BUDGET_MS, true, true };
+    const Walk walk = RunWalk(&limits, 0);
+    CHECK(walk.deepest == 2);
+    CHECK(!walk.overFull);
+    CHECK(walk.truncated == 1);
+    CHECK(walk.listed == 22 + 100 + 4 + 4);
+
+    const EnumLimits flat = { 1, 100, ENUM_TOTAL_ENTRIES, ENUM_BUDGET_MS, true, true };
+    const Walk root = RunWalk(&flat, 0);
+    CHECK(root.deepest == 0 && root.listed == 22);
+}
+
+/** Total cap: the walk stops at maxTotalEntries across folders. */
+static void TestTotal(void)
+{
+    const EnumLimits limits = { MAX_DEPTH, ENUM_FOLDER_ENTRIES, 150, ENUM_BUDGET_MS, true, true };
+    const Walk walk = RunWalk(&limits, 0);
+    CHECK(walk.listed == 150);
+    CHECK(walk.truncated >= 1);
+}
+
+/** Time budget: a slow file system is cut off shortly after budgetMs. */
+static void TestTimeBudget(void)
+{
+    const EnumLimits limits = { MAX_DEPTH, ENUM_FOLDER_ENTRIES, ENUM_TOTAL_ENTRIES, ENUM_BUDGET_MS_MIN, true, true };
+    const double start = NowMs();
+    const Walk walk = RunWalk(&limits, 1000);
+    const double took = NowMs() - start;
+    CHECK(walk.truncated >= 1);
+    CHECK(walk.listed < 20 + 2 + 400);
+    CHECK(took >= ENUM_BUDGET_MS_MIN);
+    // one more entry per open folder, plus scheduling slack
+    CHECK(took < ENUM_BUDGET_MS_MIN + 250);
+}
+
+int main(void)
+{
+    TestLoad();
+
+    BuildTree();
+    TestDefaults();
+    TestDepthAndFanOut();
+    TestTotal();
+    TestTimeBudget();
+    RemoveTree(g_root);
+
+    return TestResult("enum_limits");
+}
@@ -0,0 +1,396 @@
+/*
+ * test_enum_queue.c – the background enumeration queue: FIFO order, growth
+ * and promotion, then sendto.c's pipeline (UI thread + worker around one
+ * EnumQueue) over a slow fake file system: early partial results, an
+ * opened submenu listed next, prompt cancellation, no leaked jobs
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "check.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Fake submenu handle of folder @id (never dereferenced). */
+#define FAKE_MENU(id) ((HMENU)(ULONG_PTR)((id) + 1))
+
+static double NowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static PWSTR FolderPath(UINT id)
+{
+    char narrow[32];
+    WCHAR wide[32];
+    snprintf(narrow, sizeof narrow, "/fake/%u", id);
+    Widen(wide, 32, narrow);
+    return _wcsdup(wide);
+}
+
+static UINT FolderId(PCWSTR path)
+{
+    UINT id = 0;
+    for (PCWSTR p = path + 6; *p; ++p) {
+        id = id * 10 + (UINT)(*p - L'0');
+    }
+    return id;
+}
+
+static EnumJob Job(UINT id, UINT depth)
+{
+    return (EnumJob){ FAKE_MENU(id), FolderPath(id), id, depth };
+}
+
+static bool Push(EnumQueue *queue, UINT id)
+{
+    const EnumJob job = Job(id, 1);
+    return EnumQueuePush(queue, &job);
+}
+
+/* ---- the queue ----------------------------------------------------------- */
+
+/** Jobs come out in order, across growth, and the drained queue rewinds. */
+static void TestFifo(void)
+{
+    EnumQueue queue = { 0 };
+    EnumJob job;
+    CHECK(!EnumQueueTake(&queue, &job));
+
+    for (UINT id = 0; id < 100; ++id) {
+        CHECK(Push(&queue, id));
+    }
+    CHECK(queue.count == 100 && queue.capacity >= 100);
+
+    for (UINT id = 0; id < 100; ++id) {
+        CHECK(EnumQueueTake(&queue, &job));
+        CHECK(job.menu == FAKE_MENU(id) && FolderId(job.path) == id);
+        free(job.path);
+    }
+    CHECK(!EnumQueueTake(&queue, &job));
+    CHECK(queue.head == 0 && queue.count == 0);
+
+    // slots are reused once drained instead of growing forever
+    const UINT capacity = queue.capacity;
+    for (UINT round = 0; round < 10; ++round) {
+        for (UINT id = 0; id < 50; ++id) {
+            CHECK(Push(&queue, id));
+        }
+        while (EnumQueueTake(&queue, &job)) {
+            free(job.path);
+        }
+    }
+    CHECK(queue.capacity == capacity);
+    EnumQueueFree(&queue);
+}
+
+/** Promotion moves one job to the front and keeps the others in order. */
+static void TestPromote(void)
+{
+    EnumQueue queue = { 0 };
+    EnumJob job;
+    for (UINT id = 0; id < 10; ++id) {
+        Push(&queue, id);
+    }
+    CHECK(EnumQueueTake(&queue, &job) && FolderId(job.path) == 0);
+    free(job.path);
+
+    EnumQueuePromote(&queue, FAKE_MENU(7));
+    EnumQueuePromote(&queue, FAKE_MENU(42));    // not queued: no-op
+    EnumQueuePromote(&queue, FAKE_MENU(0));     // already taken: no-op
+
+    static const UINT order[] = { 7, 1, 2, 3, 4, 5, 6, 8, 9 };
+    for (size_t i = 0; i < ARRAYSIZE(order); ++i) {
+        CHECK(EnumQueueTake(&queue, &job) && FolderId(job.path) == order[i]);
+        free(job.path);
+    }
+    CHECK(!EnumQueueTake(&queue, &job));
+    EnumQueueFree(&queue);
+}
+
+/** Jobs never taken are freed with the queue (LeakSanitizer checks). */
+static void TestFreePending(void)
+{
+    EnumQueue queue = { 0 };
+    EnumJob job;
+    for (UINT id = 0; id < 40; ++id) {
+        Push(&queue, id);
+    }
+    EnumQueueTake(&queue, &job);
+    free(job.path);
+
+    EnumQueueFree(&queue);
+    CHECK(!queue.jobs && queue.head == 0 && queue.count == 0 && queue.capacity == 0);
+}
+
+/* ---- the pipeline -------------------------------------------------------- */
+
+/**
+ * The fake tree: folder k has subfolders 3k+1..3k+3 (below FOLDERS) and
+ * FILES files; listing costs ENTRY_US per entry.
+ */
+#define FOLDERS   40
+#define FILES     10
+#define ENTRY_US  300
+
+/**
+ * Pipeline – EnumPipeline with pthreads, plus the UI thread's mailbox
+ *            (WM_ENUM_LISTED) and what the test observes.
+ */
+typedef struct {
+    EnumQueue       queue;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    volatile bool   cancel;
+    UINT            entryUs;
+
+    pthread_mutex_t mailLock;
+    pthread_cond_t  mailWake;
+    UINT            mail[FOLDERS];
+    UINT            mailCount;
+
+    UINT            order[FOLDERS];     // folders in the order listed
+    UINT            orderCount;
+    double          cancelledAt;
+    double          stoppedAt;
+} Pipeline;
+
+static void PipelineQueue(Pipeline *pipeline, UINT id, UINT depth)
+{
+    EnumJob job = Job(id, depth);
+    pthread_mutex_lock(&pipeline->lock);
+    const bool ok = EnumQueuePush(&pipeline->queue, &job);
+    if (ok) {
+        pthread_cond_signal(&pipeline->wake);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    if (!ok) {
+        free(job.path);
+    }
+}
+
+/**
+ * ListFake – ListFolder over the fake tree: ENTRY_US per entry, stopped
+ *            between entries once cancelled.
+ *
+ * @return  false if cancelled mid-listing.
+ */
+static bool ListFake(Pipeline *pipeline, UINT id)
+{
+    (void)id;
+    for (UINT i = 0; i < 3 + FILES; ++i) {
+        if (pipeline->cancel) {
+            return false;
+        }
+        usleep(pipeline->entryUs);
+    }
+    return true;
+}
+
+/** EnumWorkerProc with the same take / cancel protocol. */
+static void *WorkerProc(void *param)
+{
+    Pipeline *pipeline = param;
+
+    for (;;) {
+        EnumJob job;
+        pthread_mutex_lock(&pipeline->lock);
+        while (!pipeline->cancel && !EnumQueueTake(&pipeline->queue, &job)) {
+            pthread_cond_wait(&pipeline->wake, &pipeline->lock);
+        }
+        if (pipeline->cancel) {
+            pthread_mutex_unlock(&pipeline->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+
+        const UINT id = FolderId(job.path);
+        free(job.path);
+        if (!ListFake(pipeline, id)) {
+            break;
+        }
+
+        pthread_mutex_lock(&pipeline->mailLock);
+        pipeline->order[pipeline->orderCount++] = id;
+        pipeline->mail[pipeline->mailCount++]   = id;
+        pthread_cond_signal(&pipeline->mailWake);
+        pthread_mutex_unlock(&pipeline->mailLock);
+    }
+
+    pipeline->stoppedAt = NowMs();
+    return NULL;
+}
+
+/**
+ * TakeMail – wait up to @timeoutMs for the next listed folder, as the UI
+ *            thread's message loop does.
+ *
+ * @return  Its id, or FOLDERS on timeout.
+ */
+static UINT TakeMail(Pipeline *pipeline, double timeoutMs)
+{
+    const double deadline = NowMs() + timeoutMs;
+    UINT id = FOLDERS;
+    pthread_mutex_lock(&pipeline->mailLock);
+    while (!pipeline->mailCount && NowMs() < deadline) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&pipeline->mailWake, &pipeline->mailLock, &until);
+    }
+    if (pipeline->mailCount) {
+        id = pipeline->mail[0];
+        memmove(pipeline->mail, pipeline->mail + 1, --pipeline->mailCount * sizeof *pipeline->mail);
+    }
+    pthread_mutex_unlock(&pipeline->mailLock);
+    return id;
+}
+
+/** The UI thread's WM_ENUM_LISTED: queue the new submenus' folders. */
+static void OnListed(Pipeline *pipeline, UINT id)
+{
+    for (UINT child = 3 * id + 1; child <= 3 * id + 3 && child < FOLDERS; ++child) {
+        PipelineQueue(pipeline, child, 1);
+    }
+}
+
+static void PipelineStart(Pipeline *pipeline, pthread_t *thread, UINT entryUs)
+{
+    *pipeline = (Pipeline){ .entryUs = entryUs };
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->wake, NULL);
+    pthread_mutex_init(&pipeline->mailLock, NULL);
+    pthread_cond_init(&pipeline->mailWake, NULL);
+    // the root listing (synchronous, before the menu shows) queues folder 0's children
+    OnListed(pipeline, 0);
+    CHECK(pthread_create(thread, NULL, WorkerProc, pipeline) == 0);
+}
+
+/** EnumPipelineStop: cancel, wake, join, free what was never listed. */
+static void PipelineStop(Pipeline *pipeline, pthread_t thread)
+{
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->cancelledAt = NowMs();
+    pipeline->cancel = true;
+    pthread_cond_broadcast(&pipeline->wake);
+    pthread_mutex_unlock(&pipeline->lock);
+    pthread_join(thread, NULL);
+
+    EnumQueueFree(&pipeline->queue);
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->wake);
+    pthread_mutex_destroy(&pipeline->mailLock);
+    pthread_cond_destroy(&pipeline->mailWake);
+}
+
+/** Cost of listing the whole fake tree synchronously. */
+static double SyncWalkMs(void)
+{
+    return (FOLDERS - 1) * (3 + FILES) * ENTRY_US / 1000.0;
+}
+
+/**
+ * The first submenu is filled after one listing, long before the whole
+ * tree would have been walked; every folder is eventually listed once.
+ */
+static void TestPartialResults(void)
+{
+    Pipeline pipeline;
+    pthread_t thread;
+    const double start = NowMs();
+    PipelineStart(&pipeline, &thread, ENTRY_US);
+
+    const UINT first = TakeMail(&pipeline, 5000);
+    const double firstMs = NowMs() - start;
+    CHECK(first == 1);
+    CHECK(firstMs < SyncWalkMs() / 4);
+    OnListed(&pipeline, first);
+
+    UINT listed = 1;
+    UINT id;
+    while (listed < FOLDERS - 1 && (id = TakeMail(&pipeline, 5000)) != FOLDERS) {
+        OnListed(&pipeline, id);
+        listed++;
+    }
+    CHECK(listed == FOLDERS - 1);
+
+    bool seen[FOLDERS] = { false };
+    for (UINT i = 0; i < pipeline.orderCount; ++i) {
+        CHECK(!seen[pipeline.order[i]]);
+        seen[pipeline.order[i]] = true;
+    }
+    PipelineStop(&pipeline, thread);
+    CHECK(pipeline.orderCount == FOLDERS - 1);
+}
+
+/**
+ * An opened submenu jumps the queue: after the promotion, it is the next
+ * folder the worker starts (the one in progress finishes first).
+ */
+static void TestPromotion(void)
+{
+    Pipeline pipeline;
+    pthread_t thread;
+    PipelineStart(&pipeline, &thread, ENTRY_US);
+
+    // queue a long tail behind folder 0's children before anything drains
+    UINT id = TakeMail(&pipeline, 5000);
+    for (UINT child = 4; child < FOLDERS; ++child) {
+        PipelineQueue(&pipeline, child, 2);
+    }
+
+    pthread_mutex_lock(&pipeline.lock);
+    EnumQueuePromote(&pipeline.queue, FAKE_MENU(FOLDERS - 1));
+    pthread_mutex_unlock(&pipeline.lock);
+
+    UINT after[2];
+    for (UINT i = 0; i < 2 && id != FOLDERS; ++i) {
+        after[i] = id = TakeMail(&pipeline, 5000);
+    }
+    // the listing in progress at promotion time, then the promoted folder
+    CHECK(id != FOLDERS);
+    CHECK(after[0] == FOLDERS - 1 || after[1] == FOLDERS - 1);
+    PipelineStop(&pipeline, thread);
+}
+
+/**
+ * Dismissing the menu stops the worker within one entry of the listing in
+ * progress, however much is still queued, and frees the queued jobs.
+ */
+static void TestCancellation(void)
+{
+    Pipeline pipeline;
+    pthread_t thread;
+    PipelineStart(&pipeline, &thread, 20000);    // a very slow share
+    for (UINT child = 4; child < FOLDERS; ++child) {
+        PipelineQueue(&pipeline, child, 2);
+    }
+    usleep(30000);
+
+    PipelineStop(&pipeline, thread);
+    CHECK(pipeline.stoppedAt - pipeline.cancelledAt < 20 + 50);
+    CHECK(pipeline.orderCount <= 1);
+    CHECK(!pipeline.queue.jobs && pipeline.queue.count == 0);
+}
+
+int main(void)
+{
+    TestFifo();
+    TestPromote();
+    TestFreePending();
+
+    TestPartialResults();
+    TestPromotion();
+    TestCancellation();
+
+    return TestResult("enum_queue");
+}
@@ -0,0 +1,209 @@
+/*
+ * test_eviction.c – cache budget: LRU eviction by entry count and blob
+ * bytes, pruning of entries the background sweep found gone, and lastHit
+ * surviving a save/load round trip
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#include "check.h"
+
+#define ENTRIES 200
+
+static void EntryPath(char *out, size_t size, UINT i)
+{
+    snprintf(out, size, "C:\\Users\\me\\SendTo\\target %03u.lnk", i);
+}
+
+static const IconCacheEntry *FindEntry(UINT i)
+{
+    char path[64];
+    WCHAR wide[64];
+    EntryPath(path, sizeof path, i);
+    Widen(wide, 64, path);
+    return IconCacheFind(wide, 32);
+}
+
+/**
+ * FillCache – ENTRIES entries whose lastHit is a permutation of 1..ENTRIES
+ *             (entry i was hit as the @hitRank[i]-th), blob sizes vary.
+ */
+static void FillCache(UINT hitRank[ENTRIES])
+{
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        hitRank[i] = i + 1;
+    }
+    UINT32 state = 12345;
+    for (UINT i = ENTRIES - 1; i > 0; --i) {
+        state = state * 1103515245u + 12345u;
+        const UINT j = (state >> 8) % (i + 1);
+        const UINT t = hitRank[i];
+        hitRank[i] = hitRank[j];
+        hitRank[j] = t;
+    }
+
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        char path[64];
+        EntryPath(path, sizeof path, i);
+        IconCacheEntry e = TestEntry(path, 32, i);
+        e.lastHit = hitRank[i];
+        CHECK(IconCacheAdd(&e) != NULL);
+    }
+}
+
+/** Over the entry budget the least recently hit entries go, the rest stay findable. */
+static void TestEvictByCount(void)
+{
+    UINT hitRank[ENTRIES];
+    FillCache(hitRank);
+
+    const UINT keep = 64;
+    CHECK(IconCacheEvictLru(keep, CACHE_MAX_BLOB_BYTES) == ENTRIES - keep);
+    IconCacheRemoveDropped();
+    CHECK(g_iconCache.count == keep);
+
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        const IconCacheEntry *e = FindEntry(i);
+        if (hitRank[i] > ENTRIES - keep) {
+            CHECK(e && e->lastHit == hitRank[i] && e->blob);
+        } else {
+            CHECK(e == NULL);
+        }
+    }
+    IconCacheFree();
+}
+
+/**
+ * Over the byte budget the oldest entries go until the rest fits: the
+ * survivors are the most recent entries, and keeping the youngest evicted
+ * one as well would have broken the budget.
+ */
+static void TestEvictByBytes(void)
+{
+    UINT hitRank[ENTRIES];
+    FillCache(hitRank);
+
+    UINT64 total = 0;
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        total += g_iconCache.entries[i].blobSize;
+    }
+    const UINT64 budget = total / 3;
+    const UINT evicted = IconCacheEvictLru(ENTRIES, budget);
+    CHECK(evicted > 0 && evicted < ENTRIES);
+    IconCacheRemoveDropped();
+
+    UINT64 kept = 0;
+    UINT   youngestEvicted = 0;
+    DWORD  youngestEvictedSize = 0;
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        const IconCacheEntry *e = FindEntry(i);
+        const bool survives = hitRank[i] > evicted;
+        CHECK((e != NULL) == survives);
+        if (e) {
+            kept += e->blobSize;
+        } else if (hitRank[i] > youngestEvicted) {
+            youngestEvicted     = hitRank[i];
+            youngestEvictedSize = 16 + i % 64;
+        }
+    }
+    CHECK(kept <= budget);
+    CHECK(kept + youngestEvictedSize > budget);
+    IconCacheFree();
+}
+
+/** Within budget nothing is touched; entries dropped earlier do not count. */
+static void TestWithinBudget(void)
+{
+    UINT hitRank[ENTRIES];
+    FillCache(hitRank);
+
+    CHECK(IconCacheEvictLru(ENTRIES, CACHE_MAX_BLOB_BYTES) == 0);
+    CHECK(g_iconCache.count == ENTRIES);
+
+    for (UINT i = 0; i < ENTRIES / 2; ++i) {
+        free(g_iconCache.entries[i].blob);
+        g_iconCache.entries[i].blob = NULL;
+    }
+    CHECK(IconCacheEvictLru(ENTRIES / 2, CACHE_MAX_BLOB_BYTES) == 0);
+    IconCacheRemoveDropped();
+    CHECK(g_iconCache.count == ENTRIES / 2);
+    IconCacheFree();
+}
+
+/**
+ * Entries the sweep flagged are pruned, unless they were refreshed
+ * (dirty) since or their slot now holds another path.
+ */
+static void TestPruneMissing(void)
+{
+    UINT hitRank[ENTRIES];
+    FillCache(hitRank);
+
+    // the sweep's snapshot, and what it found
+    PWSTR paths[ENTRIES];
+    BYTE  missing[ENTRIES];
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        paths[i]   = _wcsdup(g_iconCache.entries[i].path);
+        missing[i] = i % 3 == 0;
+    }
+
+    // meanwhile the menu re-resolved entry 3 and entry 6 moved to another slot
+    g_iconCache.entries[3].dirty = true;
+    free(g_iconCache.entries[6].path);
+    g_iconCache.entries[6].path = _wcsdup(paths[7]);
+
+    UINT expected = 0;
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        expected += missing[i] && i != 3 && i != 6;
+    }
+    CHECK(IconCachePruneMissing((const PCWSTR *)paths, missing, ENTRIES) == expected);
+    CHECK(g_iconCache.entries[3].blob && g_iconCache.entries[6].blob);
+
+    // a snapshot longer than the cache (entries dropped meanwhile) is safe
+    IconCacheRemoveDropped();
+    CHECK(g_iconCache.count == ENTRIES - expected);
+    CHECK(IconCachePruneMissing((const PCWSTR *)paths, missing, ENTRIES) <= g_iconCache.count);
+    CHECK(FindEntry(0) == NULL);
+    CHECK(FindEntry(1) != NULL);
+
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        free(paths[i]);
+    }
+    IconCacheFree();
+}
+
+/** lastHit is persisted, so eviction after a reload picks the same victims. */
+static void TestLastHitPersisted(void)
+{
+    UINT hitRank[ENTRIES];
+    FillCache(hitRank);
+
+    JournalBuffer journal = JournalStart();
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        JournalAppendEntry(&journal, &g_iconCache.entries[i]);
+    }
+    IconCacheFree();
+
+    CHECK(IconCacheReplayRecords(journal.data, journal.size, CACHE_HEADER_SIZE) == journal.size);
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        const IconCacheEntry *e = FindEntry(i);
+        CHECK(e && e->lastHit == hitRank[i]);
+    }
+    CHECK(IconCacheEvictLru(ENTRIES - 1, CACHE_MAX_BLOB_BYTES) == 1);
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        if (hitRank[i] == 1) {
+            CHECK(FindEntry(i) && FindEntry(i)->blob == NULL);
+        }
+    }
+    IconCacheFree();
+    free(journal.data);
+}
+
+int main(void)
+{
+    TestEvictByCount();
+    TestEvictByBytes();
+    TestWithinBudget();
+    TestPruneMissing();
+    TestLastHitPersisted();
+    return TestResult("eviction");
+}
@@ -0,0 +1,201 @@
+/*
+ * test_file_identity.c – cache entries keyed by file identity: a renamed
+ * or hard-linked target keeps its icon, a changed or different file does
+ * not, using st_dev/st_ino for the volume serial and file index
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "check.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Seconds between 1601-01-01 (FILETIME) and 1970-01-01 (time_t). */
+#define EPOCH_DIFF 11644473600ull
+
+static char g_dir[] = "/tmp/sendto-identity-XXXXXX";
+
+/**
+ * FileIdentity – GetFileIdentity and GetFileLastWriteTime for POSIX.
+ */
+static bool FileIdentity(const char *file, DWORD *volume, UINT64 *fileId, FILETIME *lastWrite)
+{
+    struct stat st;
+    if (stat(file, &st) != 0) {
+        return false;
+    }
+    const UINT64 time = ((UINT64)st.st_mtim.tv_sec + EPOCH_DIFF) * 10000000u + (UINT64)st.st_mtim.tv_nsec / 100;
+    *volume = (DWORD)st.st_dev;
+    *fileId = (UINT64)st.st_ino;
+    lastWrite->dwLowDateTime  = (DWORD)time;
+    lastWrite->dwHighDateTime = (DWORD)(time >> 32);
+    return true;
+}
+
+static void MakeFile(char *out, size_t size, const char *name, const char *content)
+{
+    snprintf(out, size, "%s/%s", g_dir, name);
+    FILE *f = fopen(out, "wb");
+    CHECK(f != NULL);
+    if (f) {
+        fputs(content, f);
+        fclose(f);
+    }
+}
+
+/**
+ * StoreFile – IconCacheStore: cache an icon for @file under its path and
+ *             identity.
+ */
+static void StoreFile(const char *file, UINT seed)
+{
+    IconCacheEntry e = TestEntry(file, 32, seed);
+    CHECK(FileIdentity(file, &e.volume, &e.fileId, &e.lastWrite));
+    e.dirty = true;
+    CHECK(IconCacheAdd(&e) != NULL);
+}
+
+/**
+ * LookupFile – CachedIconForItem's cache path: by path, then by identity.
+ *
+ * @return  Cached entry, or NULL on a miss.
+ */
+static const IconCacheEntry *LookupFile(const char *file, int size, bool *moved)
+{
+    WCHAR wide[MAX_PATH];
+    Widen(wide, MAX_PATH, file);
+
+    DWORD volume;
+    UINT64 fileId;
+    FILETIME lastWrite;
+    *moved = false;
+    if (!FileIdentity(file, &volume, &fileId, &lastWrite)) {
+        return NULL;
+    }
+
+    const IconCacheEntry *e = IconCacheFind(wide, size);
+    if (e && e->lastWrite.dwLowDateTime == lastWrite.dwLowDateTime &&
+        e->lastWrite.dwHighDateTime == lastWrite.dwHighDateTime) {
+        return e;
+    }
+    e = IconCacheCopyMoved(wide, size, &lastWrite, volume, fileId);
+    *moved = e != NULL;
+    return e;
+}
+
+/** A renamed file is found by identity and copied under its new path. */
+static void TestRename(void)
+{
+    char before[512], after[512];
+    MakeFile(before, sizeof before, "before.lnk", "target one");
+    snprintf(after, sizeof after, "%s/after.lnk", g_dir);
+    StoreFile(before, 11);
+    g_iconCache.dirty = false;
+
+    CHECK(rename(before, after) == 0);
+    bool moved;
+    const IconCacheEntry *e = LookupFile(after, 32, &moved);
+    CHECK(e && moved && e->dirty && g_iconCache.dirty);
+    CHECK(e && e->lastHit == 1000 + 11 && e->blobSize == 16 + 11);
+    CHECK(g_iconCache.count == 2);
+
+    // the copy is a path hit from now on
+    e = LookupFile(after, 32, &moved);
+    CHECK(e && !moved);
+
+    // another icon size of the same file was never cached
+    CHECK(LookupFile(after, 48, &moved) == NULL);
+    unlink(after);
+    IconCacheFree();
+}
+
+/** A hard link is the same file: both names serve the icon. */
+static void TestHardLink(void)
+{
+    char file[512], link_[512];
+    MakeFile(file, sizeof file, "linked.lnk", "target two");
+    snprintf(link_, sizeof link_, "%s/alias.lnk", g_dir);
+    CHECK(link(file, link_) == 0);
+    StoreFile(file, 12);
+
+    bool moved;
+    CHECK(LookupFile(link_, 32, &moved) && moved);
+    CHECK(LookupFile(file, 32, &moved) && !moved);
+    unlink(file);
+    unlink(link_);
+    IconCacheFree();
+}
+
+/** A rewritten file (new last-write time) or a different file misses. */
+static void TestChangedOrDifferent(void)
+{
+    char file[512], other[512], renamed[512];
+    MakeFile(file, sizeof file, "changed.lnk", "target three");
+    MakeFile(other, sizeof other, "other.lnk", "target four");
+    StoreFile(file, 13);
+
+    bool moved;
+    CHECK(LookupFile(other, 32, &moved) == NULL);
+
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { 1000000000, 0 } };
+    CHECK(utimensat(AT_FDCWD, file, times, 0) == 0);
+    snprintf(renamed, sizeof renamed, "%s/changed-renamed.lnk", g_dir);
+    CHECK(rename(file, renamed) == 0);
+    CHECK(LookupFile(renamed, 32, &moved) == NULL);
+    CHECK(g_iconCache.count == 1);
+
+    unlink(renamed);
+    unlink(other);
+    IconCacheFree();
+}
+
+/**
+ * The identity survives the journal, so a rename between two runs still
+ * hits; entries without an identity are not matched by identity.
+ */
+static void TestIdentityPersisted(void)
+{
+    char before[512], after[512];
+    MakeFile(before, sizeof before, "persisted.lnk", "target five");
+    snprintf(after, sizeof after, "%s/persisted-moved.lnk", g_dir);
+    StoreFile(before, 14);
+
+    IconCacheEntry anonymous = TestEntry("C:\\no identity.lnk", 32, 15);
+    anonymous.volume = 0;
+    CHECK(IconCacheAdd(&anonymous) != NULL);
+    CHECK(IconCacheFindId(0, 0, 32) == NULL);
+
+    JournalBuffer journal = JournalStart();
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        JournalAppendEntry(&journal, &g_iconCache.entries[i]);
+    }
+    IconCacheFree();
+
+    CHECK(rename(before, after) == 0);
+    CHECK(IconCacheReplayRecords(journal.data, journal.size, CACHE_HEADER_SIZE) == journal.size);
+    bool moved;
+    CHECK(LookupFile(after, 32, &moved) && moved);
+
+    unlink(after);
+    IconCacheFree();
+    free(journal.data);
+}
+
+int main(void)
+{
+    CHECK(mkdtemp(g_dir) != NULL);
+
+    // entries hold a heap path, not a MAX_PATH array
+    CHECK(sizeof(IconCacheEntry) < MAX_PATH * sizeof(WCHAR) / 4);
+
+    TestRename();
+    TestHardLink();
+    TestChangedOrDifferent();
+    TestIdentityPersisted();
+
+    rmdir(g_dir);
+    return TestResult("file_identity");
+}
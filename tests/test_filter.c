@@ -0,0 +1,139 @@
+/*
+ * test_filter.c – [Exclude] / [Include] patterns: parsing of the section
+ * lines, the exact / affix / glob rule kinds and FilterGlobMatch's
+ * PathMatchSpecW semantics
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#include "check.h"
+
+/**
+ * CompileLines – FilterCompileLines over ASCII @lines (GetPrivateProfileSectionW
+ *                format is built here).
+ */
+static FilterList CompileLines(const char *const *lines, UINT count)
+{
+    size_t chars = 1;
+    for (UINT i = 0; i < count; ++i) {
+        chars += strlen(lines[i]) + 1;
+    }
+    PWSTR pool = malloc(chars * sizeof(WCHAR));
+    PWSTR p = pool;
+    for (UINT i = 0; i < count; ++i) {
+        Widen(p, strlen(lines[i]) + 1, lines[i]);
+        p += strlen(lines[i]) + 1;
+    }
+    *p = L'\0';
+
+    FilterList list = { 0 };
+    FilterCompileLines(&list, pool);
+    return list;
+}
+
+static bool Matches(const FilterList *list, const char *name, bool isDirectory)
+{
+    WCHAR wide[MAX_PATH];
+    Widen(wide, MAX_PATH, name);
+    return FilterMatches(list, wide, wcslen(wide), isDirectory);
+}
+
+static bool Glob(const char *name, const char *spec)
+{
+    WCHAR wideName[MAX_PATH], wideSpec[MAX_PATH];
+    Widen(wideName, MAX_PATH, name);
+    Widen(wideSpec, MAX_PATH, spec);
+    return FilterGlobMatch(wideName, wideSpec);
+}
+
+/** Blank lines and comments are dropped, patterns trimmed and classified. */
+static void TestCompile(void)
+{
+    static const char *const lines[] = {
+        "  desktop.ini  ", "; a comment", "# another", "*.bak", "~*", "scratch\\",
+        "Thumbs.db", "*.t?p", "*cache*", "   ", "build/"
+    };
+    FilterList list = CompileLines(lines, ARRAYSIZE(lines));
+    CHECK(list.count == 8);
+
+    const FilterRule *r = list.rules;
+    CHECK(r[0].kind == FILTER_EXACT && wcscmp(r[0].text, L"desktop.ini") == 0 && r[0].prefixLen == 11);
+    CHECK(r[1].kind == FILTER_AFFIX && r[1].prefixLen == 0 && wcscmp(r[1].suffix, L".bak") == 0);
+    CHECK(r[2].kind == FILTER_AFFIX && r[2].prefixLen == 1 && r[2].suffixLen == 0);
+    CHECK(r[3].kind == FILTER_EXACT && r[3].dirOnly && wcscmp(r[3].text, L"scratch") == 0);
+    CHECK(r[5].kind == FILTER_GLOB);
+    CHECK(r[6].kind == FILTER_GLOB);
+    CHECK(r[7].dirOnly && wcscmp(r[7].text, L"build") == 0);
+    FilterFree(&list);
+    CHECK(list.count == 0 && !list.rules && !list.pool);
+
+    static const char *const nothing[] = { "; only comments", "   " };
+    list = CompileLines(nothing, ARRAYSIZE(nothing));
+    CHECK(list.count == 0);
+    CHECK(!Matches(&list, "anything", false));
+    FilterFree(&list);
+}
+
+/** What the rules hide, case-insensitively; folder-only rules spare files. */
+static void TestMatches(void)
+{
+    static const char *const lines[] = {
+        "desktop.ini", "*.bak", "~*", "scratch\\", "*.t?p", "*cache*", "Old *.lnk"
+    };
+    FilterList list = CompileLines(lines, ARRAYSIZE(lines));
+
+    CHECK(Matches(&list, "desktop.ini", false));
+    CHECK(Matches(&list, "DESKTOP.INI", false));
+    CHECK(!Matches(&list, "desktop.ini.lnk", false));
+    CHECK(Matches(&list, "notes.BAK", false));
+    CHECK(Matches(&list, ".bak", false));
+    CHECK(!Matches(&list, "notes.bak.lnk", false));
+    CHECK(Matches(&list, "~lock", false));
+    CHECK(Matches(&list, "Scratch", true));
+    CHECK(!Matches(&list, "scratch", false));
+    CHECK(Matches(&list, "a.tmp", false) && Matches(&list, "a.TXP", false));
+    CHECK(!Matches(&list, "a.tp", false));
+    CHECK(Matches(&list, "IconCache.db", false) && Matches(&list, "cache", false));
+    CHECK(Matches(&list, "old Editor.lnk", false));
+    CHECK(!Matches(&list, "Editor.lnk", false));
+    CHECK(!Matches(&list, "Notepad++.lnk", false));
+    FilterFree(&list);
+}
+
+/** FilterGlobMatch against PathMatchSpecW's documented behaviour. */
+static void TestGlob(void)
+{
+    CHECK(Glob("anything", "*"));
+    CHECK(Glob("", "*"));
+    CHECK(Glob("no dot", "*.*"));
+    CHECK(Glob("a.b", "?.?"));
+    CHECK(!Glob("ab.b", "?.?"));
+    CHECK(Glob("report 2024.docx", "*20??.doc*"));
+    CHECK(Glob("REPORT.DOCX", "report.*"));
+    CHECK(Glob("readme", "readme.*"));
+    CHECK(!Glob("readme", "readme.?"));
+    CHECK(!Glob("readme", "readme.txt"));
+    CHECK(Glob("aaa", "*a*a*a*"));
+    CHECK(!Glob("aa", "*a*a*a*"));
+    CHECK(Glob("mississippi", "m*iss*ppi"));
+    CHECK(!Glob("mississippi", "m*iss*ppx"));
+    CHECK(Glob("x.bak", "*.tmp;*.bak"));
+    CHECK(Glob("x.bak", "*.tmp; *.bak"));
+    CHECK(!Glob("x.old", "*.tmp;*.bak"));
+    CHECK(!Glob("abc", "ab"));
+    CHECK(!Glob("ab", "abc"));
+
+    // one backtrack point keeps this O(name × mask) instead of exponential
+    char name[200], spec[200];
+    memset(name, 'a', sizeof name - 1);
+    name[sizeof name - 1] = '\0';
+    strcpy(spec, "*a*a*a*a*a*a*a*a*a*a*a*a*a*a*b");
+    CHECK(!Glob(name, spec));
+}
+
+int main(void)
+{
+    TestCompile();
+    TestMatches();
+    TestGlob();
+    return TestResult("filter");
+}
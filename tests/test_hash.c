@@ -0,0 +1,111 @@
+/*
+ * test_hash.c – CacheHash32 against the XXH32 reference: the published
+ * sanity vectors, more lengths around every lane and tail boundary, short
+ * strings, and independence from alignment
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#include "check.h"
+
+/** Seed of the reference sanity vectors (PRIME32_1). */
+#define SANITY_SEED 2654435761u
+#define SANITY_SIZE 2367
+
+/**
+ * KnownAnswer – XXH32 of the first @length bytes of the sanity buffer.
+ *               Lengths 0, 1, 14 and 222 are the vectors published with
+ *               xxHash (xsum_sanity_check.c); the others were produced
+ *               by the reference library.
+ */
+typedef struct {
+    size_t length;
+    UINT32 seed0;
+    UINT32 seedPrime;
+} KnownAnswer;
+
+static const KnownAnswer g_sanity[] = {
+    {    0, 0x02CC5D05u, 0x36B78AE7u },
+    {    1, 0xCF65B03Eu, 0xB4545AA4u },
+    {    2, 0x1151BEE4u, 0x1EDB879Au },
+    {    3, 0xC23884F5u, 0x1A269947u },
+    {    4, 0xA9DE7CE9u, 0x2BAAFE83u },
+    {    7, 0x5E1056CDu, 0x3ED9D3FCu },
+    {   14, 0x1208E7E2u, 0x6AF1D1FEu },
+    {   15, 0x6B859E14u, 0xAD53090Du },
+    {   16, 0x93BA3759u, 0xA94FC1E1u },
+    {   17, 0x89FDC23Eu, 0xC9910739u },
+    {   31, 0x5F40E562u, 0x5C0C3350u },
+    {   32, 0xD89829ECu, 0xA5C44467u },
+    {  222, 0x5BD11DBDu, 0x58803C5Fu },
+    { 2367, 0x4C8A9773u, 0x6D5366F6u },
+};
+
+/**
+ * FillSanityBuffer – the reference test buffer: the top byte of a 64-bit
+ *                    generator stepped by PRIME64_1, seeded with PRIME32_1.
+ */
+static void FillSanityBuffer(BYTE *buffer, size_t size)
+{
+    UINT64 generator = SANITY_SEED;
+    for (size_t i = 0; i < size; ++i) {
+        buffer[i] = (BYTE)(generator >> 56);
+        generator *= 11400714785074694797ull;
+    }
+}
+
+static void TestSanityVectors(void)
+{
+    static BYTE buffer[SANITY_SIZE];
+    FillSanityBuffer(buffer, sizeof buffer);
+
+    for (size_t i = 0; i < ARRAYSIZE(g_sanity); ++i) {
+        const KnownAnswer *k = &g_sanity[i];
+        const UINT32 h0 = CacheHash32(buffer, k->length, 0);
+        const UINT32 hp = CacheHash32(buffer, k->length, SANITY_SEED);
+        if (h0 != k->seed0 || hp != k->seedPrime) {
+            fprintf(stderr, "  length %zu: got %08X / %08X, expected %08X / %08X\n",
+                    k->length, h0, hp, k->seed0, k->seedPrime);
+        }
+        CHECK(h0 == k->seed0);
+        CHECK(hp == k->seedPrime);
+    }
+}
+
+static void TestStrings(void)
+{
+    static const struct { const char *text; UINT32 seed0; UINT32 seed1; } strings[] = {
+        { "",                           0x02CC5D05u, 0x0B2CB792u },
+        { "a",                          0x550D7456u, 0xF514706Fu },
+        { "abc",                        0x32D153FFu, 0xAA3DA8FFu },
+        { "message digest",             0x7C948494u, 0x70768498u },
+        { "abcdefghijklmnopqrstuvwxyz", 0x63A14D5Fu, 0xCADF7A88u },
+        { "The quick brown fox jumps over the lazy dog", 0xE85EA4DEu, 0x234F8471u },
+    };
+    for (size_t i = 0; i < ARRAYSIZE(strings); ++i) {
+        CHECK(CacheHash32(strings[i].text, strlen(strings[i].text), 0) == strings[i].seed0);
+        CHECK(CacheHash32(strings[i].text, strlen(strings[i].text), 1) == strings[i].seed1);
+    }
+}
+
+/** Loads are unaligned-safe: the same bytes hash alike at every offset. */
+static void TestAlignment(void)
+{
+    static BYTE buffer[SANITY_SIZE], shifted[SANITY_SIZE + 8];
+    FillSanityBuffer(buffer, sizeof buffer);
+
+    for (size_t offset = 1; offset < 8; ++offset) {
+        memcpy(shifted + offset, buffer, sizeof buffer);
+        for (size_t length = 0; length <= 64; ++length) {
+            CHECK(CacheHash32(shifted + offset, length, 7) == CacheHash32(buffer, length, 7));
+        }
+        CHECK(CacheHash32(shifted + offset, 222, 0) == 0x5BD11DBDu);
+    }
+}
+
+int main(void)
+{
+    TestSanityVectors();
+    TestStrings();
+    TestAlignment();
+    return TestResult("hash");
+}
@@ -0,0 +1,374 @@
+/*
+ * test_journal.c – append-only cache journal: replay, torn tails,
+ * corruption and compaction, with faults injected at every offset, and
+ * conversion of the previous format
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "check.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define KEYS    12
+#define RECORDS 30
+
+/** Records of the test journal: which key each is and where it ends. */
+static UINT  g_recordKey[RECORDS];
+static UINT  g_recordSeed[RECORDS];
+static DWORD g_recordEnd[RECORDS];
+
+static void KeyPath(UINT key, char *out, size_t size)
+{
+    snprintf(out, size, "C:\\Users\\me\\SendTo\\target %02u.lnk", key);
+}
+
+/**
+ * BuildJournal – RECORDS records over KEYS keys, so later records supersede
+ *                earlier ones for the same key.
+ */
+static JournalBuffer BuildJournal(void)
+{
+    JournalBuffer journal = JournalStart();
+    for (UINT i = 0; i < RECORDS; ++i) {
+        char path[64];
+        g_recordKey[i]  = (i * 7) % KEYS;
+        g_recordSeed[i] = i + 1;
+        KeyPath(g_recordKey[i], path, sizeof path);
+
+        IconCacheEntry e = TestEntry(path, 32, g_recordSeed[i]);
+        JournalAppendEntry(&journal, &e);
+        g_recordEnd[i] = journal.size;
+        free(e.path);
+        free(e.blob);
+    }
+    return journal;
+}
+
+/**
+ * CheckReplayedPrefix – g_iconCache must hold exactly the state of the
+ *                       first @records records: latest seed per key.
+ */
+static void CheckReplayedPrefix(UINT records)
+{
+    UINT expected = 0;
+    for (UINT key = 0; key < KEYS; ++key) {
+        UINT seed = 0;
+        for (UINT i = 0; i < records; ++i) {
+            if (g_recordKey[i] == key) {
+                seed = g_recordSeed[i];
+            }
+        }
+
+        char path[64];
+        WCHAR wide[64];
+        KeyPath(key, path, sizeof path);
+        Widen(wide, 64, path);
+        const IconCacheEntry *e = IconCacheFind(wide, 32);
+        if (!seed) {
+            CHECK(e == NULL);
+            continue;
+        }
+        expected++;
+        CHECK(e != NULL);
+        if (e) {
+            CHECK(e->lastWrite.dwLowDateTime == seed);
+            CHECK(e->blobSize == 16 + seed % 64);
+            CHECK(CacheHash32(e->blob, e->blobSize, 0) == e->blobHash);
+            CHECK(!e->dirty);
+        }
+    }
+    CHECK(g_iconCache.count == expected);
+    CHECK(g_iconCache.fileRecords == records);
+}
+
+/** CacheHash32 is the reference XXH32. */
+static void TestHashKnownAnswers(void)
+{
+    CHECK(CacheHash32("", 0, 0) == 0x02CC5D05u);
+    CHECK(CacheHash32("abc", 3, 0) == 0x32D153FFu);
+    CHECK(CacheHash32("Nobody inspects the spammish repetition", 39, 0) == 0xE2293B2Fu);
+}
+
+/** A whole journal replays to the latest record of every key. */
+static void TestReplay(const JournalBuffer *journal)
+{
+    CHECK(IconCacheHeaderValid(journal->data, journal->size));
+    const DWORD end = IconCacheReplayRecords(journal->data, journal->size, CACHE_HEADER_SIZE);
+    CHECK(end == journal->size);
+    CheckReplayedPrefix(RECORDS);
+    IconCacheFree();
+}
+
+/** A journal cut at any byte replays every complete record and stops at the cut one. */
+static void TestTornTailAtEveryOffset(const JournalBuffer *journal)
+{
+    for (DWORD cut = CACHE_HEADER_SIZE; cut <= journal->size; ++cut) {
+        UINT complete = 0;
+        while (complete < RECORDS && g_recordEnd[complete] <= cut) {
+            complete++;
+        }
+
+        BYTE *copy = malloc(cut);
+        memcpy(copy, journal->data, cut);
+        const DWORD end = IconCacheReplayRecords(copy, cut, CACHE_HEADER_SIZE);
+        CHECK(end == (complete ? g_recordEnd[complete - 1] : CACHE_HEADER_SIZE));
+        CheckReplayedPrefix(complete);
+        IconCacheFree();
+        free(copy);
+    }
+}
+
+/**
+ * A flipped byte anywhere either stops replay at or before its record, or
+ * sits in a blob and is caught by that entry's blobHash when served.
+ */
+static void TestCorruptionAtEveryOffset(const JournalBuffer *journal)
+{
+    BYTE *copy = malloc(journal->size);
+    for (DWORD at = CACHE_HEADER_SIZE; at < journal->size; ++at) {
+        UINT record = 0;
+        while (g_recordEnd[record] <= at) {
+            record++;
+        }
+        const DWORD recordStart = record ? g_recordEnd[record - 1] : CACHE_HEADER_SIZE;
+
+        memcpy(copy, journal->data, journal->size);
+        copy[at] ^= 0x5A;
+        const DWORD end = IconCacheReplayRecords(copy, journal->size, CACHE_HEADER_SIZE);
+
+        if (end <= recordStart) {
+            CHECK(g_iconCache.fileRecords == record);
+        } else {
+            // accepted: the flip must be in the blob, which no longer matches
+            const DWORD blobStart = g_recordEnd[record] - (16 + g_recordSeed[record] % 64);
+            CHECK(at >= blobStart);
+            CHECK(end == journal->size);
+
+            bool caught = false;
+            for (UINT i = 0; i < g_iconCache.count; ++i) {
+                const IconCacheEntry *e = &g_iconCache.entries[i];
+                caught = caught || CacheHash32(e->blob, e->blobSize, 0) != e->blobHash;
+            }
+            // a later record of the same key may have superseded the bad one
+            bool superseded = false;
+            for (UINT i = record + 1; i < RECORDS; ++i) {
+                superseded = superseded || g_recordKey[i] == g_recordKey[record];
+            }
+            CHECK(caught || superseded);
+        }
+        IconCacheFree();
+    }
+    free(copy);
+}
+
+/** Another build's header (or a corrupt one) is not replayed. */
+static void TestForeignHeader(const JournalBuffer *journal)
+{
+    BYTE *copy = malloc(journal->size);
+    for (DWORD at = 0; at < CACHE_HEADER_SIZE; ++at) {
+        memcpy(copy, journal->data, journal->size);
+        copy[at] ^= 0x01;
+        CHECK(!IconCacheHeaderValid(copy, journal->size));
+    }
+    CHECK(!IconCacheHeaderValid(journal->data, CACHE_HEADER_SIZE - 1));
+    free(copy);
+}
+
+/**
+ * WriteFileAtomic – what IconCacheCompact does on Windows: write a temp
+ *                   file, flush it, rename it over the journal.  With
+ *                   @crashAfter < @size the "process dies" after that many
+ *                   bytes, before the rename.
+ */
+static bool WriteFileAtomic(const char *file, const BYTE *data, DWORD size, DWORD crashAfter)
+{
+    char temp[512];
+    snprintf(temp, sizeof temp, "%s.tmp", file);
+
+    FILE *f = fopen(temp, "wb");
+    if (!f) {
+        return false;
+    }
+    const DWORD written = crashAfter < size ? crashAfter : size;
+    fwrite(data, 1, written, f);
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+    if (written < size) {
+        return false;
+    }
+    return rename(temp, file) == 0;
+}
+
+static BYTE *ReadWholeFile(const char *file, DWORD *outSize)
+{
+    FILE *f = fopen(file, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    BYTE *data = malloc(size ? size : 1);
+    *outSize = (DWORD)fread(data, 1, size, f);
+    fclose(f);
+    return data;
+}
+
+/**
+ * Compaction writes one record per live entry; the result replays to the
+ * same state, and a compaction that dies at any byte leaves the old
+ * journal untouched.
+ */
+static void TestCompaction(const JournalBuffer *journal)
+{
+    char file[] = "/tmp/sendto-journal-XXXXXX";
+    const int fd = mkstemp(file);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+    CHECK(WriteFileAtomic(file, journal->data, journal->size, journal->size));
+
+    IconCacheReplayRecords(journal->data, journal->size, CACHE_HEADER_SIZE);
+    JournalBuffer compacted = JournalStart();
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        JournalAppendEntry(&compacted, &g_iconCache.entries[i]);
+    }
+    const UINT live = g_iconCache.count;
+    IconCacheFree();
+    CHECK(compacted.size < journal->size);
+
+    for (DWORD crash = 0; crash < compacted.size; ++crash) {
+        CHECK(!WriteFileAtomic(file, compacted.data, compacted.size, crash));
+        DWORD size = 0;
+        BYTE *data = ReadWholeFile(file, &size);
+        CHECK(data && size == journal->size && memcmp(data, journal->data, size) == 0);
+        free(data);
+    }
+
+    CHECK(WriteFileAtomic(file, compacted.data, compacted.size, compacted.size));
+    DWORD size = 0;
+    BYTE *data = ReadWholeFile(file, &size);
+    CHECK(data && IconCacheHeaderValid(data, size));
+    if (data) {
+        CHECK(IconCacheReplayRecords(data, size, CACHE_HEADER_SIZE) == size);
+        CHECK(g_iconCache.fileRecords == live);
+        g_iconCache.fileRecords = RECORDS;   // same state as the full journal
+        CheckReplayedPrefix(RECORDS);
+        IconCacheFree();
+    }
+    free(data);
+
+    char temp[512];
+    snprintf(temp, sizeof temp, "%s.tmp", file);
+    unlink(temp);
+    unlink(file);
+    free(compacted.data);
+}
+
+/**
+ * An append after a torn tail starts at the replayed end, so the leftover
+ * bytes are overwritten rather than left between records.
+ */
+static void TestAppendOverTornTail(const JournalBuffer *journal)
+{
+    const DWORD cut = g_recordEnd[RECORDS - 2] + 9;
+    JournalBuffer torn = { 0 };
+    JournalAppend(&torn, journal->data, cut);
+
+    const DWORD end = IconCacheReplayRecords(torn.data, torn.size, CACHE_HEADER_SIZE);
+    CHECK(end == g_recordEnd[RECORDS - 2]);
+    IconCacheFree();
+
+    torn.size = end;
+    IconCacheEntry e = TestEntry("C:\\Users\\me\\SendTo\\appended.lnk", 32, 99);
+    JournalAppendEntry(&torn, &e);
+
+    CHECK(IconCacheReplayRecords(torn.data, torn.size, CACHE_HEADER_SIZE) == torn.size);
+    CHECK(g_iconCache.fileRecords == RECORDS);
+    CHECK(IconCacheFind(e.path, 32) != NULL);
+    IconCacheFree();
+
+    free(e.path);
+    free(e.blob);
+    free(torn.data);
+}
+
+/**
+ * A CACHE_PREVIOUS_VERSION journal replays with the same supersede rules;
+ * its entries come out dirty, with a computed blobHash, and re-encode as
+ * current records that replay to the same state.  A torn tail stops it,
+ * and no other header is taken for one.
+ */
+static void TestConvertPrevious(void)
+{
+    JournalBuffer previous = JournalStartPrevious();
+    DWORD ends[RECORDS];
+    for (UINT r = 0; r < RECORDS; ++r) {
+        char path[MAX_PATH];
+        KeyPath(g_recordKey[r], path, sizeof path);
+        IconCacheEntry e = TestEntry(path, 32, g_recordSeed[r]);
+        JournalAppendPrevious(&previous, &e);
+        ends[r] = previous.size;
+        free(e.path);
+        free(e.blob);
+    }
+
+    CHECK(!IconCacheHeaderValid(previous.data, previous.size));
+    CHECK(IconCacheConvertPrevious(previous.data, previous.size) == previous.size);
+    CHECK(g_iconCache.fileEnd == 0 && g_iconCache.dirty);
+
+    JournalBuffer converted = JournalStart();
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        IconCacheEntry *e = &g_iconCache.entries[i];
+        CHECK(e->dirty && e->verified);
+        JournalAppendEntry(&converted, e);
+        e->dirty = false;
+    }
+    CheckReplayedPrefix(RECORDS);
+    IconCacheFree();
+
+    CHECK(IconCacheReplayRecords(converted.data, converted.size, CACHE_HEADER_SIZE) == converted.size);
+    g_iconCache.fileRecords = RECORDS;    // same state as the full journal
+    CheckReplayedPrefix(RECORDS);
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        CHECK(IconCacheVerifyBlob(&g_iconCache.entries[i]));
+    }
+    IconCacheFree();
+
+    CHECK(IconCacheConvertPrevious(previous.data, ends[RECORDS - 2] + 9) == ends[RECORDS - 2]);
+    CHECK(g_iconCache.fileRecords == RECORDS - 1);
+    IconCacheFree();
+
+    // the current header, an older version and a short file are not converted
+    CHECK(IconCacheConvertPrevious(converted.data, converted.size) == 0);
+    previous.data[sizeof(DWORD)] = CACHE_PREVIOUS_VERSION - 1;
+    CHECK(IconCacheConvertPrevious(previous.data, previous.size) == 0);
+    CHECK(IconCacheConvertPrevious(previous.data, CACHE_PREVIOUS_HEADER_SIZE - 1) == 0);
+    CHECK(g_iconCache.count == 0);
+
+    free(previous.data);
+    free(converted.data);
+}
+
+int main(void)
+{
+    JournalBuffer journal = BuildJournal();
+
+    TestHashKnownAnswers();
+    TestReplay(&journal);
+    TestTornTailAtEveryOffset(&journal);
+    TestCorruptionAtEveryOffset(&journal);
+    TestForeignHeader(&journal);
+    TestCompaction(&journal);
+    TestAppendOverTornTail(&journal);
+    TestConvertPrevious();
+
+    free(journal.data);
+    return TestResult("journal");
+}
@@ -0,0 +1,174 @@
+/*
+ * test_paging.c – overflow paging of large folders: AddPages' recursive
+ * split checked for popup size, order, fill and progress over folder
+ * sizes up to well past ENUM_FOLDER_ENTRIES_CAP
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#include "check.h"
+
+/** Deepest nesting of page submenus any test folder may need. */
+#define MAX_LEVELS 4
+
+/**
+ * Partition – what AddPages builds for one folder: leaves cover every
+ *             entry in order, levels counted from the folder's own popup.
+ */
+typedef struct {
+    const WIN32_FIND_DATAW *entries;
+    UINT next;          // entry the next leaf must start at
+    UINT leaves;
+    UINT levels;
+    UINT widestPopup;
+    UINT cuts;          // pages ending before the end of their popup
+    UINT boundaryCuts;  // ... at a new initial or the dir/file split
+} Partition;
+
+/**
+ * Split – AddPages' recursion over [@start, @end) at @level, checking
+ *         each popup as it goes.
+ */
+static void Split(Partition *p, UINT start, UINT end, UINT level)
+{
+    CHECK(level < MAX_LEVELS);
+    if (level + 1 > p->levels) {
+        p->levels = level + 1;
+    }
+
+    const UINT span = PageSpan(end - start);
+    CHECK(span >= MENU_PAGE_SIZE);
+
+    UINT popupItems = 0;
+    for (UINT first = start; first < end; ) {
+        const UINT last = NextPageEnd(p->entries, first, end, span);
+        CHECK(last > first && last <= end);
+        if (last <= first) {
+            return;    // no progress: stop rather than loop
+        }
+        CHECK(last - first <= span);
+        // every page but the last is more than half full
+        CHECK(last == end || last - first > span / 2);
+
+        if (last < end) {
+            p->cuts++;
+            const WIN32_FIND_DATAW *a = &p->entries[last - 1], *b = &p->entries[last];
+            p->boundaryCuts += (a->dwFileAttributes ^ b->dwFileAttributes) & FILE_ATTRIBUTE_DIRECTORY ||
+                               PageKeyChar(a->cFileName) != PageKeyChar(b->cFileName);
+        }
+
+        popupItems++;
+        if (last - first > MENU_PAGE_SIZE) {
+            Split(p, first, last, level + 1);
+        } else {
+            CHECK(first == p->next);
+            p->next = last;
+            p->leaves++;
+        }
+        first = last;
+    }
+
+    CHECK(popupItems <= MENU_PAGE_SIZE);
+    if (popupItems > p->widestPopup) {
+        p->widestPopup = popupItems;
+    }
+}
+
+static Partition Run(const WIN32_FIND_DATAW *entries, UINT count)
+{
+    Partition p = { .entries = entries };
+    Split(&p, 0, count, 0);
+    CHECK(p.next == count);
+    return p;
+}
+
+/**
+ * MakeEntries – @count names in display order: @dirs folders, then files;
+ *               initials change every @run names (0: all share one).
+ */
+static WIN32_FIND_DATAW *MakeEntries(UINT count, UINT dirs, UINT run)
+{
+    WIN32_FIND_DATAW *entries = calloc(count ? count : 1, sizeof *entries);
+    for (UINT i = 0; i < count; ++i) {
+        const bool isDir = i < dirs;
+        const UINT index = isDir ? i : i - dirs;
+        const UINT group = run ? index / run : 0;
+        char name[64];
+        snprintf(name, sizeof name, "%c%c item %06u", 'A' + group % 26, 'a' + group / 26 % 26, index);
+        entries[i].dwFileAttributes = isDir ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+        Widen(entries[i].cFileName, MAX_PATH, name);
+    }
+    return entries;
+}
+
+static void TestKeyChar(void)
+{
+    CHECK(PageKeyChar(L"apple") == L'A');
+    CHECK(PageKeyChar(L"Apple") == L'A');
+    CHECK(PageKeyChar(L"7-Zip") == L'7');
+    CHECK(PageKeyChar(L"") == 0);
+}
+
+/** PageSpan keeps count / (span / 2) + 1 pages within one popup. */
+static void TestSpan(void)
+{
+    CHECK(PageSpan(MENU_PAGE_THRESHOLD + 1) == MENU_PAGE_SIZE);
+    for (UINT count = 1; count <= 200000; count += count / 7 + 1) {
+        const UINT span = PageSpan(count);
+        CHECK(count / (span / 2) + 1 <= MENU_PAGE_SIZE);
+        CHECK(span == MENU_PAGE_SIZE || count / (span / 4) + 1 > MENU_PAGE_SIZE);
+    }
+}
+
+/** No popup exceeds MENU_PAGE_SIZE items, whatever the size and names. */
+static void TestPartitions(void)
+{
+    static const UINT sizes[] = {
+        MENU_PAGE_THRESHOLD + 1, 100, 513, 1000, 1024, 4097, ENUM_FOLDER_ENTRIES_CAP, 50000
+    };
+    static const UINT runs[] = { 0, 1, 7, 40, 1000 };
+
+    for (size_t s = 0; s < ARRAYSIZE(sizes); ++s) {
+        for (size_t r = 0; r < ARRAYSIZE(runs); ++r) {
+            WIN32_FIND_DATAW *entries = MakeEntries(sizes[s], sizes[s] / 10, runs[r]);
+            const Partition p = Run(entries, sizes[s]);
+            CHECK(p.widestPopup <= MENU_PAGE_SIZE);
+            CHECK(p.leaves * MENU_PAGE_SIZE >= sizes[s]);
+            free(entries);
+        }
+    }
+
+    // PageSpan's example: 10000 entries in three levels
+    WIN32_FIND_DATAW *entries = MakeEntries(10000, 0, 0);
+    CHECK(Run(entries, 10000).levels == 3);
+    free(entries);
+}
+
+/** Pages end at a new initial (or the folder / file split) when they can. */
+static void TestNaturalBoundaries(void)
+{
+    // initials change every 10 names: every cut can land on one
+    WIN32_FIND_DATAW *entries = MakeEntries(600, 0, 10);
+    Partition p = Run(entries, 600);
+    CHECK(p.cuts > 0 && p.boundaryCuts == p.cuts);
+    free(entries);
+
+    // one initial throughout: hard cuts at span, pages full
+    entries = MakeEntries(600, 0, 0);
+    p = Run(entries, 600);
+    CHECK(p.cuts > 0 && p.boundaryCuts == 0);
+    free(entries);
+
+    // 30 folders then files of one initial: the first cut is the split
+    entries = MakeEntries(100, 30, 0);
+    CHECK(NextPageEnd(entries, 0, 100, PageSpan(100)) == 30);
+    free(entries);
+}
+
+int main(void)
+{
+    TestKeyChar();
+    TestSpan();
+    TestPartitions();
+    TestNaturalBoundaries();
+    return TestResult("paging");
+}
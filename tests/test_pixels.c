@@ -0,0 +1,189 @@
+/*
+ * test_pixels.c – the pixel kernels: scalar results checked against exact
+ * arithmetic, and the SSE2 kernels held to the scalar ones bit for bit over
+ * every alpha value and every tail length
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#include "check.h"
+
+/** Pixels per alpha value in the sweep buffer. */
+#define PER_ALPHA 64
+#define SWEEP     (256 * PER_ALPHA)
+
+/** round(c * a / 255), the premultiplied channel. */
+static UINT32 Scale(UINT32 c, UINT32 a)
+{
+    return (c * a * 2 + 255) / 510;
+}
+
+/**
+ * Sweep – every alpha with PER_ALPHA channel patterns each.  @premultiplied
+ *         keeps channels <= alpha (what a premultiplied DIB holds);
+ *         otherwise channels take any value, including inconsistent input
+ *         for the unpremultiply clamp.  @mixed interleaves alphas so quads
+ *         are neither all opaque nor all transparent.
+ */
+static void Sweep(UINT32 *out, bool premultiplied, bool mixed)
+{
+    for (UINT i = 0; i < SWEEP; ++i) {
+        const UINT32 a = mixed ? (i * 97) % 256 : i / PER_ALPHA;
+        const UINT32 k = i % PER_ALPHA;
+        UINT32 r = (k * 4) & 0xFF, g = 255 - r, b = (k * 37 + a) & 0xFF;
+        if (premultiplied) {
+            r = Scale(r, a);
+            g = Scale(g, a);
+            b = Scale(b, a);
+        }
+        out[i] = a << 24 | r << 16 | g << 8 | b;
+    }
+}
+
+/** Lengths that leave every tail 0-3 after the 4-pixel steps. */
+static const size_t g_lengths[] = { 0, 1, 2, 3, 4, 5, 6, 7, 9, 15, 17, 31, 33, 1023, SWEEP - 1, SWEEP };
+
+static void TestPremultiplyScalar(void)
+{
+    static UINT32 pixels[SWEEP], source[SWEEP];
+    Sweep(source, false, false);
+    memcpy(pixels, source, sizeof pixels);
+    PremultiplyRowScalar(pixels, SWEEP);
+
+    for (UINT i = 0; i < SWEEP; ++i) {
+        const UINT32 s = source[i], a = s >> 24;
+        const UINT32 expected = a << 24 | Scale((s >> 16) & 0xFF, a) << 16 |
+                                Scale((s >> 8) & 0xFF, a) << 8 | Scale(s & 0xFF, a);
+        CHECK(pixels[i] == expected);
+    }
+}
+
+/** Unpremultiplying then premultiplying again gives back the same pixel. */
+static void TestUnpremultiplyScalar(void)
+{
+    static UINT32 pixels[SWEEP], source[SWEEP];
+    Sweep(source, true, false);
+    memcpy(pixels, source, sizeof pixels);
+    UnpremultiplyRowScalar(pixels, SWEEP);
+
+    for (UINT i = 0; i < SWEEP; ++i) {
+        const UINT32 a = source[i] >> 24;
+        CHECK((pixels[i] >> 24) == a);
+        if (a == 0) {
+            CHECK(pixels[i] == 0);
+        } else if (a == 255) {
+            CHECK(pixels[i] == source[i]);
+        }
+    }
+    PremultiplyRowScalar(pixels, SWEEP);
+    CHECK(memcmp(pixels, source, sizeof pixels) == 0);
+
+    // inconsistent input (channel above alpha) clamps instead of wrapping
+    UINT32 bad = 0x10FF8000u;
+    UnpremultiplyRowScalar(&bad, 1);
+    CHECK(bad == 0x10FFFF00u);
+}
+
+static void TestMaskAndAlphaScalar(void)
+{
+    UINT32 pixels[4] = { 0x00123456u, 0x00ABCDEFu, 0x7F010203u, 0x00000000u };
+    const UINT32 mask[4] = { 0x00000000u, 0x00FFFFFFu, 0xFF000000u, 0x00000001u };
+    MaskToAlphaRowScalar(pixels, mask, 4);
+    CHECK(pixels[0] == 0xFF123456u && pixels[1] == 0 && pixels[2] == 0xFF010203u && pixels[3] == 0);
+
+    const UINT32 none[3] = { 0x00FFFFFFu, 0x00000001u, 0x00808080u };
+    CHECK(!HasAlphaRowScalar(none, 3));
+    CHECK(HasAlphaRowScalar(pixels, 4));
+    CHECK(!HasAlphaRowScalar(pixels, 0));
+}
+
+#ifdef SENDTO_SSE2
+typedef void (*RowKernel)(UINT32 *pixels, size_t count);
+
+/** Run @scalar and @simd over every length and offset; results must match. */
+static void Equivalent(const char *name, RowKernel scalar, RowKernel simd, bool premultiplied)
+{
+    static UINT32 source[SWEEP + 3], a[SWEEP + 3], b[SWEEP + 3];
+    for (int mixed = 0; mixed < 2; ++mixed) {
+        Sweep(source, premultiplied, mixed);
+        for (size_t l = 0; l < ARRAYSIZE(g_lengths); ++l) {
+            for (size_t offset = 0; offset < 4 && offset + g_lengths[l] <= SWEEP; ++offset) {
+                memcpy(a, source, sizeof source);
+                memcpy(b, source, sizeof source);
+                scalar(a + offset, g_lengths[l]);
+                simd(b + offset, g_lengths[l]);
+                if (memcmp(a, b, sizeof a) != 0) {
+                    fprintf(stderr, "  %s: length %zu offset %zu mixed %d differs\n",
+                            name, g_lengths[l], offset, mixed);
+                    g_failures++;
+                }
+            }
+        }
+    }
+}
+
+static void TestSse2MatchesScalar(void)
+{
+    Equivalent("premultiply", PremultiplyRowScalar, PremultiplyRowSse2, false);
+    Equivalent("unpremultiply", UnpremultiplyRowScalar, UnpremultiplyRowSse2, true);
+    Equivalent("unpremultiply (inconsistent)", UnpremultiplyRowScalar, UnpremultiplyRowSse2, false);
+
+    static UINT32 pixels[SWEEP], mask[SWEEP], a[SWEEP], b[SWEEP];
+    Sweep(pixels, false, true);
+    Sweep(mask, false, false);
+    for (UINT i = 0; i < SWEEP; ++i) {
+        mask[i] = (i % 3) ? 0 : mask[i] & 0x00FFFFFFu;    // mostly opaque, some holes
+    }
+    for (size_t l = 0; l < ARRAYSIZE(g_lengths); ++l) {
+        memcpy(a, pixels, sizeof a);
+        memcpy(b, pixels, sizeof b);
+        MaskToAlphaRowScalar(a, mask, g_lengths[l]);
+        MaskToAlphaRowSse2(b, mask, g_lengths[l]);
+        CHECK(memcmp(a, b, sizeof a) == 0);
+    }
+
+    // a single alpha byte anywhere, including the tail, is found
+    for (size_t l = 1; l < 40; ++l) {
+        for (size_t at = 0; at < l; ++at) {
+            memset(a, 0x7F, l * sizeof *a);
+            for (size_t i = 0; i < l; ++i) a[i] &= 0x00FFFFFFu;
+            CHECK(!HasAlphaRowSse2(a, l) && !HasAlphaRowScalar(a, l));
+            a[at] |= 0x01000000u;
+            CHECK(HasAlphaRowSse2(a, l) && HasAlphaRowScalar(a, l));
+        }
+    }
+}
+#endif /* SENDTO_SSE2 */
+
+/** Odd widths and strides copy exactly the block and nothing else. */
+static void TestCopyRows(void)
+{
+    static UINT32 src[40 * 40], dst[64 * 40];
+    for (UINT i = 0; i < ARRAYSIZE(src); ++i) {
+        src[i] = i * 2654435761u;
+    }
+    for (int width = 1; width <= 37; width += 3) {
+        memset(dst, 0xEE, sizeof dst);
+        CopyPixelRows(dst + 5, 64, src + 1, 40, width, 9);
+        for (int y = 0; y < 40; ++y) {
+            for (int x = 0; x < 64; ++x) {
+                const bool inside = y < 9 && x >= 5 && x < 5 + width;
+                const UINT32 expected = inside ? src[1 + y * 40 + (x - 5)] : 0xEEEEEEEEu;
+                CHECK(dst[y * 64 + x] == expected);
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    TestPremultiplyScalar();
+    TestUnpremultiplyScalar();
+    TestMaskAndAlphaScalar();
+#ifdef SENDTO_SSE2
+    TestSse2MatchesScalar();
+#else
+    printf("pixels: SSE2 kernels not built for this target, scalar checks only\n");
+#endif
+    TestCopyRows();
+    return TestResult("pixels");
+}
@@ -0,0 +1,336 @@
+/*
+ * test_shared_journal.c – simultaneous instances sharing one cache journal:
+ * writer processes serialise appends (and a compaction) through a lock
+ * file, reader processes map and replay the journal without a lock, and
+ * crashed writers leave torn tails behind
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ *
+ * The file I/O mirrors IconCacheSave on POSIX: flock on "<cache>.lock"
+ * for LockFileEx, pread/pwrite for ReadFile/WriteFile, rename for
+ * MoveFileExW and the inode for the file index.  Merge and replay are the
+ * core's own IconCacheMergeOffset / IconCacheMergeRecords.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "check.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define WRITERS          4
+#define ENTRIES          25
+#define READERS          2
+#define READER_PASSES    400
+#define CRASHES          6
+/** Writer 0 compacts the journal after this many of its own saves. */
+#define COMPACT_AFTER    12
+/** A crashed writer leaves this many bytes of its record: fewer than any
+ *  whole record, so the next append always grows the file again and a
+ *  reader's mapping never loses pages (on Windows the cut simply fails
+ *  while a view is open; on POSIX it would raise SIGBUS). */
+#define TORN_BYTES       10
+
+static char g_file[256];
+static char g_lockFile[280];
+static ino_t g_fileIno = 0;
+
+static void EntryPath(char *out, size_t size, UINT writer, UINT i)
+{
+    snprintf(out, size, "C:\\SendTo\\writer %u\\entry %02u.lnk", writer, i);
+}
+
+static UINT EntrySeed(UINT writer, UINT i)
+{
+    return writer * 100 + i + 1;
+}
+
+/**
+ * LockJournal – take the writer lock, like IconCacheLock.
+ */
+static int LockJournal(void)
+{
+    const int lock = open(g_lockFile, O_RDWR | O_CREAT, 0644);
+    if (lock >= 0 && flock(lock, LOCK_EX) != 0) {
+        close(lock);
+        return -1;
+    }
+    return lock;
+}
+
+static void UnlockJournal(int lock)
+{
+    flock(lock, LOCK_UN);
+    close(lock);
+}
+
+/**
+ * MergeTail – IconCacheMergeTail: pick up what other writers appended.
+ */
+static bool MergeTail(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+
+    const DWORD size  = (DWORD)st.st_size;
+    const DWORD start = IconCacheMergeOffset(size, st.st_ino == g_fileIno);
+    BYTE *data = malloc(size - start + 1);
+    const bool ok = data && pread(fd, data, size - start, start) == (ssize_t)(size - start) &&
+                    IconCacheMergeRecords(data, size, start);
+    free(data);
+    g_fileIno = st.st_ino;
+    return ok;
+}
+
+/**
+ * Compact – IconCacheCompact: one record per live entry, swapped in by rename.
+ */
+static bool Compact(void)
+{
+    char temp[300];
+    snprintf(temp, sizeof temp, "%s.tmp", g_file);
+    const int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    DWORD header[CACHE_HEADER_SIZE / sizeof(DWORD)];
+    IconCacheHeader(header);
+    bool ok = write(fd, header, sizeof header) == sizeof header;
+    UINT64 fileEnd = CACHE_HEADER_SIZE;
+    for (UINT i = 0; ok && i < g_iconCache.count; ++i) {
+        DWORD size;
+        BYTE *record = IconCacheEncodeRecord(&g_iconCache.entries[i], &size);
+        ok = record && write(fd, record, size) == (ssize_t)size;
+        fileEnd += size;
+        free(record);
+    }
+
+    struct stat st;
+    ok = ok && fsync(fd) == 0 && fstat(fd, &st) == 0;
+    close(fd);
+    if (!ok || rename(temp, g_file) != 0) {
+        unlink(temp);
+        return false;
+    }
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        g_iconCache.entries[i].dirty = false;
+    }
+    g_iconCache.fileEnd     = fileEnd;
+    g_iconCache.fileRecords = g_iconCache.count;
+    g_fileIno = st.st_ino;
+    return true;
+}
+
+/**
+ * Save – IconCacheSave: under the lock, merge, then append the dirty
+ *        entries at @fileEnd (or compact) and cut any torn leftovers.
+ *
+ * @param crash  Die halfway through the first append instead.
+ */
+static bool Save(bool compact, bool crash)
+{
+    const int lock = LockJournal();
+    if (lock < 0) {
+        return false;
+    }
+    const int fd = open(g_file, O_RDWR);
+    bool ok = fd >= 0 && MergeTail(fd);
+
+    if (ok && compact) {
+        close(fd);
+        ok = Compact();
+        UnlockJournal(lock);
+        return ok;
+    }
+
+    for (UINT i = 0; ok && i < g_iconCache.count; ++i) {
+        IconCacheEntry *e = &g_iconCache.entries[i];
+        if (!e->dirty) continue;
+
+        DWORD size;
+        BYTE *record = IconCacheEncodeRecord(e, &size);
+        if (crash) {
+            pwrite(fd, record, TORN_BYTES, (off_t)g_iconCache.fileEnd);
+            _exit(0);   // the kernel drops the lock with the process
+        }
+        ok = record && pwrite(fd, record, size, (off_t)g_iconCache.fileEnd) == (ssize_t)size;
+        free(record);
+
+        e->dirty = false;
+        g_iconCache.fileEnd += size;
+        g_iconCache.fileRecords++;
+    }
+    ok = ok && ftruncate(fd, (off_t)g_iconCache.fileEnd) == 0;
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    UnlockJournal(lock);
+    return ok;
+}
+
+/**
+ * AddEntry – a fresh icon resolved by this instance (dirty until saved).
+ */
+static void AddEntry(const char *path, UINT seed)
+{
+    IconCacheEntry e = TestEntry(path, 32, seed);
+    e.dirty = true;
+    if (!IconCacheAdd(&e)) {
+        free(e.path);
+        free(e.blob);
+    }
+}
+
+/** A writer instance: resolve ENTRIES icons, saving after each one. */
+static int WriterMain(UINT writer)
+{
+    for (UINT i = 0; i < ENTRIES; ++i) {
+        char path[128];
+        EntryPath(path, sizeof path, writer, i);
+        AddEntry(path, EntrySeed(writer, i));
+        if (!Save(writer == 0 && i == COMPACT_AFTER, false)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** A writer that keeps crashing halfway through its append. */
+static int CrasherMain(void)
+{
+    for (UINT i = 0; i < CRASHES; ++i) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            AddEntry("C:\\SendTo\\crashed.lnk", 7);
+            Save(false, true);
+            _exit(1);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            return 1;
+        }
+        usleep(1000);
+    }
+    return 0;
+}
+
+/**
+ * A reader instance: map the journal without the lock (IconCacheLoad) and
+ * replay it.  Every pass must see a valid header, only intact records and
+ * never fewer records than the pass before.
+ */
+static int ReaderMain(void)
+{
+    UINT seen = 0;
+    for (UINT pass = 0; pass < READER_PASSES; ++pass) {
+        const int fd = open(g_file, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            return 1;
+        }
+        const DWORD size = (DWORD)st.st_size;
+        const BYTE *view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED || !IconCacheHeaderValid(view, size)) {
+            return 2;
+        }
+
+        IconCacheReplayRecords(view, size, CACHE_HEADER_SIZE);
+        for (UINT i = 0; i < g_iconCache.count; ++i) {
+            const IconCacheEntry *e = &g_iconCache.entries[i];
+            if (CacheHash32(e->blob, e->blobSize, 0) != e->blobHash) {
+                return 3;
+            }
+        }
+        if (g_iconCache.fileRecords < seen) {
+            return 4;
+        }
+        seen = g_iconCache.fileRecords;
+
+        IconCacheFree();
+        munmap((void *)view, size);
+    }
+    return 0;
+}
+
+static pid_t Spawn(int (*body)(UINT), UINT arg)
+{
+    const pid_t pid = fork();
+    if (pid == 0) {
+        _exit(body(arg));
+    }
+    return pid;
+}
+
+static int RunWriter(UINT writer)  { return WriterMain(writer); }
+static int RunReader(UINT unused)  { (void)unused; return ReaderMain(); }
+static int RunCrasher(UINT unused) { (void)unused; return CrasherMain(); }
+
+int main(void)
+{
+    snprintf(g_file, sizeof g_file, "/tmp/sendto-shared-%d.cache", (int)getpid());
+    snprintf(g_lockFile, sizeof g_lockFile, "%s.lock", g_file);
+
+    // an empty journal, as the first compaction leaves it
+    DWORD header[CACHE_HEADER_SIZE / sizeof(DWORD)];
+    IconCacheHeader(header);
+    FILE *f = fopen(g_file, "wb");
+    CHECK(f && fwrite(header, 1, sizeof header, f) == sizeof header);
+    if (f) {
+        fclose(f);
+    }
+
+    pid_t pids[WRITERS + READERS + 1];
+    UINT n = 0;
+    for (UINT r = 0; r < READERS; ++r) {
+        pids[n++] = Spawn(RunReader, r);
+    }
+    pids[n++] = Spawn(RunCrasher, 0);
+    for (UINT w = 0; w < WRITERS; ++w) {
+        pids[n++] = Spawn(RunWriter, w);
+    }
+    for (UINT i = 0; i < n; ++i) {
+        int status;
+        CHECK(waitpid(pids[i], &status, 0) == pids[i]);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    // one more save cuts a torn tail the last crash may have left
+    CHECK(Save(false, false));
+
+    struct stat st;
+    CHECK(stat(g_file, &st) == 0);
+    CHECK(g_iconCache.fileEnd == (UINT64)st.st_size);
+
+    // nothing lost, nothing duplicated, no torn record survived
+    CHECK(g_iconCache.count == WRITERS * ENTRIES);
+    CHECK(g_iconCache.fileRecords == WRITERS * ENTRIES);
+    for (UINT w = 0; w < WRITERS; ++w) {
+        for (UINT i = 0; i < ENTRIES; ++i) {
+            char path[128];
+            WCHAR wide[128];
+            EntryPath(path, sizeof path, w, i);
+            Widen(wide, 128, path);
+            const IconCacheEntry *e = IconCacheFind(wide, 32);
+            CHECK(e && e->lastWrite.dwLowDateTime == EntrySeed(w, i));
+        }
+    }
+    WCHAR crashed[64];
+    Widen(crashed, 64, "C:\\SendTo\\crashed.lnk");
+    CHECK(IconCacheFind(crashed, 32) == NULL);
+    IconCacheFree();
+
+    unlink(g_file);
+    unlink(g_lockFile);
+    return TestResult("shared_journal");
+}
@@ -0,0 +1,442 @@
+/*
+ * test_snapshot.c – the persisted menu snapshot: encode / decode round
+ * trip, rejection of corrupt, stale and foreign images, and the
+ * revalidation walk over a fake file system with per-call latency
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "check.h"
+
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+/** One minute in FILETIME units. */
+#define MINUTE (60ull * 10000000)
+
+static double NowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void Narrow(char *out, size_t cch, PCWSTR text)
+{
+    size_t i = 0;
+    for (; text[i] && i + 1 < cch; ++i) {
+        out[i] = (char)text[i];
+    }
+    out[i] = '\0';
+}
+
+static UINT64 Stamp(const FILETIME *ft)
+{
+    return ((UINT64)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+}
+
+/* ---- the fake file system ------------------------------------------------ */
+
+/**
+ * FakeFolder – a folder of the fake tree; names ending in '/' are
+ *              subfolders (listed first, as ListFolder sorts them).
+ */
+typedef struct {
+    const char *path;
+    UINT64      stamp;
+    const char *names[8];
+    bool        offline;
+} FakeFolder;
+
+/**
+ * FakeFs – the tree plus what a pass cost: every stamp query and listing
+ *          sleeps @latencyUs, like a round trip to a file share.
+ */
+typedef struct {
+    FakeFolder    folders[8];
+    UINT          count;
+    UINT          latencyUs;
+    UINT          stampCalls;
+    UINT          listCalls;
+    UINT          cancelAfter;     // calls before *cancel is set (0 = never)
+    volatile LONG cancel;
+} FakeFs;
+
+static FakeFs MakeFs(UINT latencyUs)
+{
+    FakeFs fs = {
+        .folders = {
+            { "C:\\SendTo",                130, { "Docs/", "Tools/", "Mail.lnk", "Notepad.lnk" }, false },
+            { "C:\\SendTo\\Docs",          200, { "Archive/", "Report.lnk" }, false },
+            { "C:\\SendTo\\Docs\\Archive", 300, { "Old.lnk" }, false },
+            { "C:\\SendTo\\Tools",         400, { "7-Zip.lnk", "Hash.lnk" }, false },
+        },
+        .count     = 4,
+        .latencyUs = latencyUs
+    };
+    return fs;
+}
+
+static FakeFolder *FindFake(FakeFs *fs, PCWSTR path)
+{
+    char narrow[MAX_PATH];
+    Narrow(narrow, MAX_PATH, path);
+    for (UINT i = 0; i < fs->count; ++i) {
+        if (strcasecmp(fs->folders[i].path, narrow) == 0) {
+            return &fs->folders[i];
+        }
+    }
+    return NULL;
+}
+
+static void Latency(FakeFs *fs)
+{
+    if (fs->latencyUs) {
+        usleep(fs->latencyUs);
+    }
+    if (fs->cancelAfter && fs->stampCalls + fs->listCalls >= fs->cancelAfter) {
+        fs->cancel = 1;
+    }
+}
+
+/** SnapshotStampReader over the fake tree. */
+static UINT64 FakeStamp(PCWSTR path, void *context)
+{
+    FakeFs *fs = context;
+    fs->stampCalls++;
+    Latency(fs);
+    const FakeFolder *folder = FindFake(fs, path);
+    return folder && !folder->offline ? folder->stamp : 0;
+}
+
+/** SnapshotLister over the fake tree; a subfolder's time is its stamp. */
+static bool FakeList(PCWSTR path, UINT listed, void *context, FolderListing *out)
+{
+    (void)listed;
+    FakeFs *fs = context;
+    fs->listCalls++;
+    Latency(fs);
+
+    *out = (FolderListing){ 0 };
+    const FakeFolder *folder = FindFake(fs, path);
+    if (!folder || folder->offline) {
+        return false;
+    }
+
+    out->entries = calloc(ARRAYSIZE(folder->names), sizeof *out->entries);
+    for (UINT i = 0; i < ARRAYSIZE(folder->names) && folder->names[i]; ++i) {
+        WIN32_FIND_DATAW *entry = &out->entries[out->count++];
+        const char *name = folder->names[i];
+        const size_t len = strlen(name);
+        const bool isDir = name[len - 1] == '/';
+
+        char child[MAX_PATH];
+        snprintf(child, sizeof child, "%s\\%.*s", folder->path, (int)(len - isDir), name);
+        WCHAR wideChild[MAX_PATH];
+        Widen(wideChild, MAX_PATH, child);
+        const FakeFolder *sub = isDir ? FindFake(fs, wideChild) : NULL;
+        const UINT64 time = sub ? sub->stamp : 1;
+
+        entry->dwFileAttributes = isDir ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+        entry->ftLastWriteTime  = (FILETIME){ (DWORD)time, (DWORD)(time >> 32) };
+        Widen(entry->cFileName, len - isDir + 1, name);
+    }
+    return true;
+}
+
+/**
+ * Revalidate – one SnapshotRevalidateFolder pass of @loaded over @fs from
+ *              the root; an empty @loaded captures the whole tree.
+ */
+static bool Revalidate(FakeFs *fs, const MenuSnapshot *loaded, UINT maxDepth,
+                       SnapshotRevalidation *pass)
+{
+    static EnumLimits limits;
+    limits = (EnumLimits){ maxDepth, ENUM_FOLDER_ENTRIES, ENUM_TOTAL_ENTRIES, ENUM_BUDGET_MS, true, true };
+    *pass = (SnapshotRevalidation){
+        .loaded  = loaded,
+        .limits  = &limits,
+        .stamp   = FakeStamp,
+        .list    = FakeList,
+        .context = fs,
+        .cancel  = &fs->cancel,
+        .next    = { .savedAt = loaded->savedAt }
+    };
+    return SnapshotRevalidateFolder(pass, L"C:\\SendTo", 0, 0);
+}
+
+static MenuSnapshot Capture(FakeFs *fs, UINT64 savedAt)
+{
+    const MenuSnapshot empty = { .savedAt = savedAt };
+    SnapshotRevalidation pass;
+    CHECK(Revalidate(fs, &empty, MAX_DEPTH, &pass));
+    return pass.next;
+}
+
+static const SnapshotFolder *Find(const MenuSnapshot *snapshot, const char *path)
+{
+    WCHAR wide[MAX_PATH];
+    Widen(wide, MAX_PATH, path);
+    return SnapshotFind(snapshot, wide);
+}
+
+static bool HasEntry(const SnapshotFolder *folder, const char *name)
+{
+    WCHAR wide[MAX_PATH];
+    Widen(wide, MAX_PATH, name);
+    for (UINT i = 0; folder && i < folder->listing.count; ++i) {
+        if (wcscmp(folder->listing.entries[i].cFileName, wide) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool SameSnapshot(const MenuSnapshot *a, const MenuSnapshot *b)
+{
+    if (a->count != b->count || a->savedAt != b->savedAt) {
+        return false;
+    }
+    for (UINT i = 0; i < a->count; ++i) {
+        const SnapshotFolder *x = &a->folders[i], *y = &b->folders[i];
+        if (wcscmp(x->path, y->path) != 0 || x->hash != y->hash || x->depth != y->depth ||
+            x->lastWrite != y->lastWrite || x->listing.count != y->listing.count) {
+            return false;
+        }
+        for (UINT j = 0; j < x->listing.count; ++j) {
+            const WIN32_FIND_DATAW *e = &x->listing.entries[j], *f = &y->listing.entries[j];
+            if (e->dwFileAttributes != f->dwFileAttributes ||
+                Stamp(&e->ftLastWriteTime) != Stamp(&f->ftLastWriteTime) ||
+                wcscmp(e->cFileName, f->cFileName) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* ---- the file image ------------------------------------------------------ */
+
+static const UINT32 g_settings = 0x5E771265;
+static const UINT64 g_savedAt  = 133500000000000000ull;
+
+/** A captured tree survives encode / decode, root matched case-insensitively. */
+static void TestRoundTrip(void)
+{
+    FakeFs fs = MakeFs(0);
+    MenuSnapshot snapshot = Capture(&fs, g_savedAt);
+    CHECK(snapshot.count == 4);
+    CHECK(Find(&snapshot, "C:\\SendTo\\Docs\\Archive")->depth == 2);
+    CHECK(Find(&snapshot, "C:\\SendTo\\Tools")->lastWrite == 400);
+
+    BYTE *data;
+    DWORD size;
+    CHECK(SnapshotEncode(&snapshot, L"C:\\SendTo", g_settings, &data, &size));
+    CHECK(size > SNAPSHOT_HEADER_SIZE);
+
+    MenuSnapshot decoded = { 0 };
+    CHECK(SnapshotDecode(data, size, L"c:\\sendto", g_settings, g_savedAt + MINUTE, 10 * MINUTE, &decoded));
+    CHECK(SameSnapshot(&snapshot, &decoded));
+
+    // an empty snapshot is a valid image too
+    SnapshotFree(&decoded);
+    BYTE *emptyData;
+    DWORD emptySize;
+    const MenuSnapshot empty = { .savedAt = g_savedAt };
+    CHECK(SnapshotEncode(&empty, L"C:\\SendTo", g_settings, &emptyData, &emptySize));
+    CHECK(SnapshotDecode(emptyData, emptySize, L"C:\\SendTo", g_settings, g_savedAt, MINUTE, &decoded));
+    CHECK(decoded.count == 0);
+
+    free(emptyData);
+    free(data);
+    SnapshotFree(&decoded);
+    SnapshotFree(&snapshot);
+}
+
+/** Any flipped byte or cut tail is refused, and nothing is left allocated. */
+static void TestCorruption(void)
+{
+    FakeFs fs = MakeFs(0);
+    MenuSnapshot snapshot = Capture(&fs, g_savedAt);
+    BYTE *data;
+    DWORD size;
+    CHECK(SnapshotEncode(&snapshot, L"C:\\SendTo", g_settings, &data, &size));
+
+    MenuSnapshot out = { 0 };
+    UINT accepted = 0;
+    for (DWORD i = 0; i < size; ++i) {
+        data[i] ^= 0x20;
+        accepted += SnapshotDecode(data, size, L"C:\\SendTo", g_settings, g_savedAt, MINUTE, &out);
+        CHECK(out.count == 0 && !out.folders);
+        data[i] ^= 0x20;
+    }
+    CHECK(accepted == 0);
+
+    for (DWORD cut = 0; cut < size; ++cut) {
+        accepted += SnapshotDecode(data, cut, L"C:\\SendTo", g_settings, g_savedAt, MINUTE, &out);
+    }
+    CHECK(accepted == 0);
+    CHECK(!SnapshotDecode(data, SNAPSHOT_MAX_FILE_SIZE + 1, L"C:\\SendTo", g_settings, g_savedAt, MINUTE, &out));
+
+    // a checksum-valid image with an absurd entry count: refused, not allocated
+    BYTE *crafted = malloc(size);
+    memcpy(crafted, data, size);
+    const DWORD payload = SNAPSHOT_HEADER_SIZE + 8 + 4 + 4 + 9 * sizeof(WCHAR) + 4;
+    const DWORD countAt = payload + 4 + 9 * sizeof(WCHAR) + 8 + 4;
+    const UINT32 huge = 0xFFFFFFFF;
+    memcpy(crafted + countAt, &huge, sizeof huge);
+    DWORD *head = (DWORD *)crafted;
+    head[3] = CacheHash32(crafted + SNAPSHOT_HEADER_SIZE, head[2], SNAPSHOT_MAGIC);
+    CHECK(!SnapshotDecode(crafted, size, L"C:\\SendTo", g_settings, g_savedAt, MINUTE, &out));
+    CHECK(out.count == 0);
+
+    free(crafted);
+    free(data);
+    SnapshotFree(&snapshot);
+}
+
+/** Too old, other settings or another root: not served. */
+static void TestStaleness(void)
+{
+    FakeFs fs = MakeFs(0);
+    MenuSnapshot snapshot = Capture(&fs, g_savedAt);
+    BYTE *data;
+    DWORD size;
+    CHECK(SnapshotEncode(&snapshot, L"C:\\SendTo", g_settings, &data, &size));
+
+    MenuSnapshot out = { 0 };
+    CHECK(SnapshotDecode(data, size, L"C:\\SendTo", g_settings, g_savedAt + 60 * MINUTE, 60 * MINUTE, &out));
+    SnapshotFree(&out);
+    CHECK(!SnapshotDecode(data, size, L"C:\\SendTo", g_settings, g_savedAt + 60 * MINUTE + 1, 60 * MINUTE, &out));
+    CHECK(!SnapshotDecode(data, size, L"C:\\SendTo", g_settings ^ 1, g_savedAt, 60 * MINUTE, &out));
+    CHECK(!SnapshotDecode(data, size, L"D:\\SendTo", g_settings, g_savedAt, 60 * MINUTE, &out));
+    CHECK(!SnapshotDecode(data, size, L"C:\\SendTo\\Docs", g_settings, g_savedAt, 60 * MINUTE, &out));
+    CHECK(out.count == 0);
+
+    free(data);
+    SnapshotFree(&snapshot);
+}
+
+/* ---- revalidation -------------------------------------------------------- */
+
+/** Latency per call of the fake share. */
+#define LATENCY_US 2000
+
+/**
+ * Unchanged tree: one stamp query per folder and no listing, so serving
+ * the snapshot costs a fraction of a fresh walk.
+ */
+static void TestUnchanged(void)
+{
+    FakeFs fs = MakeFs(LATENCY_US);
+    double start = NowMs();
+    MenuSnapshot loaded = Capture(&fs, g_savedAt);
+    const double captureMs = NowMs() - start;
+    CHECK(fs.listCalls == 4);
+
+    fs.stampCalls = fs.listCalls = 0;
+    SnapshotRevalidation pass;
+    start = NowMs();
+    CHECK(Revalidate(&fs, &loaded, MAX_DEPTH, &pass));
+    const double revalidateMs = NowMs() - start;
+
+    CHECK(fs.listCalls == 0 && pass.relisted == 0);
+    CHECK(fs.stampCalls == 4 && pass.checked == 4);
+    CHECK(SameSnapshot(&loaded, &pass.next));
+    CHECK(revalidateMs < captureMs);
+
+    SnapshotFree(&pass.next);
+    SnapshotFree(&loaded);
+}
+
+/**
+ * A changed folder is listed again; its subfolders take their times from
+ * that fresh listing instead of another round trip.
+ */
+static void TestChangedFolder(void)
+{
+    FakeFs fs = MakeFs(LATENCY_US);
+    MenuSnapshot loaded = Capture(&fs, g_savedAt);
+
+    fs.folders[1].names[2] = "New.lnk";
+    fs.folders[1].stamp    = 201;
+    fs.stampCalls = fs.listCalls = 0;
+
+    SnapshotRevalidation pass;
+    CHECK(Revalidate(&fs, &loaded, MAX_DEPTH, &pass));
+    CHECK(pass.relisted == 1 && fs.listCalls == 1);
+    CHECK(pass.checked == 3);    // root, Docs, Tools; Archive's time came with Docs
+    CHECK(HasEntry(Find(&pass.next, "C:\\SendTo\\Docs"), "New.lnk"));
+    CHECK(Find(&pass.next, "C:\\SendTo\\Docs")->lastWrite == 201);
+    CHECK(!HasEntry(Find(&loaded, "C:\\SendTo\\Docs"), "New.lnk"));
+    CHECK(pass.next.savedAt == loaded.savedAt);
+
+    SnapshotFree(&pass.next);
+    SnapshotFree(&loaded);
+}
+
+/** An unreachable folder keeps its old listing; a new one is listed. */
+static void TestOfflineAndNew(void)
+{
+    FakeFs fs = MakeFs(LATENCY_US);
+    MenuSnapshot loaded = Capture(&fs, g_savedAt);
+
+    fs.folders[3].offline = true;
+    SnapshotRevalidation pass;
+    CHECK(Revalidate(&fs, &loaded, MAX_DEPTH, &pass));
+    CHECK(pass.relisted == 0);
+    CHECK(SameSnapshot(&loaded, &pass.next));
+    SnapshotFree(&pass.next);
+
+    fs.folders[3].offline  = false;
+    fs.folders[3].names[0] = "Extra/";
+    fs.folders[3].stamp    = 401;
+    fs.folders[fs.count++] = (FakeFolder){ "C:\\SendTo\\Tools\\Extra", 500, { "Deep.lnk" }, false };
+    CHECK(Revalidate(&fs, &loaded, MAX_DEPTH, &pass));
+    CHECK(pass.relisted == 2);
+    CHECK(pass.next.count == 5);
+    CHECK(HasEntry(Find(&pass.next, "C:\\SendTo\\Tools\\Extra"), "Deep.lnk"));
+    CHECK(!HasEntry(Find(&pass.next, "C:\\SendTo\\Tools"), "7-Zip.lnk"));
+
+    SnapshotFree(&pass.next);
+    SnapshotFree(&loaded);
+}
+
+/** The depth limit bounds the pass; cancellation stops it early. */
+static void TestDepthAndCancel(void)
+{
+    FakeFs fs = MakeFs(LATENCY_US);
+    MenuSnapshot loaded = Capture(&fs, g_savedAt);
+
+    SnapshotRevalidation pass;
+    fs.stampCalls = 0;
+    CHECK(Revalidate(&fs, &loaded, 2, &pass));
+    CHECK(pass.next.count == 3 && !Find(&pass.next, "C:\\SendTo\\Docs\\Archive"));
+    CHECK(fs.stampCalls == 3);
+    SnapshotFree(&pass.next);
+
+    fs.stampCalls = fs.listCalls = 0;
+    fs.cancelAfter = 2;
+    CHECK(!Revalidate(&fs, &loaded, MAX_DEPTH, &pass));
+    CHECK(fs.stampCalls + fs.listCalls <= 3);
+    CHECK(pass.next.count < loaded.count);
+
+    SnapshotFree(&pass.next);
+    SnapshotFree(&loaded);
+}
+
+int main(void)
+{
+    TestRoundTrip();
+    TestCorruption();
+    TestStaleness();
+
+    TestUnchanged();
+    TestChangedFolder();
+    TestOfflineAndNew();
+    TestDepthAndCancel();
+
+    return TestResult("snapshot");
+}
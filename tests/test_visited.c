@@ -0,0 +1,230 @@
+/*
+ * test_visited.c – cycle-aware traversal: the VisitedSet table itself, and
+ * walks over real symlink loops identified by st_dev/st_ino
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "check.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Depth limit of the test walks (ENUM_MAX_DEPTH_CAP, the worst case). */
+#define WALK_DEPTH ENUM_MAX_DEPTH_CAP
+
+/** Identities are distinct per (volume, file index); repeats are refused. */
+static void TestTable(void)
+{
+    VisitedSet set = { 0 };
+    for (UINT64 id = 1; id <= 20000; ++id) {
+        CHECK(VisitedAdd(&set, (DWORD)(id % 3), id * 0x9E3779B97F4A7C15ull));
+    }
+    CHECK(set.count == 20000);
+    CHECK((set.mask + 1) >= set.count * 2);
+
+    for (UINT64 id = 1; id <= 20000; ++id) {
+        CHECK(!VisitedAdd(&set, (DWORD)(id % 3), id * 0x9E3779B97F4A7C15ull));
+    }
+    // same file index on another volume is another directory
+    CHECK(VisitedAdd(&set, 7, 1 * 0x9E3779B97F4A7C15ull));
+    CHECK(set.count == 20001);
+
+    VisitedFree(&set);
+    CHECK(set.count == 0 && set.mask == 0 && !set.fileIds);
+    CHECK(VisitedAdd(&set, 1, 42) && !VisitedAdd(&set, 1, 42));
+    VisitedFree(&set);
+}
+
+static char g_root[] = "/tmp/sendto-visited-XXXXXX";
+
+/**
+ * Walk – result of one walk: folders entered, symlinked folders refused by
+ *        policy, and how often each real directory was entered.
+ */
+typedef struct {
+    VisitedSet *visited;    // NULL: the old, blind walk
+    bool        followLinks;
+    UINT        entered;
+    UINT        skippedLinks;
+    UINT        maxPerInode;
+    ino_t       inodes[64];
+    UINT        inodeHits[64];
+    UINT        inodeCount;
+} Walk;
+
+static void CountInode(Walk *walk, ino_t ino)
+{
+    for (UINT i = 0; i < walk->inodeCount; ++i) {
+        if (walk->inodes[i] == ino) {
+            if (++walk->inodeHits[i] > walk->maxPerInode) {
+                walk->maxPerInode = walk->inodeHits[i];
+            }
+            return;
+        }
+    }
+    if (walk->inodeCount < 64) {
+        walk->inodes[walk->inodeCount]    = ino;
+        walk->inodeHits[walk->inodeCount] = 1;
+        walk->inodeCount++;
+        if (!walk->maxPerInode) walk->maxPerInode = 1;
+    }
+}
+
+/**
+ * EnterDirectory – the POSIX twin of sendto.c's: refuse symlinks by policy,
+ *                  else enter unless the identity was visited already.
+ */
+static bool EnterDirectory(Walk *walk, const char *path)
+{
+    struct stat link, st;
+    if (lstat(path, &link) != 0 || stat(path, &st) != 0) {
+        return false;
+    }
+    if (S_ISLNK(link.st_mode) && !walk->followLinks) {
+        walk->skippedLinks++;
+        return false;
+    }
+    return !walk->visited || VisitedAdd(walk->visited, (DWORD)st.st_dev, (UINT64)st.st_ino);
+}
+
+static void WalkFolder(Walk *walk, const char *dir, UINT depth)
+{
+    struct stat st;
+    if (stat(dir, &st) == 0) {
+        CountInode(walk, st.st_ino);
+    }
+    walk->entered++;
+    if (depth + 1 >= WALK_DEPTH) {
+        return;
+    }
+
+    DIR *d = opendir(dir);
+    struct dirent *item;
+    char (*children)[512] = malloc(16 * sizeof *children);
+    UINT count = 0;
+    while (d && (item = readdir(d)) != NULL) {
+        if (item->d_name[0] == '.' || count == 16) continue;
+        snprintf(children[count], sizeof *children, "%.250s/%.250s", dir, item->d_name);
+        if (stat(children[count], &st) == 0 && S_ISDIR(st.st_mode)) {
+            count++;
+        }
+    }
+    if (d) closedir(d);
+
+    for (UINT i = 0; i < count; ++i) {
+        if (EnterDirectory(walk, children[i])) {
+            WalkFolder(walk, children[i], depth + 1);
+        }
+    }
+    free(children);
+}
+
+/**
+ * RunWalk – VisitedReset + the walk: the root is recorded up front, so a
+ *           link back to it is caught too.
+ */
+static Walk RunWalk(bool useVisited, bool followLinks)
+{
+    VisitedSet set = { 0 };
+    Walk walk = { 0 };
+    walk.visited     = useVisited ? &set : NULL;
+    walk.followLinks = followLinks;
+
+    struct stat st;
+    if (useVisited && stat(g_root, &st) == 0) {
+        VisitedAdd(&set, (DWORD)st.st_dev, (UINT64)st.st_ino);
+    }
+    WalkFolder(&walk, g_root, 0);
+    VisitedFree(&set);
+    return walk;
+}
+
+static void MakeDir(const char *relative)
+{
+    char path[512];
+    snprintf(path, sizeof path, "%s/%s", g_root, relative);
+    CHECK(mkdir(path, 0755) == 0);
+}
+
+static void MakeLink(const char *target, const char *relative)
+{
+    char path[512];
+    snprintf(path, sizeof path, "%s/%s", g_root, relative);
+    CHECK(symlink(target, path) == 0);
+}
+
+/**
+ * The tree: 6 real folders (root, a, a/b, a/b/c, d, d/e) and four
+ * symlinks – a/b/up -> root (loop to an ancestor), a/self -> a (loop to
+ * itself), d/e/back -> a/b (cross link) and alias -> d (folder reachable
+ * twice).
+ */
+static void BuildTree(void)
+{
+    CHECK(mkdtemp(g_root) != NULL);
+    MakeDir("a");
+    MakeDir("a/b");
+    MakeDir("a/b/c");
+    MakeDir("d");
+    MakeDir("d/e");
+    MakeLink("../..", "a/b/up");
+    MakeLink(".", "a/self");
+    MakeLink("../../a/b", "d/e/back");
+    MakeLink("d", "alias");
+}
+
+static void RemoveTree(void)
+{
+    static const char *const paths[] = {
+        "a/b/up", "a/self", "d/e/back", "alias", "a/b/c", "a/b", "a", "d/e", "d"
+    };
+    for (size_t i = 0; i < ARRAYSIZE(paths); ++i) {
+        char path[512];
+        snprintf(path, sizeof path, "%s/%s", g_root, paths[i]);
+        remove(path);
+    }
+    rmdir(g_root);
+}
+
+/** Every real folder is entered exactly once, whatever the links. */
+static void TestLoopsEnteredOnce(void)
+{
+    const Walk walk = RunWalk(true, true);
+    CHECK(walk.entered == 6);
+    CHECK(walk.inodeCount == 6);
+    CHECK(walk.maxPerInode == 1);
+}
+
+/** Without the set the loops multiply the walk up to the depth limit. */
+static void TestBlindWalkMultiplies(void)
+{
+    const Walk walk = RunWalk(false, true);
+    CHECK(walk.inodeCount == 6);
+    CHECK(walk.entered > 100);
+    CHECK(walk.maxPerInode > 10);
+}
+
+/** FollowReparsePoints=0: no symlinked folder is entered at all. */
+static void TestLinksNotFollowed(void)
+{
+    const Walk walk = RunWalk(true, false);
+    CHECK(walk.entered == 6);
+    CHECK(walk.skippedLinks == 4);
+    CHECK(walk.maxPerInode == 1);
+}
+
+int main(void)
+{
+    TestTable();
+
+    BuildTree();
+    TestLoopsEnteredOnce();
+    TestBlindWalkMultiplies();
+    TestLinksNotFollowed();
+    RemoveTree();
+
+    return TestResult("visited");
+}
@@ -0,0 +1,384 @@
+/*
+ * sendto_cachetool.c – inspect, validate and compact a sendto.cache file
+ * on any host, with the same journal code sendto.exe uses
+ * Copyright (c) 2025 DSR! <xchwarze@gmail.com>
+ *
+ * Usage: sendto-cachetool stat|validate|compact <file>
+ *
+ *   stat      Report records, entries, budget use, sizes, duplicate and
+ *             corrupt blobs (like "sendto.exe /cachestat").  Cached paths
+ *             are Windows paths, so missing / changed files are not checked.
+ *   validate  Print one verdict line; exit 0 if the header is current and
+ *             every blob passes its checksum and decodes, 1 otherwise.
+ *   compact   Drop corrupt entries, apply the LRU budget and rewrite the
+ *             journal in the current format (temp file + rename).  A v6
+ *             journal (CACHE_PREVIOUS_VERSION) is converted, keeping its
+ *             entries; anything older is reset to an empty journal.
+ *
+ * Exit codes: 0 healthy / done, 1 corrupt or failed, 2 usage or I/O error.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "sendto_core.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define EXIT_USAGE 2
+
+/* -------------------------------------------------------------------------- */
+/* Loading                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * CacheFile – a journal read into memory and replayed into g_iconCache.
+ *
+ * @member data      File bytes (heap).
+ * @member size      Bytes in @data.
+ * @member version   Version field of the header (0 if too short).
+ * @member ours      The file carries the cache magic.
+ * @member current   The header is this build's (IconCacheHeaderValid).
+ * @member previous  The file is a CACHE_PREVIOUS_VERSION journal, replayed
+ *                   by IconCacheConvertPrevious.
+ * @member tail      Bytes past the last good record (torn or foreign).
+ * @member corrupt   Entries failing their checksum or decode; their
+ *                   blobs are freed, so compaction drops them.
+ */
+typedef struct {
+    BYTE  *data;
+    DWORD  size;
+    DWORD  version;
+    bool   ours;
+    bool   current;
+    bool   previous;
+    DWORD  tail;
+    UINT   corrupt;
+} CacheFile;
+
+/**
+ * BlobDecodes – TRUE if @e's blob expands to exactly width*height pixels.
+ */
+static bool BlobDecodes(const IconCacheEntry *e)
+{
+    const size_t count = (size_t)e->width * e->height;
+    if (e->blobSize == count * 4) {
+        return true;
+    }
+
+    UINT32 *pixels = malloc(count * sizeof *pixels);
+    const bool ok = pixels && BlobDecode(e->blob, e->blobSize, pixels, count);
+    free(pixels);
+    return ok;
+}
+
+/**
+ * LoadCache – read @path and replay it; every blob is checked.
+ *
+ * @return  false if the file cannot be read or is too large.
+ */
+static bool LoadCache(const char *path, CacheFile *out)
+{
+    *out = (CacheFile){ 0 };
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    bool ok = fseek(f, 0, SEEK_END) == 0;
+    const long size = ok ? ftell(f) : -1;
+    ok = ok && size >= 0 && (unsigned long)size <= CACHE_MAX_FILE_SIZE && fseek(f, 0, SEEK_SET) == 0;
+    out->data = ok ? malloc(size ? (size_t)size : 1) : NULL;
+    ok = out->data && fread(out->data, 1, (size_t)size, f) == (size_t)size;
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "%s: cannot read (or larger than %u bytes)\n", path, CACHE_MAX_FILE_SIZE);
+        free(out->data);
+        out->data = NULL;
+        return false;
+    }
+    out->size = (DWORD)size;
+
+    if (out->size >= 2 * sizeof(DWORD)) {
+        DWORD magic;
+        memcpy(&magic,        out->data,                  sizeof magic);
+        memcpy(&out->version, out->data + sizeof magic,   sizeof out->version);
+        out->ours = magic == CACHE_MAGIC;
+    }
+    out->current = IconCacheHeaderValid(out->data, out->size);
+    DWORD end;
+    if (out->current) {
+        end = IconCacheReplayRecords(out->data, out->size, CACHE_HEADER_SIZE);
+    } else {
+        end = IconCacheConvertPrevious(out->data, out->size);
+        out->previous = end != 0;
+        if (!out->previous) {
+            return true;
+        }
+    }
+    g_iconCache.fileEnd = end;
+    out->tail = out->size - end;
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        IconCacheEntry *e = &g_iconCache.entries[i];
+        if (!IconCacheVerifyBlob(e) || !BlobDecodes(e)) {
+            out->corrupt++;
+            free(e->blob);
+            e->blob = NULL;
+        }
+    }
+    return true;
+}
+
+/** Describe the header of @file on stdout. */
+static void PrintFormat(const CacheFile *file)
+{
+    if (file->current) {
+        printf("format:      v%u (current)\n", file->version);
+    } else if (file->previous) {
+        printf("format:      v%u; compact converts it to v%u\n", file->version, CACHE_VERSION);
+    } else if (file->ours) {
+        printf("format:      v%u, too old to convert; compact resets it to an empty v%u\n",
+               file->version, CACHE_VERSION);
+    } else {
+        printf("format:      not a SendTo+ cache, or a corrupt header\n");
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Commands                                                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * CompareBlobKey – qsort comparator over (blobHash, blobSize) pairs packed
+ *                  into a UINT64, for duplicate detection.
+ */
+static int CompareBlobKey(const void *a, const void *b)
+{
+    const UINT64 ka = *(const UINT64 *)a;
+    const UINT64 kb = *(const UINT64 *)b;
+    return (ka > kb) - (ka < kb);
+}
+
+/** stat: the /cachestat report, minus the file-system checks. */
+static int Stat(const char *path, const CacheFile *file)
+{
+    printf("file:        %s, %u bytes\n", path, file->size);
+    PrintFormat(file);
+    if (!file->current && !file->previous) {
+        return EXIT_FAILURE;
+    }
+
+    UINT   packed = 0, duplicates = 0;
+    UINT64 pathBytes = 0, blobBytes = 0, rawBytes = 0, duplicateBytes = 0;
+    int    widths[8] = { 0 };
+    UINT   widthCounts[8] = { 0 };
+
+    UINT64 *blobKeys = g_iconCache.count ? malloc(g_iconCache.count * sizeof *blobKeys) : NULL;
+    UINT keyCount = 0;
+
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        const IconCacheEntry *e = &g_iconCache.entries[i];
+
+        pathBytes += (wcslen(e->path) + 1) * sizeof(WCHAR);
+        blobBytes += e->blobSize;
+        rawBytes  += (UINT64)e->width * e->height * 4;
+        packed    += e->blobSize != (DWORD)(e->width * e->height * 4);
+
+        for (size_t w = 0; w < ARRAYSIZE(widths); ++w) {
+            if (widths[w] == e->width || widths[w] == 0) {
+                widths[w] = e->width;
+                widthCounts[w]++;
+                break;
+            }
+        }
+        if (e->blob && blobKeys) {
+            blobKeys[keyCount++] = ((UINT64)e->blobHash << 32) | e->blobSize;
+        }
+    }
+
+    if (keyCount > 1) {
+        qsort(blobKeys, keyCount, sizeof *blobKeys, CompareBlobKey);
+        for (UINT i = 1; i < keyCount; ++i) {
+            if (blobKeys[i] == blobKeys[i - 1]) {
+                duplicates++;
+                duplicateBytes += (DWORD)blobKeys[i];
+            }
+        }
+    }
+    free(blobKeys);
+
+    const UINT dead = g_iconCache.fileRecords > g_iconCache.count ? g_iconCache.fileRecords - g_iconCache.count : 0;
+    printf("journal:     %u records, %u live entries, %u superseded%s, %u tail bytes\n",
+           g_iconCache.fileRecords, g_iconCache.count, dead,
+           g_iconCache.compact ? " (load limit reached)" : "", file->tail);
+    printf("budget:      %u / %u entries, %llu / %u blob bytes\n",
+           g_iconCache.count, CACHE_MAX_ENTRIES, (unsigned long long)blobBytes, CACHE_MAX_BLOB_BYTES);
+    printf("bytes:       %llu paths, %llu pixels (%.0f%% of %llu unpacked, %u of %u packed)\n",
+           (unsigned long long)pathBytes, (unsigned long long)blobBytes,
+           rawBytes ? 100.0 * (double)blobBytes / (double)rawBytes : 0.0,
+           (unsigned long long)rawBytes, packed, g_iconCache.count);
+    for (size_t w = 0; w < ARRAYSIZE(widths) && widths[w]; ++w) {
+        printf("size %3d px: %u entries\n", widths[w], widthCounts[w]);
+    }
+    printf("duplicates:  %u blobs repeat an earlier one (%llu bytes)\n",
+           duplicates, (unsigned long long)duplicateBytes);
+    printf("corrupt:     %u entries fail their checksum or decode\n", file->corrupt);
+
+    return file->corrupt || !file->current ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/** validate: one verdict line and the exit code. */
+static int Validate(const char *path, const CacheFile *file)
+{
+    if (!file->current) {
+        printf("%s: %s\n", path, file->previous ? "older format, compact converts it" :
+                              file->ours ? "older format, compact resets it" : "not a SendTo+ cache");
+        return EXIT_FAILURE;
+    }
+    if (file->corrupt) {
+        printf("%s: %u of %u entries corrupt\n", path, file->corrupt, g_iconCache.count);
+        return EXIT_FAILURE;
+    }
+    printf("%s: ok, %u entries\n", path, g_iconCache.count);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * WriteJournal – write the header and every live entry of g_iconCache to
+ *                @fd, then make it durable.
+ *
+ * @return  Records written, or -1 on failure.
+ */
+static int WriteJournal(int fd)
+{
+    DWORD header[CACHE_HEADER_SIZE / sizeof(DWORD)];
+    IconCacheHeader(header);
+    if (write(fd, header, sizeof header) != (ssize_t)sizeof header) {
+        return -1;
+    }
+
+    int records = 0;
+    for (UINT i = 0; i < g_iconCache.count; ++i) {
+        DWORD size;
+        BYTE *record = IconCacheEncodeRecord(&g_iconCache.entries[i], &size);
+        const bool ok = record && write(fd, record, size) == (ssize_t)size;
+        free(record);
+        if (!ok) {
+            return -1;
+        }
+        records++;
+    }
+    return fsync(fd) == 0 ? records : -1;
+}
+
+/**
+ * LockCache – take the "<file>.lock" writer lock sendto.exe appends under.
+ *             Compaction loads the file only after this, so a record
+ *             appended meanwhile is either in what it reads or waits for
+ *             the rewrite to finish.
+ *
+ * @return  The lock descriptor (close it to release), or -1.
+ */
+static int LockCache(const char *path)
+{
+    char lockPath[4096];
+    if (snprintf(lockPath, sizeof lockPath, "%s.lock", path) >= (int)sizeof lockPath) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+
+    const int lock = open(lockPath, O_RDWR | O_CREAT, 0644);
+    if (lock < 0 || flock(lock, LOCK_EX) != 0) {
+        perror(lockPath);
+        if (lock >= 0) close(lock);
+        return -1;
+    }
+    return lock;
+}
+
+/**
+ * Compact – rewrite the journal without dead weight, as IconCacheCompact
+ *           does: "<file>.tmp" is written, synced and renamed over the
+ *           file.  The caller holds LockCache from before LoadCache.
+ */
+static int Compact(const char *path, const CacheFile *file)
+{
+    if (!file->ours && file->size) {
+        fprintf(stderr, "%s: not a SendTo+ cache, left alone\n", path);
+        return EXIT_FAILURE;
+    }
+
+    char tempPath[4096];
+    if (snprintf(tempPath, sizeof tempPath, "%s.tmp", path) >= (int)sizeof tempPath) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return EXIT_USAGE;
+    }
+
+    const UINT corrupt = file->corrupt;
+    const UINT evicted = IconCacheEvictLru(CACHE_MAX_ENTRIES, CACHE_MAX_BLOB_BYTES);
+    IconCacheRemoveDropped();
+
+    const int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    const int records = fd >= 0 ? WriteJournal(fd) : -1;
+    const bool ok = fd >= 0 && close(fd) == 0 && records >= 0 && rename(tempPath, path) == 0;
+    if (!ok) {
+        perror(tempPath);
+        unlink(tempPath);
+    }
+
+    struct stat st;
+    if (!ok || stat(path, &st) != 0) {
+        return EXIT_FAILURE;
+    }
+    if (file->previous) {
+        printf("converted:   v%u -> v%u\n", file->version, CACHE_VERSION);
+    } else if (!file->current && file->size) {
+        printf("reset:       v%u is too old to convert; its icons are resolved again\n", file->version);
+    }
+    printf("compacted:   %d entries (%u corrupt, %u over budget dropped), %u -> %lld bytes\n",
+           records, corrupt, evicted, file->size, (long long)st.st_size);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3 ||
+        (strcmp(argv[1], "stat") != 0 && strcmp(argv[1], "validate") != 0 && strcmp(argv[1], "compact") != 0)) {
+        fprintf(stderr, "usage: sendto-cachetool stat|validate|compact <file>\n");
+        return EXIT_USAGE;
+    }
+
+    const bool compact = strcmp(argv[1], "compact") == 0;
+    const int lock = compact ? LockCache(argv[2]) : -1;
+    if (compact && lock < 0) {
+        return EXIT_FAILURE;
+    }
+
+    CacheFile file;
+    if (!LoadCache(argv[2], &file)) {
+        if (lock >= 0) close(lock);
+        return EXIT_USAGE;
+    }
+
+    int exitCode;
+    if (strcmp(argv[1], "stat") == 0) {
+        exitCode = Stat(argv[2], &file);
+    } else if (strcmp(argv[1], "validate") == 0) {
+        exitCode = Validate(argv[2], &file);
+    } else {
+        exitCode = Compact(argv[2], &file);
+    }
+
+    IconCacheFree();
+    free(file.data);
+    if (lock >= 0) close(lock);
+    return exitCode;
+}